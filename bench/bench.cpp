@@ -0,0 +1,1359 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <new>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <random>
+#include <vector>
+#include <list>
+#include <set>
+#include <queue>
+#include <unordered_map>
+#include <algorithm>
+#include <sstream>
+#include <string>
+#include "tds.h"
+
+/*
+* Microbenchmarks for the containers in tds.h (and the STL containers they would replace).
+* Every result is printed as one CSV line (or one JSON object per line with --json):
+*
+*	container,workload,distribution,payload,size,ops,ns_per_op,allocs_per_op
+*
+* Usage: TemplateDatastructuresBench [--min-size N] [--max-size N] [--max-degenerate N]
+*                                    [--filter container_substring] [--json]
+*/
+
+/* ---- Allocation counting ---- */
+
+static std::atomic<long long> g_allocs(0); /**< Number of calls to the global operator new since the program started */
+
+/* The replacements are kept out of line - once GCC inlines free into a call site that used new it
+   warns about a mismatched new/delete pair (-Wmismatched-new-delete) */
+#if defined(__GNUC__) || defined(__clang__)
+#define TDS_NOINLINE __attribute__((noinline))
+#elif defined(_MSC_VER)
+#define TDS_NOINLINE __declspec(noinline)
+#else
+#define TDS_NOINLINE
+#endif
+
+TDS_NOINLINE void* operator new(size_t size)
+{
+	g_allocs.fetch_add(1, std::memory_order_relaxed);
+	void* p = malloc(size ? size : 1);
+	if (p == NULL) throw std::bad_alloc();
+	return p;
+}
+
+TDS_NOINLINE void* operator new[](size_t size)
+{
+	g_allocs.fetch_add(1, std::memory_order_relaxed);
+	void* p = malloc(size ? size : 1);
+	if (p == NULL) throw std::bad_alloc();
+	return p;
+}
+
+TDS_NOINLINE void operator delete(void* p) noexcept { free(p); }
+TDS_NOINLINE void operator delete[](void* p) noexcept { free(p); }
+TDS_NOINLINE void operator delete(void* p, size_t) noexcept { free(p); }
+TDS_NOINLINE void operator delete[](void* p, size_t) noexcept { free(p); }
+
+/* ---- Options ---- */
+
+struct Options
+{
+	long long _minSize; /**< The smallest container size to run */
+	long long _maxSize; /**< The largest container size to run */
+	long long _maxDegenerate; /**< Largest size to run for workloads that are quadratic on an unbalanced TTree (sorted keys) */
+	const char* _filter; /**< Only run containers whose name contains this (NULL for all) */
+	bool _json; /**< Print JSON lines rather than CSV */
+};
+
+static Options g_options;
+
+static bool Enabled(const char* name)
+{
+	return g_options._filter == NULL || strstr(name, g_options._filter) != NULL;
+}
+
+/* ---- Timing and reporting ---- */
+
+static inline long long NowNs()
+{
+	return (long long)std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+* Prints one result line
+*/
+static void Report(const char* container, const char* workload, const char* dist, int payload,
+	long long size, long long ops, long long ns, long long allocs)
+{
+	if (ops <= 0) ops = 1;
+	double ns_per_op = (double)ns / (double)ops;
+	double allocs_per_op = (double)allocs / (double)ops;
+
+	if (g_options._json)
+	{
+		printf("{\"container\":\"%s\",\"workload\":\"%s\",\"distribution\":\"%s\",\"payload\":%d,"
+			"\"size\":%lld,\"ops\":%lld,\"ns_per_op\":%.3f,\"allocs_per_op\":%.3f}\n",
+			container, workload, dist, payload, size, ops, ns_per_op, allocs_per_op);
+	}
+	else
+	{
+		printf("%s,%s,%s,%d,%lld,%lld,%.3f,%.3f\n",
+			container, workload, dist, payload, size, ops, ns_per_op, allocs_per_op);
+	}
+	fflush(stdout);
+}
+
+/**
+* Measures the time and allocations of a block of code
+*/
+struct Measure
+{
+	long long _start;
+	long long _allocs;
+
+	Measure()
+	{
+		_allocs = g_allocs.load(std::memory_order_relaxed);
+		_start = NowNs();
+	}
+
+	long long Ns() const { return NowNs() - _start; }
+	long long Allocs() const { return g_allocs.load(std::memory_order_relaxed) - _allocs; }
+};
+
+/* ---- Payloads ---- */
+
+/**
+* Element type of a given size in bytes whose ordering is defined by _key
+*/
+template<int Size>
+struct Payload
+{
+	int _key;
+	char _pad[Size - sizeof(int)];
+
+	Payload() { _key = 0; }
+	Payload(int key) { _key = key; _pad[0] = (char)key; }
+	bool operator!=(const Payload& rhs) const { return _key != rhs._key; }
+	bool operator==(const Payload& rhs) const { return _key == rhs._key; }
+	bool operator<(const Payload& rhs) const { return _key < rhs._key; }
+	bool operator>(const Payload& rhs) const { return _key > rhs._key; }
+};
+
+template<>
+struct Payload<4>
+{
+	int _key;
+
+	Payload() { _key = 0; }
+	Payload(int key) { _key = key; }
+	bool operator!=(const Payload& rhs) const { return _key != rhs._key; }
+	bool operator==(const Payload& rhs) const { return _key == rhs._key; }
+	bool operator<(const Payload& rhs) const { return _key < rhs._key; }
+	bool operator>(const Payload& rhs) const { return _key > rhs._key; }
+};
+
+template<typename P>
+int ComparePayload(P lhs, P rhs)
+{
+	if (lhs._key < rhs._key) return -1;
+	else if (lhs._key > rhs._key) return 1;
+	else return 0;
+}
+
+/* ---- Key distributions ---- */
+
+enum Distribution
+{
+	DIST_SORTED,
+	DIST_RANDOM,
+	DIST_ZIPFIAN,
+	DIST_COUNT
+};
+
+static const char* DistName(int dist)
+{
+	switch (dist)
+	{
+	case DIST_SORTED: return "sorted";
+	case DIST_RANDOM: return "random";
+	default: return "zipfian";
+	}
+}
+
+/**
+* Zipfian generator over [0, n) (Gray et al. as used by YCSB) with ranks scattered over the key space
+*/
+class Zipfian
+{
+private:
+	long long _n;
+	double _theta, _alpha, _zetan, _eta;
+	std::uniform_real_distribution<double> _uniform;
+
+public:
+	Zipfian(long long n, double theta = 0.99) : _uniform(0.0, 1.0)
+	{
+		_n = n;
+		_theta = theta;
+		_alpha = 1.0 / (1.0 - theta);
+		_zetan = 0;
+		for (long long i = 1; i <= n; i++)
+			_zetan += 1.0 / pow((double)i, theta);
+		double zeta2 = 1.0 + 1.0 / pow(2.0, theta);
+		_eta = (1.0 - pow(2.0 / (double)n, 1.0 - theta)) / (1.0 - zeta2 / _zetan);
+	}
+
+	template<typename RNG>
+	long long Next(RNG& rng)
+	{
+		double u = _uniform(rng);
+		double uz = u * _zetan;
+		long long rank;
+		if (uz < 1.0) rank = 0;
+		else if (uz < 1.0 + pow(0.5, _theta)) rank = 1;
+		else rank = (long long)((double)_n * pow(_eta * u - _eta + 1.0, _alpha));
+		if (rank >= _n) rank = _n - 1;
+
+		//scatter the hot ranks over the key space (2654435761 is prime so this is a permutation unless n is a multiple of it)
+		return (long long)(((unsigned long long)rank * 2654435761ULL) % (unsigned long long)_n);
+	}
+};
+
+/**
+* The keys a benchmark run uses: the order the n distinct keys (0..n-1) are inserted in and
+* the keys used for lookups/removals/mixed operations
+*/
+struct Keys
+{
+	int _dist;
+	std::vector<int> _insert; /**< Every key in [0, n) once, in insertion order */
+	std::vector<int> _ops; /**< Keys for lookups, removals and mixed operations */
+	std::vector<unsigned char> _mix; /**< Random numbers (0-99) used to pick mixed operations */
+
+	Keys(long long n, int dist)
+	{
+		_dist = dist;
+		std::mt19937_64 rng(12345 + n + dist);
+
+		_insert.resize((size_t)n);
+		for (long long i = 0; i < n; i++)
+			_insert[(size_t)i] = (int)i;
+		if (dist != DIST_SORTED)
+			std::shuffle(_insert.begin(), _insert.end(), rng);
+
+		_ops.resize((size_t)n);
+		if (dist == DIST_SORTED)
+		{
+			for (long long i = 0; i < n; i++)
+				_ops[(size_t)i] = (int)i;
+		}
+		else if (dist == DIST_RANDOM)
+		{
+			_ops = _insert;
+			std::shuffle(_ops.begin(), _ops.end(), rng);
+		}
+		else
+		{
+			Zipfian zipf(n);
+			for (long long i = 0; i < n; i++)
+				_ops[(size_t)i] = (int)zipf.Next(rng);
+		}
+
+		_mix.resize((size_t)n);
+		for (long long i = 0; i < n; i++)
+			_mix[(size_t)i] = (unsigned char)(rng() % 100);
+	}
+};
+
+/* ---- Allocator construction ---- */
+
+/**
+* Creates the allocator a benchmarked container uses (arena allocators need the arena)
+*/
+template<typename Alloc>
+struct MakeAlloc
+{
+	static Alloc Make(TArena*) { return Alloc(); }
+};
+
+template<>
+struct MakeAlloc<TArenaAllocator>
+{
+	static TArenaAllocator Make(TArena* arena) { return TArenaAllocator(arena); }
+};
+
+template<>
+struct MakeAlloc<THugePageAllocator>
+{
+	static THugePageAllocator Make(TArena*)
+	{
+		//one pool for the whole run - freed nodes are reused by the next container
+		static THugePagePool pool(THUGEPAGE_TRANSPARENT);
+		return THugePageAllocator(&pool);
+	}
+};
+
+/* ---- Ordered container adapters (TTree vs std::multiset) ---- */
+
+template<typename P, typename Alloc>
+struct TreeAdapter
+{
+	TArena _arena;
+	TTree<P, Alloc> _tree;
+
+	TreeAdapter() : _tree(ComparePayload<P>, MakeAlloc<Alloc>::Make(&_arena)) {}
+	inline void Insert(int key) { _tree.Insert(P(key)); }
+	inline bool Find(int key) { return _tree.Find(P(key)) != NULL; }
+	inline void Remove(int key) { _tree.Remove(P(key)); }
+	inline long long Iterate()
+	{
+		long long sum = 0;
+		TTREE_foreach(P, itr, _tree)
+		{
+			sum += itr.Value()._key;
+		}
+		return sum;
+	}
+};
+
+template<typename P>
+struct MultisetAdapter
+{
+	std::multiset<P> _set;
+
+	inline void Insert(int key) { _set.insert(P(key)); }
+	inline bool Find(int key) { return _set.find(P(key)) != _set.end(); }
+	inline void Remove(int key)
+	{
+		typename std::multiset<P>::iterator itr = _set.find(P(key));
+		if (itr != _set.end()) _set.erase(itr);
+	}
+	inline long long Iterate()
+	{
+		long long sum = 0;
+		for (typename std::multiset<P>::iterator itr = _set.begin(); itr != _set.end(); ++itr)
+			sum += itr->_key;
+		return sum;
+	}
+};
+
+/* ---- Hashed container adapters (THashMap vs std::unordered_map, keyed by id) ---- */
+
+template<typename P>
+struct HashMapAdapter
+{
+	THashMap<int, P> _map;
+
+	inline void Insert(int key) { _map.Insert(key, P(key)); }
+	inline bool Find(int key) { return _map.Find(key) != NULL; }
+	inline void Remove(int key) { _map.Remove(key); }
+	inline long long Iterate()
+	{
+		long long sum = 0;
+		THASHMAP_foreach(int, P, itr, _map)
+		{
+			sum += itr.Value()._key;
+		}
+		return sum;
+	}
+};
+
+template<typename P>
+struct UnorderedMapAdapter
+{
+	std::unordered_map<int, P> _map;
+
+	inline void Insert(int key) { _map[key] = P(key); }
+	inline bool Find(int key) { return _map.find(key) != _map.end(); }
+	inline void Remove(int key) { _map.erase(key); }
+	inline long long Iterate()
+	{
+		long long sum = 0;
+		for (typename std::unordered_map<int, P>::iterator itr = _map.begin(); itr != _map.end(); ++itr)
+			sum += itr->second._key;
+		return sum;
+	}
+};
+
+static volatile long long g_sink; /**< Stops the compiler optimising away results */
+
+template<typename Adapter, typename P>
+void BenchOrdered(const char* name, bool degenerates, const Keys& keys)
+{
+	long long n = (long long)keys._insert.size();
+	const char* dist = DistName(keys._dist);
+
+	//an unbalanced tree is quadratic (and recursion deep) with sorted keys
+	if (degenerates && keys._dist == DIST_SORTED && n > g_options._maxDegenerate)
+		return;
+
+	Adapter* a = new Adapter();
+
+	//insert
+	{
+		Measure m;
+		for (long long i = 0; i < n; i++)
+			a->Insert(keys._insert[(size_t)i]);
+		Report(name, "insert", dist, (int)sizeof(P), n, n, m.Ns(), m.Allocs());
+	}
+
+	//find
+	{
+		long long hits = 0;
+		Measure m;
+		for (long long i = 0; i < n; i++)
+			hits += a->Find(keys._ops[(size_t)i]);
+		Report(name, "find", dist, (int)sizeof(P), n, n, m.Ns(), m.Allocs());
+		g_sink = hits;
+	}
+
+	//full iteration
+	{
+		Measure m;
+		g_sink = a->Iterate();
+		Report(name, "iterate", dist, (int)sizeof(P), n, n, m.Ns(), m.Allocs());
+	}
+
+	//mixed 50% find, 25% insert, 25% remove
+	{
+		long long hits = 0;
+		Measure m;
+		for (long long i = 0; i < n; i++)
+		{
+			int key = keys._ops[(size_t)i];
+			int r = keys._mix[(size_t)i];
+			if (r < 50) hits += a->Find(key);
+			else if (r < 75) a->Insert(key);
+			else a->Remove(key);
+		}
+		Report(name, "mixed", dist, (int)sizeof(P), n, n, m.Ns(), m.Allocs());
+		g_sink = hits;
+	}
+
+	//remove
+	{
+		Measure m;
+		for (long long i = 0; i < n; i++)
+			a->Remove(keys._insert[(size_t)(keys._dist == DIST_SORTED ? i : n - 1 - i)]);
+		Report(name, "remove", dist, (int)sizeof(P), n, n, m.Ns(), m.Allocs());
+	}
+	delete a;
+
+	//teardown of a full container
+	a = new Adapter();
+	for (long long i = 0; i < n; i++)
+		a->Insert(keys._insert[(size_t)i]);
+	{
+		Measure m;
+		delete a;
+		Report(name, "teardown", dist, (int)sizeof(P), n, n, m.Ns(), m.Allocs());
+	}
+}
+
+/**
+* Times reloading a TTree from a snapshot (compare with the TTree insert workload)
+*/
+template<typename P>
+void BenchReload(const Keys& keys)
+{
+	long long n = (long long)keys._insert.size();
+	if (keys._dist == DIST_SORTED && n > g_options._maxDegenerate)
+		return;
+
+	std::stringstream snapshot;
+	{
+		TTree<P> tree(ComparePayload<P>);
+		for (long long i = 0; i < n; i++)
+			tree.Insert(P(keys._insert[(size_t)i]));
+		tree.Serialize(snapshot);
+	}
+
+	TTree<P> tree(ComparePayload<P>);
+	Measure m;
+	tree.Deserialize(snapshot);
+	Report("TTree", "reload", DistName(keys._dist), (int)sizeof(P), n, n, m.Ns(), m.Allocs());
+}
+
+/**
+* Times applying a second set of n keys to a TTree of n keys one Insert / Remove at a time and as
+* one InsertBatch / RemoveBatch
+*/
+template<typename P>
+void BenchBatch(const Keys& keys)
+{
+	long long n = (long long)keys._insert.size();
+	if (keys._dist == DIST_SORTED && n > g_options._maxDegenerate)
+		return;
+
+	std::vector<P> batch;
+	for (long long i = 0; i < n; i++)
+		batch.push_back(P(keys._ops[(size_t)i]));
+
+	for (int batched = 0; batched < 2; batched++)
+	{
+		TTree<P> tree(ComparePayload<P>);
+		for (long long i = 0; i < n; i++)
+			tree.Insert(P(keys._insert[(size_t)i]));
+
+		{
+			Measure m;
+			if (batched)
+				tree.InsertBatch(batch.data(), (int)n);
+			else
+				for (long long i = 0; i < n; i++)
+					tree.Insert(batch[(size_t)i]);
+			Report("TTree", batched ? "batch-insert" : "loop-insert", DistName(keys._dist), (int)sizeof(P), n, n, m.Ns(), m.Allocs());
+		}
+		{
+			Measure m;
+			if (batched)
+				tree.RemoveBatch(batch.data(), (int)n);
+			else
+				for (long long i = 0; i < n; i++)
+					tree.Remove(batch[(size_t)i]);
+			Report("TTree", batched ? "batch-remove" : "loop-remove", DistName(keys._dist), (int)sizeof(P), n, n, m.Ns(), m.Allocs());
+		}
+	}
+}
+
+/**
+* Random lookups of the op keys in a TTree one at a time with Find and in batches of 256 with
+* FindMany (which overlaps the cache misses of up to TTREE_FIND_GROUP lookups)
+*/
+template<typename P>
+void BenchFindMany(const Keys& keys)
+{
+	long long n = (long long)keys._insert.size();
+	if (keys._dist == DIST_SORTED && n > g_options._maxDegenerate)
+		return;
+
+	TTree<P> tree(ComparePayload<P>);
+	for (long long i = 0; i < n; i++)
+		tree.Insert(P(keys._insert[(size_t)i]));
+
+	const int batch = 256;
+	std::vector<P> query;
+	for (long long i = 0; i < n; i++)
+		query.push_back(P(keys._ops[(size_t)i]));
+	std::vector<TTreeNode<P>*> results((size_t)batch);
+
+	for (int batched = 0; batched < 2; batched++)
+	{
+		long long found = 0;
+		Measure m;
+		for (long long i = 0; i < n; i += batch)
+		{
+			int count = n - i < batch ? (int)(n - i) : batch;
+			if (batched)
+			{
+				tree.FindMany(&query[(size_t)i], count, results.data());
+			}
+			else
+			{
+				for (int j = 0; j < count; j++)
+					results[(size_t)j] = tree.Find(query[(size_t)(i + j)]);
+			}
+			for (int j = 0; j < count; j++)
+				found += results[(size_t)j] != NULL;
+		}
+		Report("TTree", batched ? "find-many" : "find-loop", DistName(keys._dist), (int)sizeof(P), n, n, m.Ns(), m.Allocs());
+		g_sink = found;
+	}
+}
+
+/* ---- Concurrent ordered containers (TSkipList vs TTree behind a mutex) ---- */
+
+/**
+* Inserts the n keys from 1, 2, 4... threads (up to the number of hardware threads, at least 2)
+* into one shared container, each thread inserting its own slice of the keys. ns_per_op is wall
+* time divided by n so it falls as writers scale
+*/
+template<typename P>
+void BenchConcurrent(const Keys& keys)
+{
+	long long n = (long long)keys._insert.size();
+	if (keys._dist == DIST_SORTED && n > g_options._maxDegenerate)
+		return;
+
+	int maxThreads = (int)std::thread::hardware_concurrency();
+	if (maxThreads < 2)
+		maxThreads = 2;
+
+	for (int threads = 1; threads <= maxThreads; threads *= 2)
+	{
+		char workload[32];
+		snprintf(workload, sizeof(workload), "insert-%dt", threads);
+
+		for (int locked = 0; locked < 2; locked++)
+		{
+			TSkipList<P, TLess<P>, TThreadCacheAllocator> list;
+			TTree<P, TThreadCacheAllocator> tree(ComparePayload<P>);
+			std::mutex lock;
+			std::vector<std::thread> pool;
+
+			Measure m;
+			for (int t = 0; t < threads; t++)
+			{
+				pool.push_back(std::thread([&, t]()
+				{
+					for (long long i = t; i < n; i += threads)
+					{
+						P key(keys._insert[(size_t)i]);
+						if (locked)
+						{
+							std::lock_guard<std::mutex> guard(lock);
+							tree.Insert(key);
+						}
+						else
+						{
+							list.Insert(key);
+						}
+					}
+				}));
+			}
+			for (size_t i = 0; i < pool.size(); i++)
+				pool[i].join();
+			Report(locked ? "TTree+mutex" : "TSkipList", workload, DistName(keys._dist), (int)sizeof(P), n, n, m.Ns(), m.Allocs());
+		}
+	}
+}
+
+/* ---- Passing elements between two threads (TRingBuffer vs TList behind a mutex) ---- */
+
+/**
+* A producer thread passes the n keys to the calling thread one at a time, in spans of 64
+* (PushMany/PopMany) and through a TList behind a mutex. ns_per_op is wall time per element
+*/
+template<typename P>
+void BenchRingBuffer(const Keys& keys)
+{
+	long long n = (long long)keys._insert.size();
+	const char* dist = DistName(keys._dist);
+	const int span = 64;
+
+	for (int mode = 0; mode < 3; mode++)
+	{
+		TRingBuffer<P> ring(1024);
+		TList<P> list;
+		std::mutex lock;
+		long long sum = 0;
+
+		Measure m;
+		std::thread producer([&]()
+		{
+			P batch[span];
+			for (long long i = 0; i < n; )
+			{
+				if (mode == 0)
+				{
+					ring.Push(P(keys._insert[(size_t)i++]));
+				}
+				else if (mode == 1)
+				{
+					int count = n - i < span ? (int)(n - i) : span;
+					for (int j = 0; j < count; j++)
+						batch[j] = P(keys._insert[(size_t)(i + j)]);
+					for (int done = 0; done < count; )
+					{
+						int pushed = ring.PushMany(batch + done, count - done);
+						if (pushed == 0)
+							std::this_thread::yield();
+						done += pushed;
+					}
+					i += count;
+				}
+				else
+				{
+					std::lock_guard<std::mutex> guard(lock);
+					list.PushBack(P(keys._insert[(size_t)i++]));
+				}
+			}
+		});
+
+		P batch[span];
+		for (long long i = 0; i < n; )
+		{
+			if (mode == 0)
+			{
+				sum += ring.Pop()._key;
+				i++;
+			}
+			else if (mode == 1)
+			{
+				int count = ring.PopMany(batch, span);
+				if (count == 0)
+					std::this_thread::yield();
+				for (int j = 0; j < count; j++)
+					sum += batch[j]._key;
+				i += count;
+			}
+			else
+			{
+				bool popped = false;
+				{
+					std::lock_guard<std::mutex> guard(lock);
+					if (!list.IsEmpty())
+					{
+						sum += list.PopBack()._key;
+						popped = true;
+						i++;
+					}
+				}
+				if (!popped)
+					std::this_thread::yield();
+			}
+		}
+		producer.join();
+		Report(mode == 2 ? "TList+mutex" : "TRingBuffer", mode == 1 ? "transfer-span" : "transfer", dist, (int)sizeof(P), n, n, m.Ns(), m.Allocs());
+		g_sink = sum;
+	}
+}
+
+/* ---- Sequence container adapters (TList vs std::list) ---- */
+
+template<typename P, typename Alloc>
+struct ListAdapter
+{
+	TArena _arena;
+	TList<P, Alloc> _list;
+
+	ListAdapter() : _list(MakeAlloc<Alloc>::Make(&_arena)) {}
+	inline void PushBack(int key) { _list.PushBack(P(key)); }
+	inline void PopBack() { _list.PopBack(); }
+	inline bool Remove(int key) { return _list.Remove(P(key)); }
+	inline bool Find(int key)
+	{
+		P p(key);
+		TLIST_foreach(P, itr, _list)
+		{
+			if (itr.Value() == p) return true;
+		}
+		return false;
+	}
+	inline long long Iterate()
+	{
+		long long sum = 0;
+		TLIST_foreach(P, itr, _list)
+		{
+			sum += itr.Value()._key;
+		}
+		return sum;
+	}
+};
+
+template<typename P>
+struct StdListAdapter
+{
+	std::list<P> _list;
+
+	inline void PushBack(int key) { _list.push_back(P(key)); }
+	inline void PopBack() { if (!_list.empty()) _list.pop_back(); }
+	inline bool Remove(int key)
+	{
+		typename std::list<P>::iterator itr = std::find(_list.begin(), _list.end(), P(key));
+		if (itr == _list.end()) return false;
+		_list.erase(itr);
+		return true;
+	}
+	inline bool Find(int key) { return std::find(_list.begin(), _list.end(), P(key)) != _list.end(); }
+	inline long long Iterate()
+	{
+		long long sum = 0;
+		for (typename std::list<P>::iterator itr = _list.begin(); itr != _list.end(); ++itr)
+			sum += itr->_key;
+		return sum;
+	}
+};
+
+template<typename Adapter, typename P>
+void BenchSequence(const char* name, const Keys& keys)
+{
+	long long n = (long long)keys._insert.size();
+	const char* dist = DistName(keys._dist);
+
+	//finding/removing by value is linear so only run a bounded number of them
+	long long linear_ops = n < 1000 ? n : 1000;
+
+	Adapter* a = new Adapter();
+
+	//insert (push back)
+	{
+		Measure m;
+		for (long long i = 0; i < n; i++)
+			a->PushBack(keys._insert[(size_t)i]);
+		Report(name, "insert", dist, (int)sizeof(P), n, n, m.Ns(), m.Allocs());
+	}
+
+	//find (linear search)
+	{
+		long long hits = 0;
+		Measure m;
+		for (long long i = 0; i < linear_ops; i++)
+			hits += a->Find(keys._ops[(size_t)i]);
+		Report(name, "find", dist, (int)sizeof(P), n, linear_ops, m.Ns(), m.Allocs());
+		g_sink = hits;
+	}
+
+	//full iteration
+	{
+		Measure m;
+		g_sink = a->Iterate();
+		Report(name, "iterate", dist, (int)sizeof(P), n, n, m.Ns(), m.Allocs());
+	}
+
+	//remove by value
+	{
+		Measure m;
+		for (long long i = 0; i < linear_ops; i++)
+			a->Remove(keys._ops[(size_t)i]);
+		Report(name, "remove", dist, (int)sizeof(P), n, linear_ops, m.Ns(), m.Allocs());
+	}
+
+	//mixed 50% push back, 50% pop back
+	{
+		Measure m;
+		for (long long i = 0; i < n; i++)
+		{
+			if (keys._mix[(size_t)i] < 50) a->PushBack(keys._ops[(size_t)i]);
+			else a->PopBack();
+		}
+		Report(name, "mixed", dist, (int)sizeof(P), n, n, m.Ns(), m.Allocs());
+	}
+	delete a;
+
+	//teardown of a full container
+	a = new Adapter();
+	for (long long i = 0; i < n; i++)
+		a->PushBack(keys._insert[(size_t)i]);
+	{
+		Measure m;
+		delete a;
+		Report(name, "teardown", dist, (int)sizeof(P), n, n, m.Ns(), m.Allocs());
+	}
+}
+
+/* ---- LIFO container adapters (TStack vs std::vector) ---- */
+
+template<typename P, typename Alloc>
+struct StackAdapter
+{
+	TArena _arena;
+	TStack<P, Alloc> _stack;
+
+	StackAdapter() : _stack(MakeAlloc<Alloc>::Make(&_arena)) {}
+	inline void Push(int key) { _stack.Push(P(key)); }
+	inline int Pop() { return _stack.Pop()._key; }
+	inline int Peek() { return _stack.Peek()._key; }
+};
+
+template<typename P>
+struct VectorAdapter
+{
+	std::vector<P> _vec;
+
+	inline void Push(int key) { _vec.push_back(P(key)); }
+	inline int Pop()
+	{
+		if (_vec.empty()) return 0;
+		int ret = _vec.back()._key;
+		_vec.pop_back();
+		return ret;
+	}
+	inline int Peek() { return _vec.empty() ? 0 : _vec.back()._key; }
+};
+
+template<typename Adapter, typename P>
+void BenchStack(const char* name, const Keys& keys)
+{
+	long long n = (long long)keys._insert.size();
+	const char* dist = DistName(keys._dist);
+	long long sum = 0;
+
+	Adapter* a = new Adapter();
+
+	//insert (push)
+	{
+		Measure m;
+		for (long long i = 0; i < n; i++)
+			a->Push(keys._insert[(size_t)i]);
+		Report(name, "insert", dist, (int)sizeof(P), n, n, m.Ns(), m.Allocs());
+	}
+
+	//find (peek)
+	{
+		Measure m;
+		for (long long i = 0; i < n; i++)
+			sum += a->Peek();
+		Report(name, "find", dist, (int)sizeof(P), n, n, m.Ns(), m.Allocs());
+	}
+
+	//remove (pop)
+	{
+		Measure m;
+		for (long long i = 0; i < n; i++)
+			sum += a->Pop();
+		Report(name, "remove", dist, (int)sizeof(P), n, n, m.Ns(), m.Allocs());
+	}
+
+	//mixed 40% push, 40% pop, 20% peek
+	{
+		Measure m;
+		for (long long i = 0; i < n; i++)
+		{
+			int r = keys._mix[(size_t)i];
+			if (r < 40) a->Push(keys._ops[(size_t)i]);
+			else if (r < 80) sum += a->Pop();
+			else sum += a->Peek();
+		}
+		Report(name, "mixed", dist, (int)sizeof(P), n, n, m.Ns(), m.Allocs());
+	}
+	delete a;
+	g_sink = sum;
+
+	//teardown of a full container
+	a = new Adapter();
+	for (long long i = 0; i < n; i++)
+		a->Push(keys._insert[(size_t)i]);
+	{
+		Measure m;
+		delete a;
+		Report(name, "teardown", dist, (int)sizeof(P), n, n, m.Ns(), m.Allocs());
+	}
+}
+
+/* ---- Priority queue adapters (TPriorityQueue vs std::priority_queue and a tree used as a queue) ---- */
+
+template<typename P, int D>
+struct PriorityQueueAdapter
+{
+	TPriorityQueue<P, TLess<P>, D> _queue;
+
+	inline void Push(int key) { _queue.Push(P(key)); }
+	inline int Pop() { return _queue.Pop()._key; }
+};
+
+template<typename P>
+struct StdPriorityQueueAdapter
+{
+	std::priority_queue<P, std::vector<P>, std::greater<P> > _queue;
+
+	inline void Push(int key) { _queue.push(P(key)); }
+	inline int Pop() { int ret = _queue.top()._key; _queue.pop(); return ret; }
+};
+
+template<typename P>
+struct MultisetQueueAdapter
+{
+	std::multiset<P> _set;
+
+	inline void Push(int key) { _set.insert(P(key)); }
+	inline int Pop() { int ret = _set.begin()->_key; _set.erase(_set.begin()); return ret; }
+};
+
+template<typename Adapter, typename P>
+void BenchPriority(const char* name, const Keys& keys)
+{
+	long long n = (long long)keys._insert.size();
+	const char* dist = DistName(keys._dist);
+	Adapter* a = new Adapter();
+
+	//push
+	{
+		Measure m;
+		for (long long i = 0; i < n; i++)
+			a->Push(keys._insert[(size_t)i]);
+		Report(name, "push", dist, (int)sizeof(P), n, n, m.Ns(), m.Allocs());
+	}
+
+	//hold model (a scheduler loop): pop the first task and push a later one
+	{
+		long long sum = 0;
+		Measure m;
+		for (long long i = 0; i < n; i++)
+		{
+			int key = a->Pop();
+			sum += key;
+			a->Push(key + 1 + keys._mix[(size_t)i]);
+		}
+		Report(name, "hold", dist, (int)sizeof(P), n, n, m.Ns(), m.Allocs());
+		g_sink = sum;
+	}
+
+	//pop everything
+	{
+		long long sum = 0;
+		Measure m;
+		for (long long i = 0; i < n; i++)
+			sum += a->Pop();
+		Report(name, "pop", dist, (int)sizeof(P), n, n, m.Ns(), m.Allocs());
+		g_sink = sum;
+	}
+	delete a;
+}
+
+/* ---- Aggregates (Sum / MinMax / CountIf / FilterInto) ---- */
+
+/**
+* Aggregates over n int keys: a TList summed with TLIST_foreach vs its Sum method, and
+* the plain loop kernels vs the SSE2/AVX2 ones (what TPriorityQueue and TStaticTree use) over a
+* contiguous array. Runs once per key set (the kernels are only vectorized for int and float so
+* payloads don't apply). ops is the number of elements scanned
+*/
+void BenchAggregates(const Keys& keys)
+{
+	long long n = (long long)keys._insert.size();
+	const char* dist = DistName(keys._dist);
+	const int reps = 8;
+	TInRange<int> range(0, (int)(n / 2));
+	std::vector<int> out((size_t)n);
+
+	if (Enabled("TList"))
+	{
+		TList<int> list;
+		for (long long i = 0; i < n; i++)
+			list.PushBack(keys._insert[(size_t)i]);
+		{
+			long long sum = 0;
+			Measure m;
+			for (int r = 0; r < reps; r++)
+			{
+				TLIST_foreach(int, itr, list)
+				{
+					sum += itr.Value();
+				}
+			}
+			Report("TList", "foreach-sum", dist, 4, n, n * reps, m.Ns(), m.Allocs());
+			g_sink = sum;
+		}
+		{
+			long long sum = 0;
+			Measure m;
+			for (int r = 0; r < reps; r++)
+				sum += list.Sum();
+			Report("TList", "sum", dist, 4, n, n * reps, m.Ns(), m.Allocs());
+			g_sink = sum;
+		}
+	}
+
+	if (Enabled("TSimd"))
+	{
+		const int* data = keys._insert.data();
+		size_t count = (size_t)n;
+		for (int simd = 0; simd < 2; simd++)
+		{
+			long long sum = 0;
+			{
+				Measure m;
+				for (int r = 0; r < reps; r++)
+					sum += simd ? TSum(data, count) : TScalarKernels<int>::Sum(data, count);
+				Report("TSimd", simd ? "sum-simd" : "sum-scalar", dist, 4, n, n * reps, m.Ns(), m.Allocs());
+			}
+			{
+				Measure m;
+				for (int r = 0; r < reps; r++)
+				{
+					int min = 0, max = 0;
+					if (simd)
+						TMinMax(data, count, min, max);
+					else
+						TScalarKernels<int>::MinMax(data, count, min, max);
+					sum += min + max;
+				}
+				Report("TSimd", simd ? "minmax-simd" : "minmax-scalar", dist, 4, n, n * reps, m.Ns(), m.Allocs());
+			}
+			{
+				Measure m;
+				for (int r = 0; r < reps; r++)
+					sum += (long long)(simd ? TCountIf(data, count, range) : TScalarKernels<int>::CountIf(data, count, range));
+				Report("TSimd", simd ? "count-if-simd" : "count-if-scalar", dist, 4, n, n * reps, m.Ns(), m.Allocs());
+			}
+			{
+				Measure m;
+				for (int r = 0; r < reps; r++)
+					sum += (long long)(simd ? TFilterInto(data, count, range, out.data()) : TScalarKernels<int>::FilterInto(data, count, range, out.data()));
+				Report("TSimd", simd ? "filter-simd" : "filter-scalar", dist, 4, n, n * reps, m.Ns(), m.Allocs());
+			}
+			g_sink = sum;
+		}
+	}
+}
+
+/* ---- String keys (TRadixTree vs TTree and THashMap) ---- */
+
+static int CompareName(const char* lhs, const char* rhs)
+{
+	return strcmp(lhs, rhs);
+}
+
+/**
+* Formats the name used as the string key for an int key ("object/<group>/<key>" so names share
+* long prefixes and each of the 100 groups can be listed by prefix)
+*/
+static void KeyName(int key, char* out)
+{
+	sprintf(out, "object/%02d/%d", key % 100, key);
+}
+
+/**
+* Inserts and looks up n names in a TRadixTree, a TTree of names compared with strcmp and a
+* THashMap hashing the names, then lists the names of 100 groups by prefix (a prefix walk of the
+* radix tree, a full scan of the TTree). Runs once per key set
+*/
+void BenchStrings(const Keys& keys)
+{
+	long long n = (long long)keys._insert.size();
+	const char* dist = DistName(keys._dist);
+	std::vector<std::string> names((size_t)n), lookups((size_t)n);
+	char name[32];
+	for (long long i = 0; i < n; i++)
+	{
+		KeyName(keys._insert[(size_t)i], name);
+		names[(size_t)i] = name;
+		KeyName(keys._ops[(size_t)i], name);
+		lookups[(size_t)i] = name;
+	}
+	const int groups = 100;
+
+	if (Enabled("TRadixTree"))
+	{
+		TRadixTree<int> tree;
+		{
+			Measure m;
+			for (long long i = 0; i < n; i++)
+				tree.Insert(names[(size_t)i].c_str(), (int)i);
+			Report("TRadixTree", "insert", dist, 4, n, n, m.Ns(), m.Allocs());
+		}
+		{
+			long long hits = 0;
+			Measure m;
+			for (long long i = 0; i < n; i++)
+				hits += tree.Find(lookups[(size_t)i].c_str()) != NULL;
+			Report("TRadixTree", "find", dist, 4, n, n, m.Ns(), m.Allocs());
+			g_sink = hits;
+		}
+		{
+			long long found = 0;
+			Measure m;
+			for (int g = 0; g < groups; g++)
+			{
+				sprintf(name, "object/%02d/", g);
+				TRADIXTREE_prefix_foreach(int, itr, tree, name)
+				{
+					found++;
+				}
+			}
+			Report("TRadixTree", "prefix-scan", dist, 4, n, groups, m.Ns(), m.Allocs());
+			g_sink = found;
+		}
+	}
+
+	if (Enabled("TTree"))
+	{
+		TTree<const char*> tree(CompareName);
+		{
+			Measure m;
+			for (long long i = 0; i < n; i++)
+				tree.Insert(names[(size_t)i].c_str());
+			Report("TTree<const char*>", "insert", dist, 4, n, n, m.Ns(), m.Allocs());
+		}
+		{
+			long long hits = 0;
+			Measure m;
+			for (long long i = 0; i < n; i++)
+				hits += tree.Find(lookups[(size_t)i].c_str()) != NULL;
+			Report("TTree<const char*>", "find", dist, 4, n, n, m.Ns(), m.Allocs());
+			g_sink = hits;
+		}
+		{
+			long long found = 0;
+			Measure m;
+			for (int g = 0; g < groups; g++)
+			{
+				sprintf(name, "object/%02d/", g);
+				size_t length = strlen(name);
+				TTREE_foreach(const char*, itr, tree)
+				{
+					found += strncmp(itr.Value(), name, length) == 0;
+				}
+			}
+			Report("TTree<const char*>", "prefix-scan", dist, 4, n, groups, m.Ns(), m.Allocs());
+			g_sink = found;
+		}
+	}
+
+	if (Enabled("THashMap"))
+	{
+		THashMap<const char*, int, THashString, TEqualString> map;
+		{
+			Measure m;
+			for (long long i = 0; i < n; i++)
+				map.Insert(names[(size_t)i].c_str(), (int)i);
+			Report("THashMap<const char*>", "insert", dist, 4, n, n, m.Ns(), m.Allocs());
+		}
+		{
+			long long hits = 0;
+			Measure m;
+			for (long long i = 0; i < n; i++)
+				hits += map.Find(lookups[(size_t)i].c_str()) != NULL;
+			Report("THashMap<const char*>", "find", dist, 4, n, n, m.Ns(), m.Allocs());
+			g_sink = hits;
+		}
+	}
+}
+
+/* ---- Intervals (TIntervalTree vs a TTree scan) ---- */
+
+static int CompareInterval(TInterval<int> lhs, TInterval<int> rhs)
+{
+	return lhs._lo < rhs._lo ? -1 : (rhs._lo < lhs._lo ? 1 : 0);
+}
+
+/**
+* Interval workloads: n intervals [key, key + 0..15] inserted into a TIntervalTree one at a time
+* and built in one pass, then n overlap queries of width 8 (each matching ~16 intervals) answered
+* by the tree and, for comparison, 100 of them answered by a scan of a TTree ordered by start.
+* Runs once per key set. ops is the number of intervals inserted or queries answered
+*/
+void BenchIntervals(const Keys& keys)
+{
+	long long n = (long long)keys._insert.size();
+	const char* dist = DistName(keys._dist);
+	std::vector<TInterval<int> > intervals((size_t)n);
+	for (long long i = 0; i < n; i++)
+		intervals[(size_t)i] = TInterval<int>(keys._insert[(size_t)i], keys._insert[(size_t)i] + keys._mix[(size_t)i] % 16);
+	const long long scans = n < 100 ? n : 100;
+
+	if (Enabled("TIntervalTree"))
+	{
+		TIntervalTree<int> tree;
+		{
+			Measure m;
+			for (long long i = 0; i < n; i++)
+				tree.Insert(intervals[(size_t)i]);
+			Report("TIntervalTree", "insert", dist, 4, n, n, m.Ns(), m.Allocs());
+		}
+		{
+			Measure m;
+			tree.Build(intervals.data(), (int)n);
+			Report("TIntervalTree", "build", dist, 4, n, n, m.Ns(), m.Allocs());
+		}
+		{
+			long long found = 0;
+			Measure m;
+			for (long long i = 0; i < n; i++)
+			{
+				int lo = keys._ops[(size_t)i];
+				found += tree.Overlapping(lo, lo + 8, [](const TInterval<int>&) {});
+			}
+			Report("TIntervalTree", "overlap", dist, 4, n, n, m.Ns(), m.Allocs());
+			g_sink = found;
+		}
+	}
+
+	if (Enabled("TTree"))
+	{
+		TTree<TInterval<int> > tree(CompareInterval);
+		tree.InsertBatch(intervals.data(), (int)n);
+		long long found = 0;
+		Measure m;
+		for (long long i = 0; i < scans; i++)
+		{
+			int lo = keys._ops[(size_t)i];
+			TTREE_foreach(TInterval<int>, itr, tree)
+			{
+				found += itr.Value().Overlaps(lo, lo + 8);
+			}
+		}
+		Report("TTree<TInterval>", "overlap-scan", dist, 4, n, scans, m.Ns(), m.Allocs());
+		g_sink = found;
+	}
+}
+
+/* ---- Driver ---- */
+
+/**
+* Runs every container for the given keys and payload type
+*/
+template<typename P>
+void RunPayload(const Keys& keys)
+{
+	if (Enabled("TTree")) BenchOrdered<TreeAdapter<P, TDefaultAllocator>, P>("TTree", true, keys);
+	if (Enabled("TTree")) BenchReload<P>(keys);
+	if (Enabled("TTree")) BenchBatch<P>(keys);
+	if (Enabled("TTree")) BenchFindMany<P>(keys);
+	if (Enabled("TSkipList")) BenchConcurrent<P>(keys);
+	if (Enabled("TTree+cache")) BenchOrdered<TreeAdapter<P, TThreadCacheAllocator>, P>("TTree+cache", true, keys);
+	if (Enabled("TTree+arena")) BenchOrdered<TreeAdapter<P, TArenaAllocator>, P>("TTree+arena", true, keys);
+	if (Enabled("TTree+huge")) BenchOrdered<TreeAdapter<P, THugePageAllocator>, P>("TTree+huge", true, keys);
+	if (Enabled("std::multiset")) BenchOrdered<MultisetAdapter<P>, P>("std::multiset", false, keys);
+	if (Enabled("THashMap")) BenchOrdered<HashMapAdapter<P>, P>("THashMap", false, keys);
+	if (Enabled("std::unordered_map")) BenchOrdered<UnorderedMapAdapter<P>, P>("std::unordered_map", false, keys);
+
+	if (Enabled("TList")) BenchSequence<ListAdapter<P, TDefaultAllocator>, P>("TList", keys);
+	if (Enabled("TList+arena")) BenchSequence<ListAdapter<P, TArenaAllocator>, P>("TList+arena", keys);
+	if (Enabled("std::list")) BenchSequence<StdListAdapter<P>, P>("std::list", keys);
+
+	if (Enabled("TRingBuffer")) BenchRingBuffer<P>(keys);
+
+	if (Enabled("TStack")) BenchStack<StackAdapter<P, TDefaultAllocator>, P>("TStack", keys);
+	if (Enabled("TStack+cache")) BenchStack<StackAdapter<P, TThreadCacheAllocator>, P>("TStack+cache", keys);
+	if (Enabled("std::vector")) BenchStack<VectorAdapter<P>, P>("std::vector", keys);
+
+	if (Enabled("TPriorityQueue")) BenchPriority<PriorityQueueAdapter<P, 4>, P>("TPriorityQueue", keys);
+	if (Enabled("TPriorityQueue<2>")) BenchPriority<PriorityQueueAdapter<P, 2>, P>("TPriorityQueue<2>", keys);
+	if (Enabled("std::priority_queue")) BenchPriority<StdPriorityQueueAdapter<P>, P>("std::priority_queue", keys);
+	if (Enabled("std::multiset")) BenchPriority<MultisetQueueAdapter<P>, P>("std::multiset", keys);
+}
+
+int main(int argc, char** argv)
+{
+	g_options._minSize = 1000;
+	g_options._maxSize = 1000000;
+	g_options._maxDegenerate = 16384;
+	g_options._filter = NULL;
+	g_options._json = false;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--min-size") == 0 && i + 1 < argc) g_options._minSize = atoll(argv[++i]);
+		else if (strcmp(argv[i], "--max-size") == 0 && i + 1 < argc) g_options._maxSize = atoll(argv[++i]);
+		else if (strcmp(argv[i], "--max-degenerate") == 0 && i + 1 < argc) g_options._maxDegenerate = atoll(argv[++i]);
+		else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) g_options._filter = argv[++i];
+		else if (strcmp(argv[i], "--json") == 0) g_options._json = true;
+		else
+		{
+			fprintf(stderr, "usage: %s [--min-size N] [--max-size N] [--max-degenerate N] [--filter name] [--json]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	if (!g_options._json)
+		printf("container,workload,distribution,payload,size,ops,ns_per_op,allocs_per_op\n");
+
+	for (long long n = g_options._minSize; n <= g_options._maxSize; n *= 10)
+	{
+		for (int dist = 0; dist < DIST_COUNT; dist++)
+		{
+			Keys keys(n, dist);
+			RunPayload<Payload<4> >(keys);
+			RunPayload<Payload<64> >(keys);
+			RunPayload<Payload<256> >(keys);
+			BenchAggregates(keys);
+			BenchStrings(keys);
+			BenchIntervals(keys);
+		}
+	}
+
+	return 0;
+}
\ No newline at end of file
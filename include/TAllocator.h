@@ -0,0 +1,324 @@
+#ifndef TALLOCATOR_H
+#define TALLOCATOR_H
+
+/* Includes for size_t and placement new */
+#include <stddef.h>
+#include <new>
+#include <type_traits>
+
+/* Definitions and macros */
+#ifndef NULL
+#define NULL 0
+#endif
+
+/**
+* The allocators in this file are what TList, TStack and TTree use to get memory for
+* their nodes. Any class can be used as an allocator as long as it provides the following
+* two methods:
+*
+*	void* Allocate(size_t size);          - returns size bytes suitably aligned for any node
+*	void Free(void* ptr, size_t size);    - releases memory returned by Allocate (size is the same as passed to Allocate)
+*
+* A copy of the allocator is stored inside each container so allocators can hold state
+* (e.g. a pointer to an arena or pool) and should be cheap to copy.
+*/
+
+/**
+* Returns the number of bytes the global heap uses for a block of the given size. This models
+* a typical 64 bit malloc (an 8 byte header, 16 byte granularity and a 32 byte minimum)
+* @param size The requested size in bytes
+* @return The number of bytes the block occupies
+*/
+inline size_t THeapFootprint(size_t size)
+{
+	size_t ret = (size + sizeof(size_t) + 15) & ~(size_t)15;
+	return ret < 32 ? 32 : ret;
+}
+
+/**
+* Traits describing an allocator. Specialize this for allocators whose Free does nothing
+* (IsMonotonic = true) so containers know they can drop their nodes without visiting them,
+* or whose blocks take up a different amount of memory than the global heap
+*/
+
+template<typename Alloc>
+struct TAllocatorTraits
+{
+	static const bool IsMonotonic = false; /**< True if memory is only released in bulk (Free is a no-op) */
+
+	/**
+	* Returns the number of bytes an allocation of the given size really occupies
+	* @param size The requested size in bytes
+	* @return The number of bytes including allocator overhead
+	*/
+	static size_t Footprint(size_t size)
+	{
+		return THeapFootprint(size);
+	}
+};
+
+/**
+* The default allocator which simply uses the global new and delete operators
+* (this is the behaviour the containers had before allocators were added)
+*/
+
+class TDefaultAllocator
+{
+public:
+	/**
+	* Allocates size bytes from the global heap
+	* @param size The number of bytes to allocate
+	* @return Pointer to the allocated memory
+	*/
+	inline void* Allocate(size_t size)
+	{
+		return ::operator new(size);
+	}
+
+	/**
+	* Returns memory to the global heap
+	* @param ptr The memory to free (returned by Allocate)
+	* @param size The size that was passed to Allocate
+	*/
+	inline void Free(void* ptr, size_t size)
+	{
+		(void)size;
+		::operator delete(ptr);
+	}
+};
+
+
+
+/**
+* An allocator which keeps a small per thread cache of freed blocks (one free list for each
+* 16 byte size class up to MAX_SIZE) so allocating and freeing nodes on hot paths does not
+* need to take the global heap lock. Blocks larger than MAX_SIZE go straight to the global heap.
+* Each cached block is still an individual global heap allocation so a block may be freed
+* on a different thread to the one that allocated it. When a thread exits its cache is
+* released back to the global heap.
+*/
+
+class TThreadCacheAllocator
+{
+public:
+	enum
+	{
+		GRANULARITY = 16, /**< The size (in bytes) between each size class */
+		MAX_SIZE = 256, /**< Allocations larger than this are not cached */
+		NUM_CLASSES = MAX_SIZE / GRANULARITY, /**< Number of size classes (and free lists) per thread */
+		MAX_CACHED = 1024 /**< Maximum number of free blocks cached per size class per thread */
+	};
+
+private:
+	/**
+	* A freed block which is linked into the free list of its size class
+	*/
+	struct FreeBlock
+	{
+		FreeBlock* _next; /**< The next free block in the same size class */
+	};
+
+	/**
+	* The per thread state. This must stay trivially destructible so accessing it
+	* never requires a thread_local guard on the fast path
+	*/
+	struct Cache
+	{
+		FreeBlock* _lists[NUM_CLASSES]; /**< Head of the free list for each size class */
+		int _counts[NUM_CLASSES]; /**< Number of blocks in each free list */
+		bool _registered; /**< True once the Reaper for this thread has been created */
+		bool _dead; /**< True once the thread is exiting (from then on all calls go to the global heap) */
+	};
+
+	/**
+	* Object which releases the cache of a thread when the thread exits
+	*/
+	struct Reaper
+	{
+		~Reaper()
+		{
+			Cache& cache = GetCache();
+
+			//release every cached block
+			for (int i = 0; i < NUM_CLASSES; i++)
+			{
+				while (cache._lists[i] != NULL)
+				{
+					FreeBlock* tmp = cache._lists[i];
+					cache._lists[i] = tmp->_next;
+					::operator delete(tmp);
+				}
+				cache._counts[i] = 0;
+			}
+
+			//anything freed after this point goes to the global heap
+			cache._dead = true;
+		}
+	};
+
+	/**
+	* Returns the cache of the calling thread
+	* @return Reference to the thread local cache
+	*/
+	static inline Cache& GetCache()
+	{
+		static thread_local Cache cache;
+		return cache;
+	}
+
+	/**
+	* Makes sure the Reaper for this thread exists (only called on the slow path)
+	* @param cache The cache of the calling thread
+	*/
+	static void Register(Cache& cache)
+	{
+		static thread_local Reaper reaper;
+		(void)reaper;
+		cache._registered = true;
+	}
+
+	/**
+	* Returns the size class index for the given size
+	* @param size The size in bytes (must be > 0 and <= MAX_SIZE)
+	* @return Index of the size class
+	*/
+	static inline int SizeClass(size_t size)
+	{
+		return (int)((size + GRANULARITY - 1) / GRANULARITY) - 1;
+	}
+
+public:
+	/**
+	* Allocates size bytes from the thread cache (or the global heap if the cache is empty)
+	* @param size The number of bytes to allocate
+	* @return Pointer to the allocated memory
+	*/
+	inline void* Allocate(size_t size)
+	{
+		if (size == 0 || size > MAX_SIZE)
+			return ::operator new(size);
+
+		Cache& cache = GetCache();
+		int sc = SizeClass(size);
+
+		//fast path - pop a block off the free list
+		FreeBlock* block = cache._lists[sc];
+		if (block != NULL)
+		{
+			cache._lists[sc] = block->_next;
+			cache._counts[sc]--;
+			return block;
+		}
+
+		//slow path - always allocate the full size class so the block can be reused by any size in the class
+		return ::operator new((size_t)(sc + 1) * GRANULARITY);
+	}
+
+	/**
+	* Returns memory to the thread cache (or the global heap if the cache is full)
+	* @param ptr The memory to free (returned by Allocate)
+	* @param size The size that was passed to Allocate
+	*/
+	inline void Free(void* ptr, size_t size)
+	{
+		if (ptr == NULL)
+			return;
+
+		if (size == 0 || size > MAX_SIZE)
+		{
+			::operator delete(ptr);
+			return;
+		}
+
+		Cache& cache = GetCache();
+		int sc = SizeClass(size);
+
+		if (cache._dead || cache._counts[sc] >= MAX_CACHED)
+		{
+			::operator delete(ptr);
+			return;
+		}
+
+		//make sure the blocks get released when this thread exits
+		if (!cache._registered)
+			Register(cache);
+
+		FreeBlock* block = (FreeBlock*)ptr;
+		block->_next = cache._lists[sc];
+		cache._lists[sc] = block;
+		cache._counts[sc]++;
+	}
+
+	/**
+	* Returns how many blocks are currently cached by the calling thread
+	* @return Integer
+	*/
+	static int CachedBlocks()
+	{
+		Cache& cache = GetCache();
+		int ret = 0;
+		for (int i = 0; i < NUM_CLASSES; i++)
+			ret += cache._counts[i];
+		return ret;
+	}
+};
+
+
+
+/**
+* Blocks from TThreadCacheAllocator are rounded up to their size class
+*/
+template<>
+struct TAllocatorTraits<TThreadCacheAllocator>
+{
+	static const bool IsMonotonic = false;
+
+	static size_t Footprint(size_t size)
+	{
+		if (size > TThreadCacheAllocator::MAX_SIZE)
+			return THeapFootprint(size);
+		size_t gran = TThreadCacheAllocator::GRANULARITY;
+		return THeapFootprint((size + gran - 1) / gran * gran);
+	}
+};
+
+
+
+/**
+* Constructs a new node of type NodeT using memory from the given allocator
+* @param alloc The allocator to get the memory from
+* @return Pointer to the new (default constructed) node
+*/
+template<typename NodeT, typename Alloc>
+inline NodeT* TAllocNode(Alloc& alloc)
+{
+	return new(alloc.Allocate(sizeof(NodeT))) NodeT();
+}
+
+/**
+* Destructs the given node and returns its memory to the allocator
+* @param alloc The allocator the node was allocated from
+* @param node The node to free (can be NULL)
+*/
+template<typename NodeT, typename Alloc>
+inline void TFreeNode(Alloc& alloc, NodeT* node)
+{
+	if (node != NULL)
+	{
+		node->~NodeT();
+		alloc.Free(node, sizeof(NodeT));
+	}
+}
+
+/**
+* Returns true if a container of T using Alloc can simply forget about its nodes rather than
+* freeing them one by one (i.e. the allocator is monotonic and T needs no destructor call)
+* @return Boolean
+*/
+template<typename T, typename Alloc>
+inline bool TCanDropNodes()
+{
+	return TAllocatorTraits<Alloc>::IsMonotonic && std::is_trivially_destructible<T>::value;
+}
+
+#endif
\ No newline at end of file
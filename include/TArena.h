@@ -0,0 +1,232 @@
+#ifndef TARENA_H
+#define TARENA_H
+
+/* Include for the allocator traits */
+#include "TAllocator.h"
+
+/* Definitions and macros */
+#ifndef NULL
+#define NULL 0
+#endif
+
+/**
+* A monotonic (bump pointer) memory resource. Memory is handed out from large chunks
+* and is never given back individually - everything is released at once when the arena
+* is Released or destroyed. Use TArenaAllocator to make containers allocate from an arena.
+* Note that an arena is not thread safe.
+*/
+
+class TArena
+{
+private:
+	/**
+	* Header placed at the start of every chunk the arena allocates
+	*/
+	struct Chunk
+	{
+		Chunk* _prev; /**< The previously allocated chunk (NULL if this is the first) */
+		size_t _size; /**< The usable size of this chunk in bytes (excluding this header) */
+	};
+
+	enum
+	{
+		ALIGNMENT = 16, /**< Every allocation is aligned to this many bytes */
+		HEADER_SIZE = (sizeof(Chunk) + ALIGNMENT - 1) & ~(ALIGNMENT - 1) /**< Size of the chunk header rounded up to ALIGNMENT */
+	};
+
+	Chunk* _chunk; /**< The chunk currently being allocated from (NULL if nothing allocated yet) */
+
+	char* _cur; /**< The next free byte in _chunk */
+
+	char* _end; /**< One past the last usable byte in _chunk */
+
+	size_t _chunkSize; /**< The size of the next chunk to allocate (grows as the arena grows) */
+
+	size_t _maxChunkSize; /**< The largest size _chunkSize will grow to */
+
+	size_t _used; /**< Number of bytes handed out by Allocate */
+
+	size_t _reserved; /**< Number of bytes allocated from the global heap for chunks */
+
+	/**
+	* Allocates a new chunk big enough to hold at least size bytes
+	* @param size The size of the allocation that didn't fit in the current chunk
+	*/
+	void Grow(size_t size)
+	{
+		size_t chunk_size = _chunkSize;
+		if (chunk_size < size)
+			chunk_size = size;
+
+		Chunk* chunk = (Chunk*)::operator new(HEADER_SIZE + chunk_size);
+		chunk->_prev = _chunk;
+		chunk->_size = chunk_size;
+
+		_chunk = chunk;
+		_cur = (char*)chunk + HEADER_SIZE;
+		_end = _cur + chunk_size;
+		_reserved += HEADER_SIZE + chunk_size;
+
+		//grow the next chunk geometrically so large containers need few chunks
+		if (_chunkSize < _maxChunkSize)
+			_chunkSize *= 2;
+	}
+
+	/**
+	* The arena owns its chunks so it can't be copied
+	*/
+	TArena(const TArena&);
+	TArena& operator=(const TArena&);
+
+public:
+	/**
+	* Constructor of the arena (no memory is allocated until the first call to Allocate)
+	* @param chunkSize The size of the first chunk in bytes
+	* @param maxChunkSize The size chunks will double up to as the arena grows
+	*/
+	TArena(size_t chunkSize = 64 * 1024, size_t maxChunkSize = 16 * 1024 * 1024)
+	{
+		_chunk = NULL;
+		_cur = _end = NULL;
+		_chunkSize = chunkSize > 0 ? chunkSize : 1;
+		_maxChunkSize = maxChunkSize > _chunkSize ? maxChunkSize : _chunkSize;
+		_used = 0;
+		_reserved = 0;
+	}
+
+	/**
+	* Destructor which releases every chunk at once
+	*/
+	~TArena()
+	{
+		Release();
+	}
+
+	/**
+	* Allocates size bytes from the arena
+	* @param size The number of bytes to allocate
+	* @return Pointer to the memory (aligned to 16 bytes)
+	*/
+	inline void* Allocate(size_t size)
+	{
+		size = (size + ALIGNMENT - 1) & ~(size_t)(ALIGNMENT - 1);
+
+		if ((size_t)(_end - _cur) < size)
+			Grow(size);
+
+		void* ret = _cur;
+		_cur += size;
+		_used += size;
+		return ret;
+	}
+
+	/**
+	* Releases every chunk back to the global heap. Anything allocated from the arena
+	* (including the nodes of containers using it) becomes invalid
+	*/
+	void Release()
+	{
+		while (_chunk != NULL)
+		{
+			Chunk* prev = _chunk->_prev;
+			::operator delete(_chunk);
+			_chunk = prev;
+		}
+
+		_cur = _end = NULL;
+		_used = 0;
+		_reserved = 0;
+	}
+
+	/**
+	* Returns how many bytes have been handed out by the arena
+	* @return Number of bytes
+	*/
+	inline size_t BytesUsed() const
+	{
+		return _used;
+	}
+
+	/**
+	* Returns how many bytes the arena has taken from the global heap
+	* @return Number of bytes
+	*/
+	inline size_t BytesReserved() const
+	{
+		return _reserved;
+	}
+};
+
+
+
+/**
+* Allocator handle which allocates container nodes from a TArena. Free is a no-op
+* so memory is only released when the arena is. When T is trivially destructible,
+* a container using this allocator does not walk its nodes in Empty() or its destructor,
+* which makes teardown O(1) and also means the container may outlive the arena.
+*/
+
+class TArenaAllocator
+{
+private:
+	TArena* _arena; /**< The arena memory is allocated from */
+
+public:
+	/**
+	* Constructor which takes the arena to allocate from
+	* @param arena The arena (must outlive anything allocated from it)
+	*/
+	TArenaAllocator(TArena* arena)
+	{
+		_arena = arena;
+	}
+
+	/**
+	* Allocates size bytes from the arena
+	* @param size The number of bytes to allocate
+	* @return Pointer to the allocated memory
+	*/
+	inline void* Allocate(size_t size)
+	{
+		return _arena->Allocate(size);
+	}
+
+	/**
+	* Does nothing - memory is released when the arena is
+	* @param ptr The memory to free
+	* @param size The size that was passed to Allocate
+	*/
+	inline void Free(void* ptr, size_t size)
+	{
+		(void)ptr;
+		(void)size;
+	}
+
+	/**
+	* Returns the arena this allocator allocates from
+	* @return Pointer to the arena
+	*/
+	inline TArena* GetArena()
+	{
+		return _arena;
+	}
+};
+
+/**
+* TArenaAllocator never frees memory individually
+*/
+template<>
+struct TAllocatorTraits<TArenaAllocator>
+{
+	static const bool IsMonotonic = true;
+
+	/**
+	* Allocations are only rounded up to the arena alignment
+	*/
+	static size_t Footprint(size_t size)
+	{
+		return (size + 15) & ~(size_t)15;
+	}
+};
+
+#endif
\ No newline at end of file
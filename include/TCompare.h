@@ -0,0 +1,70 @@
+#ifndef TCOMPARE_H
+#define TCOMPARE_H
+
+/**
+* Comparison functors for the containers that take their ordering as a type (so it can be inlined
+* and used at compile time) rather than as a function pointer. The ordering functors return true
+* if lhs is ordered before rhs
+*/
+
+/**
+* Orders values with operator<
+*/
+
+template<typename T>
+struct TLess
+{
+	constexpr bool operator()(const T& lhs, const T& rhs) const
+	{
+		return lhs < rhs;
+	}
+};
+
+/**
+* Orders null terminated strings alphabetically (by unsigned char value)
+*/
+
+struct TLessString
+{
+	constexpr bool operator()(const char* lhs, const char* rhs) const
+	{
+		while (*lhs != '\0' && *lhs == *rhs)
+		{
+			lhs++;
+			rhs++;
+		}
+		return (unsigned char)*lhs < (unsigned char)*rhs;
+	}
+};
+
+/**
+* Tests values for equality with operator== (used by the hashed containers)
+*/
+
+template<typename T>
+struct TEqual
+{
+	constexpr bool operator()(const T& lhs, const T& rhs) const
+	{
+		return lhs == rhs;
+	}
+};
+
+/**
+* Tests null terminated strings for equality by their characters
+*/
+
+struct TEqualString
+{
+	constexpr bool operator()(const char* lhs, const char* rhs) const
+	{
+		while (*lhs != '\0' && *lhs == *rhs)
+		{
+			lhs++;
+			rhs++;
+		}
+		return *lhs == *rhs;
+	}
+};
+
+#endif
\ No newline at end of file
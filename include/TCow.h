@@ -0,0 +1,165 @@
+#ifndef TCOW_H
+#define TCOW_H
+
+/* Include for the reference count */
+#include <atomic>
+
+/* Definitions and macros */
+#ifndef NULL
+#define NULL 0
+#endif
+
+/**
+* Copy on write wrapper for a container with a deep copy constructor (e.g. TTree or TList). Copies
+* of a TCow share one container until one of them calls Write, which first clones the container
+* if anyone else is still sharing it. Copying a TCow is therefore O(1) and a copy that is only ever
+* read never pays for a clone:
+*
+*	TCow<TTree<int> > config(tree);
+*	TCow<TTree<int> > request = config; //shares the tree
+*	request->Find(5); //reads the shared tree
+*	request.Write().Insert(7); //clones the tree first, config is unchanged
+*
+* Reads go through Read (or ->) which only give const access. The reference count is atomic so
+* copies sharing one container can be read, written and destroyed on different threads, but a
+* single TCow object must not be used by two threads at once
+*/
+
+template<typename C>
+class TCow
+{
+private:
+	/**
+	* The container and the number of TCow objects sharing it
+	*/
+	struct Shared
+	{
+		C _container; /**< The shared container */
+
+		std::atomic<int> _refs; /**< Number of TCow objects sharing the container */
+
+		/**
+		* Constructor of an empty container
+		*/
+		Shared() : _refs(1)
+		{
+		}
+
+		/**
+		* Constructor which deep copies container
+		* @param container The container to copy
+		*/
+		Shared(const C& container) : _container(container), _refs(1)
+		{
+		}
+	};
+
+	Shared* _shared; /**< The container of this object (shared with its copies) */
+
+	/**
+	* Drops this object's reference to the shared container, deleting it if it was the last one
+	*/
+	inline void Release()
+	{
+		if (_shared->_refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+			delete _shared;
+		_shared = NULL;
+	}
+
+public:
+	/**
+	* Default constructor of an empty container
+	*/
+	TCow()
+	{
+		_shared = new Shared();
+	}
+
+	/**
+	* Overloaded constructor which deep copies container
+	* @param container The container to copy
+	*/
+	explicit TCow(const C& container)
+	{
+		_shared = new Shared(container);
+	}
+
+	/**
+	* Copy constructor which shares the container of other (O(1))
+	* @param other The object to share with
+	*/
+	TCow(const TCow& other)
+	{
+		_shared = other._shared;
+		_shared->_refs.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	/**
+	* Assignment which releases the current container and shares the one of other (O(1))
+	* @param other The object to share with
+	* @return This object
+	*/
+	TCow& operator=(const TCow& other)
+	{
+		if (_shared != other._shared)
+		{
+			other._shared->_refs.fetch_add(1, std::memory_order_relaxed);
+			Release();
+			_shared = other._shared;
+		}
+		return *this;
+	}
+
+	/**
+	* Default destructor which releases the container
+	*/
+	~TCow()
+	{
+		Release();
+	}
+
+	/**
+	* Returns the container for reading (never copies)
+	* @return Const reference to the container
+	*/
+	inline const C& Read() const
+	{
+		return _shared->_container;
+	}
+
+	/**
+	* Returns the container for reading (never copies)
+	* @return Const pointer to the container
+	*/
+	inline const C* operator->() const
+	{
+		return &_shared->_container;
+	}
+
+	/**
+	* Returns the container for writing, cloning it first if it is shared with other objects.
+	* The reference stays valid until this object is copied over or destroyed
+	* @return Reference to the container (owned by this object alone)
+	*/
+	C& Write()
+	{
+		if (_shared->_refs.load(std::memory_order_acquire) != 1)
+		{
+			Shared* copy = new Shared(_shared->_container);
+			Release();
+			_shared = copy;
+		}
+		return _shared->_container;
+	}
+
+	/**
+	* Returns true if the container is shared with another object (so Write would clone it)
+	* @return Boolean
+	*/
+	inline bool IsShared() const
+	{
+		return _shared->_refs.load(std::memory_order_acquire) != 1;
+	}
+};
+
+#endif
\ No newline at end of file
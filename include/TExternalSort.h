@@ -0,0 +1,662 @@
+#ifndef TEXTERNALSORT_H
+#define TEXTERNALSORT_H
+
+/* Includes for temporary files and std::sort */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <algorithm>
+#include <istream>
+#include <type_traits>
+#if !defined(_WIN32)
+#include <unistd.h>
+#endif
+
+/* Include for the trees it can build */
+#include "TTree.h"
+#include "TMappedTree.h"
+
+/* Definitions and macros */
+#ifndef NULL
+#define NULL 0
+#endif
+
+/**
+* Size of the read and write buffers of every run file while merging (smaller if the memory budget
+* can't hold three of them)
+*/
+#define TEXTERNALSORT_MIN_BUFFER_BYTES (64 * 1024)
+
+/**
+* Sorts more data than fits in memory. Elements are added with Add, AddStream or AddFile and
+* collected in a buffer of at most memoryBytes; every time it fills it is sorted and written out as
+* a run to an (already unlinked) temporary file. Once everything is added the runs are k-way merged
+* with sequential reads and the elements handed out in sorted order by Read, which is what
+* TTree::BuildSorted and TMappedTree::BuildSorted consume (see BuildTree and BuildMapped).
+* If there are too many runs to merge within the memory budget they are merged in several passes.
+* If everything fits in memory no temporary files are written at all.
+*
+* T must be trivially copyable as runs are written as raw bytes.
+*/
+
+template<typename T>
+class TExternalSorter
+{
+	static_assert(std::is_trivially_copyable<T>::value, "TExternalSorter can only sort trivially copyable types");
+
+private:
+	/**
+	* A sorted run in a temporary file and the cursor used to merge it
+	*/
+	struct Run
+	{
+		FILE* _file; /**< The temporary file (deleted when closed) */
+		uint64_t _remaining; /**< Elements in the file not yet read into _buffer */
+		T* _buffer; /**< Elements read but not yet merged */
+		size_t _used; /**< Number of elements in _buffer */
+		size_t _next; /**< Index of the next element to merge */
+	};
+
+	int(*_comparison)(T, T); /**< The comparison function (see TTree) */
+
+	size_t _memoryBytes; /**< Memory budget for buffers */
+
+	char _tempDir[256]; /**< Directory temporary files are created in */
+
+	uint64_t _maxTempBytes; /**< Largest size all temporary files may reach together (0 for no limit) */
+
+	uint64_t _tempBytes; /**< Current size of all temporary files */
+
+	T* _buffer; /**< Elements added but not yet written as a run (also the output buffer of merge passes) */
+
+	size_t _bufferCapacity; /**< Number of elements _buffer can hold */
+
+	size_t _bufferUsed; /**< Number of elements in _buffer */
+
+	Run* _runs; /**< Runs written so far */
+
+	int _runCount; /**< Number of runs in _runs */
+
+	int _runCapacity; /**< Number of runs _runs can hold */
+
+	int* _heap; /**< Indices of the runs being merged as a min heap on their next element */
+
+	int _heapSize; /**< Number of runs in _heap */
+
+	uint64_t _count; /**< Number of elements added */
+
+	uint64_t _handedOut; /**< Number of elements returned by Read */
+
+	bool _finished; /**< True once Finish has been called */
+
+	bool _failed; /**< True if any I/O failed or the temp limit was hit */
+
+	/**
+	* Comparison used by std::sort
+	*/
+	struct Less
+	{
+		int(*_comparison)(T, T);
+		bool operator()(const T& lhs, const T& rhs) const
+		{
+			return _comparison(lhs, rhs) < 0;
+		}
+	};
+
+	/**
+	* Opens an anonymous temporary file in _tempDir
+	* @return The file (NULL on failure)
+	*/
+	FILE* OpenTempFile()
+	{
+#if defined(_WIN32)
+		return tmpfile();
+#else
+		char path[300];
+		snprintf(path, sizeof(path), "%s/tds_sort_XXXXXX", _tempDir);
+		int fd = mkstemp(path);
+		if (fd < 0)
+			return NULL;
+
+		//unlink straight away so the file disappears when closed (even if we crash)
+		unlink(path);
+		FILE* file = fdopen(fd, "w+b");
+		if (file == NULL)
+			close(fd);
+		return file;
+#endif
+	}
+
+	/**
+	* Adds a run to _runs
+	* @param file The file holding the run
+	* @param count The number of elements in it
+	*/
+	void AddRun(FILE* file, uint64_t count)
+	{
+		if (_runCount == _runCapacity)
+		{
+			int capacity = _runCapacity ? _runCapacity * 2 : 16;
+			Run* runs = new Run[capacity];
+			if (_runCount > 0)
+				memcpy(runs, _runs, _runCount * sizeof(Run));
+			delete[] _runs;
+			_runs = runs;
+			_runCapacity = capacity;
+		}
+
+		Run& run = _runs[_runCount++];
+		run._file = file;
+		run._remaining = count;
+		run._buffer = NULL;
+		run._used = run._next = 0;
+	}
+
+	/**
+	* Closes a run and frees its buffer
+	* @param run The run
+	*/
+	void CloseRun(Run& run)
+	{
+		if (run._file != NULL)
+			fclose(run._file);
+		delete[] run._buffer;
+		run._file = NULL;
+		run._buffer = NULL;
+	}
+
+	/**
+	* Checks count more elements can be written to temporary files
+	* @param count The number of elements
+	* @return True if they fit within _maxTempBytes
+	*/
+	bool ReserveTemp(uint64_t count)
+	{
+		uint64_t bytes = count * sizeof(T);
+		if (_maxTempBytes != 0 && _tempBytes + bytes > _maxTempBytes)
+			return false;
+		_tempBytes += bytes;
+		return true;
+	}
+
+	/**
+	* Sorts the buffer and writes it out as a new run
+	* @return True if the run was written
+	*/
+	bool SpillBuffer()
+	{
+		if (_bufferUsed == 0)
+			return true;
+
+		Less less = { _comparison };
+		std::sort(_buffer, _buffer + _bufferUsed, less);
+
+		FILE* file;
+		if (!ReserveTemp(_bufferUsed) || (file = OpenTempFile()) == NULL)
+			return false;
+
+		if (fwrite(_buffer, sizeof(T), _bufferUsed, file) != _bufferUsed)
+		{
+			fclose(file);
+			return false;
+		}
+
+		AddRun(file, _bufferUsed);
+		_bufferUsed = 0;
+		return true;
+	}
+
+	/**
+	* Reads the next block of a run into its buffer
+	* @param run The run
+	* @return True if any elements were read
+	*/
+	bool FillRun(Run& run)
+	{
+		size_t count = run._remaining < (uint64_t)_bufferCapacity ? (size_t)run._remaining : _bufferCapacity;
+		if (count == 0 || fread(run._buffer, sizeof(T), count, run._file) != count)
+			return false;
+
+		run._remaining -= count;
+		run._used = count;
+		run._next = 0;
+		return true;
+	}
+
+	/**
+	* Returns true if the next element of run a is less than that of run b
+	*/
+	inline bool RunLess(int a, int b)
+	{
+		return _comparison(_runs[a]._buffer[_runs[a]._next], _runs[b]._buffer[_runs[b]._next]) < 0;
+	}
+
+	/**
+	* Moves the heap entry at index down until the heap is ordered again
+	* @param index The index in _heap
+	*/
+	void SiftDown(int index)
+	{
+		for (;;)
+		{
+			int smallest = index;
+			int left = index * 2 + 1;
+			int right = left + 1;
+			if (left < _heapSize && RunLess(_heap[left], _heap[smallest]))
+				smallest = left;
+			if (right < _heapSize && RunLess(_heap[right], _heap[smallest]))
+				smallest = right;
+			if (smallest == index)
+				return;
+
+			int temp = _heap[index];
+			_heap[index] = _heap[smallest];
+			_heap[smallest] = temp;
+			index = smallest;
+		}
+	}
+
+	/**
+	* Starts merging the runs [first, first + count), giving each run a buffer of _bufferCapacity elements
+	* @param first Index of the first run
+	* @param count Number of runs
+	* @return True if every run could be read
+	*/
+	bool StartMerge(int first, int count)
+	{
+		delete[] _heap;
+		_heap = new int[count];
+		_heapSize = 0;
+
+		for (int i = first; i < first + count; i++)
+		{
+			Run& run = _runs[i];
+			if (fseek(run._file, 0, SEEK_SET) != 0)
+				return false;
+
+			run._buffer = new T[_bufferCapacity];
+			if (!FillRun(run))
+				return false;
+			_heap[_heapSize++] = i;
+		}
+
+		for (int i = _heapSize / 2 - 1; i >= 0; i--)
+			SiftDown(i);
+		return true;
+	}
+
+	/**
+	* Takes the smallest element from the runs being merged
+	* @param value Set to the element
+	* @return True if there was an element left
+	*/
+	bool MergeNext(T& value)
+	{
+		if (_heapSize == 0)
+			return false;
+
+		Run& run = _runs[_heap[0]];
+		value = run._buffer[run._next++];
+
+		//refill or drop the run once its buffer is used up
+		if (run._next == run._used)
+		{
+			if (run._remaining == 0)
+			{
+				delete[] run._buffer;
+				run._buffer = NULL;
+				_heap[0] = _heap[--_heapSize];
+			}
+			else if (!FillRun(run))
+			{
+				_failed = true;
+				_heapSize = 0;
+				return false;
+			}
+		}
+
+		SiftDown(0);
+		return true;
+	}
+
+	/**
+	* Merges the runs [first, first + count) into a single new run (one extra pass)
+	* @param first Index of the first run
+	* @param count Number of runs
+	* @return True if merged
+	*/
+	bool MergePass(int first, int count)
+	{
+		uint64_t total = 0;
+		for (int i = first; i < first + count; i++)
+			total += _runs[i]._remaining;
+
+		FILE* file;
+		if (!ReserveTemp(total) || (file = OpenTempFile()) == NULL || !StartMerge(first, count))
+			return false;
+
+		//_buffer is free while merging so use it as the output buffer
+		T value;
+		_bufferUsed = 0;
+		while (MergeNext(value))
+		{
+			_buffer[_bufferUsed++] = value;
+			if (_bufferUsed == _bufferCapacity)
+			{
+				if (fwrite(_buffer, sizeof(T), _bufferUsed, file) != _bufferUsed)
+					break;
+				_bufferUsed = 0;
+			}
+		}
+		if (_failed || fwrite(_buffer, sizeof(T), _bufferUsed, file) != _bufferUsed)
+		{
+			fclose(file);
+			return false;
+		}
+		_bufferUsed = 0;
+
+		//swap the merged runs for the new one
+		for (int i = first; i < first + count; i++)
+			CloseRun(_runs[i]);
+		_tempBytes -= total * sizeof(T);
+		memmove(_runs + first, _runs + first + count, (_runCount - first - count) * sizeof(Run));
+		_runCount -= count;
+		AddRun(file, total);
+		return true;
+	}
+
+	/**
+	* The sorter owns its files and buffers so it can't be copied
+	*/
+	TExternalSorter(const TExternalSorter&);
+	TExternalSorter& operator=(const TExternalSorter&);
+
+public:
+	/**
+	* Constructor of the sorter
+	* @param ComparisonFunc The comparison function (see TTree)
+	* @param memoryBytes The memory budget for buffered elements (sets the size of each run). Small
+	* budgets are honoured (down to one buffered element) at the cost of more runs and smaller reads
+	* @param tempDir The directory temporary files are created in (NULL for /tmp)
+	* @param maxTempBytes The largest size the temporary files may reach together (0 for no limit)
+	*/
+	TExternalSorter(int(*ComparisonFunc)(T, T), size_t memoryBytes = 64 * 1024 * 1024, const char* tempDir = NULL, uint64_t maxTempBytes = 0)
+	{
+		_comparison = ComparisonFunc;
+		_memoryBytes = memoryBytes;
+		snprintf(_tempDir, sizeof(_tempDir), "%s", tempDir != NULL ? tempDir : "/tmp");
+		_maxTempBytes = maxTempBytes;
+		_tempBytes = 0;
+
+		_bufferCapacity = memoryBytes / sizeof(T);
+		if (_bufferCapacity < 1)
+			_bufferCapacity = 1;
+		_buffer = NULL;
+		_bufferUsed = 0;
+
+		_runs = NULL;
+		_runCount = _runCapacity = 0;
+		_heap = NULL;
+		_heapSize = 0;
+		_count = _handedOut = 0;
+		_finished = _failed = false;
+	}
+
+	/**
+	* Destructor which closes (and so deletes) every temporary file
+	*/
+	~TExternalSorter()
+	{
+		for (int i = 0; i < _runCount; i++)
+			CloseRun(_runs[i]);
+		delete[] _runs;
+		delete[] _heap;
+		delete[] _buffer;
+	}
+
+	/**
+	* Adds an element to be sorted
+	* @param value The element
+	* @return True if added (false once Finish has been called or after an I/O error)
+	*/
+	bool Add(const T& value)
+	{
+		if (_finished || _failed)
+			return false;
+
+		if (_buffer == NULL)
+			_buffer = new T[_bufferCapacity];
+
+		if (_bufferUsed == _bufferCapacity && !SpillBuffer())
+		{
+			_failed = true;
+			return false;
+		}
+
+		_buffer[_bufferUsed++] = value;
+		_count++;
+		return true;
+	}
+
+	/**
+	* Adds every element in a stream of raw (native byte order) elements up to the end of the stream
+	* @param stream The stream to read from
+	* @return True if everything was added (false if the stream ended part way through an element)
+	*/
+	bool AddStream(std::istream& stream)
+	{
+		if (_finished || _failed)
+			return false;
+
+		if (_buffer == NULL)
+			_buffer = new T[_bufferCapacity];
+
+		//read straight into the free part of the buffer
+		for (;;)
+		{
+			if (_bufferUsed == _bufferCapacity && !SpillBuffer())
+			{
+				_failed = true;
+				return false;
+			}
+
+			size_t free = _bufferCapacity - _bufferUsed;
+			stream.read((char*)(_buffer + _bufferUsed), (std::streamsize)(free * sizeof(T)));
+			size_t bytes = (size_t)stream.gcount();
+			_bufferUsed += bytes / sizeof(T);
+			_count += bytes / sizeof(T);
+
+			if (bytes % sizeof(T) != 0)
+				return false;
+			if (!stream.good())
+				return stream.eof();
+		}
+	}
+
+	/**
+	* Adds every element in a file of raw (native byte order) elements
+	* @param path The path of the file
+	* @return True if the whole file was added
+	*/
+	bool AddFile(const char* path)
+	{
+		if (_finished || _failed)
+			return false;
+
+		FILE* file = fopen(path, "rb");
+		if (file == NULL)
+			return false;
+
+		if (_buffer == NULL)
+			_buffer = new T[_bufferCapacity];
+
+		bool ret = true;
+		for (;;)
+		{
+			if (_bufferUsed == _bufferCapacity && !SpillBuffer())
+			{
+				_failed = true;
+				ret = false;
+				break;
+			}
+
+			size_t read = fread(_buffer + _bufferUsed, sizeof(T), _bufferCapacity - _bufferUsed, file);
+			_bufferUsed += read;
+			_count += read;
+			if (read == 0)
+			{
+				ret = !ferror(file);
+				break;
+			}
+		}
+
+		fclose(file);
+		return ret;
+	}
+
+	/**
+	* Returns the number of elements added
+	* @return Count
+	*/
+	inline uint64_t Count() const
+	{
+		return _count;
+	}
+
+	/**
+	* Returns the number of runs written to temporary files so far
+	* @return Integer
+	*/
+	inline int RunCount() const
+	{
+		return _runCount;
+	}
+
+	/**
+	* Returns the current size of the temporary files
+	* @return Number of bytes
+	*/
+	inline uint64_t TempBytes() const
+	{
+		return _tempBytes;
+	}
+
+	/**
+	* Stops adding elements and prepares to hand them out in sorted order. Runs are merged in extra
+	* passes until they can all be merged at once with buffers of at least
+	* TEXTERNALSORT_MIN_BUFFER_BYTES within the memory budget
+	* @return True if the elements are ready to be read
+	*/
+	bool Finish()
+	{
+		if (_finished)
+			return !_failed;
+		_finished = true;
+		if (_failed)
+			return false;
+
+		//everything fits in memory so just sort it
+		if (_runCount == 0)
+		{
+			Less less = { _comparison };
+			std::sort(_buffer, _buffer + _bufferUsed, less);
+			return true;
+		}
+
+		if (!SpillBuffer())
+		{
+			_failed = true;
+			return false;
+		}
+
+		//the buffer is split between the runs being merged from now on (the budget must hold at least
+		//two runs and the output of a merge pass)
+		size_t run_bytes = _memoryBytes / 3 < TEXTERNALSORT_MIN_BUFFER_BYTES ? _memoryBytes / 3 : TEXTERNALSORT_MIN_BUFFER_BYTES;
+		size_t run_buffer = run_bytes > sizeof(T) ? run_bytes / sizeof(T) : 1;
+		int fan_in = (int)(_memoryBytes / (run_buffer * sizeof(T)));
+		if (fan_in < 2)
+			fan_in = 2;
+
+		if (_runCount > fan_in)
+		{
+			//every merge pass also needs an output buffer
+			fan_in = fan_in > 2 ? fan_in - 1 : 2;
+			_bufferCapacity = run_buffer;
+			delete[] _buffer;
+			_buffer = new T[_bufferCapacity];
+
+			while (_runCount > fan_in)
+			{
+				if (!MergePass(0, fan_in))
+				{
+					_failed = true;
+					return false;
+				}
+			}
+		}
+		else
+			_bufferCapacity = _memoryBytes / sizeof(T) / _runCount > run_buffer ? _memoryBytes / sizeof(T) / _runCount : run_buffer;
+
+		delete[] _buffer;
+		_buffer = NULL;
+
+		if (!StartMerge(0, _runCount))
+		{
+			_failed = true;
+			return false;
+		}
+		return true;
+	}
+
+	/**
+	* Returns the next element in sorted order (call Finish first)
+	* @param value Set to the element
+	* @return True if there was an element left
+	*/
+	bool Read(T& value)
+	{
+		if (!_finished || _failed || _handedOut == _count)
+			return false;
+
+		if (_runCount == 0)
+			value = _buffer[_handedOut];
+		else if (!MergeNext(value))
+			return false;
+
+		_handedOut++;
+		return true;
+	}
+
+	/**
+	* Sorts everything added and replaces the contents of tree with it as a perfectly balanced tree
+	* @param tree The tree to build (at most 2^31 - 1 elements)
+	* @return True if the tree was built
+	*/
+	template<typename Alloc>
+	bool BuildTree(TTree<T, Alloc>& tree)
+	{
+		if (_count > 0x7FFFFFFF || !Finish())
+			return false;
+		return tree.BuildSorted(*this, (int)_count);
+	}
+
+#if !defined(_WIN32)
+	/**
+	* Sorts everything added and writes it to a new mapped tree file with the nodes laid out in sorted
+	* order (see TMappedTree::BuildSorted). The tree is left open for writing
+	* @param tree The tree to build
+	* @param path The path of the file to create
+	* @return True if the file was built
+	*/
+	bool BuildMapped(TMappedTree<T>& tree, const char* path)
+	{
+		if (!Finish() || !tree.Create(path, _count))
+			return false;
+		tree.SetComparisonFunc(_comparison);
+		return tree.BuildSorted(*this, _count);
+	}
+#endif
+};
+
+#endif
\ No newline at end of file
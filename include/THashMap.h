@@ -0,0 +1,643 @@
+#ifndef THASHMAP_H
+#define THASHMAP_H
+
+/* Include for the allocators */
+#include "TAllocator.h"
+
+/* Include for the instrumentation counters */
+#include "TStats.h"
+
+/* Include for the latency histograms */
+#include "TLatency.h"
+
+/* Include for the default key equality */
+#include "TCompare.h"
+
+/* Includes for fixed size integers and std::move/std::swap */
+#include <stdint.h>
+#include <string.h>
+#include <utility>
+#include <type_traits>
+
+/* Forward Decl */
+template<typename K, typename V> class THashMapIter;
+
+/* Definitions and macros */
+#ifndef NULL
+#define NULL 0
+#endif
+
+/**
+* Macro to iterate over every key and value in a hash map (that is not a pointer). The order is unspecified
+*/
+#define THASHMAP_foreach(KeyType, ValueType, name, in_map) for (THashMapIter<KeyType, ValueType> name = THashMapIter<KeyType, ValueType>(&in_map); !name.IsFinished(); name.Next())
+
+/**
+* Hashes integer, enum and pointer keys. The map scrambles the result itself so the identity is a
+* good hash for these. Specialize THash (or pass your own functor) for other key types
+*/
+
+template<typename K>
+struct THash
+{
+	static_assert(std::is_integral<K>::value || std::is_enum<K>::value, "THash only handles integer, enum and pointer keys - pass a hash functor for other keys");
+
+	inline size_t operator()(const K& key) const
+	{
+		return (size_t)key;
+	}
+};
+
+template<typename K>
+struct THash<K*>
+{
+	inline size_t operator()(K* key) const
+	{
+		return (size_t)key;
+	}
+};
+
+/**
+* Hashes null terminated strings (FNV-1a). Use with TEqualString
+*/
+
+struct THashString
+{
+	inline size_t operator()(const char* key) const
+	{
+		uint64_t hash = 14695981039346656037ULL;
+		while (*key != '\0')
+		{
+			hash ^= (unsigned char)*key++;
+			hash *= 1099511628211ULL;
+		}
+		return (size_t)hash;
+	}
+};
+
+/**
+* A slot of the hash map table. The key and value are stored inline (so a lookup usually touches
+* a single cache line) and are only constructed while the slot is in use
+*/
+
+template<typename K, typename V>
+struct THashSlot
+{
+	unsigned int _dist; /**< 0 if the slot is empty, otherwise 1 + how far the entry is from its home slot */
+
+	alignas(K) unsigned char _key[sizeof(K)]; /**< Storage for the key */
+
+	alignas(V) unsigned char _value[sizeof(V)]; /**< Storage for the value */
+
+	/**
+	* Returns the key stored in the slot (the slot must be in use)
+	*/
+	inline K& Key()
+	{
+		return *(K*)_key;
+	}
+
+	/**
+	* Returns the value stored in the slot (the slot must be in use)
+	*/
+	inline V& Value()
+	{
+		return *(V*)_value;
+	}
+};
+
+
+
+/**
+* An unordered map from keys to values using open addressing with Robin Hood linear probing. Entries
+* are stored inline in one power of two sized table (nothing is allocated per entry) which grows when
+* it is 7/8 full. Robin Hood insertion keeps every entry close to its home slot so a lookup is O(1)
+* and usually a single cache miss, and removal shifts later entries back so no tombstones build up.
+* Hash and Equal are functor types (see THash and TCompare.h) and the table is allocated from Alloc
+* (see TAllocator.h). Pointers to values are invalidated by any Insert, Remove or Reserve.
+*/
+
+template<typename K, typename V, typename Hash = THash<K>, typename Equal = TEqual<K>, typename Alloc = TDefaultAllocator>
+class THashMap
+{
+	template<typename, typename> friend class THashMapIter;
+
+private:
+	Alloc _alloc; /**< The allocator the table is allocated from */
+
+	TDS_STAT(TContainerStats _stats;) /**< Instrumentation counters (only when TDS_ENABLE_STATS is defined) */
+
+	TDS_LATENCY(TLatencyRecorder _latency;) /**< Latency histograms (only when TDS_ENABLE_LATENCY is defined) */
+
+	THashSlot<K, V>* _slots; /**< The table (NULL until the first insert or Reserve) */
+
+	size_t _capacity; /**< Number of slots in the table (0 or a power of two) */
+
+	int _shift; /**< 64 - log2(_capacity), used to take the top bits of the scrambled hash */
+
+	int _count; /**< Number of entries in the map */
+
+	enum
+	{
+		MIN_CAPACITY = 8 /**< Smallest table allocated */
+	};
+
+	/**
+	* Returns the home slot of a key (Fibonacci hashing so weak hashes such as the identity spread well)
+	* @param key The key
+	* @return Index of the slot
+	*/
+	inline size_t HomeSlot(const K& key) const
+	{
+		return (size_t)(((uint64_t)Hash()(key) * 11400714819323198485ULL) >> _shift);
+	}
+
+	/**
+	* Returns the number of entries a table of capacity slots may hold before it grows
+	*/
+	static inline size_t MaxLoad(size_t capacity)
+	{
+		return capacity - capacity / 8;
+	}
+
+	/**
+	* Destroys every entry (the slots are left marked as in use)
+	*/
+	void DestroyEntries()
+	{
+		if (std::is_trivially_destructible<K>::value && std::is_trivially_destructible<V>::value)
+			return;
+
+		for (size_t i = 0; i < _capacity; i++)
+		{
+			if (_slots[i]._dist != 0)
+			{
+				_slots[i].Key().~K();
+				_slots[i].Value().~V();
+			}
+		}
+	}
+
+	/**
+	* Places an entry whose key is not in the map yet (the table must have room for it)
+	* @param key The key (moved from)
+	* @param value The value (moved from)
+	* @return The number of slots probed
+	*/
+	unsigned int Place(K& key, V& value)
+	{
+		size_t mask = _capacity - 1;
+		size_t index = HomeSlot(key);
+		unsigned int dist = 1;
+
+		for (;;)
+		{
+			THashSlot<K, V>& slot = _slots[index];
+			if (slot._dist == 0)
+			{
+				new(slot._key) K(std::move(key));
+				new(slot._value) V(std::move(value));
+				slot._dist = dist;
+				return dist;
+			}
+
+			//take the slot from entries closer to home than us (Robin Hood) and carry on placing them
+			if (slot._dist < dist)
+			{
+				std::swap(key, slot.Key());
+				std::swap(value, slot.Value());
+				std::swap(dist, slot._dist);
+			}
+
+			index = (index + 1) & mask;
+			dist++;
+		}
+	}
+
+	/**
+	* Finds the slot holding key
+	* @param key The key
+	* @param probes Set to the number of slots probed
+	* @return Index of the slot (_capacity if not found)
+	*/
+	size_t FindSlot(const K& key, unsigned int& probes) const
+	{
+		probes = 0;
+		if (_count == 0)
+			return _capacity;
+
+		size_t mask = _capacity - 1;
+		size_t index = HomeSlot(key);
+		unsigned int dist = 1;
+
+		for (;;)
+		{
+			const THashSlot<K, V>& slot = _slots[index];
+			probes++;
+
+			//every entry past here is closer to its home than key would be so key isn't in the map
+			if (slot._dist < dist)
+				return _capacity;
+			if (slot._dist == dist && Equal()(((THashSlot<K, V>&)slot).Key(), key))
+				return index;
+
+			index = (index + 1) & mask;
+			dist++;
+		}
+	}
+
+	/**
+	* Moves every entry into a new table of the given capacity
+	* @param capacity The new number of slots (a power of two)
+	*/
+	void Rehash(size_t capacity)
+	{
+		THashSlot<K, V>* old_slots = _slots;
+		size_t old_capacity = _capacity;
+
+		_slots = (THashSlot<K, V>*)_alloc.Allocate(capacity * sizeof(THashSlot<K, V>));
+		TDS_STAT(_stats._allocations++;)
+		for (size_t i = 0; i < capacity; i++)
+			_slots[i]._dist = 0;
+
+		_capacity = capacity;
+		_shift = 64;
+		while (capacity > 1)
+		{
+			capacity >>= 1;
+			_shift--;
+		}
+
+		for (size_t i = 0; i < old_capacity; i++)
+		{
+			THashSlot<K, V>& slot = old_slots[i];
+			if (slot._dist != 0)
+			{
+				Place(slot.Key(), slot.Value());
+				slot.Key().~K();
+				slot.Value().~V();
+			}
+		}
+
+		if (old_slots != NULL)
+		{
+			TDS_STAT(_stats._frees++;)
+			_alloc.Free(old_slots, old_capacity * sizeof(THashSlot<K, V>));
+		}
+	}
+
+	/**
+	* The map owns its table so it can't be copied
+	*/
+	THashMap(const THashMap&);
+	THashMap& operator=(const THashMap&);
+
+public:
+	/**
+	* Default constructor (nothing is allocated until the first insert or Reserve)
+	*/
+	THashMap()
+	{
+		_slots = NULL;
+		_capacity = 0;
+		_shift = 64;
+		_count = 0;
+	}
+
+	/**
+	* Overloaded constructor which takes the allocator the table will be allocated from
+	* @param alloc The allocator to copy into the map
+	*/
+	THashMap(const Alloc& alloc) : _alloc(alloc)
+	{
+		_slots = NULL;
+		_capacity = 0;
+		_shift = 64;
+		_count = 0;
+	}
+
+	/**
+	* Destructor which destroys every entry and frees the table
+	*/
+	~THashMap()
+	{
+		if (_slots != NULL)
+		{
+			DestroyEntries();
+			_alloc.Free(_slots, _capacity * sizeof(THashSlot<K, V>));
+		}
+	}
+
+	/**
+	* Returns the allocator used by this map
+	* @return Reference to the allocator
+	*/
+	inline Alloc& GetAllocator()
+	{
+		return _alloc;
+	}
+
+	/**
+	* Returns the instrumentation counters of this map (all zero unless TDS_ENABLE_STATS is defined, see TStats.h)
+	* @return Reference to the stats
+	*/
+	inline const TContainerStats& GetStats() const
+	{
+#ifdef TDS_ENABLE_STATS
+		return _stats;
+#else
+		return TContainerStats::Disabled();
+#endif
+	}
+
+	/**
+	* Zeroes the instrumentation counters of this map
+	*/
+	inline void ResetStats()
+	{
+		TDS_STAT(_stats.Reset();)
+	}
+
+	/**
+	* Returns the latency histograms of this map (empty unless TDS_ENABLE_LATENCY is defined, see TLatency.h)
+	* @return Reference to the recorder (print it with Dump)
+	*/
+	inline const TLatencyRecorder& GetLatency() const
+	{
+#ifdef TDS_ENABLE_LATENCY
+		return _latency;
+#else
+		return TLatencyRecorder::Disabled();
+#endif
+	}
+
+	/**
+	* Empties the latency histograms of this map
+	*/
+	inline void ResetLatency()
+	{
+		TDS_LATENCY(_latency.Reset();)
+	}
+
+	/**
+	* Sets how many calls are made for every one that is timed (does nothing unless TDS_ENABLE_LATENCY is defined)
+	* @param rate 1 to time every call (the default unless TLATENCY_SAMPLE_RATE is defined), n to time one in n, 0 to stop timing
+	*/
+	inline void SetLatencySampleRate(unsigned int rate)
+	{
+		TDS_LATENCY(_latency.SetSampleRate(rate);)
+		(void)rate;
+	}
+
+	/**
+	* Returns the number of entries in the map
+	* @return Count
+	*/
+	inline int Count() const
+	{
+		return _count;
+	}
+
+	/**
+	* Returns true if the map is empty
+	* @return Boolean
+	*/
+	inline bool IsEmpty() const
+	{
+		return _count == 0;
+	}
+
+	/**
+	* Returns the number of slots in the table
+	* @return Integer
+	*/
+	inline size_t Capacity() const
+	{
+		return _capacity;
+	}
+
+	/**
+	* Grows the table so it can hold count entries without growing again
+	* @param count The number of entries
+	*/
+	void Reserve(size_t count)
+	{
+		size_t capacity = _capacity ? _capacity : (size_t)MIN_CAPACITY;
+		while (MaxLoad(capacity) < count)
+			capacity *= 2;
+
+		if (capacity != _capacity)
+			Rehash(capacity);
+	}
+
+	/**
+	* Inserts a key and value, replacing the value if the key is already in the map
+	* @param key The key
+	* @param value The value
+	* @return True if the key was new, false if an existing value was replaced
+	*/
+	bool Insert(const K& key, const V& value)
+	{
+		TDS_LATENCY(TLatencyScope latency(_latency, TLATENCY_INSERT);)
+		unsigned int probes;
+		size_t index = FindSlot(key, probes);
+		TDS_STAT(_stats._comparisons += probes;)
+		if (index != _capacity)
+		{
+			_slots[index].Value() = value;
+			TDS_STAT(_stats._insert.Record(probes, probes);)
+			return false;
+		}
+
+		if ((size_t)_count + 1 > MaxLoad(_capacity))
+			Rehash(_capacity ? _capacity * 2 : (size_t)MIN_CAPACITY);
+
+		K new_key(key);
+		V new_value(value);
+		unsigned int placed = Place(new_key, new_value);
+		(void)placed;
+		TDS_STAT(_stats._insert.Record(probes, placed);)
+		_count++;
+		return true;
+	}
+
+	/**
+	* Finds the value of a key
+	* @param key The key
+	* @return Pointer to the value (NULL if the key is not in the map)
+	*/
+	V* Find(const K& key)
+	{
+		TDS_LATENCY(TLatencyScope latency(_latency, TLATENCY_FIND);)
+		unsigned int probes;
+		size_t index = FindSlot(key, probes);
+		TDS_STAT(_stats._comparisons += probes;)
+		TDS_STAT(_stats._find.Record(probes, probes);)
+		return index != _capacity ? &_slots[index].Value() : NULL;
+	}
+
+	/**
+	* Returns true if the key is in the map
+	* @param key The key
+	* @return Boolean
+	*/
+	bool Contains(const K& key)
+	{
+		return Find(key) != NULL;
+	}
+
+	/**
+	* Removes a key and its value from the map
+	* @param key The key
+	* @return True if the key was found and removed
+	*/
+	bool Remove(const K& key)
+	{
+		TDS_LATENCY(TLatencyScope latency(_latency, TLATENCY_REMOVE);)
+		unsigned int probes;
+		size_t index = FindSlot(key, probes);
+		TDS_STAT(_stats._comparisons += probes;)
+		TDS_STAT(_stats._remove.Record(probes, probes);)
+		if (index == _capacity)
+			return false;
+
+		_slots[index].Key().~K();
+		_slots[index].Value().~V();
+
+		//shift the following entries back a slot until one is empty or already at home
+		size_t mask = _capacity - 1;
+		size_t next = (index + 1) & mask;
+		while (_slots[next]._dist > 1)
+		{
+			THashSlot<K, V>& from = _slots[next];
+			THashSlot<K, V>& to = _slots[index];
+			new(to._key) K(std::move(from.Key()));
+			new(to._value) V(std::move(from.Value()));
+			to._dist = from._dist - 1;
+			from.Key().~K();
+			from.Value().~V();
+
+			index = next;
+			next = (next + 1) & mask;
+		}
+		_slots[index]._dist = 0;
+
+		_count--;
+		return true;
+	}
+
+	/**
+	* Removes every entry (the table keeps its capacity)
+	*/
+	void Empty()
+	{
+		TDS_LATENCY(TLatencyScope latency(_latency, TLATENCY_EMPTY);)
+		if (_slots == NULL)
+			return;
+
+		DestroyEntries();
+		for (size_t i = 0; i < _capacity; i++)
+			_slots[i]._dist = 0;
+		_count = 0;
+	}
+};
+
+
+
+/**
+* Iterates over every entry of a THashMap in table order
+*/
+
+template<typename K, typename V>
+class THashMapIter
+{
+private:
+	THashSlot<K, V>* _current; /**< The current slot (equal to _end when finished) */
+
+	THashSlot<K, V>* _end; /**< One past the last slot of the table */
+
+	TDS_STAT(TContainerStats* _stats;) /**< Stats of the map being iterated */
+
+	/**
+	* Moves _current forward to the next slot in use (or _end)
+	*/
+	inline void SkipEmpty()
+	{
+		while (_current != _end && _current->_dist == 0)
+			_current++;
+	}
+
+public:
+	/**
+	* Default constructor
+	*/
+	THashMapIter()
+	{
+		_current = _end = NULL;
+		TDS_STAT(_stats = NULL;)
+	}
+
+	/**
+	* Constructor which starts at the first entry of the map
+	* @param map The map to iterate over
+	*/
+	template<typename Hash, typename Equal, typename Alloc>
+	THashMapIter(THashMap<K, V, Hash, Equal, Alloc>* map)
+	{
+		_current = map->_slots;
+		_end = map->_slots + map->_capacity;
+		TDS_STAT(_stats = &map->_stats;)
+		SkipEmpty();
+	}
+
+	/**
+	* Returns true once every entry has been visited
+	* @return Boolean
+	*/
+	inline bool IsFinished()
+	{
+		return _current == _end;
+	}
+
+	/**
+	* Moves to the next entry
+	*/
+	inline void Next()
+	{
+		if (_current == _end)
+			return;
+
+		TDS_STAT(_stats->_iteratorNexts++;)
+		_current++;
+		SkipEmpty();
+	}
+
+	/**
+	* Returns the key of the current entry (must not be finished)
+	* @return The key
+	*/
+	inline const K& Key()
+	{
+		return _current->Key();
+	}
+
+	/**
+	* Returns the value of the current entry (must not be finished)
+	* @return Reference to the value
+	*/
+	inline V& Value()
+	{
+		return _current->Value();
+	}
+
+	/**
+	* Overloaded operator to de-reference the iterator to the value of the current entry
+	* @return Reference to the value
+	*/
+	V& operator*()
+	{
+		return Value();
+	}
+};
+
+#endif
\ No newline at end of file
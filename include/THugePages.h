@@ -0,0 +1,458 @@
+#ifndef THUGEPAGES_H
+#define THUGEPAGES_H
+
+/* Include for the allocator traits */
+#include "TAllocator.h"
+
+/* Include for reading /proc/self/smaps */
+#include <stdio.h>
+
+/* Include for mmap and madvise */
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+/* Definitions and macros */
+#ifndef NULL
+#define NULL 0
+#endif
+
+#define THUGEPAGE_SIZE (2 * 1024 * 1024) /**< Size of a huge page on x86-64 and most arm64 kernels */
+
+/**
+* Where a THugePagePool gets its regions from
+*/
+enum THugePageMode
+{
+	THUGEPAGE_NONE, /**< Ordinary memory from the global heap */
+	THUGEPAGE_TRANSPARENT, /**< 2MB aligned anonymous mappings advised with MADV_HUGEPAGE (falls back to the heap) */
+	THUGEPAGE_EXPLICIT /**< Pre-reserved hugetlbfs pages with MAP_HUGETLB (falls back to THUGEPAGE_TRANSPARENT) */
+};
+
+/**
+* How much of a THugePagePool is really backed by huge pages (see THugePagePool::Coverage)
+*/
+struct THugePageCoverage
+{
+	size_t _reserved; /**< Bytes in every region of the pool */
+
+	size_t _explicit; /**< Bytes in regions mapped from hugetlbfs (always huge) */
+
+	size_t _transparent; /**< Bytes of the advised regions the kernel currently backs with huge pages */
+
+	size_t _fallback; /**< Bytes in regions that came from the global heap */
+
+	/**
+	* Returns the fraction of the pool backed by huge pages
+	* @return Value between 0 and 1
+	*/
+	inline double Fraction() const
+	{
+		return _reserved > 0 ? (double)(_explicit + _transparent) / (double)_reserved : 0.0;
+	}
+};
+
+/**
+* A node pool that carves container nodes out of a few large regions instead of spreading them
+* over the global heap, so a tree or list with millions of nodes touches a few hundred huge
+* pages rather than hundreds of thousands of 4K pages and random lookups stop missing the TLB.
+* On Linux regions are mapped with MAP_HUGETLB (THUGEPAGE_EXPLICIT, needs pages reserved in
+* /proc/sys/vm/nr_hugepages) or aligned to 2MB and advised with MADV_HUGEPAGE
+* (THUGEPAGE_TRANSPARENT); if that fails, or on other platforms, they come from the global heap.
+*
+* Freed nodes go on a free list per 16 byte size class and are reused, and allocations larger
+* than MAX_SIZE go straight to the global heap. Regions are only given back when the pool is
+* Released or destroyed. Use THugePageAllocator to make containers allocate from a pool. Note
+* that a pool is not thread safe.
+*/
+
+class THugePagePool
+{
+public:
+	enum
+	{
+		GRANULARITY = 16, /**< The size (in bytes) between each size class */
+		MAX_SIZE = 512, /**< Allocations larger than this are not pooled */
+		NUM_CLASSES = MAX_SIZE / GRANULARITY /**< Number of size classes (and free lists) */
+	};
+
+private:
+	/**
+	* Where a region's memory came from
+	*/
+	enum Backing
+	{
+		BACKING_HEAP,
+		BACKING_TRANSPARENT,
+		BACKING_EXPLICIT
+	};
+
+	/**
+	* Header placed at the start of every region
+	*/
+	struct Region
+	{
+		Region* _prev; /**< The previously mapped region (NULL if this is the first) */
+		size_t _size; /**< Size of the region in bytes (including this header) */
+		int _backing; /**< One of Backing */
+	};
+
+	/**
+	* A freed block linked into the free list of its size class
+	*/
+	struct FreeBlock
+	{
+		FreeBlock* _next; /**< The next free block in the same size class */
+	};
+
+	enum
+	{
+		HEADER_SIZE = (sizeof(Region) + GRANULARITY - 1) & ~(GRANULARITY - 1) /**< Size of the region header rounded up to GRANULARITY */
+	};
+
+	FreeBlock* _lists[NUM_CLASSES]; /**< Head of the free list for each size class */
+
+	Region* _region; /**< The region currently being carved up (NULL if nothing mapped yet) */
+
+	char* _cur; /**< The next unused byte in _region */
+
+	char* _end; /**< One past the last byte of _region */
+
+	size_t _regionSize; /**< Size of each region (a multiple of THUGEPAGE_SIZE) */
+
+	int _mode; /**< The THugePageMode regions are mapped with */
+
+	size_t _used; /**< Bytes currently handed out from regions */
+
+	/**
+	* Maps a region of size bytes, trying the pool's mode first
+	* @param size Size in bytes (a multiple of THUGEPAGE_SIZE)
+	* @param backing Receives where the memory came from
+	* @return The region
+	*/
+	void* MapRegion(size_t size, int& backing)
+	{
+#if defined(__linux__)
+#if defined(MAP_HUGETLB)
+		if (_mode == THUGEPAGE_EXPLICIT)
+		{
+			void* mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+			if (mem != MAP_FAILED)
+			{
+				backing = BACKING_EXPLICIT;
+				return mem;
+			}
+		}
+#endif
+#if defined(MADV_HUGEPAGE)
+		if (_mode != THUGEPAGE_NONE)
+		{
+			//the kernel only backs whole aligned 2MB pages so map one extra and trim to a boundary
+			size_t span = size + THUGEPAGE_SIZE;
+			void* mem = mmap(NULL, span, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (mem != MAP_FAILED)
+			{
+				char* raw = (char*)mem;
+				char* aligned = (char*)(((size_t)raw + THUGEPAGE_SIZE - 1) & ~(size_t)(THUGEPAGE_SIZE - 1));
+				if (aligned > raw)
+					munmap(raw, aligned - raw);
+				if (raw + span > aligned + size)
+					munmap(aligned + size, (raw + span) - (aligned + size));
+
+				madvise(aligned, size, MADV_HUGEPAGE);
+				backing = BACKING_TRANSPARENT;
+				return aligned;
+			}
+		}
+#endif
+#endif
+		backing = BACKING_HEAP;
+		return ::operator new(size);
+	}
+
+	/**
+	* Returns a region to where it came from
+	* @param region The region
+	*/
+	static void UnmapRegion(Region* region)
+	{
+#if defined(__linux__)
+		if (region->_backing != BACKING_HEAP)
+		{
+			munmap(region, region->_size);
+			return;
+		}
+#endif
+		::operator delete(region);
+	}
+
+	/**
+	* Maps a new region and starts carving from it (the rest of the current one is left unused)
+	*/
+	void Grow()
+	{
+		int backing = BACKING_HEAP;
+		Region* region = (Region*)MapRegion(_regionSize, backing);
+		region->_prev = _region;
+		region->_size = _regionSize;
+		region->_backing = backing;
+
+		_region = region;
+		_cur = (char*)region + HEADER_SIZE;
+		_end = (char*)region + _regionSize;
+	}
+
+	/**
+	* The pool owns its regions so it can't be copied
+	*/
+	THugePagePool(const THugePagePool&);
+	THugePagePool& operator=(const THugePagePool&);
+
+public:
+	/**
+	* Constructor of the pool (nothing is mapped until the first call to Allocate)
+	* @param mode Where to get regions from (see THugePageMode)
+	* @param regionSize The size of each region in bytes (rounded up to a multiple of 2MB)
+	*/
+	THugePagePool(THugePageMode mode = THUGEPAGE_TRANSPARENT, size_t regionSize = 32 * 1024 * 1024)
+	{
+		for (int i = 0; i < NUM_CLASSES; i++)
+			_lists[i] = NULL;
+		_region = NULL;
+		_cur = _end = NULL;
+		_mode = mode;
+		_regionSize = (regionSize + THUGEPAGE_SIZE - 1) & ~(size_t)(THUGEPAGE_SIZE - 1);
+		if (_regionSize == 0)
+			_regionSize = THUGEPAGE_SIZE;
+		_used = 0;
+	}
+
+	/**
+	* Destructor which gives back every region at once
+	*/
+	~THugePagePool()
+	{
+		Release();
+	}
+
+	/**
+	* Allocates size bytes, reusing a freed block of the same size class if there is one
+	* @param size The number of bytes to allocate
+	* @return Pointer to the memory (aligned to 16 bytes)
+	*/
+	inline void* Allocate(size_t size)
+	{
+		if (size > MAX_SIZE)
+			return ::operator new(size);
+
+		size_t index = size > 0 ? (size - 1) / GRANULARITY : 0;
+		FreeBlock* block = _lists[index];
+		if (block != NULL)
+		{
+			_lists[index] = block->_next;
+			_used += (index + 1) * GRANULARITY;
+			return block;
+		}
+
+		size_t rounded = (index + 1) * GRANULARITY;
+		if ((size_t)(_end - _cur) < rounded)
+			Grow();
+
+		void* ret = _cur;
+		_cur += rounded;
+		_used += rounded;
+		return ret;
+	}
+
+	/**
+	* Puts a block back on the free list of its size class
+	* @param ptr The memory to free (returned by Allocate)
+	* @param size The size that was passed to Allocate
+	*/
+	inline void Free(void* ptr, size_t size)
+	{
+		if (size > MAX_SIZE)
+		{
+			::operator delete(ptr);
+			return;
+		}
+
+		size_t index = size > 0 ? (size - 1) / GRANULARITY : 0;
+		FreeBlock* block = (FreeBlock*)ptr;
+		block->_next = _lists[index];
+		_lists[index] = block;
+		_used -= (index + 1) * GRANULARITY;
+	}
+
+	/**
+	* Gives back every region. Anything allocated from the pool (including the nodes of
+	* containers using it) becomes invalid
+	*/
+	void Release()
+	{
+		while (_region != NULL)
+		{
+			Region* prev = _region->_prev;
+			UnmapRegion(_region);
+			_region = prev;
+		}
+
+		for (int i = 0; i < NUM_CLASSES; i++)
+			_lists[i] = NULL;
+		_cur = _end = NULL;
+		_used = 0;
+	}
+
+	/**
+	* Returns how many bytes are currently handed out from regions
+	* @return Number of bytes
+	*/
+	inline size_t BytesUsed() const
+	{
+		return _used;
+	}
+
+	/**
+	* Returns how many bytes of regions the pool has mapped
+	* @return Number of bytes
+	*/
+	size_t BytesReserved() const
+	{
+		size_t ret = 0;
+		for (Region* region = _region; region != NULL; region = region->_prev)
+			ret += region->_size;
+		return ret;
+	}
+
+	/**
+	* Reports how much of the pool is backed by huge pages. For transparent regions this reads
+	* AnonHugePages from /proc/self/smaps (crediting each mapping in proportion to how much of it
+	* overlaps the pool), so it is slow and only meant for diagnostics
+	* @return The coverage
+	*/
+	THugePageCoverage Coverage() const
+	{
+		THugePageCoverage ret = { 0, 0, 0, 0 };
+		bool advised = false;
+		for (Region* region = _region; region != NULL; region = region->_prev)
+		{
+			ret._reserved += region->_size;
+			if (region->_backing == BACKING_EXPLICIT)
+				ret._explicit += region->_size;
+			else if (region->_backing == BACKING_HEAP)
+				ret._fallback += region->_size;
+			else
+				advised = true;
+		}
+
+#if defined(__linux__)
+		if (!advised)
+			return ret;
+
+		FILE* smaps = fopen("/proc/self/smaps", "r");
+		if (smaps == NULL)
+			return ret;
+
+		char line[256];
+		size_t overlap = 0, length = 0;
+		while (fgets(line, sizeof(line), smaps) != NULL)
+		{
+			unsigned long start, end;
+			unsigned long kb;
+			if (sscanf(line, "%lx-%lx ", &start, &end) == 2)
+			{
+				//a new mapping - work out how much of it belongs to our advised regions
+				overlap = 0;
+				length = end - start;
+				for (Region* region = _region; region != NULL; region = region->_prev)
+				{
+					if (region->_backing != BACKING_TRANSPARENT)
+						continue;
+					size_t lo = (size_t)region > start ? (size_t)region : start;
+					size_t hi = (size_t)region + region->_size < end ? (size_t)region + region->_size : end;
+					if (hi > lo)
+						overlap += hi - lo;
+				}
+			}
+			else if (overlap > 0 && sscanf(line, "AnonHugePages: %lu kB", &kb) == 1)
+			{
+				ret._transparent += (size_t)((double)kb * 1024.0 * (double)overlap / (double)length);
+			}
+		}
+		fclose(smaps);
+#else
+		(void)advised;
+#endif
+		return ret;
+	}
+};
+
+
+
+/**
+* Allocator handle which allocates container nodes from a THugePagePool
+*/
+
+class THugePageAllocator
+{
+private:
+	THugePagePool* _pool; /**< The pool memory is allocated from */
+
+public:
+	/**
+	* Constructor which takes the pool to allocate from
+	* @param pool The pool (must outlive anything allocated from it)
+	*/
+	THugePageAllocator(THugePagePool* pool)
+	{
+		_pool = pool;
+	}
+
+	/**
+	* Allocates size bytes from the pool
+	* @param size The number of bytes to allocate
+	* @return Pointer to the allocated memory
+	*/
+	inline void* Allocate(size_t size)
+	{
+		return _pool->Allocate(size);
+	}
+
+	/**
+	* Returns memory to the pool
+	* @param ptr The memory to free
+	* @param size The size that was passed to Allocate
+	*/
+	inline void Free(void* ptr, size_t size)
+	{
+		_pool->Free(ptr, size);
+	}
+
+	/**
+	* Returns the pool this allocator allocates from
+	* @return Pointer to the pool
+	*/
+	inline THugePagePool* GetPool()
+	{
+		return _pool;
+	}
+};
+
+/**
+* Pooled blocks are rounded up to their size class with no header
+*/
+template<>
+struct TAllocatorTraits<THugePageAllocator>
+{
+	static const bool IsMonotonic = false;
+
+	static size_t Footprint(size_t size)
+	{
+		if (size > THugePagePool::MAX_SIZE)
+			return THeapFootprint(size);
+		size_t gran = THugePagePool::GRANULARITY;
+		return size == 0 ? gran : (size + gran - 1) / gran * gran;
+	}
+};
+
+#endif
\ No newline at end of file
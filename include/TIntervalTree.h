@@ -0,0 +1,536 @@
+#ifndef TINTERVALTREE_H
+#define TINTERVALTREE_H
+
+/* Include for the node, rebuild and allocation machinery */
+#include "TTree.h"
+
+/* Include for sorting the input of Build */
+#include <algorithm>
+
+/* Definitions and macros */
+#ifndef NULL
+#define NULL 0
+#endif
+
+/**
+* A closed interval [_lo, _hi] (T needs operator<)
+*/
+
+template<typename T>
+struct TInterval
+{
+	T _lo; /**< The start of the interval */
+
+	T _hi; /**< The end of the interval (not less than _lo) */
+
+	/**
+	* Default constructor (the ends are left default constructed)
+	*/
+	TInterval() : _lo(), _hi()
+	{
+	}
+
+	/**
+	* Constructor
+	* @param lo The start of the interval
+	* @param hi The end of the interval (not less than lo)
+	*/
+	TInterval(const T& lo, const T& hi) : _lo(lo), _hi(hi)
+	{
+	}
+
+	/**
+	* Returns true if this interval shares at least one point with [lo, hi]
+	* @param lo The start of the other interval
+	* @param hi The end of the other interval
+	* @return Boolean
+	*/
+	inline bool Overlaps(const T& lo, const T& hi) const
+	{
+		return !(hi < _lo) && !(_hi < lo);
+	}
+
+	/**
+	* Returns true if [lo, hi] lies inside this interval
+	* @param lo The start of the other interval
+	* @param hi The end of the other interval
+	* @return Boolean
+	*/
+	inline bool Contains(const T& lo, const T& hi) const
+	{
+		return !(lo < _lo) && !(_hi < hi);
+	}
+};
+
+/**
+* What a TIntervalTree stores in each TTreeNode: the interval and the largest end of any interval
+* in the node's subtree, which is what lets a query skip whole subtrees
+*/
+
+template<typename T>
+struct TIntervalData
+{
+	TInterval<T> _interval; /**< The interval */
+
+	T _max; /**< The largest _hi in the subtree of the node holding this (kept up to date by the tree) */
+};
+
+
+
+/**
+* A set of intervals (duplicates allowed) answering overlap, stabbing and containment queries. It
+* is a TTree of TIntervalData ordered by start (then end) where every node also records the
+* largest end below it. A query walks the nodes in order and skips every subtree whose largest end
+* is before the query and stops at the first start after it, so it visits O(log n) nodes for each
+* interval reported (O(log n) when there are none) instead of scanning the whole tree.
+*
+* Overlapping, Stabbing and Containing are O(log n + k log n) for k results in the worst case, not
+* O(log n + k): a node that fails the query can still be visited on the way to a reported interval
+* below it. The bound is close to O(log n + k) when the reported intervals are neighbours in start
+* order (e.g. short intervals). Reaching O(log n + k) needs a priority search tree or a centered
+* interval tree, neither of which can be stored in TTree's nodes. ContainedIn and FindOverlap do
+* meet their stated bounds.
+*
+* Insert and Remove fix the largest ends on the path they change, and automatic rebuilds (see
+* TTree::SetAutoRebuild, on at a ratio of 2 by default) keep the height logarithmic. Build
+* replaces the contents with a perfectly balanced tree in one pass for static interval sets.
+* Results are reported in order of start through a functor taking a const TInterval<T>&
+*/
+
+template<typename T, typename Alloc = TDefaultAllocator>
+class TIntervalTree : protected TTree<TIntervalData<T>, Alloc>
+{
+private:
+	typedef TTree<TIntervalData<T>, Alloc> Base;
+	typedef TTreeNode<TIntervalData<T> > Node;
+
+	/**
+	* Orders intervals by start then end (the comparison the base tree is given)
+	*/
+	static int CompareData(TIntervalData<T> lhs, TIntervalData<T> rhs)
+	{
+		if (lhs._interval._lo < rhs._interval._lo) return -1;
+		if (rhs._interval._lo < lhs._interval._lo) return 1;
+		if (lhs._interval._hi < rhs._interval._hi) return -1;
+		if (rhs._interval._hi < lhs._interval._hi) return 1;
+		return 0;
+	}
+
+	/**
+	* Recomputes the largest end of a node from its interval and its children
+	* @param node The node
+	*/
+	static inline void FixMax(Node* node)
+	{
+		T max = node->_data._interval._hi;
+		if (node->_left != NULL && max < node->_left->_data._max)
+			max = node->_left->_data._max;
+		if (node->_right != NULL && max < node->_right->_data._max)
+			max = node->_right->_data._max;
+		node->_data._max = max;
+	}
+
+	/**
+	* Recomputes the largest ends from a node up to the root
+	* @param node The lowest node that changed (can be NULL)
+	*/
+	static void FixPath(Node* node)
+	{
+		for (; node != NULL; node = node->_parent)
+			FixMax(node);
+	}
+
+	/**
+	* Recomputes the largest ends of every node in a subtree (after it was relinked)
+	* @param node The root of the subtree (can be NULL)
+	*/
+	static void FixSubtree(Node* node)
+	{
+		if (node == NULL)
+			return;
+		FixSubtree(node->_left);
+		FixSubtree(node->_right);
+		FixMax(node);
+	}
+
+	/**
+	* Returns the first node in order of the subtree at node that may end at or after from,
+	* skipping left subtrees that end before it
+	* @param node The root of the subtree (its largest end must not be before from)
+	* @param from The end the intervals must reach
+	* @return The node
+	*/
+	static inline Node* FirstReaching(Node* node, const T& from)
+	{
+		while (node->_left != NULL && !(node->_left->_data._max < from))
+			node = node->_left;
+		return node;
+	}
+
+	/**
+	* Calls func for every interval that starts at or before until and ends at or after from, in
+	* order. Overlap queries are Search(lo, hi) and containment queries Search(hi, lo)
+	* @param from The end the intervals must reach
+	* @param until The start the intervals must not be after
+	* @param func Called with each interval
+	* @return Number of intervals reported
+	*/
+	template<typename Func>
+	int Search(const T& from, const T& until, Func& func) const
+	{
+		TDS_LATENCY(TLatencyScope latency(this->_latency, TLATENCY_FIND);)
+		int ret = 0;
+		unsigned int visited = 0;
+		Node* node = this->_root;
+		if (node != NULL && node->_data._max < from)
+			node = NULL;
+		if (node != NULL)
+			node = FirstReaching(node, from);
+
+		while (node != NULL)
+		{
+			visited++;
+			//every node after this one in order starts after until
+			if (until < node->_data._interval._lo)
+				break;
+
+			if (!(node->_data._interval._hi < from))
+			{
+				func((const TInterval<T>&)node->_data._interval);
+				ret++;
+			}
+
+			//move to the next node in order whose subtree reaches from
+			if (node->_right != NULL && !(node->_right->_data._max < from))
+			{
+				node = FirstReaching(node->_right, from);
+			}
+			else
+			{
+				while (node->_parent != NULL && node == node->_parent->_right)
+					node = node->_parent;
+				node = node->_parent;
+			}
+		}
+
+		(void)visited;
+		TDS_STAT(this->_stats._find.Record(visited, visited);)
+		return ret;
+	}
+
+public:
+	using Base::Count;
+	using Base::IsEmpty;
+	using Base::Empty;
+	using Base::Height;
+	using Base::Shape;
+	using Base::HeightEstimate;
+	using Base::SetAutoRebuild;
+	using Base::GetStats;
+	using Base::ResetStats;
+	using Base::GetLatency;
+	using Base::ResetLatency;
+	using Base::SetLatencySampleRate;
+	using Base::GetAllocator;
+
+	/**
+	* Default constructor of an empty tree (automatic rebuilds on at a ratio of 2)
+	*/
+	TIntervalTree() : Base(CompareData)
+	{
+		SetAutoRebuild(2.0f);
+	}
+
+	/**
+	* Overloaded constructor which takes the allocator the nodes will be allocated from
+	* @param alloc The allocator to copy into the tree
+	*/
+	TIntervalTree(const Alloc& alloc) : Base(CompareData, alloc)
+	{
+		SetAutoRebuild(2.0f);
+	}
+
+	/**
+	* Inserts an interval (duplicates are kept)
+	* @param lo The start of the interval
+	* @param hi The end of the interval (not less than lo)
+	*/
+	void Insert(const T& lo, const T& hi)
+	{
+		TDS_LATENCY(TLatencyScope latency(this->_latency, TLATENCY_INSERT);)
+		TIntervalData<T> data;
+		data._interval = TInterval<T>(lo, hi);
+		data._max = hi;
+
+		//walk down raising the largest end of every subtree the interval joins
+		Node* cur = this->_root, *prev = NULL;
+		int result = 0;
+		unsigned int depth = 0;
+		while (cur != NULL)
+		{
+			result = CompareData(data, cur->_data);
+			depth++;
+			if (cur->_data._max < hi)
+				cur->_data._max = hi;
+			prev = cur;
+			cur = result < 0 ? cur->_left : cur->_right;
+		}
+
+		Node* node = this->NewNode();
+		node->_data = data;
+		node->_parent = prev;
+		if (prev == NULL)
+			this->_root = node;
+		else if (result < 0)
+			prev->_left = node;
+		else
+			prev->_right = node;
+
+		this->_count++;
+		if ((int)depth + 1 > this->_heightEstimate)
+			this->_heightEstimate = (int)depth + 1;
+
+		TDS_STAT(this->_stats._comparisons += depth;)
+		TDS_STAT(this->_stats._insert.Record(depth, depth);)
+
+		//a rebuilt subtree holds the same intervals so only its own nodes need fixing
+		FixSubtree(this->CheckAutoRebuild(node, (int)depth + 1));
+	}
+
+	/**
+	* Inserts an interval (duplicates are kept)
+	* @param interval The interval
+	*/
+	inline void Insert(const TInterval<T>& interval)
+	{
+		Insert(interval._lo, interval._hi);
+	}
+
+	/**
+	* Removes one copy of an interval
+	* @param lo The start of the interval
+	* @param hi The end of the interval
+	* @return True if the interval was found and removed
+	*/
+	bool Remove(const T& lo, const T& hi)
+	{
+		TDS_LATENCY(TLatencyScope latency(this->_latency, TLATENCY_REMOVE);)
+		TIntervalData<T> data;
+		data._interval = TInterval<T>(lo, hi);
+
+		Node* node = this->_root;
+		unsigned int depth = 0;
+		while (node != NULL)
+		{
+			int result = CompareData(data, node->_data);
+			depth++;
+			if (result == 0)
+				break;
+			node = result < 0 ? node->_left : node->_right;
+		}
+
+		TDS_STAT(this->_stats._comparisons += depth;)
+		TDS_STAT(this->_stats._remove.Record(depth, depth);)
+		if (node == NULL)
+			return false;
+
+		//a node with two children takes its successor's interval and the successor is unlinked instead
+		if (node->_left != NULL && node->_right != NULL)
+		{
+			Node* next = this->FirstInOrder(node->_right);
+			node->_data._interval = next->_data._interval;
+			node = next;
+		}
+
+		Node* child = node->_left != NULL ? node->_left : node->_right;
+		Node* parent = node->_parent;
+		if (child != NULL)
+			child->_parent = parent;
+		if (parent == NULL)
+			this->_root = child;
+		else if (parent->_left == node)
+			parent->_left = child;
+		else
+			parent->_right = child;
+
+		this->FreeNode(node);
+		this->_count--;
+		if (this->_count == 0)
+			this->_heightEstimate = 0;
+
+		//the path covers the node that took the successor's interval as it is an ancestor
+		FixPath(parent);
+		return true;
+	}
+
+	/**
+	* Removes one copy of an interval
+	* @param interval The interval
+	* @return True if the interval was found and removed
+	*/
+	inline bool Remove(const TInterval<T>& interval)
+	{
+		return Remove(interval._lo, interval._hi);
+	}
+
+	/**
+	* Replaces the contents of the tree with count intervals (in any order) linked into a perfectly
+	* balanced tree in O(n log n), or O(n) if they are already sorted by start then end
+	* @param intervals The intervals
+	* @param count The number of intervals
+	*/
+	void Build(const TInterval<T>* intervals, int count)
+	{
+		Empty();
+		if (count <= 0)
+			return;
+
+		Node** nodes = new Node*[count];
+		for (int i = 0; i < count; i++)
+		{
+			nodes[i] = this->NewNode();
+			nodes[i]->_data._interval = intervals[i];
+			nodes[i]->_data._max = intervals[i]._hi;
+		}
+
+		auto less = [](const Node* lhs, const Node* rhs) { return CompareData(lhs->_data, rhs->_data) < 0; };
+		if (!std::is_sorted(nodes, nodes + count, less))
+			std::stable_sort(nodes, nodes + count, less);
+
+		this->_root = Base::LinkBalanced(nodes, 0, count, NULL);
+		this->_count = count;
+		this->_heightEstimate = Base::BalancedHeight(count);
+		FixSubtree(this->_root);
+
+		delete[] nodes;
+	}
+
+	/**
+	* Relinks every node into a perfectly balanced tree in O(n)
+	*/
+	void Rebuild()
+	{
+		Base::Rebuild();
+		FixSubtree(this->_root);
+	}
+
+	/**
+	* Calls func for every interval overlapping [lo, hi] in order of start
+	* @param lo The start of the query
+	* @param hi The end of the query (not less than lo)
+	* @param func Callable taking a const TInterval<T>&
+	* @return Number of intervals reported
+	*/
+	template<typename Func>
+	int Overlapping(const T& lo, const T& hi, Func func) const
+	{
+		return Search(lo, hi, func);
+	}
+
+	/**
+	* Calls func for every interval containing point in order of start (a stabbing query)
+	* @param point The point
+	* @param func Callable taking a const TInterval<T>&
+	* @return Number of intervals reported
+	*/
+	template<typename Func>
+	int Stabbing(const T& point, Func func) const
+	{
+		return Search(point, point, func);
+	}
+
+	/**
+	* Calls func for every interval that contains the whole of [lo, hi] in order of start
+	* @param lo The start of the query
+	* @param hi The end of the query (not less than lo)
+	* @param func Callable taking a const TInterval<T>&
+	* @return Number of intervals reported
+	*/
+	template<typename Func>
+	int Containing(const T& lo, const T& hi, Func func) const
+	{
+		//starting at or before lo and ending at or after hi is an overlap search with the ends swapped
+		return Search(hi, lo, func);
+	}
+
+	/**
+	* Calls func for every interval that lies inside [lo, hi] in order of start. Walks the intervals
+	* starting in [lo, hi] so the cost is O(log n) plus the number of those
+	* @param lo The start of the query
+	* @param hi The end of the query (not less than lo)
+	* @param func Callable taking a const TInterval<T>&
+	* @return Number of intervals reported
+	*/
+	template<typename Func>
+	int ContainedIn(const T& lo, const T& hi, Func func) const
+	{
+		TDS_LATENCY(TLatencyScope latency(this->_latency, TLATENCY_FIND);)
+		//find the first interval starting at or after lo
+		Node* node = this->_root, *first = NULL;
+		unsigned int visited = 0;
+		while (node != NULL)
+		{
+			visited++;
+			if (node->_data._interval._lo < lo)
+			{
+				node = node->_right;
+			}
+			else
+			{
+				first = node;
+				node = node->_left;
+			}
+		}
+
+		int ret = 0;
+		for (node = first; node != NULL && !(hi < node->_data._interval._lo); node = this->NextInOrder(node))
+		{
+			visited++;
+			if (!(hi < node->_data._interval._hi))
+			{
+				func((const TInterval<T>&)node->_data._interval);
+				ret++;
+			}
+		}
+
+		(void)visited;
+		TDS_STAT(this->_stats._find.Record(visited, visited);)
+		return ret;
+	}
+
+	/**
+	* Returns an interval overlapping [lo, hi] (the one starting first) in O(log n)
+	* @param lo The start of the query
+	* @param hi The end of the query (not less than lo)
+	* @return Pointer to the interval (NULL if none overlaps)
+	*/
+	const TInterval<T>* FindOverlap(const T& lo, const T& hi) const
+	{
+		TDS_LATENCY(TLatencyScope latency(this->_latency, TLATENCY_FIND);)
+		Node* node = this->_root;
+		if (node == NULL || node->_data._max < lo)
+			return NULL;
+
+		//the first node in order that reaches lo is the only candidate: every interval before it
+		//ends before lo and every one after it starts no earlier
+		node = FirstReaching(node, lo);
+		while (node->_data._interval._hi < lo)
+		{
+			if (node->_right != NULL && !(node->_right->_data._max < lo))
+			{
+				node = FirstReaching(node->_right, lo);
+			}
+			else
+			{
+				while (node->_parent != NULL && node == node->_parent->_right)
+					node = node->_parent;
+				node = node->_parent;
+			}
+			if (node == NULL)
+				return NULL;
+		}
+		return hi < node->_data._interval._lo ? NULL : &node->_data._interval;
+	}
+};
+
+#endif
\ No newline at end of file
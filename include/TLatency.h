@@ -0,0 +1,579 @@
+#ifndef TLATENCY_H
+#define TLATENCY_H
+
+/**
+* Per operation latency histograms for the containers. Define TDS_ENABLE_LATENCY (or turn on the
+* TDS_ENABLE_LATENCY cmake option) before including tds.h to make the single threaded containers
+* (TList, TStack, TTree, TIntervalTree, THashMap, TRadixTree, TMultiIndex and the priority
+* queues) time their Insert, Find, Remove and Empty calls (and the Push / Pop / Erase equivalents)
+* into one log-linear histogram per operation, read with GetLatency() and printed with
+* TLatencyRecorder::Dump. A timed call pays for two timestamp reads (tens of nanoseconds, more
+* under some hypervisors), so by default every call is timed but SetLatencySampleRate(n) (or
+* defining TLATENCY_SAMPLE_RATE) times only one call in n and the others pay for a counter
+* decrement. Without the define the recorder is compiled out completely and GetLatency() returns
+* an empty TLatencyRecorder. Like TStats.h, every translation unit in a program must agree on the
+* setting.
+*
+* The lock-free TSkipList and TRingBuffer are not timed (their point is that concurrent callers
+* share no written state) and neither are TPersistentTree versions, which are immutable values
+* shared between threads with no single owner to record into.
+*
+* A container read from several threads at once (const Find, e.g. a TCow snapshot) records into
+* its histograms without locking, so concurrent samples can be lost. The sample countdown can't get
+* stuck and the nesting of scopes is tracked per thread, so a race never stops the recording.
+*/
+
+/* Include for FILE and fprintf (Dump) */
+#include <stdio.h>
+
+/* Include for the steady_clock fallback and for calibrating the timestamp counter */
+#include <chrono>
+
+/* Include for the sample countdown (shared by concurrent readers) */
+#include <atomic>
+
+/* Include for __rdtsc */
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__)) && !defined(TDS_LATENCY_STEADY_CLOCK)
+#define TDS_LATENCY_TSC 1
+#include <x86intrin.h>
+#elif (defined(_M_X64) || defined(_M_IX86)) && defined(_MSC_VER) && !defined(TDS_LATENCY_STEADY_CLOCK)
+#define TDS_LATENCY_TSC 1
+#include <intrin.h>
+#endif
+
+/**
+* Wraps code that should only be compiled when latency recording is enabled
+*/
+#ifdef TDS_ENABLE_LATENCY
+#define TDS_LATENCY(...) __VA_ARGS__
+#else
+#define TDS_LATENCY(...)
+#endif
+
+#ifndef TLATENCY_SAMPLE_RATE
+#define TLATENCY_SAMPLE_RATE 1 /**< One call in this many is timed until SetLatencySampleRate is called */
+#endif
+
+#define TLATENCY_SUB_BITS 4 /**< Bits of each value kept below its leading bit (buckets are at most 1/16 wide) */
+#define TLATENCY_SUB_COUNT (1 << TLATENCY_SUB_BITS) /**< Buckets per power of 2 */
+#define TLATENCY_MAX_BITS 44 /**< Values of 2^44 ticks (hours) or more go in the last bucket */
+#define TLATENCY_BUCKETS ((TLATENCY_MAX_BITS - TLATENCY_SUB_BITS + 1) * TLATENCY_SUB_COUNT) /**< Buckets per histogram */
+
+/**
+* The clock operations are timed with: the CPU timestamp counter (rdtsc) on x86, otherwise
+* std::chrono::steady_clock. Define TDS_LATENCY_STEADY_CLOCK to always use steady_clock (e.g. on
+* machines without an invariant TSC)
+*/
+
+struct TLatencyClock
+{
+	/**
+	* Returns the current time in ticks
+	* @return Ticks (only differences are meaningful)
+	*/
+	static inline unsigned long long Now()
+	{
+#ifdef TDS_LATENCY_TSC
+		return (unsigned long long)__rdtsc();
+#else
+		return (unsigned long long)std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+	}
+
+	/**
+	* Returns the length of one tick (the timestamp counter is measured against steady_clock for
+	* 10ms the first time this is called)
+	* @return Nanoseconds per tick
+	*/
+	static double NsPerTick()
+	{
+#ifdef TDS_LATENCY_TSC
+		static const double ns = []()
+		{
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now(), end;
+			unsigned long long ticks = Now();
+			do
+			{
+				end = std::chrono::steady_clock::now();
+			} while (end - start < std::chrono::milliseconds(10));
+			ticks = Now() - ticks;
+			double elapsed = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+			return ticks > 0 ? elapsed / (double)ticks : 1.0;
+		}();
+		return ns;
+#else
+		return 1.0;
+#endif
+	}
+};
+
+
+
+/**
+* Percentiles of one histogram in nanoseconds (what Dump prints and Export hands out)
+*/
+
+struct TLatencySummary
+{
+	unsigned long long _count; /**< Number of operations recorded */
+	double _p50; /**< Median */
+	double _p99; /**< 99th percentile */
+	double _p999; /**< 99.9th percentile */
+	double _max; /**< The slowest operation recorded (exact) */
+};
+
+
+
+/**
+* A log-linear (HDR style) histogram of durations in ticks. Values below 16 get a bucket each and
+* every power of 2 above that is split into 16 buckets, so a percentile read back is within 1/16
+* of the true value whatever the scale, in a fixed TLATENCY_BUCKETS counters. Recording is a bit
+* scan and an increment
+*/
+
+class TLatencyHistogram
+{
+private:
+	unsigned long long _counts[TLATENCY_BUCKETS]; /**< Number of values in each bucket */
+
+	unsigned long long _count; /**< Number of values recorded */
+
+	unsigned long long _max; /**< The largest value recorded */
+
+	/**
+	* Returns the bucket a value goes in
+	* @param value The value in ticks
+	* @return Index into _counts
+	*/
+	static inline int BucketOf(unsigned long long value)
+	{
+		if (value < TLATENCY_SUB_COUNT)
+			return (int)value;
+		if (value >> TLATENCY_MAX_BITS)
+			return TLATENCY_BUCKETS - 1;
+
+		//shift so the leading bit and the TLATENCY_SUB_BITS bits below it remain
+		int top = 63 - Clz(value);
+		int shift = top - TLATENCY_SUB_BITS;
+		return shift * TLATENCY_SUB_COUNT + (int)(value >> shift);
+	}
+
+	/**
+	* Returns the largest value that goes in a bucket
+	* @param bucket Index into _counts
+	* @return The value in ticks
+	*/
+	static inline unsigned long long BucketMax(int bucket)
+	{
+		if (bucket < 2 * TLATENCY_SUB_COUNT)
+			return (unsigned long long)bucket;
+		int shift = bucket / TLATENCY_SUB_COUNT - 1;
+		unsigned long long mantissa = (unsigned long long)(bucket % TLATENCY_SUB_COUNT + TLATENCY_SUB_COUNT);
+		return ((mantissa + 1) << shift) - 1;
+	}
+
+	/**
+	* Returns the number of leading zero bits of a non zero value
+	*/
+	static inline int Clz(unsigned long long value)
+	{
+#if defined(__GNUC__) || defined(__clang__)
+		return __builtin_clzll(value);
+#else
+		int n = 0;
+		for (unsigned long long bit = 1ULL << 63; (value & bit) == 0; bit >>= 1)
+			n++;
+		return n;
+#endif
+	}
+
+public:
+	/**
+	* Default constructor of an empty histogram
+	*/
+	TLatencyHistogram()
+	{
+		Reset();
+	}
+
+	/**
+	* Removes every value
+	*/
+	void Reset()
+	{
+		for (int i = 0; i < TLATENCY_BUCKETS; i++)
+			_counts[i] = 0;
+		_count = _max = 0;
+	}
+
+	/**
+	* Records one duration
+	* @param ticks The duration in TLatencyClock ticks
+	*/
+	inline void Record(unsigned long long ticks)
+	{
+		_counts[BucketOf(ticks)]++;
+		_count++;
+		if (ticks > _max)
+			_max = ticks;
+	}
+
+	/**
+	* Adds every value of another histogram to this one
+	* @param other The histogram to add
+	*/
+	void Merge(const TLatencyHistogram& other)
+	{
+		for (int i = 0; i < TLATENCY_BUCKETS; i++)
+			_counts[i] += other._counts[i];
+		_count += other._count;
+		if (other._max > _max)
+			_max = other._max;
+	}
+
+	/**
+	* Returns the number of values recorded
+	* @return Count
+	*/
+	inline unsigned long long Count() const
+	{
+		return _count;
+	}
+
+	/**
+	* Returns the largest value recorded
+	* @return Ticks (0 if nothing was recorded)
+	*/
+	inline unsigned long long Max() const
+	{
+		return _max;
+	}
+
+	/**
+	* Returns the value that percent of the recorded values are at or below (rounded up to the end
+	* of its bucket, and never more than Max())
+	* @param percent The percentile (0-100)
+	* @return Ticks (0 if nothing was recorded)
+	*/
+	unsigned long long Percentile(double percent) const
+	{
+		if (_count == 0)
+			return 0;
+
+		//the rank of the value wanted, counting from 1
+		double wanted = percent / 100.0 * (double)_count;
+		unsigned long long rank = (unsigned long long)wanted;
+		if ((double)rank < wanted || rank == 0)
+			rank++;
+
+		unsigned long long seen = 0;
+		for (int i = 0; i < TLATENCY_BUCKETS; i++)
+		{
+			seen += _counts[i];
+			//the last bucket also holds everything too large for the others
+			if (seen >= rank)
+				return BucketMax(i) < _max && i != TLATENCY_BUCKETS - 1 ? BucketMax(i) : _max;
+		}
+		return _max;
+	}
+
+	/**
+	* Returns the count, p50, p99, p999 and max of the histogram in nanoseconds
+	* @return The summary
+	*/
+	TLatencySummary Summary() const
+	{
+		double ns = TLatencyClock::NsPerTick();
+		TLatencySummary summary;
+		summary._count = _count;
+		summary._p50 = (double)Percentile(50.0) * ns;
+		summary._p99 = (double)Percentile(99.0) * ns;
+		summary._p999 = (double)Percentile(99.9) * ns;
+		summary._max = (double)_max * ns;
+		return summary;
+	}
+};
+
+
+
+/**
+* The operations a container times (each gets its own histogram)
+*/
+enum TLatencyOp
+{
+	TLATENCY_INSERT, /**< Insert / PushBack / Push */
+	TLATENCY_FIND, /**< Find / LongestPrefix */
+	TLATENCY_REMOVE, /**< Remove / Erase / PopBack / Pop */
+	TLATENCY_EMPTY, /**< Empty */
+	TLATENCY_OPS /**< Number of operations */
+};
+
+
+
+/**
+* The latency histograms kept by a container and the sample rate they are recorded at. The
+* histograms are allocated the first time a call is timed, so a recorder that never times anything
+* (e.g. one owned by an iterator's internal TStack) costs a few words and no allocation
+*/
+
+class TLatencyRecorder
+{
+private:
+	std::atomic<unsigned int> _sampleRate; /**< One call in this many is timed (0 for none) */
+
+	std::atomic<unsigned int> _countdown; /**< Calls left until the next one that is timed (1 to _sampleRate) */
+
+	std::atomic<TLatencyHistogram*> _histograms; /**< TLATENCY_OPS histograms (NULL until the first call is timed) */
+
+	/**
+	* Returns the histograms, allocating them if this is the first call timed (concurrent readers
+	* race to install theirs and the losers free their copy)
+	* @return The TLATENCY_OPS histograms
+	*/
+	TLatencyHistogram* Histograms()
+	{
+		TLatencyHistogram* histograms = _histograms.load(std::memory_order_acquire);
+		if (histograms != NULL)
+			return histograms;
+
+		TLatencyHistogram* created = new TLatencyHistogram[TLATENCY_OPS];
+		if (_histograms.compare_exchange_strong(histograms, created, std::memory_order_acq_rel))
+			return created;
+		delete[] created;
+		return histograms;
+	}
+
+	/**
+	* Makes this recorder a copy of another
+	* @param other The recorder to copy
+	*/
+	void CopyFrom(const TLatencyRecorder& other)
+	{
+		SetSampleRate(other.GetSampleRate());
+		const TLatencyHistogram* from = other._histograms.load(std::memory_order_acquire);
+		if (from == NULL)
+		{
+			Reset();
+			return;
+		}
+		TLatencyHistogram* to = Histograms();
+		for (int i = 0; i < TLATENCY_OPS; i++)
+			to[i] = from[i];
+	}
+
+public:
+	/**
+	* Default constructor which times one call in TLATENCY_SAMPLE_RATE (every call by default)
+	*/
+	TLatencyRecorder() : _sampleRate(TLATENCY_SAMPLE_RATE), _countdown(TLATENCY_SAMPLE_RATE), _histograms(NULL)
+	{
+	}
+
+	/**
+	* Copy constructor (copies the histograms and the sample rate)
+	* @param other The recorder to copy
+	*/
+	TLatencyRecorder(const TLatencyRecorder& other) : _sampleRate(0), _countdown(0), _histograms(NULL)
+	{
+		CopyFrom(other);
+	}
+
+	/**
+	* Assignment operator (copies the histograms and the sample rate)
+	* @param other The recorder to copy
+	* @return Reference to this recorder
+	*/
+	TLatencyRecorder& operator=(const TLatencyRecorder& other)
+	{
+		if (this != &other)
+			CopyFrom(other);
+		return *this;
+	}
+
+	/**
+	* Destructor which frees the histograms
+	*/
+	~TLatencyRecorder()
+	{
+		delete[] _histograms.load(std::memory_order_relaxed);
+	}
+
+	/**
+	* Sets how many calls are made for every one that is timed
+	* @param rate 1 to time every call, n to time one in n, 0 to stop timing
+	*/
+	inline void SetSampleRate(unsigned int rate)
+	{
+		_sampleRate.store(rate, std::memory_order_relaxed);
+		_countdown.store(rate, std::memory_order_relaxed);
+	}
+
+	/**
+	* Returns how many calls are made for every one that is timed
+	* @return The rate (0 if timing is off)
+	*/
+	inline unsigned int GetSampleRate() const
+	{
+		return _sampleRate.load(std::memory_order_relaxed);
+	}
+
+	/**
+	* Counts a call and returns true if it should be timed. The countdown is a relaxed load and store
+	* rather than a locked decrement so it stays cheap; racing callers can lose a step but it only
+	* ever moves within [1, rate], so sampling can never stall
+	* @return Boolean
+	*/
+	inline bool Sample()
+	{
+		unsigned int rate = _sampleRate.load(std::memory_order_relaxed);
+		if (rate == 0)
+			return false;
+		unsigned int left = _countdown.load(std::memory_order_relaxed);
+		if (left > 1)
+		{
+			_countdown.store(left - 1, std::memory_order_relaxed);
+			return false;
+		}
+		_countdown.store(rate, std::memory_order_relaxed);
+		return true;
+	}
+
+	/**
+	* Records the duration of one call
+	* @param op The operation
+	* @param ticks The duration in TLatencyClock ticks
+	*/
+	inline void Record(TLatencyOp op, unsigned long long ticks)
+	{
+		Histograms()[op].Record(ticks);
+	}
+
+	/**
+	* Returns the histogram of an operation
+	* @param op The operation
+	* @return Reference to the histogram (an empty one if nothing has been timed)
+	*/
+	const TLatencyHistogram& Histogram(TLatencyOp op) const
+	{
+		static const TLatencyHistogram empty;
+		const TLatencyHistogram* histograms = _histograms.load(std::memory_order_acquire);
+		return histograms != NULL ? histograms[op] : empty;
+	}
+
+	/**
+	* Empties every histogram (the sample rate is kept)
+	*/
+	void Reset()
+	{
+		TLatencyHistogram* histograms = _histograms.load(std::memory_order_acquire);
+		if (histograms != NULL)
+		{
+			for (int i = 0; i < TLATENCY_OPS; i++)
+				histograms[i].Reset();
+		}
+	}
+
+	/**
+	* Calls func(name, summary) for every operation that recorded anything
+	* @param func Callable taking (const char*, const TLatencySummary&)
+	*/
+	template<typename Func>
+	void Export(Func func) const
+	{
+		static const char* const names[TLATENCY_OPS] = { "insert", "find", "remove", "empty" };
+		for (int i = 0; i < TLATENCY_OPS; i++)
+		{
+			const TLatencyHistogram& histogram = Histogram((TLatencyOp)i);
+			if (histogram.Count())
+				func(names[i], histogram.Summary());
+		}
+	}
+
+	/**
+	* Prints one line of count, p50, p99, p999 and max (in nanoseconds) per operation recorded
+	* @param out The stream to print to
+	* @param name Printed at the start of every line to tell containers apart (can be NULL)
+	*/
+	void Dump(FILE* out, const char* name = NULL) const
+	{
+		Export([out, name](const char* op, const TLatencySummary& s)
+		{
+			fprintf(out, "%s%s%-6s count=%llu p50=%.0fns p99=%.0fns p999=%.0fns max=%.0fns\n", name ? name : "", name ? " " : "",
+				op, s._count, s._p50, s._p99, s._p999, s._max);
+		});
+	}
+
+	/**
+	* Returns the empty recorder returned by containers when latency recording is compiled out
+	* @return Reference to the shared empty recorder
+	*/
+	static const TLatencyRecorder& Disabled()
+	{
+		static const TLatencyRecorder recorder;
+		return recorder;
+	}
+};
+
+
+
+/**
+* Times the rest of the scope it is declared in into one of a recorder's histograms if the recorder
+* samples this call (wrap it in TDS_LATENCY so it disappears when latency recording is compiled
+* out). A scope opened directly inside another on the same recorder (e.g. the PopBack calls made by
+* TList::Empty) is not timed so each call is only counted as the operation the caller made. The
+* open scope is tracked per thread so concurrent readers of one container don't see each other's
+* scopes
+*/
+
+class TLatencyScope
+{
+private:
+	TLatencyRecorder* _recorder; /**< Where the duration goes (NULL if this call is not sampled) */
+
+	TLatencyOp _op; /**< The operation being timed */
+
+	const TLatencyRecorder* _outer; /**< The recorder of the scope this one is nested in on this thread (NULL if none) */
+
+	unsigned long long _start; /**< Ticks when the scope was entered */
+
+	TLatencyScope(const TLatencyScope&);
+	TLatencyScope& operator=(const TLatencyScope&);
+
+	/**
+	* Returns the recorder of the innermost scope open on this thread
+	* @return Reference to the thread's slot (NULL if no scope is open)
+	*/
+	static inline const TLatencyRecorder*& Open()
+	{
+		static thread_local const TLatencyRecorder* open = NULL;
+		return open;
+	}
+
+public:
+	/**
+	* Constructor which starts timing if the call is sampled
+	* @param recorder The recorder of the container
+	* @param op The operation being timed
+	*/
+	inline TLatencyScope(TLatencyRecorder& recorder, TLatencyOp op) : _op(op)
+	{
+		const TLatencyRecorder*& open = Open();
+		_outer = open;
+		open = &recorder;
+		_recorder = _outer != &recorder && recorder.Sample() ? &recorder : NULL;
+		_start = _recorder != NULL ? TLatencyClock::Now() : 0;
+	}
+
+	/**
+	* Destructor which records the time since the constructor
+	*/
+	inline ~TLatencyScope()
+	{
+		if (_recorder != NULL)
+			_recorder->Record(_op, TLatencyClock::Now() - _start);
+		Open() = _outer;
+	}
+};
+
+#endif
\ No newline at end of file
@@ -1,8 +1,23 @@
 #ifndef TLIST_H
 #define TLIST_H
 
+/* Include for the node allocators */
+#include "TAllocator.h"
+
+/* Include for the instrumentation counters */
+#include "TStats.h"
+
+/* Include for the latency histograms */
+#include "TLatency.h"
+
+/* Include for the aggregate kernels */
+#include "TSimd.h"
+
+/* Include for snapshots */
+#include "TSerialize.h"
+
 /* Forward Decl */
-template<typename T>
+template<typename T, typename Alloc = TDefaultAllocator>
 class TList;
 template<typename T>
 class TListIter;
@@ -48,15 +63,22 @@ struct TListNode
 
 
 /**
-* The template list data structure
+* The template list data structure. The optional Alloc parameter is the allocator
+* used for the list nodes (see TAllocator.h)
 */
 
-template<typename T>
+template<typename T, typename Alloc>
 class TList
 {
 	friend class TListIter<T>;
 
 private:
+	Alloc _alloc; /**< The allocator the nodes are allocated from */
+
+	TDS_STAT(mutable TContainerStats _stats;) /**< Instrumentation counters (only when TDS_ENABLE_STATS is defined, updated by const iterators too) */
+
+	TDS_LATENCY(TLatencyRecorder _latency;) /**< Latency histograms (only when TDS_ENABLE_LATENCY is defined) */
+
 	TListNode<T>* _head; /**< The head of the list (note that although this has been allocated memory the actual start of the list is at _head->_next) */
 	
 	TListNode<T>* _top; /**< The last inserted element (may point to _head if list is empty */
@@ -68,7 +90,7 @@ private:
 	* internally for adding and removing nodes
 	* @return Pointer to the first node the _head points to (can be NULL)
 	*/
-	inline TListNode<T>* FirstNode()
+	inline TListNode<T>* FirstNode() const
 	{
 		return _head->_next;
 	}
@@ -79,7 +101,43 @@ private:
 	*/
 	inline TListNode<T>* Top()
 	{
-		return _too != _head ? _top : NULL;
+		return _top != _head ? _top : NULL;
+	}
+
+	/**
+	* Allocates a new node from the allocator
+	* @return Pointer to the new node
+	*/
+	inline TListNode<T>* NewNode()
+	{
+		TDS_STAT(_stats._allocations++;)
+		return TAllocNode<TListNode<T> >(_alloc);
+	}
+
+	/**
+	* Returns a node to the allocator
+	* @param node The node to free
+	*/
+	inline void FreeNode(TListNode<T>* node)
+	{
+		TDS_STAT(_stats._frees++;)
+		TFreeNode(_alloc, node);
+	}
+	/**
+	* Appends a copy of every node of other onto the top of this list in one pass
+	* @param other The list to copy
+	*/
+	void CopyFrom(const TList& other)
+	{
+		for (TListNode<T>* cur = other.FirstNode(); cur != NULL; cur = cur->_next)
+		{
+			TListNode<T>* node = NewNode();
+			node->_data = cur->_data;
+			node->_prev = _top;
+			_top->_next = node;
+			_top = node;
+		}
+		_count += other._count;
 	}
 public:
 	/** 
@@ -91,23 +149,144 @@ public:
 		_count = 0;
 
 		//instantiate _head (z node)
-		_head = new TListNode<T>();
+		_head = NewNode();
+
+		//point _top to head
+		_top = _head;
+	}
+
+	/**
+	* Overloaded constructor which takes the allocator the list will allocate its nodes from
+	* @param alloc The allocator to copy into the list
+	*/
+	TList(const Alloc& alloc) : _alloc(alloc)
+	{
+		_count = 0;
+
+		//instantiate _head (z node)
+		_head = NewNode();
 
 		//point _top to head
 		_top = _head;
 	}
 	
+	/**
+	* Copy constructor which deep copies other (see Clone). The allocator is copied too
+	* @param other The list to copy
+	*/
+	TList(const TList& other) : _alloc(other._alloc)
+	{
+		_count = 0;
+
+		//instantiate _head (z node)
+		_head = NewNode();
+
+		//point _top to head
+		_top = _head;
+
+		CopyFrom(other);
+	}
+
+	/**
+	* Assignment which empties this list and deep copies other into it. This list keeps its own allocator
+	* @param other The list to copy
+	* @return This list
+	*/
+	TList& operator=(const TList& other)
+	{
+		if (this != &other)
+		{
+			Empty();
+			CopyFrom(other);
+		}
+		return *this;
+	}
+
+	/**
+	* Returns a deep copy of the list (same order and allocator) made in one pass
+	* @return The copy
+	*/
+	TList Clone() const
+	{
+		return TList(*this);
+	}
+
 	/**
 	* The destructor for TTList will empty the list (delete nodes
 	* and leave data untouched) will also delete _head
 	*/
 	~TList()
 	{
+		//nodes from a monotonic allocator are released with it (and may already be gone)
+		if (TCanDropNodes<T, Alloc>())
+			return;
+
 		//empty the list
 		Empty();
 
 		//delete _head
-		delete(_head);
+		FreeNode(_head);
+	}
+
+	/**
+	* Returns the allocator used by this list
+	* @return Reference to the allocator
+	*/
+	inline Alloc& GetAllocator()
+	{
+		return _alloc;
+	}
+
+	/**
+	* Returns the instrumentation counters of this list (all zero unless TDS_ENABLE_STATS is defined, see TStats.h)
+	* @return Reference to the stats
+	*/
+	inline const TContainerStats& GetStats() const
+	{
+#ifdef TDS_ENABLE_STATS
+		return _stats;
+#else
+		return TContainerStats::Disabled();
+#endif
+	}
+
+	/**
+	* Zeroes the instrumentation counters of this list
+	*/
+	inline void ResetStats()
+	{
+		TDS_STAT(_stats.Reset();)
+	}
+
+	/**
+	* Returns the latency histograms of this list (empty unless TDS_ENABLE_LATENCY is defined, see TLatency.h)
+	* @return Reference to the recorder (print it with Dump)
+	*/
+	inline const TLatencyRecorder& GetLatency() const
+	{
+#ifdef TDS_ENABLE_LATENCY
+		return _latency;
+#else
+		return TLatencyRecorder::Disabled();
+#endif
+	}
+
+	/**
+	* Empties the latency histograms of this list
+	*/
+	inline void ResetLatency()
+	{
+		TDS_LATENCY(_latency.Reset();)
+	}
+
+	/**
+	* Sets how many calls are made for every one that is timed (does nothing unless TDS_ENABLE_LATENCY is defined)
+	* @param rate 1 to time every call (the default unless TLATENCY_SAMPLE_RATE is defined), n to time one in n, 0 to stop timing
+	*/
+	inline void SetLatencySampleRate(unsigned int rate)
+	{
+		TDS_LATENCY(_latency.SetSampleRate(rate);)
+		(void)rate;
 	}
 
 
@@ -117,6 +296,17 @@ public:
 	*/
 	void Empty()
 	{
+		TDS_LATENCY(TLatencyScope latency(_latency, TLATENCY_EMPTY);)
+
+		//nothing to free so just unlink every node at once
+		if (TCanDropNodes<T, Alloc>())
+		{
+			_head->_next = NULL;
+			_top = _head;
+			_count = 0;
+			return;
+		}
+
 		while (!IsEmpty())
 			PopBack();
 	}
@@ -125,7 +315,7 @@ public:
 	* Returns true if the list is empty and false if not
 	* @return Boolean
 	*/
-	inline bool IsEmpty()
+	inline bool IsEmpty() const
 	{
 		return !_count;
 	}
@@ -134,17 +324,84 @@ public:
 	* Returns the number of items on the list
 	* @return integer count
 	*/
-	inline int Count()
+	inline int Count() const
 	{
 		return _count;
 	}
 
+	/**
+	* Returns the sum of every element (walks the nodes rather than copying each element out
+	* through an iterator)
+	* @return The sum (see TSumType in TSimd.h)
+	*/
+	typename TSumType<T>::Type Sum() const
+	{
+		typename TSumType<T>::Type sum = typename TSumType<T>::Type();
+		for (TListNode<T>* node = FirstNode(); node != NULL; node = node->_next)
+			sum += node->_data;
+		return sum;
+	}
+
+	/**
+	* Finds the smallest and largest element
+	* @param min Receives the smallest element
+	* @param max Receives the largest element
+	* @return False if the list is empty (min and max are left untouched)
+	*/
+	bool MinMax(T& min, T& max) const
+	{
+		TListNode<T>* node = FirstNode();
+		if (node == NULL)
+			return false;
+		min = max = node->_data;
+		for (node = node->_next; node != NULL; node = node->_next)
+		{
+			if (node->_data < min) min = node->_data;
+			if (max < node->_data) max = node->_data;
+		}
+		return true;
+	}
+
+	/**
+	* Counts the elements pred is true for
+	* @param pred Predicate functor, e.g. TInRange<int>(0, 9)
+	* @return Number of matching elements
+	*/
+	template<typename Pred>
+	int CountIf(Pred pred) const
+	{
+		int ret = 0;
+		for (TListNode<T>* node = FirstNode(); node != NULL; node = node->_next)
+			ret += pred(node->_data) ? 1 : 0;
+		return ret;
+	}
+
+	/**
+	* Copies the elements pred is true for to out in list order
+	* @param pred Predicate functor, e.g. TInRange<int>(0, 9)
+	* @param out Receives the matching elements (must have room for Count() elements)
+	* @return Number of elements copied
+	*/
+	template<typename Pred>
+	int FilterInto(Pred pred, T* out) const
+	{
+		int ret = 0;
+		for (TListNode<T>* node = FirstNode(); node != NULL; node = node->_next)
+		{
+			if (pred(node->_data))
+				out[ret++] = node->_data;
+		}
+		return ret;
+	}
+
 	/** 
 	* Pops the last element off the list and also returns the data
 	* @return The data of the element that was popped off the list (will be NULL if list was empty)
 	*/
 	T PopBack()
 	{
+		TDS_LATENCY(TLatencyScope latency(_latency, TLATENCY_REMOVE);)
+
 		//the data to return
 		T ret = T();
 
@@ -160,10 +417,12 @@ public:
 			_top->_next = NULL;
 
 			//delete tmp
-			delete(tmp);
+			FreeNode(tmp);
 
 			//deduct count 
 			_count--;
+
+			TDS_STAT(_stats._remove.Record(0, 0);)
 		}
 
 		//return it
@@ -176,8 +435,10 @@ public:
 	*/
 	void PushBack(T data)
 	{
+		TDS_LATENCY(TLatencyScope latency(_latency, TLATENCY_INSERT);)
+
 		//append a new node and set its data
-		_top->_next = new TListNode<T>();
+		_top->_next = NewNode();
 		_top->_next->_data = data;
 
 		//set the new nodes previous to be the top
@@ -188,6 +449,64 @@ public:
 
 		//increment count
 		_count++;
+
+		TDS_STAT(_stats._insert.Record(0, 0);)
+	}
+
+	/**
+	* Writes a snapshot of the list (a header followed by the data in list order) to the stream.
+	* T must be trivially copyable or have a TSerializeTraits specialization (see TSerialize.h)
+	* @param stream The stream to write to
+	* @return True if the snapshot was written
+	*/
+	bool Serialize(std::ostream& stream)
+	{
+		if (!TWriteSnapshotHeader<T>(stream, TSNAPSHOT_LIST, (uint64_t)_count))
+			return false;
+
+		TSnapshotWriter<T> writer(stream);
+		for (TListNode<T>* cur = FirstNode(); cur != NULL; cur = cur->_next)
+		{
+			if (!writer.Write(cur->_data))
+				return false;
+		}
+		return writer.Flush();
+	}
+
+	/**
+	* Replaces the contents of the list with a snapshot written by Serialize
+	* @param stream The stream to read from
+	* @return True if the snapshot was read (the list is left empty if it was not)
+	*/
+	bool Deserialize(std::istream& stream)
+	{
+		//drop the old contents first so a bad header leaves the list empty too
+		Empty();
+
+		uint64_t count = 0;
+		if (!TReadSnapshotHeader<T>(stream, TSNAPSHOT_LIST, count) || count > 0x7FFFFFFF)
+			return false;
+
+		TSnapshotReader<T> reader(stream, count);
+		for (uint64_t i = 0; i < count; i++)
+		{
+			//append straight onto the top so no data is copied twice
+			TListNode<T>* node = NewNode();
+			if (!reader.Read(node->_data))
+			{
+				FreeNode(node);
+				Empty();
+				return false;
+			}
+
+			node->_prev = _top;
+			_top->_next = node;
+			_top = node;
+			_count++;
+		}
+
+		TDS_STAT(_stats._insert._count += count;)
+		return true;
 	}
 
 	/**
@@ -197,10 +516,15 @@ public:
 	*/
 	bool Remove(T instance)
 	{
+		TDS_LATENCY(TLatencyScope latency(_latency, TLATENCY_REMOVE);)
+
 		//start at head->next (remember head is just a false node)
 		TListNode<T>* cur = _head->_next;
+		TDS_STAT(unsigned int visited = 0;)
 		while (cur)
 		{
+			TDS_STAT(visited++;)
+
 			//if not what we are looking for get next else break
 			if (cur->_data != instance)
 				cur = cur->_next;
@@ -208,8 +532,12 @@ public:
 				break;
 		}
 
-		//remove node
-		return Remove(cur);
+		TDS_STAT(_stats._comparisons += visited;)
+
+		//remove node (only a successful unlink counts as a remove)
+		bool ret = Remove(cur);
+		TDS_STAT(if (ret) _stats._remove.Record(visited, visited);)
+		return ret;
 	}
 
 	/**
@@ -219,6 +547,8 @@ public:
 	*/
 	bool Remove(TListNode<T>* node)
 	{
+		TDS_LATENCY(TLatencyScope latency(_latency, TLATENCY_REMOVE);)
+
 		bool ret = false;
 		//make sure it isnt a null node
 		if (node != NULL)
@@ -235,7 +565,7 @@ public:
 			if(next) next->_prev = prev;
 
 			//delete node
-			delete(node);
+			FreeNode(node);
 
 			//deduct count
 			_count--;
@@ -261,6 +591,8 @@ public:
 		//remove and cache the return flag
 		bool ret = Remove(itr._current);
 
+		TDS_STAT(if (ret) _stats._remove.Record(0, 0);)
+
 		if(ret) itr = tmp;
 
 		//remove
@@ -279,10 +611,12 @@ public:
 template<typename T>
 class TListIter
 {
-	friend class TList<T>;
+	template<typename, typename> friend class TList;
 private:
 	TListNode<T>* _current; /**< Pointer to the node this iterator is currently at */
 
+	TDS_STAT(TContainerStats* _stats;) /**< The stats of the list being iterated (only when TDS_ENABLE_STATS is defined) */
+
 public:
 	/**
 	* Default constructor will init _current to NULL
@@ -290,6 +624,7 @@ public:
 	TListIter()
 	{
 		_current = NULL;
+		TDS_STAT(_stats = NULL;)
 	}
 
 	/**
@@ -305,10 +640,12 @@ public:
 	* we want to iterate over
 	* @param list Pointer to the list we want to iterate over
 	*/
-	TListIter(TList<T>* list)
+	template<typename Alloc>
+	TListIter(const TList<T, Alloc>* list)
 	{
 		//get the head
 		_current = list->FirstNode();
+		TDS_STAT(_stats = &list->_stats;)
 
 	}
 
@@ -352,6 +689,7 @@ public:
 		if (_current != NULL)
 		{
 			_current = _current->_next;
+			TDS_STAT(if (_stats != NULL) _stats->_iteratorNexts++;)
 		}
 		return (*this);
 	}
@@ -0,0 +1,757 @@
+#ifndef TMAPPEDTREE_H
+#define TMAPPEDTREE_H
+
+/**
+* TMappedTree is only available on POSIX platforms (it needs mmap)
+*/
+#if !defined(_WIN32)
+
+/* Includes for mmap and files */
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <string.h>
+#include <type_traits>
+
+/* Definitions and macros */
+#ifndef NULL
+#define NULL 0
+#endif
+
+/* Prefetch hint for batched lookups (does nothing on compilers without one) */
+#ifndef TDS_PREFETCH
+#if defined(__GNUC__) || defined(__clang__)
+#define TDS_PREFETCH(addr) __builtin_prefetch(addr)
+#else
+#define TDS_PREFETCH(addr) ((void)0)
+#endif
+#endif
+
+/**
+* Number of lookups FindMany keeps in flight at once
+*/
+#define TMAPPEDTREE_FIND_GROUP 16
+
+/* Forward Decl */
+template<typename T> class TMappedTreeIter;
+
+/**
+* Macro to iterate over a mapped tree (that is not a pointer) in sorted order
+*/
+#define TMAPPEDTREE_foreach(Type, name, in_tree) for (TMappedTreeIter<Type> name = TMappedTreeIter<Type>(&in_tree); !name.IsFinished(); name.Next())
+
+/**
+* A node stored in the mapped file. Nodes refer to each other by their byte offset
+* from the start of the file (0 means NULL) so the file can be mapped at any address
+*/
+
+template<typename T>
+struct TMappedNode
+{
+	T _data; /**< The data this node stores */
+
+	uint64_t _left; /**< Offset of the child holding data less than _data (0 if none) */
+	uint64_t _right; /**< Offset of the child holding data greater or equal to _data (0 if none) */
+	uint64_t _parent; /**< Offset of the parent node (0 if root) */
+};
+
+/**
+* The header at the start of a mapped tree file
+*/
+
+struct TMappedTreeHeader
+{
+	char _magic[4]; /**< Always "TDSM" */
+	uint32_t _byteOrder; /**< 0x01020304 written in native byte order */
+	uint32_t _version; /**< Format version (currently 1) */
+	uint32_t _elementSize; /**< sizeof(T) */
+	uint64_t _nodeSize; /**< sizeof(TMappedNode<T>) */
+	uint64_t _count; /**< Number of nodes in the tree */
+	uint64_t _root; /**< Offset of the root node (0 if empty) */
+	uint64_t _used; /**< Number of bytes of the file in use (header and nodes) */
+	uint64_t _reserved[2]; /**< Padding to 64 bytes (always 0) */
+};
+
+
+
+/**
+* A binary tree (with the same ordering rules as TTree) whose nodes live in a memory mapped file.
+* Opening an existing file is O(1) - nothing is read or deserialized, pages are faulted in as
+* lookups touch them, and any number of processes can map the same file read-only and share
+* its physical pages. A writable tree appends new nodes to the end of the file (growing it as
+* needed) and Sync() flushes them to disk.
+*
+* A read-only tree sees the tree as it was when it was opened (or last Refresh()ed); nodes
+* appended by a writer after that are ignored. T must be trivially copyable.
+*/
+
+template<typename T>
+class TMappedTree
+{
+	friend class TMappedTreeIter<T>;
+
+	static_assert(std::is_trivially_copyable<T>::value, "TMappedTree can only store trivially copyable types");
+
+private:
+	int _fd; /**< The file descriptor of the open file (-1 if not open) */
+
+	char* _base; /**< Start of the mapping (NULL if not open) */
+
+	uint64_t _mapped; /**< Number of bytes mapped */
+
+	uint64_t _limit; /**< Offsets at or past this are treated as NULL (the used size when opened for read-only trees) */
+
+	uint64_t _root; /**< Root offset seen by this tree */
+
+	uint64_t _count; /**< Count seen by this tree */
+
+	bool _readOnly; /**< True if the tree was opened read-only */
+
+	int(*_comparison)(T, T); /**< The comparison function (see TTree) */
+
+	enum
+	{
+		HEADER_SIZE = 64 /**< Bytes reserved for the header at the start of the file */
+	};
+
+	/**
+	* Returns the header of the mapped file
+	* @return Pointer to the header
+	*/
+	inline TMappedTreeHeader* Header() const
+	{
+		return (TMappedTreeHeader*)_base;
+	}
+
+	/**
+	* Converts an offset into a node pointer
+	* @param offset The offset of the node
+	* @return Pointer to the node (NULL if the offset is 0 or not visible to this tree)
+	*/
+	inline TMappedNode<T>* NodeAt(uint64_t offset) const
+	{
+		if (offset == 0 || offset + sizeof(TMappedNode<T>) > _limit)
+			return NULL;
+		return (TMappedNode<T>*)(_base + offset);
+	}
+
+	/**
+	* Converts a node pointer into its offset
+	* @param node The node (can be NULL)
+	* @return The offset of the node (0 if NULL)
+	*/
+	inline uint64_t OffsetOf(const TMappedNode<T>* node) const
+	{
+		return node != NULL ? (uint64_t)((const char*)node - _base) : 0;
+	}
+
+	/**
+	* Maps the first bytes of the open file
+	* @param bytes The number of bytes to map
+	* @return True if the file was mapped
+	*/
+	bool Map(uint64_t bytes)
+	{
+		int prot = _readOnly ? PROT_READ : (PROT_READ | PROT_WRITE);
+		void* base = mmap(NULL, (size_t)bytes, prot, MAP_SHARED, _fd, 0);
+		if (base == MAP_FAILED)
+			return false;
+
+		_base = (char*)base;
+		_mapped = bytes;
+		return true;
+	}
+
+	/**
+	* Unmaps the file (if mapped)
+	*/
+	void Unmap()
+	{
+		if (_base != NULL)
+			munmap(_base, (size_t)_mapped);
+		_base = NULL;
+		_mapped = 0;
+	}
+
+	/**
+	* Makes sure the file (and mapping) is at least the given size, doubling it if it has to grow.
+	* Note that growing moves the mapping so node pointers must not be held across this call
+	* @param bytes The number of bytes needed
+	* @return True if the file is big enough (if it could not be remapped the old size is mapped
+	* again, and only if that fails too is the tree left unmapped and has to be reopened)
+	*/
+	bool Reserve(uint64_t bytes)
+	{
+		if (bytes <= _mapped)
+			return true;
+
+		uint64_t size = _mapped * 2;
+		if (size < bytes)
+			size = bytes;
+
+		if (ftruncate(_fd, (off_t)size) != 0)
+			return false;
+
+		uint64_t old = _mapped;
+		Unmap();
+		if (Map(size))
+			return true;
+
+		//the file only grew so the old range still holds the whole tree
+		Map(old);
+		return false;
+	}
+
+	/**
+	* Recursively writes the sorted elements [lo, hi) as a balanced subtree. The recursion is in-order
+	* so elements are read from the source and written to the file in sequence
+	* @param source The source of the sorted data
+	* @param lo Index of the first element
+	* @param hi Index one past the last element
+	* @param parent Offset of the parent of the subtree root
+	* @param next Offset the next node is written at (advanced as nodes are written)
+	* @return Offset of the subtree root (0 if empty or the source ran dry)
+	*/
+	template<typename Source>
+	uint64_t LinkSorted(Source& source, uint64_t lo, uint64_t hi, uint64_t parent, uint64_t& next)
+	{
+		if (lo >= hi)
+			return 0;
+
+		uint64_t mid = lo + (hi - lo) / 2;
+		uint64_t offset = HEADER_SIZE + mid * sizeof(TMappedNode<T>);
+		TMappedNode<T>* node = (TMappedNode<T>*)(_base + offset);
+
+		node->_left = LinkSorted(source, lo, mid, offset, next);
+
+		//nodes are visited in order so this is always the next slot
+		if (next != offset || !source.Read(node->_data))
+			return 0;
+		next += sizeof(TMappedNode<T>);
+		node->_parent = parent;
+
+		node->_right = LinkSorted(source, mid + 1, hi, offset, next);
+		return offset;
+	}
+
+	/**
+	* Sets every member back to the closed state
+	*/
+	void Reset()
+	{
+		_fd = -1;
+		_base = NULL;
+		_mapped = _limit = _root = _count = 0;
+		_readOnly = true;
+	}
+
+	/**
+	* The tree owns the mapping so it can't be copied
+	*/
+	TMappedTree(const TMappedTree&);
+	TMappedTree& operator=(const TMappedTree&);
+
+public:
+	/**
+	* Constructor which takes the comparison function (a file must then be opened with Open or Create)
+	* @param ComparisonFunc The comparison function (see TTree)
+	*/
+	TMappedTree(int(*ComparisonFunc)(T, T) = NULL)
+	{
+		Reset();
+		_comparison = ComparisonFunc;
+	}
+
+	/**
+	* Destructor which unmaps and closes the file (call Sync first for durability)
+	*/
+	~TMappedTree()
+	{
+		Close();
+	}
+
+	/**
+	* Sets the comparison function
+	* @param ComparisonFunc The comparison function (see TTree)
+	*/
+	void SetComparisonFunc(int(*ComparisonFunc)(T, T))
+	{
+		_comparison = ComparisonFunc;
+	}
+
+	/**
+	* Creates (or truncates) a file holding an empty tree and opens it for writing
+	* @param path The path of the file
+	* @param capacity The number of nodes to reserve space for up front
+	* @return True if the file was created
+	*/
+	bool Create(const char* path, uint64_t capacity = 1024)
+	{
+		Close();
+
+		_fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+		if (_fd < 0)
+		{
+			Reset();
+			return false;
+		}
+		_readOnly = false;
+
+		uint64_t size = HEADER_SIZE + capacity * sizeof(TMappedNode<T>);
+		if (ftruncate(_fd, (off_t)size) != 0 || !Map(size))
+		{
+			Close();
+			return false;
+		}
+
+		TMappedTreeHeader* header = Header();
+		memset(header, 0, HEADER_SIZE);
+		memcpy(header->_magic, "TDSM", 4);
+		header->_byteOrder = 0x01020304;
+		header->_version = 1;
+		header->_elementSize = (uint32_t)sizeof(T);
+		header->_nodeSize = sizeof(TMappedNode<T>);
+		header->_used = HEADER_SIZE;
+
+		_limit = _mapped;
+		return true;
+	}
+
+	/**
+	* Opens an existing tree file in O(1) by mapping it (nothing is read up front)
+	* @param path The path of the file
+	* @param readOnly True to map it read-only (shared with every other reader), false to allow Insert
+	* @return True if the file was opened and holds a tree of this type
+	*/
+	bool Open(const char* path, bool readOnly = true)
+	{
+		Close();
+
+		_fd = open(path, readOnly ? O_RDONLY : O_RDWR);
+		if (_fd < 0)
+		{
+			Reset();
+			return false;
+		}
+		_readOnly = readOnly;
+
+		struct stat st;
+		if (fstat(_fd, &st) != 0 || (uint64_t)st.st_size < HEADER_SIZE || !Map((uint64_t)st.st_size))
+		{
+			Close();
+			return false;
+		}
+
+		TMappedTreeHeader* header = Header();
+		if (memcmp(header->_magic, "TDSM", 4) != 0 || header->_byteOrder != 0x01020304 || header->_version != 1 ||
+			header->_elementSize != sizeof(T) || header->_nodeSize != sizeof(TMappedNode<T>) || header->_used > _mapped)
+		{
+			Close();
+			return false;
+		}
+
+		Refresh();
+		return true;
+	}
+
+	/**
+	* Unmaps and closes the file
+	*/
+	void Close()
+	{
+		Unmap();
+		if (_fd >= 0)
+			close(_fd);
+		Reset();
+	}
+
+	/**
+	* Picks up nodes appended (by another process) since the tree was opened. Read-only trees
+	* remap the file if it has grown
+	* @return True if the tree is open
+	*/
+	bool Refresh()
+	{
+		if (_base == NULL)
+			return false;
+
+		if (_readOnly)
+		{
+			struct stat st;
+			if (fstat(_fd, &st) == 0 && (uint64_t)st.st_size > _mapped)
+			{
+				Unmap();
+				if (!Map((uint64_t)st.st_size))
+				{
+					Close();
+					return false;
+				}
+			}
+
+			//only nodes that existed when the header was read are visible
+			_limit = Header()->_used;
+			_root = Header()->_root;
+			_count = Header()->_count;
+		}
+		else
+		{
+			_limit = _mapped;
+			_root = Header()->_root;
+			_count = Header()->_count;
+		}
+		return true;
+	}
+
+	/**
+	* Flushes every change to the file to disk
+	* @return True if the flush succeeded
+	*/
+	bool Sync()
+	{
+		if (_base == NULL || _readOnly)
+			return false;
+		return msync(_base, (size_t)_mapped, MS_SYNC) == 0;
+	}
+
+	/**
+	* Returns true if a file is open
+	* @return Boolean
+	*/
+	inline bool IsOpen() const
+	{
+		return _base != NULL;
+	}
+
+	/**
+	* Returns true if the tree was opened read-only
+	* @return Boolean
+	*/
+	inline bool IsReadOnly() const
+	{
+		return _readOnly;
+	}
+
+	/**
+	* Returns the number of nodes in the tree
+	* @return Count
+	*/
+	inline uint64_t Count() const
+	{
+		return _count;
+	}
+
+	/**
+	* Returns true if the tree is empty
+	* @return Boolean
+	*/
+	inline bool IsEmpty() const
+	{
+		return _count == 0;
+	}
+
+	/**
+	* Appends a node holding data to the file and links it into the tree
+	* @param data The data to insert
+	* @return True if inserted (false if the tree is read-only or the file could not grow)
+	*/
+	bool Insert(const T& data)
+	{
+		if (_base == NULL || _readOnly)
+			return false;
+
+		//grow first as it can move the mapping
+		uint64_t offset = Header()->_used;
+		if (!Reserve(offset + sizeof(TMappedNode<T>)))
+			return false;
+		_limit = _mapped;
+
+		//find where it goes
+		TMappedNode<T>* cur = NodeAt(_root), *prev = NULL;
+		int result = 0;
+		while (cur != NULL)
+		{
+			result = _comparison(data, cur->_data);
+			prev = cur;
+			cur = NodeAt(result <= -1 ? cur->_left : cur->_right);
+		}
+
+		//write the node at the end of the used space then link it under its parent
+		TMappedNode<T>* node = (TMappedNode<T>*)(_base + offset);
+		node->_data = data;
+		node->_left = node->_right = 0;
+		node->_parent = OffsetOf(prev);
+
+		TMappedTreeHeader* header = Header();
+		header->_used = offset + sizeof(TMappedNode<T>);
+
+		if (prev == NULL)
+			header->_root = offset;
+		else if (result <= -1)
+			prev->_left = offset;
+		else
+			prev->_right = offset;
+
+		header->_count++;
+		_root = header->_root;
+		_count = header->_count;
+		return true;
+	}
+
+	/**
+	* Replaces the contents of the tree with count elements read in sorted order from source (anything
+	* with a bool Read(T&) method, e.g. TExternalSorter). The nodes are written to the file sequentially
+	* in sorted order and linked into a perfectly balanced tree, so the file is written front to back
+	* and range scans read it front to back
+	* @param source The source of the sorted data
+	* @param count The number of elements to read
+	* @return True if every element was read (the tree is left empty if not)
+	*/
+	template<typename Source>
+	bool BuildSorted(Source& source, uint64_t count)
+	{
+		if (_base == NULL || _readOnly)
+			return false;
+
+		TMappedTreeHeader* header = Header();
+		header->_root = header->_count = 0;
+		header->_used = HEADER_SIZE;
+		_root = _count = 0;
+
+		if (!Reserve(HEADER_SIZE + count * sizeof(TMappedNode<T>)))
+			return false;
+		_limit = _mapped;
+
+		uint64_t next = HEADER_SIZE;
+		uint64_t root = LinkSorted(source, 0, count, 0, next);
+		if (next != HEADER_SIZE + count * sizeof(TMappedNode<T>))
+			return false;
+
+		//publish the new tree
+		header = Header();
+		header->_used = next;
+		header->_root = root;
+		header->_count = count;
+		_root = root;
+		_count = count;
+		return true;
+	}
+
+	/**
+	* Finds the data equal to obj
+	* @param obj The data to look for
+	* @return Pointer to the data in the mapping (NULL if not found)
+	*/
+	const T* Find(const T& obj) const
+	{
+		TMappedNode<T>* cur = NodeAt(_root);
+		while (cur != NULL)
+		{
+			int result = _comparison(obj, cur->_data);
+			if (result == 0)
+				return &cur->_data;
+			cur = NodeAt(result <= -1 ? cur->_left : cur->_right);
+		}
+		return NULL;
+	}
+
+	/**
+	* Finds count keys at once, interleaving up to TMAPPEDTREE_FIND_GROUP lookups so their cache
+	* misses (and page faults on a cold mapping) overlap (see TTree::FindMany)
+	* @param keys The keys to look for
+	* @param count Number of keys
+	* @param results Receives a pointer to the data in the mapping for each key (NULL if not found)
+	*/
+	void FindMany(const T* keys, int count, const T** results) const
+	{
+		TMappedNode<T>* cur[TMAPPEDTREE_FIND_GROUP];
+		int index[TMAPPEDTREE_FIND_GROUP];
+		int active = 0, next = 0;
+
+		while (active < TMAPPEDTREE_FIND_GROUP && next < count)
+		{
+			cur[active] = NodeAt(_root);
+			index[active++] = next++;
+		}
+
+		while (active > 0)
+		{
+			for (int i = 0; i < active; )
+			{
+				TMappedNode<T>* node = cur[i];
+				const T* found = NULL;
+				if (node != NULL)
+				{
+					int result = _comparison(keys[index[i]], node->_data);
+					if (result != 0)
+					{
+						node = NodeAt(result <= -1 ? node->_left : node->_right);
+						if (node != NULL)
+						{
+							TDS_PREFETCH(node);
+							cur[i++] = node;
+							continue;
+						}
+					}
+					else
+					{
+						found = &node->_data;
+					}
+				}
+
+				//this lookup is finished - start the next key in its place or close the gap
+				results[index[i]] = found;
+				if (next < count)
+				{
+					cur[i] = NodeAt(_root);
+					index[i++] = next++;
+				}
+				else
+				{
+					active--;
+					cur[i] = cur[active];
+					index[i] = index[active];
+				}
+			}
+		}
+	}
+
+	/**
+	* Finds data with a search function (see TTree::Find)
+	* @param id The id passed as the first argument of the search function
+	* @param SearchFunc The search function
+	* @return Pointer to the data in the mapping (NULL if not found)
+	*/
+	template<typename IDType>
+	const T* Find(IDType id, int(*SearchFunc)(IDType, T)) const
+	{
+		TMappedNode<T>* cur = NodeAt(_root);
+		while (cur != NULL)
+		{
+			int result = SearchFunc(id, cur->_data);
+			if (result == 0)
+				return &cur->_data;
+			cur = NodeAt(result <= -1 ? cur->_left : cur->_right);
+		}
+		return NULL;
+	}
+};
+
+
+
+/**
+* Iterates over a TMappedTree in sorted order (using the parent offsets so no stack is needed)
+*/
+
+template<typename T>
+class TMappedTreeIter
+{
+private:
+	const TMappedTree<T>* _tree; /**< The tree being iterated */
+
+	TMappedNode<T>* _current; /**< The current node (NULL when finished) */
+
+	/**
+	* Returns the leftmost node of the subtree starting at node
+	*/
+	TMappedNode<T>* Leftmost(TMappedNode<T>* node)
+	{
+		if (node != NULL)
+		{
+			TMappedNode<T>* left;
+			while ((left = _tree->NodeAt(node->_left)) != NULL)
+				node = left;
+		}
+		return node;
+	}
+
+public:
+	/**
+	* Default constructor
+	*/
+	TMappedTreeIter()
+	{
+		_tree = NULL;
+		_current = NULL;
+	}
+
+	/**
+	* Constructor which starts at the smallest data of the tree
+	* @param tree The tree to iterate over
+	*/
+	TMappedTreeIter(const TMappedTree<T>* tree)
+	{
+		_tree = tree;
+		_current = tree->IsOpen() ? Leftmost(tree->NodeAt(tree->_root)) : NULL;
+	}
+
+	/**
+	* Returns true once every node has been visited
+	* @return Boolean
+	*/
+	inline bool IsFinished()
+	{
+		return _current == NULL;
+	}
+
+	/**
+	* Moves to the next node in sorted order
+	*/
+	void Next()
+	{
+		if (_current == NULL)
+			return;
+
+		TMappedNode<T>* right = _tree->NodeAt(_current->_right);
+		if (right != NULL)
+		{
+			_current = Leftmost(right);
+			return;
+		}
+
+		//go up until we come from a left child
+		TMappedNode<T>* node = _current;
+		TMappedNode<T>* parent = _tree->NodeAt(node->_parent);
+		while (parent != NULL && _tree->NodeAt(parent->_right) == node)
+		{
+			node = parent;
+			parent = _tree->NodeAt(parent->_parent);
+		}
+		_current = parent;
+	}
+
+	/**
+	* Returns the data of the current node
+	* @return The data (default value if finished)
+	*/
+	inline T Value()
+	{
+		T ret = T();
+		if (_current != NULL)
+			ret = _current->_data;
+		return ret;
+	}
+
+	/**
+	* Overloaded operator to de-reference the iterator to the stored data
+	* @return The Data
+	*/
+	T operator*()
+	{
+		return Value();
+	}
+
+	/**
+	* Overloaded cast operator to cast the iterator into the data type
+	* @return The Data
+	*/
+	operator T()
+	{
+		return Value();
+	}
+};
+
+#endif
+
+#endif
\ No newline at end of file
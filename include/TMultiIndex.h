@@ -0,0 +1,851 @@
+#ifndef TMULTIINDEX_H
+#define TMULTIINDEX_H
+
+/* Include for the node allocators */
+#include "TAllocator.h"
+
+/* Include for the instrumentation counters */
+#include "TStats.h"
+
+/* Include for the latency histograms */
+#include "TLatency.h"
+
+/* Includes for the index tuple and fixed size integers */
+#include <stdint.h>
+#include <string.h>
+#include <tuple>
+#include <utility>
+
+/* Definitions and macros */
+#ifndef NULL
+#define NULL 0
+#endif
+
+/**
+* Macro to iterate over a multi index container (that is not a pointer) in the order of one of its
+* indexes (sorted for ordered indexes, insertion order for hashed indexes)
+*/
+#define TMULTIINDEX_foreach(index, name, in_set) for (auto name = (in_set).template Begin<index>(); !name.IsFinished(); name.Next())
+
+/**
+* The links a node keeps for one of its indexes. Ordered indexes use all three as tree links,
+* hashed indexes use _left as the next node in the bucket
+*/
+
+template<typename Node>
+struct TMultiIndexHook
+{
+	Node* _left; /**< Left child (or next node in the bucket) */
+	Node* _right; /**< Right child */
+	Node* _parent; /**< Parent (NULL for the root) */
+};
+
+/**
+* A node of a multi index container. The data is stored once and the node carries the hooks of
+* all K indexes, so it is linked into every index with a single allocation
+*/
+
+template<typename T, int K>
+struct TMultiIndexNode
+{
+	typedef T DataType;
+
+	T _data; /**< The data this node stores */
+
+	TMultiIndexNode* _next; /**< Next node in insertion order */
+	TMultiIndexNode* _prev; /**< Previous node in insertion order */
+
+	unsigned int _priority; /**< Random heap priority shared by every ordered index (they are treaps) */
+
+	TMultiIndexHook<TMultiIndexNode> _hooks[K]; /**< The links of each index */
+
+	/**
+	* Default constructor which clears every link
+	*/
+	TMultiIndexNode() : _data()
+	{
+		_next = _prev = NULL;
+		_priority = 0;
+		memset(_hooks, 0, sizeof(_hooks));
+	}
+};
+
+
+
+/**
+* Declares an ordered index. Compare is a functor type returning true if its first argument is
+* ordered before the second (see TCompare.h). To look data up by a key other than T give it
+* overloads for (T, Key) and (Key, T). Duplicates are allowed. The index is a treap so it stays
+* balanced (expected O(log n) height) whatever order data is inserted in
+*/
+
+template<typename Compare>
+struct TOrderedIndex
+{
+	template<typename Node, int I>
+	class Impl
+	{
+	private:
+		Node* _root; /**< The root of the tree */
+
+		static inline Node*& Left(Node* node) { return node->_hooks[I]._left; }
+		static inline Node*& Right(Node* node) { return node->_hooks[I]._right; }
+		static inline Node*& Parent(Node* node) { return node->_hooks[I]._parent; }
+
+		/**
+		* Points the link parent had to old at child instead (or the root if parent is NULL)
+		*/
+		inline void Replace(Node* parent, Node* old, Node* child)
+		{
+			if (parent == NULL)
+				_root = child;
+			else if (Left(parent) == old)
+				Left(parent) = child;
+			else
+				Right(parent) = child;
+
+			if (child != NULL)
+				Parent(child) = parent;
+		}
+
+		/**
+		* Rotates node above its parent
+		*/
+		void RotateUp(Node* node)
+		{
+			Node* parent = Parent(node);
+			Node* grandparent = Parent(parent);
+
+			if (Left(parent) == node)
+			{
+				Left(parent) = Right(node);
+				if (Right(node) != NULL)
+					Parent(Right(node)) = parent;
+				Right(node) = parent;
+			}
+			else
+			{
+				Right(parent) = Left(node);
+				if (Left(node) != NULL)
+					Parent(Left(node)) = parent;
+				Left(node) = parent;
+			}
+
+			Replace(grandparent, parent, node);
+			Parent(parent) = node;
+		}
+
+	public:
+		Impl()
+		{
+			_root = NULL;
+		}
+
+		/**
+		* Links a node into the tree (as a leaf, then rotated up by priority)
+		*/
+		void Insert(Node* node)
+		{
+			Node* cur = _root;
+			Node* parent = NULL;
+			bool left = false;
+			while (cur != NULL)
+			{
+				parent = cur;
+				left = Compare()(node->_data, cur->_data);
+				cur = left ? Left(cur) : Right(cur);
+			}
+
+			Left(node) = Right(node) = NULL;
+			Parent(node) = parent;
+			if (parent == NULL)
+				_root = node;
+			else if (left)
+				Left(parent) = node;
+			else
+				Right(parent) = node;
+
+			while (Parent(node) != NULL && Parent(node)->_priority < node->_priority)
+				RotateUp(node);
+		}
+
+		/**
+		* Unlinks a node from the tree (rotated down to a leaf first)
+		*/
+		void Erase(Node* node)
+		{
+			while (Left(node) != NULL && Right(node) != NULL)
+				RotateUp(Left(node)->_priority > Right(node)->_priority ? Left(node) : Right(node));
+
+			Replace(Parent(node), node, Left(node) != NULL ? Left(node) : Right(node));
+			Left(node) = Right(node) = Parent(node) = NULL;
+		}
+
+		/**
+		* Forgets every node
+		*/
+		void Empty()
+		{
+			_root = NULL;
+		}
+
+		/**
+		* Returns the first node whose data is not ordered before key
+		*/
+		template<typename Key>
+		Node* LowerBound(const Key& key) const
+		{
+			Node* cur = _root;
+			Node* ret = NULL;
+			while (cur != NULL)
+			{
+				if (Compare()(cur->_data, key))
+					cur = Right(cur);
+				else
+				{
+					ret = cur;
+					cur = Left(cur);
+				}
+			}
+			return ret;
+		}
+
+		/**
+		* Returns the first node (in order) whose data is equal to key
+		*/
+		template<typename Key>
+		Node* Find(const Key& key) const
+		{
+			Node* ret = LowerBound(key);
+			return ret != NULL && !Compare()(key, ret->_data) ? ret : NULL;
+		}
+
+		/**
+		* Returns the node with the smallest data
+		*/
+		Node* Begin(Node* first) const
+		{
+			(void)first;
+			Node* node = _root;
+			if (node != NULL)
+			{
+				while (Left(node) != NULL)
+					node = Left(node);
+			}
+			return node;
+		}
+
+		/**
+		* Returns the in-order successor of node
+		*/
+		static Node* Next(Node* node)
+		{
+			if (Right(node) != NULL)
+			{
+				node = Right(node);
+				while (Left(node) != NULL)
+					node = Left(node);
+				return node;
+			}
+
+			Node* parent = Parent(node);
+			while (parent != NULL && node == Right(parent))
+			{
+				node = parent;
+				parent = Parent(parent);
+			}
+			return parent;
+		}
+	};
+};
+
+/**
+* Declares a hashed index. Hash and Equal are functor types (see THashMap.h and TCompare.h); to look
+* data up by a key other than T give Hash an overload for Key (hashing equal keys and data the same)
+* and Equal an overload for (T, Key). Duplicates are allowed. Iterating over a hashed index visits
+* the nodes in insertion order
+*/
+
+template<typename Hash, typename Equal>
+struct THashedIndex
+{
+	template<typename Node, int I>
+	class Impl
+	{
+	private:
+		Node** _buckets; /**< Chains of nodes (NULL until the first insert) */
+
+		size_t _bucketCount; /**< Number of buckets (0 or a power of two) */
+
+		int _shift; /**< 64 - log2(_bucketCount) */
+
+		size_t _count; /**< Number of nodes in the index */
+
+		static inline Node*& Chain(Node* node) { return node->_hooks[I]._left; }
+
+		/**
+		* Returns the bucket of a hash (Fibonacci hashing)
+		*/
+		inline size_t Bucket(size_t hash) const
+		{
+			return (size_t)(((uint64_t)hash * 11400714819323198485ULL) >> _shift);
+		}
+
+		/**
+		* Doubles the number of buckets and moves every node to its new bucket
+		*/
+		void Grow()
+		{
+			Node** old_buckets = _buckets;
+			size_t old_count = _bucketCount;
+
+			_bucketCount = _bucketCount ? _bucketCount * 2 : 16;
+			_shift = 64;
+			for (size_t i = _bucketCount; i > 1; i >>= 1)
+				_shift--;
+
+			_buckets = new Node*[_bucketCount];
+			memset(_buckets, 0, _bucketCount * sizeof(Node*));
+
+			for (size_t i = 0; i < old_count; i++)
+			{
+				Node* node = old_buckets[i];
+				while (node != NULL)
+				{
+					Node* next = Chain(node);
+					size_t bucket = Bucket(Hash()(node->_data));
+					Chain(node) = _buckets[bucket];
+					_buckets[bucket] = node;
+					node = next;
+				}
+			}
+			delete[] old_buckets;
+		}
+
+		Impl(const Impl&);
+		Impl& operator=(const Impl&);
+
+	public:
+		Impl()
+		{
+			_buckets = NULL;
+			_bucketCount = 0;
+			_shift = 64;
+			_count = 0;
+		}
+
+		~Impl()
+		{
+			delete[] _buckets;
+		}
+
+		/**
+		* Links a node into its bucket (growing to keep at most one node per bucket on average)
+		*/
+		void Insert(Node* node)
+		{
+			if (_count + 1 > _bucketCount)
+				Grow();
+
+			size_t bucket = Bucket(Hash()(node->_data));
+			Chain(node) = _buckets[bucket];
+			_buckets[bucket] = node;
+			_count++;
+		}
+
+		/**
+		* Unlinks a node from its bucket
+		*/
+		void Erase(Node* node)
+		{
+			Node** link = &_buckets[Bucket(Hash()(node->_data))];
+			while (*link != node)
+				link = &Chain(*link);
+
+			*link = Chain(node);
+			Chain(node) = NULL;
+			_count--;
+		}
+
+		/**
+		* Forgets every node (the buckets are kept)
+		*/
+		void Empty()
+		{
+			if (_buckets != NULL)
+				memset(_buckets, 0, _bucketCount * sizeof(Node*));
+			_count = 0;
+		}
+
+		/**
+		* Returns a node whose data is equal to key
+		*/
+		template<typename Key>
+		Node* Find(const Key& key) const
+		{
+			if (_count == 0)
+				return NULL;
+
+			for (Node* node = _buckets[Bucket(Hash()(key))]; node != NULL; node = Chain(node))
+			{
+				if (Equal()(node->_data, key))
+					return node;
+			}
+			return NULL;
+		}
+
+		/**
+		* Iteration is in insertion order so starts at the first node inserted
+		*/
+		Node* Begin(Node* first) const
+		{
+			return first;
+		}
+
+		static Node* Next(Node* node)
+		{
+			return node->_next;
+		}
+	};
+};
+
+/**
+* The list of indexes of a TMultiIndex, e.g. TIndexes<TOrderedIndex<ById>, THashedIndex<IdHash, IdEqual> >
+*/
+template<typename... Indexes>
+struct TIndexes
+{
+};
+
+
+
+/**
+* Iterates over the nodes of a TMultiIndex in the order of one index (see TMultiIndex::Begin)
+*/
+
+template<typename Node>
+class TMultiIndexIter
+{
+private:
+	Node* _current; /**< The current node (NULL when finished) */
+
+	Node* (*_next)(Node*); /**< Returns the node after a node in the order of the index */
+
+public:
+	/**
+	* Constructor which starts at a node
+	* @param first The first node (NULL for none)
+	* @param next The function returning the next node
+	*/
+	TMultiIndexIter(Node* first, Node* (*next)(Node*))
+	{
+		_current = first;
+		_next = next;
+	}
+
+	/**
+	* Returns true once every node has been visited
+	* @return Boolean
+	*/
+	inline bool IsFinished()
+	{
+		return _current == NULL;
+	}
+
+	/**
+	* Moves to the next node
+	*/
+	inline void Next()
+	{
+		if (_current != NULL)
+			_current = _next(_current);
+	}
+
+	/**
+	* Returns the current node (e.g. to pass to TMultiIndex::Erase after moving on)
+	* @return Pointer to the node (NULL if finished)
+	*/
+	inline Node* GetNode()
+	{
+		return _current;
+	}
+
+	/**
+	* Returns the data of the current node (must not be finished)
+	* @return Reference to the data
+	*/
+	inline typename Node::DataType& Value()
+	{
+		return _current->_data;
+	}
+
+	/**
+	* Overloaded operator to de-reference the iterator to the stored data
+	* @return Reference to the data
+	*/
+	typename Node::DataType& operator*()
+	{
+		return Value();
+	}
+};
+
+
+
+/**
+* A container holding each element once while keeping it in several indexes, declared at compile time
+* with TIndexes (ordered and/or hashed). Each element lives in a single node which embeds the links
+* of every index, so Insert makes one allocation and links it into all indexes, and Erase unlinks it
+* from all of them and frees it once. Look ups go through a chosen index (Find<I>), e.g.
+*
+*	TMultiIndex<TestClass*, TIndexes<TOrderedIndex<ById>, TOrderedIndex<ByName> > > objects;
+*	objects.Insert(obj);
+*	TestClass* named = objects.Find<1>("bob")->_data;
+*
+* Never change the keys of stored data in place - use Modify so every index is updated.
+* The optional Alloc parameter is the allocator used for the nodes (see TAllocator.h)
+*/
+
+template<typename T, typename IndexList, typename Alloc = TDefaultAllocator>
+class TMultiIndex;
+
+template<typename T, typename... Indexes, typename Alloc>
+class TMultiIndex<T, TIndexes<Indexes...>, Alloc>
+{
+public:
+	enum
+	{
+		INDEX_COUNT = sizeof...(Indexes) /**< Number of indexes */
+	};
+
+	typedef TMultiIndexNode<T, sizeof...(Indexes)> Node; /**< The node type (the handle of an element) */
+
+	typedef TMultiIndexIter<Node> Iter; /**< The iterator type */
+
+private:
+	/**
+	* Builds the tuple of index implementations, giving each its hook number
+	*/
+	template<typename Sequence>
+	struct ImplTuple;
+
+	template<size_t... Is>
+	struct ImplTuple<std::index_sequence<Is...> >
+	{
+		typedef std::tuple<typename Indexes::template Impl<Node, (int)Is>...> Type;
+	};
+
+	typedef std::index_sequence_for<Indexes...> Sequence;
+
+	Alloc _alloc; /**< The allocator the nodes are allocated from */
+
+	TDS_STAT(TContainerStats _stats;) /**< Instrumentation counters (only when TDS_ENABLE_STATS is defined) */
+
+	TDS_LATENCY(TLatencyRecorder _latency;) /**< Latency histograms (only when TDS_ENABLE_LATENCY is defined) */
+
+	typename ImplTuple<Sequence>::Type _indexes; /**< The state of every index */
+
+	Node* _first; /**< The first node in insertion order */
+
+	Node* _last; /**< The last node in insertion order */
+
+	int _count; /**< Number of elements */
+
+	unsigned int _seed; /**< State of the generator of node priorities */
+
+	template<size_t... Is>
+	void LinkAll(Node* node, std::index_sequence<Is...>)
+	{
+		int expand[] = { 0, (std::get<Is>(_indexes).Insert(node), 0)... };
+		(void)expand;
+	}
+
+	template<size_t... Is>
+	void UnlinkAll(Node* node, std::index_sequence<Is...>)
+	{
+		int expand[] = { 0, (std::get<Is>(_indexes).Erase(node), 0)... };
+		(void)expand;
+	}
+
+	template<size_t... Is>
+	void EmptyAll(std::index_sequence<Is...>)
+	{
+		int expand[] = { 0, (std::get<Is>(_indexes).Empty(), 0)... };
+		(void)expand;
+	}
+
+	/**
+	* Returns the next random priority (xorshift)
+	*/
+	inline unsigned int NextPriority()
+	{
+		_seed ^= _seed << 13;
+		_seed ^= _seed >> 17;
+		_seed ^= _seed << 5;
+		return _seed;
+	}
+
+	/**
+	* Sets every member to the empty state
+	*/
+	void Init()
+	{
+		_first = _last = NULL;
+		_count = 0;
+		_seed = 2463534242u;
+	}
+
+	/**
+	* The container owns its nodes so it can't be copied
+	*/
+	TMultiIndex(const TMultiIndex&);
+	TMultiIndex& operator=(const TMultiIndex&);
+
+public:
+	/**
+	* Default constructor
+	*/
+	TMultiIndex()
+	{
+		Init();
+	}
+
+	/**
+	* Overloaded constructor which takes the allocator the nodes will be allocated from
+	* @param alloc The allocator to copy into the container
+	*/
+	TMultiIndex(const Alloc& alloc) : _alloc(alloc)
+	{
+		Init();
+	}
+
+	/**
+	* Destructor which frees every node
+	*/
+	~TMultiIndex()
+	{
+		Empty();
+	}
+
+	/**
+	* Returns the allocator used by this container
+	* @return Reference to the allocator
+	*/
+	inline Alloc& GetAllocator()
+	{
+		return _alloc;
+	}
+
+	/**
+	* Returns the instrumentation counters of this container (all zero unless TDS_ENABLE_STATS is defined, see TStats.h)
+	* @return Reference to the stats
+	*/
+	inline const TContainerStats& GetStats() const
+	{
+#ifdef TDS_ENABLE_STATS
+		return _stats;
+#else
+		return TContainerStats::Disabled();
+#endif
+	}
+
+	/**
+	* Zeroes the instrumentation counters of this container
+	*/
+	inline void ResetStats()
+	{
+		TDS_STAT(_stats.Reset();)
+	}
+
+	/**
+	* Returns the latency histograms of this container (empty unless TDS_ENABLE_LATENCY is defined, see TLatency.h)
+	* @return Reference to the recorder (print it with Dump)
+	*/
+	inline const TLatencyRecorder& GetLatency() const
+	{
+#ifdef TDS_ENABLE_LATENCY
+		return _latency;
+#else
+		return TLatencyRecorder::Disabled();
+#endif
+	}
+
+	/**
+	* Empties the latency histograms of this container
+	*/
+	inline void ResetLatency()
+	{
+		TDS_LATENCY(_latency.Reset();)
+	}
+
+	/**
+	* Sets how many calls are made for every one that is timed (does nothing unless TDS_ENABLE_LATENCY is defined)
+	* @param rate 1 to time every call (the default unless TLATENCY_SAMPLE_RATE is defined), n to time one in n, 0 to stop timing
+	*/
+	inline void SetLatencySampleRate(unsigned int rate)
+	{
+		TDS_LATENCY(_latency.SetSampleRate(rate);)
+		(void)rate;
+	}
+
+	/**
+	* Returns the number of elements
+	* @return Count
+	*/
+	inline int Count() const
+	{
+		return _count;
+	}
+
+	/**
+	* Returns true if there are no elements
+	* @return Boolean
+	*/
+	inline bool IsEmpty() const
+	{
+		return _count == 0;
+	}
+
+	/**
+	* Stores data once and links it into every index
+	* @param data The data to insert
+	* @return The node holding the data (its handle for Erase and Modify)
+	*/
+	Node* Insert(const T& data)
+	{
+		TDS_LATENCY(TLatencyScope latency(_latency, TLATENCY_INSERT);)
+
+		Node* node = TAllocNode<Node>(_alloc);
+		TDS_STAT(_stats._allocations++;)
+		TDS_STAT(_stats._insert.Record(0, 0);)
+
+		node->_data = data;
+		node->_priority = NextPriority();
+
+		node->_prev = _last;
+		if (_last != NULL)
+			_last->_next = node;
+		else
+			_first = node;
+		_last = node;
+
+		LinkAll(node, Sequence());
+		_count++;
+		return node;
+	}
+
+	/**
+	* Unlinks a node from every index and frees it
+	* @param node The node to erase (from Insert, Find or an iterator)
+	*/
+	void Erase(Node* node)
+	{
+		TDS_LATENCY(TLatencyScope latency(_latency, TLATENCY_REMOVE);)
+
+		UnlinkAll(node, Sequence());
+
+		if (node->_prev != NULL)
+			node->_prev->_next = node->_next;
+		else
+			_first = node->_next;
+		if (node->_next != NULL)
+			node->_next->_prev = node->_prev;
+		else
+			_last = node->_prev;
+
+		TDS_STAT(_stats._remove.Record(0, 0);)
+		TDS_STAT(_stats._frees++;)
+		TFreeNode(_alloc, node);
+		_count--;
+	}
+
+	/**
+	* Replaces the data of a node and moves it to its new place in every index (no allocation)
+	* @param node The node to change
+	* @param data The new data
+	*/
+	void Modify(Node* node, const T& data)
+	{
+		UnlinkAll(node, Sequence());
+		node->_data = data;
+		LinkAll(node, Sequence());
+	}
+
+	/**
+	* Finds an element through index I (the first in order for ordered indexes)
+	* @param key The key (T or any key the index functors accept)
+	* @return The node (NULL if not found)
+	*/
+	template<int I, typename Key>
+	Node* Find(const Key& key)
+	{
+		TDS_LATENCY(TLatencyScope latency(_latency, TLATENCY_FIND);)
+
+		TDS_STAT(_stats._find.Record(0, 0);)
+		return std::get<I>(_indexes).Find(key);
+	}
+
+	/**
+	* Finds an element through index I and erases it from every index
+	* @param key The key (T or any key the index functors accept)
+	* @return True if an element was found and erased
+	*/
+	template<int I, typename Key>
+	bool Remove(const Key& key)
+	{
+		TDS_LATENCY(TLatencyScope latency(_latency, TLATENCY_REMOVE);)
+
+		Node* node = std::get<I>(_indexes).Find(key);
+		if (node == NULL)
+			return false;
+		Erase(node);
+		return true;
+	}
+
+	/**
+	* Returns an iterator over index I (sorted order for ordered indexes, insertion order for hashed ones)
+	* @return The iterator
+	*/
+	template<int I>
+	Iter Begin()
+	{
+		typedef typename std::tuple_element<I, typename ImplTuple<Sequence>::Type>::type Index;
+		return Iter(std::get<I>(_indexes).Begin(_first), Index::Next);
+	}
+
+	/**
+	* Returns an iterator over ordered index I starting at the first element not ordered before key
+	* @param key The key (T or any key the index functors accept)
+	* @return The iterator
+	*/
+	template<int I, typename Key>
+	Iter LowerBound(const Key& key)
+	{
+		typedef typename std::tuple_element<I, typename ImplTuple<Sequence>::Type>::type Index;
+		return Iter(std::get<I>(_indexes).LowerBound(key), Index::Next);
+	}
+
+	/**
+	* Frees every node. Note that if T is a pointer the memory it points to is not freed
+	*/
+	void Empty()
+	{
+		TDS_LATENCY(TLatencyScope latency(_latency, TLATENCY_EMPTY);)
+
+		if (!TCanDropNodes<Node, Alloc>())
+		{
+			Node* node = _first;
+			while (node != NULL)
+			{
+				Node* next = node->_next;
+				TDS_STAT(_stats._frees++;)
+				TFreeNode(_alloc, node);
+				node = next;
+			}
+		}
+
+		EmptyAll(Sequence());
+		Init();
+	}
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,544 @@
+#ifndef TPERSISTENTTREE_H
+#define TPERSISTENTTREE_H
+
+/* Include for TStack */
+#include "TStack.h"
+
+/* Include for the node allocators */
+#include "TAllocator.h"
+
+/* Include for the reference counts */
+#include <atomic>
+
+/* Forward Decl */
+template<typename T> class TPersistentTreeIter;
+
+/* Definitions and macros */
+#ifndef NULL
+#define NULL 0
+#endif
+
+/**
+* Macro to iterate over a persistent tree (that is not a pointer) in order
+*/
+#define TPERSISTENTTREE_foreach(Type, name, in_tree) for (TPersistentTreeIter<Type> name = TPersistentTreeIter<Type>(&in_tree); !name.IsFinished(); name.Next())
+
+/**
+* A node of a TPersistentTree. Nodes never change once they are linked into a version, they are
+* shared by every version that reaches them and freed when the last of those versions goes away
+*/
+
+template<typename T>
+struct TPersistentNode
+{
+	T _data; /**< The data that this node stores */
+
+	unsigned int _priority; /**< Random heap priority (the tree is a treap) */
+
+	TPersistentNode<T>* _left; /**< The subtree of data ordered before (or equal to) _data (may be NULL) */
+	TPersistentNode<T>* _right; /**< The subtree of data ordered after (or equal to) _data (may be NULL) */
+
+	std::atomic<int> _refs; /**< Number of versions and parent nodes referencing this node */
+
+	/**
+	* The default constructor of TPersistentNode which initilizes all pointers to NULL
+	*/
+	TPersistentNode() : _refs(1)
+	{
+		_priority = 0;
+		_left = _right = NULL;
+	}
+};
+
+
+/**
+* A persistent (immutable) binary tree. Every TPersistentTree object is one version of the tree:
+* Insert and Remove never change it but return a new version which copies only the O(log n) nodes
+* on the path to the change and shares every other subtree with the old version. Copying a version
+* (or calling Snapshot) is O(1) so a reader can hold on to a consistent point in time view for as
+* long as it likes while writers keep producing new versions:
+*
+*	TPersistentTree<int> tree(CompareInt);
+*	tree = tree.Insert(5);
+*	TPersistentTree<int> snapshot = tree.Snapshot();
+*	tree = tree.Remove(5); //snapshot still holds 5
+*
+* The tree is kept balanced as a treap (random priorities) and shared nodes are reference counted,
+* so a node is freed by whichever version releases it last. Versions can be copied, read and
+* destroyed on any thread without locks. A single TPersistentTree object is a plain value though,
+* so a writer publishing new versions to readers through one shared variable should guard that
+* variable with a mutex held only while the handle is copied (see the stress test); the readers
+* then walk their copies without any lock. The comparison function works like the one of TTree
+* (-1 goes left, 0 or 1 goes right). Alloc must be stateless and safe to use from any thread (e.g.
+* TDefaultAllocator or TThreadCacheAllocator) as nodes may be freed by any version on any thread
+*/
+
+template<typename T, typename Alloc = TDefaultAllocator>
+class TPersistentTree
+{
+	friend class TPersistentTreeIter<T>;
+private:
+	typedef TPersistentNode<T> Node;
+
+	mutable Alloc _alloc; /**< The allocator the nodes are allocated from (stateless, so sharing it between versions is safe) */
+
+	Node* _root; /**< The root of this version (holds one reference) */
+
+	int _count; /**< The number of nodes in this version */
+
+	int(*_comparison)(T, T); /**< A Pointer to the specified comparison function (must not be a method of a class) the function should return -1 if lhs < rhs, 0 if lhs == rhs or 1 if lhs > rhs */
+
+	/**
+	* Returns the next random priority (xorshift, one generator per thread so writers on
+	* different threads never share state)
+	*/
+	static unsigned int NextPriority()
+	{
+		static thread_local unsigned int seed = 2463534242u;
+		seed ^= seed << 13;
+		seed ^= seed >> 17;
+		seed ^= seed << 5;
+		return seed;
+	}
+
+	/**
+	* Adds a reference to node
+	* @param node The node (can be NULL)
+	* @return The node
+	*/
+	static inline Node* Retain(Node* node)
+	{
+		if (node != NULL)
+			node->_refs.fetch_add(1, std::memory_order_relaxed);
+		return node;
+	}
+
+	/**
+	* Drops a reference to node, freeing it and releasing its children if it was the last one
+	* @param node The node (can be NULL)
+	*/
+	void Release(Node* node) const
+	{
+		TStack<Node*> pending;
+		TDS_LATENCY(pending.SetLatencySampleRate(0);)
+		while (node != NULL)
+		{
+			if (node->_refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+			{
+				if (node->_left != NULL)
+					pending.Push(node->_left);
+				if (node->_right != NULL)
+					pending.Push(node->_right);
+				TFreeNode(_alloc, node);
+			}
+			node = pending.Pop();
+		}
+	}
+
+	/**
+	* Allocates a node which takes over the given references to its children
+	* @param data The data of the node
+	* @param priority The priority of the node
+	* @param left The left child (owned reference, can be NULL)
+	* @param right The right child (owned reference, can be NULL)
+	* @return The node with one reference
+	*/
+	Node* NewNode(const T& data, unsigned int priority, Node* left, Node* right) const
+	{
+		Node* node = TAllocNode<Node>(_alloc);
+		node->_data = data;
+		node->_priority = priority;
+		node->_left = left;
+		node->_right = right;
+		return node;
+	}
+
+	/**
+	* Copies node with new children (the path copying step)
+	* @param node The node to copy
+	* @param left The left child of the copy (owned reference)
+	* @param right The right child of the copy (owned reference)
+	* @return The copy with one reference
+	*/
+	inline Node* CopyNode(Node* node, Node* left, Node* right) const
+	{
+		return NewNode(node->_data, node->_priority, left, right);
+	}
+
+	/**
+	* Splits the subtree at node into the data ordered before key or equal to it and the data
+	* ordered after key. node is only read, the results are new references
+	* @param node The subtree to split (can be NULL)
+	* @param key The key to split at
+	* @param lo Set to the subtree of data not ordered after key
+	* @param hi Set to the subtree of data ordered after key
+	*/
+	void Split(Node* node, const T& key, Node*& lo, Node*& hi) const
+	{
+		if (node == NULL)
+		{
+			lo = hi = NULL;
+		}
+		else if (_comparison(key, node->_data) <= -1)
+		{
+			Node* left;
+			Split(node->_left, key, lo, left);
+			hi = CopyNode(node, left, Retain(node->_right));
+		}
+		else
+		{
+			Node* right;
+			Split(node->_right, key, right, hi);
+			lo = CopyNode(node, Retain(node->_left), right);
+		}
+	}
+
+	/**
+	* Joins two subtrees where all of lhs is ordered before all of rhs. Both are only read
+	* @param lhs The left subtree (can be NULL)
+	* @param rhs The right subtree (can be NULL)
+	* @return The joined subtree (a new reference)
+	*/
+	Node* Merge(Node* lhs, Node* rhs) const
+	{
+		if (lhs == NULL)
+			return Retain(rhs);
+		if (rhs == NULL)
+			return Retain(lhs);
+
+		if (lhs->_priority > rhs->_priority)
+			return CopyNode(lhs, Retain(lhs->_left), Merge(lhs->_right, rhs));
+		return CopyNode(rhs, Merge(lhs, rhs->_left), Retain(rhs->_right));
+	}
+
+	/**
+	* Returns a copy of the subtree at node with data inserted
+	* @param node The subtree (only read, can be NULL)
+	* @param data The data to insert
+	* @param priority The priority of the new node
+	* @return The new subtree (a new reference)
+	*/
+	Node* InsertNode(Node* node, const T& data, unsigned int priority) const
+	{
+		if (node == NULL || priority > node->_priority)
+		{
+			//the new node becomes the root of this subtree
+			Node* lo;
+			Node* hi;
+			Split(node, data, lo, hi);
+			return NewNode(data, priority, lo, hi);
+		}
+
+		if (_comparison(data, node->_data) <= -1)
+			return CopyNode(node, InsertNode(node->_left, data, priority), Retain(node->_right));
+		return CopyNode(node, Retain(node->_left), InsertNode(node->_right, data, priority));
+	}
+
+	/**
+	* Returns a copy of the subtree at node without the first node Find would reach for data
+	* (which must exist)
+	* @param node The subtree (only read)
+	* @param data The data to remove
+	* @return The new subtree (a new reference)
+	*/
+	Node* RemoveNode(Node* node, const T& data) const
+	{
+		int result = _comparison(data, node->_data);
+		if (result == 0)
+			return Merge(node->_left, node->_right);
+		if (result <= -1)
+			return CopyNode(node, RemoveNode(node->_left, data), Retain(node->_right));
+		return CopyNode(node, Retain(node->_left), RemoveNode(node->_right, data));
+	}
+
+	/**
+	* Constructor used by Insert and Remove for the versions they return
+	* @param root The root of the version (an owned reference)
+	* @param count The number of nodes in the version
+	* @param comparison The comparison function
+	*/
+	TPersistentTree(Node* root, int count, int(*comparison)(T, T))
+	{
+		_root = root;
+		_count = count;
+		_comparison = comparison;
+	}
+
+public:
+	/**
+	* Default constructor of an empty tree. Note that the comparison function must be set
+	* before use (see SetComparisonFunc)
+	*/
+	TPersistentTree()
+	{
+		_root = NULL;
+		_count = 0;
+		_comparison = NULL;
+	}
+
+	/**
+	* Overloaded constructor of an empty tree which takes the comparison function
+	* @param comparison The comparison function (return -1 if lhs < rhs, 0 if equal or 1 if lhs > rhs)
+	*/
+	TPersistentTree(int(*comparison)(T, T))
+	{
+		_root = NULL;
+		_count = 0;
+		_comparison = comparison;
+	}
+
+	/**
+	* Copy constructor which shares the version of other (O(1))
+	* @param other The version to share
+	*/
+	TPersistentTree(const TPersistentTree& other)
+	{
+		_root = Retain(other._root);
+		_count = other._count;
+		_comparison = other._comparison;
+	}
+
+	/**
+	* Assignment which releases this version and shares the version of other (O(1) plus freeing
+	* any nodes only this version was holding)
+	* @param other The version to share
+	* @return This tree
+	*/
+	TPersistentTree& operator=(const TPersistentTree& other)
+	{
+		Node* old = _root;
+		_root = Retain(other._root);
+		_count = other._count;
+		_comparison = other._comparison;
+		Release(old);
+		return *this;
+	}
+
+	/**
+	* Default destructor which releases this version
+	*/
+	~TPersistentTree()
+	{
+		Release(_root);
+	}
+
+	/**
+	* Sets the comparison function of this version (and of the versions derived from it)
+	* @param comparison The comparison function (return -1 if lhs < rhs, 0 if equal or 1 if lhs > rhs)
+	*/
+	inline void SetComparisonFunc(int(*comparison)(T, T))
+	{
+		_comparison = comparison;
+	}
+
+	/**
+	* Returns this version (O(1), the same as copying the tree)
+	* @return The snapshot
+	*/
+	inline TPersistentTree Snapshot() const
+	{
+		return *this;
+	}
+
+	/**
+	* Returns a new version with data inserted (duplicates are kept). This version is unchanged
+	* @param data The data to insert
+	* @return The new version
+	*/
+	TPersistentTree Insert(T data) const
+	{
+		return TPersistentTree(InsertNode(_root, data, NextPriority()), _count + 1, _comparison);
+	}
+
+	/**
+	* Returns a new version without data (one copy of it if it was inserted more than once).
+	* This version is unchanged
+	* @param data The data to remove
+	* @return The new version (a snapshot of this one if data is not in the tree)
+	*/
+	TPersistentTree Remove(T data) const
+	{
+		if (Find(data) == NULL)
+			return *this;
+		return TPersistentTree(RemoveNode(_root, data), _count - 1, _comparison);
+	}
+
+	/**
+	* Finds data in this version
+	* @param obj The data to find
+	* @return Pointer to the stored data (NULL if not found). It stays valid while any version holding it exists
+	*/
+	const T* Find(T obj) const
+	{
+		Node* cur = _root;
+		while (cur != NULL)
+		{
+			int result = _comparison(obj, cur->_data);
+			if (result == 0)
+				return &cur->_data;
+			cur = result <= -1 ? cur->_left : cur->_right;
+		}
+		return NULL;
+	}
+
+	/**
+	* Finds data by an id with a search function (see TTree::Find)
+	* @param id The id that will be passed into the left hand side (first arg) of the search function
+	* @param SearchFunc Pointer to the search function (return -1 if id < rhs, 0 if equal or 1 if id > rhs)
+	* @return The data (default value if not found)
+	*/
+	template<typename IDType>
+	T Find(IDType id, int(*SearchFunc)(IDType, T)) const
+	{
+		Node* cur = _root;
+		while (cur != NULL)
+		{
+			int result = SearchFunc(id, cur->_data);
+			if (result == 0)
+				return cur->_data;
+			cur = result <= -1 ? cur->_left : cur->_right;
+		}
+		return T();
+	}
+
+	/**
+	* Returns the number of nodes in this version
+	* @return Integer
+	*/
+	inline int Count() const
+	{
+		return _count;
+	}
+
+	/**
+	* Returns true if this version is empty
+	* @return Boolean
+	*/
+	inline bool IsEmpty() const
+	{
+		return _count == 0;
+	}
+
+	/**
+	* Returns the exact height of this version (number of nodes on the longest root to leaf path)
+	* @return Integer
+	*/
+	int Height() const
+	{
+		struct Frame
+		{
+			Node* _node;
+			int _depth;
+		};
+
+		int height = 0;
+		TStack<Frame> frames;
+		TDS_LATENCY(frames.SetLatencySampleRate(0);)
+		Frame f = { _root, 1 };
+		while (f._node != NULL)
+		{
+			if (f._depth > height)
+				height = f._depth;
+			if (f._node->_left != NULL)
+			{
+				Frame left = { f._node->_left, f._depth + 1 };
+				frames.Push(left);
+			}
+			if (f._node->_right != NULL)
+			{
+				Frame right = { f._node->_right, f._depth + 1 };
+				frames.Push(right);
+			}
+			f = frames.Pop();
+		}
+		return height;
+	}
+};
+
+
+/**
+* Iterator which visits the data of one version of a TPersistentTree in order. The version
+* must outlive the iterator
+*/
+
+template<typename T>
+class TPersistentTreeIter
+{
+private:
+	TStack<TPersistentNode<T>*> _stack; /**< The ancestors still to visit */
+
+	TPersistentNode<T>* _current; /**< The current node this iterator is at */
+
+	/**
+	* Pushes node and its chain of left children on the stack
+	* @param node The node (can be NULL)
+	*/
+	inline void PushLeft(TPersistentNode<T>* node)
+	{
+		while (node != NULL)
+		{
+			_stack.Push(node);
+			node = node->_left;
+		}
+	}
+public:
+	/**
+	* Default constructor of a finished iterator
+	*/
+	TPersistentTreeIter()
+	{
+		_current = NULL;
+		TDS_LATENCY(_stack.SetLatencySampleRate(0);)
+	}
+
+	/**
+	* Overloaded constructor which takes the version to iterate over as a pointer
+	* @param tree The pointer to the version in which this iterator will loop through
+	*/
+	template<typename Alloc>
+	TPersistentTreeIter(const TPersistentTree<T, Alloc>* tree)
+	{
+		//the stack is internal so its pushes and pops stay out of the latency histograms
+		TDS_LATENCY(_stack.SetLatencySampleRate(0);)
+		PushLeft(tree->_root);
+		_current = _stack.Pop();
+	}
+
+	/**
+	* Returns true if the iterator as finished iterating over the tree
+	* @return Boolean
+	*/
+	inline bool IsFinished() const
+	{
+		return _current == NULL;
+	}
+
+	/**
+	* Moves the iterator to the next node in order
+	*/
+	inline void Next()
+	{
+		PushLeft(_current->_right);
+		_current = _stack.Pop();
+	}
+
+	/**
+	* Returns the data stored in the current node (its default value if finished)
+	* @return The Data
+	*/
+	inline T Value() const
+	{
+		return _current != NULL ? _current->_data : T();
+	}
+
+	/**
+	* Overloaded operator to de-reference the iterator to the stored data
+	* @return The Data
+	*/
+	inline T operator*() const
+	{
+		return Value();
+	}
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,894 @@
+#ifndef TPRIORITYQUEUE_H
+#define TPRIORITYQUEUE_H
+
+/* Include for the allocators */
+#include "TAllocator.h"
+
+/* Include for the instrumentation counters */
+#include "TStats.h"
+
+/* Include for the latency histograms */
+#include "TLatency.h"
+
+/* Include for the default ordering */
+#include "TCompare.h"
+
+/* Include for the aggregate kernels */
+#include "TSimd.h"
+
+/* Include for std::move */
+#include <utility>
+
+/* Definitions and macros */
+#ifndef NULL
+#define NULL 0
+#endif
+
+/**
+* A priority queue stored as a d-ary heap in one contiguous array (no allocation per element).
+* Top and Pop return the element ordered first by Compare (so with TLess it is a min queue).
+* Compare is a functor type (see TCompare.h) and D is the number of children per heap node - 4
+* halves the height of a binary heap and keeps the children of a node in one cache line for small
+* T, which makes Pop faster. The array is allocated from Alloc (see TAllocator.h).
+*/
+
+template<typename T, typename Compare = TLess<T>, int D = 4, typename Alloc = TDefaultAllocator>
+class TPriorityQueue
+{
+	static_assert(D >= 2, "a heap needs at least 2 children per node");
+
+private:
+	Alloc _alloc; /**< The allocator the array is allocated from */
+
+	TDS_STAT(TContainerStats _stats;) /**< Instrumentation counters (only when TDS_ENABLE_STATS is defined) */
+
+	TDS_LATENCY(TLatencyRecorder _latency;) /**< Latency histograms (only when TDS_ENABLE_LATENCY is defined) */
+
+	T* _data; /**< The heap (element 0 is the top) */
+
+	int _count; /**< Number of elements */
+
+	int _capacity; /**< Number of elements _data can hold */
+
+	/**
+	* Moves the elements to an array of the given capacity
+	* @param capacity The new capacity (at least _count)
+	*/
+	void Grow(int capacity)
+	{
+		T* data = (T*)_alloc.Allocate(capacity * sizeof(T));
+		TDS_STAT(_stats._allocations++;)
+		for (int i = 0; i < _count; i++)
+		{
+			new(&data[i]) T(std::move(_data[i]));
+			_data[i].~T();
+		}
+
+		if (_data != NULL)
+		{
+			TDS_STAT(_stats._frees++;)
+			_alloc.Free(_data, _capacity * sizeof(T));
+		}
+		_data = data;
+		_capacity = capacity;
+	}
+
+	/**
+	* Moves the element at pos towards the top until its parent is ordered before it
+	* @param pos The position of the element
+	*/
+	void SiftUp(int pos)
+	{
+		T value = std::move(_data[pos]);
+		SiftUp(pos, value);
+	}
+
+	/**
+	* Places value at the hole at pos, moving the hole towards the top until its parent is ordered before value
+	* @param pos The position of the hole
+	* @param value The value to place
+	*/
+	void SiftUp(int pos, T& value)
+	{
+		//work on a local copy of the pointer so writes through it don't force it to be reloaded
+		T* data = _data;
+		while (pos > 0)
+		{
+			int parent = (pos - 1) / D;
+			TDS_STAT(_stats._comparisons++;)
+			if (!Compare()(value, data[parent]))
+				break;
+			data[pos] = std::move(data[parent]);
+			pos = parent;
+		}
+		data[pos] = std::move(value);
+	}
+
+	/**
+	* Returns the position of the child ordered first among the children starting at first
+	* @param data The heap
+	* @param first The position of the first child
+	* @param count The number of elements in the heap
+	* @return Position of the child
+	*/
+	inline int BestChild(T* data, int first, int count)
+	{
+		const T* best = data + first;
+		if (first + D <= count)
+		{
+			//a full set of children - a fixed trip count the compiler can unroll
+			for (int i = 1; i < D; i++)
+			{
+				if (Compare()(data[first + i], *best))
+					best = data + first + i;
+			}
+			TDS_STAT(_stats._comparisons += D - 1;)
+		}
+		else
+		{
+			for (int i = first + 1; i < count; i++)
+			{
+				if (Compare()(data[i], *best))
+					best = data + i;
+			}
+			TDS_STAT(_stats._comparisons += count - first - 1;)
+		}
+		return (int)(best - data);
+	}
+
+	/**
+	* Moves the element at pos away from the top until none of its children are ordered before it
+	* @param pos The position of the element
+	*/
+	void SiftDown(int pos)
+	{
+		T* data = _data;
+		int count = _count;
+		T value = std::move(data[pos]);
+		for (;;)
+		{
+			int first = pos * D + 1;
+			if (first >= count)
+				break;
+
+			int best = BestChild(data, first, count);
+			TDS_STAT(_stats._comparisons++;)
+			if (!Compare()(data[best], value))
+				break;
+			data[pos] = std::move(data[best]);
+			pos = best;
+		}
+		data[pos] = std::move(value);
+	}
+
+	/**
+	* Orders the whole array as a heap in O(n) (Floyd's method)
+	*/
+	void Heapify()
+	{
+		for (int i = (_count - 2) / D; i >= 0; i--)
+			SiftDown(i);
+	}
+
+	/**
+	* The queue owns its array so it can't be copied
+	*/
+	TPriorityQueue(const TPriorityQueue&);
+	TPriorityQueue& operator=(const TPriorityQueue&);
+
+public:
+	/**
+	* Default constructor (nothing is allocated until the first push or Reserve)
+	*/
+	TPriorityQueue()
+	{
+		_data = NULL;
+		_count = _capacity = 0;
+	}
+
+	/**
+	* Overloaded constructor which takes the allocator the array will be allocated from
+	* @param alloc The allocator to copy into the queue
+	*/
+	TPriorityQueue(const Alloc& alloc) : _alloc(alloc)
+	{
+		_data = NULL;
+		_count = _capacity = 0;
+	}
+
+	/**
+	* Destructor which destroys every element and frees the array
+	*/
+	~TPriorityQueue()
+	{
+		Empty();
+		if (_data != NULL)
+			_alloc.Free(_data, _capacity * sizeof(T));
+	}
+
+	/**
+	* Returns the allocator used by this queue
+	* @return Reference to the allocator
+	*/
+	inline Alloc& GetAllocator()
+	{
+		return _alloc;
+	}
+
+	/**
+	* Returns the instrumentation counters of this queue (all zero unless TDS_ENABLE_STATS is defined, see TStats.h)
+	* @return Reference to the stats
+	*/
+	inline const TContainerStats& GetStats() const
+	{
+#ifdef TDS_ENABLE_STATS
+		return _stats;
+#else
+		return TContainerStats::Disabled();
+#endif
+	}
+
+	/**
+	* Zeroes the instrumentation counters of this queue
+	*/
+	inline void ResetStats()
+	{
+		TDS_STAT(_stats.Reset();)
+	}
+
+	/**
+	* Returns the latency histograms of this queue (empty unless TDS_ENABLE_LATENCY is defined, see TLatency.h)
+	* @return Reference to the recorder (print it with Dump)
+	*/
+	inline const TLatencyRecorder& GetLatency() const
+	{
+#ifdef TDS_ENABLE_LATENCY
+		return _latency;
+#else
+		return TLatencyRecorder::Disabled();
+#endif
+	}
+
+	/**
+	* Empties the latency histograms of this queue
+	*/
+	inline void ResetLatency()
+	{
+		TDS_LATENCY(_latency.Reset();)
+	}
+
+	/**
+	* Sets how many calls are made for every one that is timed (does nothing unless TDS_ENABLE_LATENCY is defined)
+	* @param rate 1 to time every call (the default unless TLATENCY_SAMPLE_RATE is defined), n to time one in n, 0 to stop timing
+	*/
+	inline void SetLatencySampleRate(unsigned int rate)
+	{
+		TDS_LATENCY(_latency.SetSampleRate(rate);)
+		(void)rate;
+	}
+
+	/**
+	* Returns the number of elements
+	* @return Count
+	*/
+	inline int Count() const
+	{
+		return _count;
+	}
+
+	/**
+	* Returns true if the queue is empty
+	* @return Boolean
+	*/
+	inline bool IsEmpty() const
+	{
+		return _count == 0;
+	}
+
+	/**
+	* Returns the sum of every element (SSE2/AVX2 for int and float, see TSimd.h)
+	* @return The sum
+	*/
+	typename TSumType<T>::Type Sum() const
+	{
+		return TSum(_data, (size_t)_count);
+	}
+
+	/**
+	* Finds the smallest and largest element by operator< (SSE2/AVX2 for int and float)
+	* @param min Receives the smallest element
+	* @param max Receives the largest element
+	* @return False if the queue is empty
+	*/
+	bool MinMax(T& min, T& max) const
+	{
+		return TMinMax(_data, (size_t)_count, min, max);
+	}
+
+	/**
+	* Counts the elements pred is true for (vectorized for TInRange of int and float)
+	* @param pred Predicate functor
+	* @return Number of matching elements
+	*/
+	template<typename Pred>
+	int CountIf(Pred pred) const
+	{
+		return (int)TCountIf(_data, (size_t)_count, pred);
+	}
+
+	/**
+	* Copies the elements pred is true for to out in heap (not priority) order (vectorized for
+	* TInRange of int and float)
+	* @param pred Predicate functor
+	* @param out Receives the matching elements (must have room for Count() elements)
+	* @return Number of elements copied
+	*/
+	template<typename Pred>
+	int FilterInto(Pred pred, T* out) const
+	{
+		return (int)TFilterInto(_data, (size_t)_count, pred, out);
+	}
+
+	/**
+	* Grows the array so it can hold count elements without growing again
+	* @param count The number of elements
+	*/
+	void Reserve(int count)
+	{
+		if (count > _capacity)
+			Grow(count);
+	}
+
+	/**
+	* Adds an element in O(log n)
+	* @param data The element
+	*/
+	void Push(const T& data)
+	{
+		TDS_LATENCY(TLatencyScope latency(_latency, TLATENCY_INSERT);)
+
+		if (_count == _capacity)
+			Grow(_capacity ? _capacity * 2 : 16);
+
+		new(&_data[_count]) T(data);
+		SiftUp(_count++);
+		TDS_STAT(_stats._insert.Record(0, 0);)
+	}
+
+	/**
+	* Adds count elements at once. If that at least doubles the queue the whole heap is rebuilt in
+	* O(n), otherwise they are pushed one by one
+	* @param data The elements
+	* @param count The number of elements
+	*/
+	void PushMany(const T* data, int count)
+	{
+		TDS_LATENCY(TLatencyScope latency(_latency, TLATENCY_INSERT);)
+
+		if (count <= 0)
+			return;
+
+		Reserve(_count + count);
+		if (count < _count)
+		{
+			for (int i = 0; i < count; i++)
+			{
+				new(&_data[_count]) T(data[i]);
+				SiftUp(_count++);
+			}
+			return;
+		}
+
+		for (int i = 0; i < count; i++)
+			new(&_data[_count++]) T(data[i]);
+		Heapify();
+	}
+
+	/**
+	* Returns the element ordered first without removing it
+	* @return The element (default value if the queue is empty)
+	*/
+	T Top()
+	{
+		T ret = T();
+		if (_count > 0)
+			ret = _data[0];
+		return ret;
+	}
+
+	/**
+	* Removes and returns the element ordered first in O(D log n)
+	* @return The element (default value if the queue is empty)
+	*/
+	T Pop()
+	{
+		TDS_LATENCY(TLatencyScope latency(_latency, TLATENCY_REMOVE);)
+
+		T ret = T();
+		if (_count == 0)
+			return ret;
+
+		ret = std::move(_data[0]);
+		_count--;
+		if (_count == 0)
+		{
+			_data[0].~T();
+			TDS_STAT(_stats._remove.Record(0, 0);)
+			return ret;
+		}
+
+		//move the hole at the top down to a leaf along the children ordered first, then fill it with
+		//the last element from there (it almost always belongs near the bottom so this saves comparisons)
+		T* data = _data;
+		int count = _count;
+		T last = std::move(data[count]);
+		data[count].~T();
+
+		int pos = 0;
+		for (;;)
+		{
+			int first = pos * D + 1;
+			if (first >= count)
+				break;
+
+			int best = BestChild(data, first, count);
+			data[pos] = std::move(data[best]);
+			pos = best;
+		}
+		SiftUp(pos, last);
+
+		TDS_STAT(_stats._remove.Record(0, 0);)
+		return ret;
+	}
+
+	/**
+	* Removes every element (the array keeps its capacity)
+	*/
+	void Empty()
+	{
+		TDS_LATENCY(TLatencyScope latency(_latency, TLATENCY_EMPTY);)
+
+		for (int i = 0; i < _count; i++)
+			_data[i].~T();
+		_count = 0;
+	}
+};
+
+
+
+/**
+* A d-ary heap priority queue where every element gets a handle when it is pushed, so it can later
+* be re-prioritized (DecreaseKey / Update) or erased in O(log n) without searching for it. Handles
+* are small integers that are reused once their element has left the queue.
+*/
+
+template<typename T, typename Compare = TLess<T>, int D = 4, typename Alloc = TDefaultAllocator>
+class TIndexedPriorityQueue
+{
+	static_assert(D >= 2, "a heap needs at least 2 children per node");
+
+private:
+	/**
+	* An element of the heap and the handle it was pushed with
+	*/
+	struct Entry
+	{
+		T _data;
+		int _handle;
+	};
+
+	Alloc _alloc; /**< The allocator the arrays are allocated from */
+
+	TDS_STAT(TContainerStats _stats;) /**< Instrumentation counters (only when TDS_ENABLE_STATS is defined) */
+
+	TDS_LATENCY(TLatencyRecorder _latency;) /**< Latency histograms (only when TDS_ENABLE_LATENCY is defined) */
+
+	Entry* _heap; /**< The heap (entry 0 is the top) */
+
+	int _count; /**< Number of elements */
+
+	int _capacity; /**< Number of entries _heap can hold */
+
+	int* _positions; /**< Position in _heap of the element of each handle (-1 if the handle is free) */
+
+	int* _freeHandles; /**< Stack of handles that can be reused */
+
+	int _freeCount; /**< Number of handles on _freeHandles */
+
+	int _handleCount; /**< Number of handles ever given out (the size of _positions in use) */
+
+	/**
+	* Allocates an array from the allocator and moves count elements of old into it
+	*/
+	template<typename E>
+	E* GrowArray(E* old, int count, int oldCapacity, int capacity)
+	{
+		E* data = (E*)_alloc.Allocate(capacity * sizeof(E));
+		TDS_STAT(_stats._allocations++;)
+		for (int i = 0; i < count; i++)
+		{
+			new(&data[i]) E(std::move(old[i]));
+			old[i].~E();
+		}
+		if (old != NULL)
+		{
+			TDS_STAT(_stats._frees++;)
+			_alloc.Free(old, oldCapacity * sizeof(E));
+		}
+		return data;
+	}
+
+	/**
+	* Grows every array so capacity elements fit
+	*/
+	void Grow(int capacity)
+	{
+		_heap = GrowArray(_heap, _count, _capacity, capacity);
+		_positions = GrowArray(_positions, _handleCount, _capacity, capacity);
+		_freeHandles = GrowArray(_freeHandles, _freeCount, _capacity, capacity);
+		_capacity = capacity;
+	}
+
+	/**
+	* Moves the entry at pos towards the top until its parent is ordered before it
+	* @param pos The position of the entry
+	*/
+	void SiftUp(int pos)
+	{
+		Entry entry = std::move(_heap[pos]);
+		while (pos > 0)
+		{
+			int parent = (pos - 1) / D;
+			TDS_STAT(_stats._comparisons++;)
+			if (!Compare()(entry._data, _heap[parent]._data))
+				break;
+			_heap[pos] = std::move(_heap[parent]);
+			_positions[_heap[pos]._handle] = pos;
+			pos = parent;
+		}
+		_heap[pos] = std::move(entry);
+		_positions[_heap[pos]._handle] = pos;
+	}
+
+	/**
+	* Moves the entry at pos away from the top until none of its children are ordered before it
+	* @param pos The position of the entry
+	*/
+	void SiftDown(int pos)
+	{
+		Entry entry = std::move(_heap[pos]);
+		for (;;)
+		{
+			int first = pos * D + 1;
+			if (first >= _count)
+				break;
+
+			int last = first + D < _count ? first + D : _count;
+			int best = first;
+			for (int i = first + 1; i < last; i++)
+			{
+				if (Compare()(_heap[i]._data, _heap[best]._data))
+					best = i;
+			}
+			TDS_STAT(_stats._comparisons += last - first;)
+
+			if (!Compare()(_heap[best]._data, entry._data))
+				break;
+			_heap[pos] = std::move(_heap[best]);
+			_positions[_heap[pos]._handle] = pos;
+			pos = best;
+		}
+		_heap[pos] = std::move(entry);
+		_positions[_heap[pos]._handle] = pos;
+	}
+
+	/**
+	* Removes the entry at pos from the heap and frees its handle
+	* @param pos The position of the entry
+	*/
+	void RemoveAt(int pos)
+	{
+		int handle = _heap[pos]._handle;
+		_positions[handle] = -1;
+		_freeHandles[_freeCount++] = handle;
+
+		_count--;
+		if (pos != _count)
+		{
+			//fill the hole with the last entry and move it whichever way it needs to go
+			_heap[pos] = std::move(_heap[_count]);
+			_heap[_count].~Entry();
+			if (pos > 0 && Compare()(_heap[pos]._data, _heap[(pos - 1) / D]._data))
+				SiftUp(pos);
+			else
+				SiftDown(pos);
+		}
+		else
+			_heap[_count].~Entry();
+
+		TDS_STAT(_stats._remove.Record(0, 0);)
+	}
+
+	/**
+	* The queue owns its arrays so it can't be copied
+	*/
+	TIndexedPriorityQueue(const TIndexedPriorityQueue&);
+	TIndexedPriorityQueue& operator=(const TIndexedPriorityQueue&);
+
+public:
+	/**
+	* Default constructor (nothing is allocated until the first push or Reserve)
+	*/
+	TIndexedPriorityQueue()
+	{
+		_heap = NULL;
+		_positions = _freeHandles = NULL;
+		_count = _capacity = _freeCount = _handleCount = 0;
+	}
+
+	/**
+	* Overloaded constructor which takes the allocator the arrays will be allocated from
+	* @param alloc The allocator to copy into the queue
+	*/
+	TIndexedPriorityQueue(const Alloc& alloc) : _alloc(alloc)
+	{
+		_heap = NULL;
+		_positions = _freeHandles = NULL;
+		_count = _capacity = _freeCount = _handleCount = 0;
+	}
+
+	/**
+	* Destructor which destroys every element and frees the arrays
+	*/
+	~TIndexedPriorityQueue()
+	{
+		Empty();
+		if (_heap != NULL)
+		{
+			_alloc.Free(_heap, _capacity * sizeof(Entry));
+			_alloc.Free(_positions, _capacity * sizeof(int));
+			_alloc.Free(_freeHandles, _capacity * sizeof(int));
+		}
+	}
+
+	/**
+	* Returns the allocator used by this queue
+	* @return Reference to the allocator
+	*/
+	inline Alloc& GetAllocator()
+	{
+		return _alloc;
+	}
+
+	/**
+	* Returns the instrumentation counters of this queue (all zero unless TDS_ENABLE_STATS is defined, see TStats.h)
+	* @return Reference to the stats
+	*/
+	inline const TContainerStats& GetStats() const
+	{
+#ifdef TDS_ENABLE_STATS
+		return _stats;
+#else
+		return TContainerStats::Disabled();
+#endif
+	}
+
+	/**
+	* Zeroes the instrumentation counters of this queue
+	*/
+	inline void ResetStats()
+	{
+		TDS_STAT(_stats.Reset();)
+	}
+
+	/**
+	* Returns the latency histograms of this queue (empty unless TDS_ENABLE_LATENCY is defined, see TLatency.h)
+	* @return Reference to the recorder (print it with Dump)
+	*/
+	inline const TLatencyRecorder& GetLatency() const
+	{
+#ifdef TDS_ENABLE_LATENCY
+		return _latency;
+#else
+		return TLatencyRecorder::Disabled();
+#endif
+	}
+
+	/**
+	* Empties the latency histograms of this queue
+	*/
+	inline void ResetLatency()
+	{
+		TDS_LATENCY(_latency.Reset();)
+	}
+
+	/**
+	* Sets how many calls are made for every one that is timed (does nothing unless TDS_ENABLE_LATENCY is defined)
+	* @param rate 1 to time every call (the default unless TLATENCY_SAMPLE_RATE is defined), n to time one in n, 0 to stop timing
+	*/
+	inline void SetLatencySampleRate(unsigned int rate)
+	{
+		TDS_LATENCY(_latency.SetSampleRate(rate);)
+		(void)rate;
+	}
+
+	/**
+	* Returns the number of elements
+	* @return Count
+	*/
+	inline int Count() const
+	{
+		return _count;
+	}
+
+	/**
+	* Returns true if the queue is empty
+	* @return Boolean
+	*/
+	inline bool IsEmpty() const
+	{
+		return _count == 0;
+	}
+
+	/**
+	* Grows the arrays so count elements fit without growing again
+	* @param count The number of elements
+	*/
+	void Reserve(int count)
+	{
+		if (count > _capacity)
+			Grow(count);
+	}
+
+	/**
+	* Adds an element in O(log n)
+	* @param data The element
+	* @return The handle of the element (valid until it is popped or erased)
+	*/
+	int Push(const T& data)
+	{
+		TDS_LATENCY(TLatencyScope latency(_latency, TLATENCY_INSERT);)
+
+		if (_count == _capacity)
+			Grow(_capacity ? _capacity * 2 : 16);
+
+		int handle = _freeCount > 0 ? _freeHandles[--_freeCount] : _handleCount++;
+
+		Entry* entry = new(&_heap[_count]) Entry();
+		entry->_data = data;
+		entry->_handle = handle;
+		_positions[handle] = _count;
+		SiftUp(_count++);
+
+		TDS_STAT(_stats._insert.Record(0, 0);)
+		return handle;
+	}
+
+	/**
+	* Returns true if handle belongs to an element in the queue
+	* @param handle The handle
+	* @return Boolean
+	*/
+	inline bool Contains(int handle) const
+	{
+		return handle >= 0 && handle < _handleCount && _positions[handle] >= 0;
+	}
+
+	/**
+	* Returns the element of a handle
+	* @param handle The handle (must be in the queue)
+	* @return Reference to the element (do not change how it is ordered - use Update)
+	*/
+	inline const T& Get(int handle) const
+	{
+		return _heap[_positions[handle]]._data;
+	}
+
+	/**
+	* Returns the element ordered first without removing it
+	* @return The element (default value if the queue is empty)
+	*/
+	T Top()
+	{
+		T ret = T();
+		if (_count > 0)
+			ret = _heap[0]._data;
+		return ret;
+	}
+
+	/**
+	* Returns the handle of the element ordered first
+	* @return The handle (-1 if the queue is empty)
+	*/
+	inline int TopHandle() const
+	{
+		return _count > 0 ? _heap[0]._handle : -1;
+	}
+
+	/**
+	* Removes and returns the element ordered first in O(D log n)
+	* @return The element (default value if the queue is empty)
+	*/
+	T Pop()
+	{
+		TDS_LATENCY(TLatencyScope latency(_latency, TLATENCY_REMOVE);)
+
+		T ret = T();
+		if (_count > 0)
+		{
+			ret = std::move(_heap[0]._data);
+			RemoveAt(0);
+		}
+		return ret;
+	}
+
+	/**
+	* Moves an element towards the top after giving it data ordered no later than its old data in O(log n)
+	* @param handle The handle of the element
+	* @param data The new data (must not be ordered after the old data - use Update if it might be)
+	* @return True if the handle was in the queue
+	*/
+	bool DecreaseKey(int handle, const T& data)
+	{
+		if (!Contains(handle))
+			return false;
+
+		int pos = _positions[handle];
+		_heap[pos]._data = data;
+		SiftUp(pos);
+		return true;
+	}
+
+	/**
+	* Gives an element new data and moves it whichever way it needs to go in O(D log n)
+	* @param handle The handle of the element
+	* @param data The new data
+	* @return True if the handle was in the queue
+	*/
+	bool Update(int handle, const T& data)
+	{
+		if (!Contains(handle))
+			return false;
+
+		int pos = _positions[handle];
+		bool up = Compare()(data, _heap[pos]._data);
+		_heap[pos]._data = data;
+		if (up)
+			SiftUp(pos);
+		else
+			SiftDown(pos);
+		return true;
+	}
+
+	/**
+	* Removes an element by handle in O(D log n)
+	* @param handle The handle of the element
+	* @return True if the handle was in the queue
+	*/
+	bool Erase(int handle)
+	{
+		TDS_LATENCY(TLatencyScope latency(_latency, TLATENCY_REMOVE);)
+
+		if (!Contains(handle))
+			return false;
+
+		RemoveAt(_positions[handle]);
+		return true;
+	}
+
+	/**
+	* Removes every element (every handle becomes free)
+	*/
+	void Empty()
+	{
+		TDS_LATENCY(TLatencyScope latency(_latency, TLATENCY_EMPTY);)
+
+		for (int i = 0; i < _count; i++)
+			_heap[i].~Entry();
+		_count = 0;
+		_freeCount = 0;
+		_handleCount = 0;
+	}
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,1453 @@
+#ifndef TRADIXTREE_H
+#define TRADIXTREE_H
+
+/* Include for the allocators */
+#include "TAllocator.h"
+
+/* Include for the instrumentation counters */
+#include "TStats.h"
+
+/* Include for the latency histograms */
+#include "TLatency.h"
+
+/* Includes for uintptr_t, memcmp/memcpy/strlen and placement new */
+#include <stdint.h>
+#include <string.h>
+#include <new>
+
+/* Include for the SSE2 search of 16 way nodes (part of every x86-64 CPU) */
+#if defined(__SSE2__) && !defined(TDS_DISABLE_SIMD)
+#define TRADIXTREE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+/* Forward Decl */
+template<typename V> class TRadixTreeIter;
+
+/* Definitions and macros */
+#ifndef NULL
+#define NULL 0
+#endif
+
+#define TRADIXTREE_MAX_PREFIX 10 /**< Prefix bytes stored in an inner node (the rest of a longer prefix is checked against a leaf) */
+
+/**
+* Macro to iterate over every key and value in a radix tree (that is not a pointer) in key order
+*/
+#define TRADIXTREE_foreach(ValueType, name, in_tree) for (TRadixTreeIter<ValueType> name(&in_tree); !name.IsFinished(); name.Next())
+
+/**
+* Macro to iterate over the keys starting with prefix (a null terminated string) in key order
+*/
+#define TRADIXTREE_prefix_foreach(ValueType, name, in_tree, prefix) for (TRadixTreeIter<ValueType> name(&in_tree, prefix); !name.IsFinished(); name.Next())
+
+/**
+* An inner node of a radix tree. Inner nodes come in 4 sizes (4, 16, 48 and 256 children) and are
+* swapped for the next size up or down as children are added and removed, so a node only takes the
+* memory its fan out needs. The bytes every key below a node shares are stored once in the node
+* (path compression) and a key that ends at the node hangs off _terminal. Child pointers with the
+* low bit set point to leaves (see TRadixLeaf)
+*/
+
+struct TRadixNode
+{
+	enum
+	{
+		NODE4,
+		NODE16,
+		NODE48,
+		NODE256
+	};
+
+	unsigned char _type; /**< NODE4, NODE16, NODE48 or NODE256 */
+
+	unsigned short _count; /**< Number of children (not counting _terminal) */
+
+	unsigned int _prefixLength; /**< Number of key bytes every key below this node shares after its parent's byte */
+
+	unsigned char _prefix[TRADIXTREE_MAX_PREFIX]; /**< The first TRADIXTREE_MAX_PREFIX bytes of the prefix */
+
+	TRadixNode* _terminal; /**< Tagged leaf of the key that ends at this node (NULL if there is none) */
+
+	/**
+	* Returns true if a child pointer points to a leaf
+	* @param node The child pointer
+	* @return Boolean
+	*/
+	static inline bool IsLeaf(const TRadixNode* node)
+	{
+		return ((uintptr_t)node & 1) != 0;
+	}
+
+	/**
+	* Finds the slot holding the child for a byte
+	* @param node The node (not a leaf)
+	* @param byte The key byte
+	* @return Pointer to the child slot (NULL if there is no child for the byte)
+	*/
+	static inline TRadixNode** FindChild(TRadixNode* node, unsigned char byte);
+
+	/**
+	* Returns the child at or after a position in key order
+	* @param node The node (not a leaf)
+	* @param pos The position to start from (set to the position after the child returned)
+	* @param byte Receives the key byte of the child
+	* @return The child (NULL once there are none left)
+	*/
+	static inline TRadixNode* NextChild(TRadixNode* node, int& pos, unsigned char& byte);
+
+	/**
+	* Returns the leaf of the smallest key below a node (any leaf will do to recover the bytes of a
+	* long prefix since every key below the node shares them)
+	* @param node The node or a leaf
+	* @return The tagged leaf
+	*/
+	static TRadixNode* Minimum(TRadixNode* node)
+	{
+		while (!IsLeaf(node))
+		{
+			if (node->_terminal != NULL)
+				return node->_terminal;
+			int pos = 0;
+			unsigned char byte;
+			node = NextChild(node, pos, byte);
+		}
+		return node;
+	}
+};
+
+struct TRadixNode4 : public TRadixNode
+{
+	unsigned char _keys[4]; /**< The key byte of each child, sorted */
+
+	TRadixNode* _children[4]; /**< The children in key order */
+};
+
+struct TRadixNode16 : public TRadixNode
+{
+	unsigned char _keys[16]; /**< The key byte of each child, sorted */
+
+	TRadixNode* _children[16]; /**< The children in key order */
+};
+
+struct TRadixNode48 : public TRadixNode
+{
+	unsigned char _index[256]; /**< 1 + the slot in _children of each key byte (0 if it has no child) */
+
+	TRadixNode* _children[48]; /**< The children in no particular order */
+};
+
+struct TRadixNode256 : public TRadixNode
+{
+	TRadixNode* _children[256]; /**< The child of each key byte (NULL if it has none) */
+};
+
+inline TRadixNode** TRadixNode::FindChild(TRadixNode* node, unsigned char byte)
+{
+	switch (node->_type)
+	{
+	case NODE4:
+	{
+		TRadixNode4* n = (TRadixNode4*)node;
+		for (int i = 0; i < n->_count; i++)
+		{
+			if (n->_keys[i] == byte)
+				return &n->_children[i];
+		}
+		return NULL;
+	}
+	case NODE16:
+	{
+		TRadixNode16* n = (TRadixNode16*)node;
+#ifdef TRADIXTREE_SSE2
+		//compare all 16 keys at once
+		__m128i cmp = _mm_cmpeq_epi8(_mm_set1_epi8((char)byte), _mm_loadu_si128((const __m128i*)n->_keys));
+		int mask = _mm_movemask_epi8(cmp) & ((1 << n->_count) - 1);
+		return mask != 0 ? &n->_children[__builtin_ctz((unsigned int)mask)] : NULL;
+#else
+		for (int i = 0; i < n->_count; i++)
+		{
+			if (n->_keys[i] == byte)
+				return &n->_children[i];
+		}
+		return NULL;
+#endif
+	}
+	case NODE48:
+	{
+		TRadixNode48* n = (TRadixNode48*)node;
+		return n->_index[byte] != 0 ? &n->_children[n->_index[byte] - 1] : NULL;
+	}
+	default:
+	{
+		TRadixNode256* n = (TRadixNode256*)node;
+		return n->_children[byte] != NULL ? &n->_children[byte] : NULL;
+	}
+	}
+}
+
+inline TRadixNode* TRadixNode::NextChild(TRadixNode* node, int& pos, unsigned char& byte)
+{
+	switch (node->_type)
+	{
+	case NODE4:
+	{
+		TRadixNode4* n = (TRadixNode4*)node;
+		if (pos >= n->_count)
+			return NULL;
+		byte = n->_keys[pos];
+		return n->_children[pos++];
+	}
+	case NODE16:
+	{
+		TRadixNode16* n = (TRadixNode16*)node;
+		if (pos >= n->_count)
+			return NULL;
+		byte = n->_keys[pos];
+		return n->_children[pos++];
+	}
+	case NODE48:
+	{
+		TRadixNode48* n = (TRadixNode48*)node;
+		for (; pos < 256; pos++)
+		{
+			if (n->_index[pos] != 0)
+			{
+				byte = (unsigned char)pos;
+				return n->_children[n->_index[pos++] - 1];
+			}
+		}
+		return NULL;
+	}
+	default:
+	{
+		TRadixNode256* n = (TRadixNode256*)node;
+		for (; pos < 256; pos++)
+		{
+			if (n->_children[pos] != NULL)
+			{
+				byte = (unsigned char)pos;
+				return n->_children[pos++];
+			}
+		}
+		return NULL;
+	}
+	}
+}
+
+/**
+* A leaf of a radix tree holding a value and its whole key. The key bytes are allocated inline
+* after the leaf (with a null terminator so string keys can be read back as C strings)
+*/
+
+template<typename V>
+struct TRadixLeaf
+{
+	V _value; /**< The value */
+
+	unsigned int _length; /**< Number of bytes in the key */
+
+	unsigned char _key[1]; /**< The key (the rest of it follows the leaf) */
+
+	/**
+	* Returns the number of bytes to allocate for a leaf
+	* @param length Number of bytes in the key
+	* @return Size in bytes
+	*/
+	static inline size_t SizeFor(size_t length)
+	{
+		return sizeof(TRadixLeaf<V>) + length;
+	}
+
+	/**
+	* Returns the leaf a tagged child pointer points to
+	* @param node The tagged pointer
+	* @return The leaf
+	*/
+	static inline TRadixLeaf<V>* From(TRadixNode* node)
+	{
+		return (TRadixLeaf<V>*)((uintptr_t)node & ~(uintptr_t)1);
+	}
+
+	/**
+	* Returns the tagged child pointer to this leaf
+	* @return The tagged pointer
+	*/
+	inline TRadixNode* Tagged()
+	{
+		return (TRadixNode*)((uintptr_t)this | 1);
+	}
+
+	/**
+	* Returns true if this is the leaf of a key
+	* @param key The key bytes
+	* @param length Number of bytes in the key
+	* @return Boolean
+	*/
+	inline bool Matches(const unsigned char* key, size_t length) const
+	{
+		return _length == length && memcmp(_key, key, length) == 0;
+	}
+};
+
+
+
+/**
+* An ordered map from string or byte keys to values (an adaptive radix tree). Each inner node
+* branches on one byte of the key so a lookup costs O(key length) however many keys there are,
+* and no two keys are ever compared whole the way TTree compares them. Chains of nodes with one
+* child are compressed into a prefix stored in the node below, and inner nodes grow and shrink
+* between 4, 16, 48 and 256 children so sparse nodes stay small. Keys are visited in byte order,
+* which lets TRadixTreeIter walk every key starting with a prefix, and LongestPrefix finds the
+* longest key that is a prefix of another (e.g. routing tables).
+*
+* Keys may contain any bytes; the const char* overloads take null terminated strings. Nodes and
+* leaves are allocated from Alloc (see TAllocator.h) and values are never moved, so pointers
+* returned by Find stay valid until their key is removed.
+*/
+
+template<typename V, typename Alloc = TDefaultAllocator>
+class TRadixTree
+{
+	friend class TRadixTreeIter<V>;
+
+private:
+	typedef TRadixLeaf<V> Leaf;
+
+	Alloc _alloc; /**< The allocator nodes and leaves are allocated from */
+
+	TDS_STAT(mutable TContainerStats _stats;) /**< Instrumentation counters (only when TDS_ENABLE_STATS is defined, const lookups count too) */
+
+	TDS_LATENCY(mutable TLatencyRecorder _latency;) /**< Latency histograms (only when TDS_ENABLE_LATENCY is defined, updated by const lookups too) */
+
+	TRadixNode* _root; /**< The root node or a tagged leaf (NULL if the tree is empty) */
+
+	int _count; /**< Number of keys in the tree */
+
+	size_t _bytes; /**< Bytes allocated for nodes and leaves */
+
+	/**
+	* Returns the size of an inner node type
+	* @param type NODE4, NODE16, NODE48 or NODE256
+	* @return Size in bytes
+	*/
+	static inline size_t NodeSize(int type)
+	{
+		switch (type)
+		{
+		case TRadixNode::NODE4: return sizeof(TRadixNode4);
+		case TRadixNode::NODE16: return sizeof(TRadixNode16);
+		case TRadixNode::NODE48: return sizeof(TRadixNode48);
+		default: return sizeof(TRadixNode256);
+		}
+	}
+
+	/**
+	* Allocates an empty inner node
+	* @param type NODE4, NODE16, NODE48 or NODE256
+	* @return The node
+	*/
+	TRadixNode* NewNode(int type)
+	{
+		void* mem = _alloc.Allocate(NodeSize(type));
+		TRadixNode* node;
+		switch (type)
+		{
+		case TRadixNode::NODE4: node = new(mem) TRadixNode4(); break;
+		case TRadixNode::NODE16: node = new(mem) TRadixNode16(); break;
+		case TRadixNode::NODE48: node = new(mem) TRadixNode48(); break;
+		default: node = new(mem) TRadixNode256(); break;
+		}
+		node->_type = (unsigned char)type;
+		_bytes += NodeSize(type);
+		TDS_STAT(_stats._allocations++;)
+		return node;
+	}
+
+	/**
+	* Frees an inner node (not its children)
+	* @param node The node
+	*/
+	inline void FreeNode(TRadixNode* node)
+	{
+		_bytes -= NodeSize(node->_type);
+		TDS_STAT(_stats._frees++;)
+		_alloc.Free(node, NodeSize(node->_type));
+	}
+
+	/**
+	* Allocates a leaf
+	* @param key The key bytes
+	* @param length Number of bytes in the key
+	* @param value The value to copy in
+	* @return The tagged leaf
+	*/
+	TRadixNode* NewLeaf(const unsigned char* key, size_t length, const V& value)
+	{
+		Leaf* leaf = (Leaf*)_alloc.Allocate(Leaf::SizeFor(length));
+		new(&leaf->_value) V(value);
+		leaf->_length = (unsigned int)length;
+		memcpy(leaf->_key, key, length);
+		leaf->_key[length] = '\0';
+		_bytes += Leaf::SizeFor(length);
+		TDS_STAT(_stats._allocations++;)
+		return leaf->Tagged();
+	}
+
+	/**
+	* Destroys the value of a leaf and frees it
+	* @param node The tagged leaf
+	*/
+	inline void FreeLeaf(TRadixNode* node)
+	{
+		Leaf* leaf = Leaf::From(node);
+		size_t size = Leaf::SizeFor(leaf->_length);
+		leaf->_value.~V();
+		_bytes -= size;
+		TDS_STAT(_stats._frees++;)
+		_alloc.Free(leaf, size);
+	}
+
+	/**
+	* Frees a node or leaf and everything below it
+	* @param node The node or tagged leaf
+	*/
+	void FreeAll(TRadixNode* node)
+	{
+		if (TRadixNode::IsLeaf(node))
+		{
+			FreeLeaf(node);
+			return;
+		}
+
+		if (node->_terminal != NULL)
+			FreeLeaf(node->_terminal);
+		int pos = 0;
+		unsigned char byte;
+		while (TRadixNode* child = TRadixNode::NextChild(node, pos, byte))
+			FreeAll(child);
+		FreeNode(node);
+	}
+
+	/**
+	* Sets the prefix of a node
+	* @param node The node
+	* @param bytes The prefix bytes
+	* @param length Number of bytes in the prefix
+	*/
+	static inline void SetPrefix(TRadixNode* node, const unsigned char* bytes, size_t length)
+	{
+		node->_prefixLength = (unsigned int)length;
+		memcpy(node->_prefix, bytes, length < TRADIXTREE_MAX_PREFIX ? length : TRADIXTREE_MAX_PREFIX);
+	}
+
+	/**
+	* Copies the count, prefix and terminal of a node into the node replacing it
+	* @param to The new node
+	* @param from The old node
+	*/
+	static inline void CopyHeader(TRadixNode* to, const TRadixNode* from)
+	{
+		to->_count = from->_count;
+		to->_prefixLength = from->_prefixLength;
+		memcpy(to->_prefix, from->_prefix, TRADIXTREE_MAX_PREFIX);
+		to->_terminal = from->_terminal;
+	}
+
+	/**
+	* Adds a child to a node, replacing the node with the next size up if it is full
+	* @param ref The slot pointing to the node (updated if the node is replaced)
+	* @param byte The key byte of the child (must not already have one)
+	* @param child The child node or tagged leaf
+	*/
+	void AddChild(TRadixNode** ref, unsigned char byte, TRadixNode* child)
+	{
+		TRadixNode* node = *ref;
+		switch (node->_type)
+		{
+		case TRadixNode::NODE4:
+		{
+			TRadixNode4* n = (TRadixNode4*)node;
+			if (n->_count < 4)
+			{
+				int pos = 0;
+				while (pos < n->_count && n->_keys[pos] < byte)
+					pos++;
+				memmove(n->_keys + pos + 1, n->_keys + pos, n->_count - pos);
+				memmove(n->_children + pos + 1, n->_children + pos, (n->_count - pos) * sizeof(TRadixNode*));
+				n->_keys[pos] = byte;
+				n->_children[pos] = child;
+				n->_count++;
+				return;
+			}
+			TRadixNode16* grown = (TRadixNode16*)NewNode(TRadixNode::NODE16);
+			CopyHeader(grown, n);
+			memcpy(grown->_keys, n->_keys, 4);
+			memcpy(grown->_children, n->_children, 4 * sizeof(TRadixNode*));
+			*ref = grown;
+			break;
+		}
+		case TRadixNode::NODE16:
+		{
+			TRadixNode16* n = (TRadixNode16*)node;
+			if (n->_count < 16)
+			{
+				int pos = 0;
+				while (pos < n->_count && n->_keys[pos] < byte)
+					pos++;
+				memmove(n->_keys + pos + 1, n->_keys + pos, n->_count - pos);
+				memmove(n->_children + pos + 1, n->_children + pos, (n->_count - pos) * sizeof(TRadixNode*));
+				n->_keys[pos] = byte;
+				n->_children[pos] = child;
+				n->_count++;
+				return;
+			}
+			TRadixNode48* grown = (TRadixNode48*)NewNode(TRadixNode::NODE48);
+			CopyHeader(grown, n);
+			for (int i = 0; i < 16; i++)
+			{
+				grown->_index[n->_keys[i]] = (unsigned char)(i + 1);
+				grown->_children[i] = n->_children[i];
+			}
+			*ref = grown;
+			break;
+		}
+		case TRadixNode::NODE48:
+		{
+			TRadixNode48* n = (TRadixNode48*)node;
+			if (n->_count < 48)
+			{
+				int slot = 0;
+				while (n->_children[slot] != NULL)
+					slot++;
+				n->_children[slot] = child;
+				n->_index[byte] = (unsigned char)(slot + 1);
+				n->_count++;
+				return;
+			}
+			TRadixNode256* grown = (TRadixNode256*)NewNode(TRadixNode::NODE256);
+			CopyHeader(grown, n);
+			for (int i = 0; i < 256; i++)
+			{
+				if (n->_index[i] != 0)
+					grown->_children[i] = n->_children[n->_index[i] - 1];
+			}
+			*ref = grown;
+			break;
+		}
+		default:
+		{
+			TRadixNode256* n = (TRadixNode256*)node;
+			n->_children[byte] = child;
+			n->_count++;
+			return;
+		}
+		}
+
+		//the node was full and has been copied into the next size up
+		FreeNode(node);
+		AddChild(ref, byte, child);
+	}
+
+	/**
+	* Removes the child of a byte from a node (without shrinking the node)
+	* @param node The node
+	* @param byte The key byte of the child
+	*/
+	static void RemoveChild(TRadixNode* node, unsigned char byte)
+	{
+		switch (node->_type)
+		{
+		case TRadixNode::NODE4:
+		case TRadixNode::NODE16:
+		{
+			unsigned char* keys = node->_type == TRadixNode::NODE4 ? ((TRadixNode4*)node)->_keys : ((TRadixNode16*)node)->_keys;
+			TRadixNode** children = node->_type == TRadixNode::NODE4 ? ((TRadixNode4*)node)->_children : ((TRadixNode16*)node)->_children;
+			int pos = 0;
+			while (keys[pos] != byte)
+				pos++;
+			memmove(keys + pos, keys + pos + 1, node->_count - pos - 1);
+			memmove(children + pos, children + pos + 1, (node->_count - pos - 1) * sizeof(TRadixNode*));
+			break;
+		}
+		case TRadixNode::NODE48:
+		{
+			TRadixNode48* n = (TRadixNode48*)node;
+			n->_children[n->_index[byte] - 1] = NULL;
+			n->_index[byte] = 0;
+			break;
+		}
+		default:
+			((TRadixNode256*)node)->_children[byte] = NULL;
+			break;
+		}
+		node->_count--;
+	}
+
+	/**
+	* Restores the shape of a node after a child or its terminal was removed: a node left with a
+	* single key below it is replaced by that key's leaf or merged into its only child, and a node
+	* with few enough children is replaced by the next size down
+	* @param ref The slot pointing to the node (updated if the node is replaced)
+	*/
+	void Shrink(TRadixNode** ref)
+	{
+		TRadixNode* node = *ref;
+		if (node->_count == 0)
+		{
+			*ref = node->_terminal;
+			FreeNode(node);
+			return;
+		}
+
+		if (node->_count == 1 && node->_terminal == NULL)
+		{
+			int pos = 0;
+			unsigned char byte;
+			TRadixNode* child = TRadixNode::NextChild(node, pos, byte);
+			if (!TRadixNode::IsLeaf(child))
+			{
+				//the child's prefix becomes this node's prefix + the child's byte + its own prefix
+				unsigned char prefix[TRADIXTREE_MAX_PREFIX];
+				size_t length = node->_prefixLength < TRADIXTREE_MAX_PREFIX ? node->_prefixLength : TRADIXTREE_MAX_PREFIX;
+				memcpy(prefix, node->_prefix, length);
+				if (length < TRADIXTREE_MAX_PREFIX)
+					prefix[length++] = byte;
+				size_t rest = TRADIXTREE_MAX_PREFIX - length;
+				if (rest > child->_prefixLength)
+					rest = child->_prefixLength;
+				memcpy(prefix + length, child->_prefix, rest);
+				memcpy(child->_prefix, prefix, length + rest);
+				child->_prefixLength += node->_prefixLength + 1;
+			}
+			*ref = child;
+			FreeNode(node);
+			return;
+		}
+
+		TRadixNode* shrunk = NULL;
+		if (node->_type == TRadixNode::NODE256 && node->_count <= 37)
+		{
+			TRadixNode256* n = (TRadixNode256*)node;
+			TRadixNode48* to = (TRadixNode48*)NewNode(TRadixNode::NODE48);
+			CopyHeader(to, n);
+			int slot = 0;
+			for (int i = 0; i < 256; i++)
+			{
+				if (n->_children[i] != NULL)
+				{
+					to->_children[slot] = n->_children[i];
+					to->_index[i] = (unsigned char)++slot;
+				}
+			}
+			shrunk = to;
+		}
+		else if (node->_type == TRadixNode::NODE48 && node->_count <= 12)
+		{
+			TRadixNode48* n = (TRadixNode48*)node;
+			TRadixNode16* to = (TRadixNode16*)NewNode(TRadixNode::NODE16);
+			CopyHeader(to, n);
+			int pos = 0;
+			for (int i = 0; i < 256; i++)
+			{
+				if (n->_index[i] != 0)
+				{
+					to->_keys[pos] = (unsigned char)i;
+					to->_children[pos++] = n->_children[n->_index[i] - 1];
+				}
+			}
+			shrunk = to;
+		}
+		else if (node->_type == TRadixNode::NODE16 && node->_count <= 3)
+		{
+			TRadixNode16* n = (TRadixNode16*)node;
+			TRadixNode4* to = (TRadixNode4*)NewNode(TRadixNode::NODE4);
+			CopyHeader(to, n);
+			memcpy(to->_keys, n->_keys, n->_count);
+			memcpy(to->_children, n->_children, n->_count * sizeof(TRadixNode*));
+			shrunk = to;
+		}
+
+		if (shrunk != NULL)
+		{
+			*ref = shrunk;
+			FreeNode(node);
+		}
+	}
+
+	/**
+	* Returns how many bytes of a node's prefix a key matches
+	* @param node The node
+	* @param key The key bytes
+	* @param length Number of bytes in the key
+	* @param depth Index of the key byte the prefix starts at
+	* @return Number of matching bytes (the prefix length if the whole prefix matches)
+	*/
+	static size_t PrefixMismatch(TRadixNode* node, const unsigned char* key, size_t length, size_t depth)
+	{
+		size_t max = node->_prefixLength < TRADIXTREE_MAX_PREFIX ? node->_prefixLength : TRADIXTREE_MAX_PREFIX;
+		if (max > length - depth)
+			max = length - depth;
+		size_t i = 0;
+		for (; i < max; i++)
+		{
+			if (node->_prefix[i] != key[depth + i])
+				return i;
+		}
+
+		if (node->_prefixLength > TRADIXTREE_MAX_PREFIX)
+		{
+			//the rest of the prefix is only stored in the keys below the node
+			Leaf* leaf = Leaf::From(TRadixNode::Minimum(node));
+			max = node->_prefixLength < length - depth ? node->_prefixLength : length - depth;
+			for (; i < max; i++)
+			{
+				if (leaf->_key[depth + i] != key[depth + i])
+					return i;
+			}
+		}
+		return i;
+	}
+
+	/**
+	* Hangs a leaf off a node at the given depth (as its terminal if the key ends there)
+	* @param ref The slot pointing to the node
+	* @param leaf The tagged leaf
+	* @param depth Index of the key byte the node branches on
+	*/
+	inline void Attach(TRadixNode** ref, TRadixNode* leaf, size_t depth)
+	{
+		Leaf* l = Leaf::From(leaf);
+		if (l->_length == depth)
+			(*ref)->_terminal = leaf;
+		else
+			AddChild(ref, l->_key[depth], leaf);
+	}
+
+	/**
+	* Checks the stored part of a node's prefix against a key (bytes past TRADIXTREE_MAX_PREFIX
+	* are checked later against the leaf)
+	* @param node The node
+	* @param key The key bytes
+	* @param length Number of bytes in the key
+	* @param depth Index of the key byte the prefix starts at
+	* @return False if the key can't be below the node
+	*/
+	static inline bool PrefixMatches(TRadixNode* node, const unsigned char* key, size_t length, size_t depth)
+	{
+		if (depth + node->_prefixLength > length)
+			return false;
+		size_t stored = node->_prefixLength < TRADIXTREE_MAX_PREFIX ? node->_prefixLength : TRADIXTREE_MAX_PREFIX;
+		return memcmp(node->_prefix, key + depth, stored) == 0;
+	}
+
+	/**
+	* The tree owns its nodes so it can't be copied
+	*/
+	TRadixTree(const TRadixTree&);
+	TRadixTree& operator=(const TRadixTree&);
+
+public:
+	/**
+	* Default constructor of an empty tree
+	*/
+	TRadixTree()
+	{
+		_root = NULL;
+		_count = 0;
+		_bytes = 0;
+	}
+
+	/**
+	* Overloaded constructor which takes the allocator nodes and leaves will be allocated from
+	* @param alloc The allocator to copy into the tree
+	*/
+	TRadixTree(const Alloc& alloc) : _alloc(alloc)
+	{
+		_root = NULL;
+		_count = 0;
+		_bytes = 0;
+	}
+
+	/**
+	* Destructor which frees every node and leaf
+	*/
+	~TRadixTree()
+	{
+		Empty();
+	}
+
+	/**
+	* Returns the allocator used by this tree
+	* @return Reference to the allocator
+	*/
+	inline Alloc& GetAllocator()
+	{
+		return _alloc;
+	}
+
+	/**
+	* Returns the instrumentation counters of this tree (all zero unless TDS_ENABLE_STATS is defined, see TStats.h)
+	* @return Reference to the stats
+	*/
+	inline const TContainerStats& GetStats() const
+	{
+#ifdef TDS_ENABLE_STATS
+		return _stats;
+#else
+		return TContainerStats::Disabled();
+#endif
+	}
+
+	/**
+	* Zeroes the instrumentation counters of this tree
+	*/
+	inline void ResetStats()
+	{
+		TDS_STAT(_stats.Reset();)
+	}
+
+	/**
+	* Returns the latency histograms of this tree (empty unless TDS_ENABLE_LATENCY is defined, see TLatency.h)
+	* @return Reference to the recorder (print it with Dump)
+	*/
+	inline const TLatencyRecorder& GetLatency() const
+	{
+#ifdef TDS_ENABLE_LATENCY
+		return _latency;
+#else
+		return TLatencyRecorder::Disabled();
+#endif
+	}
+
+	/**
+	* Empties the latency histograms of this tree
+	*/
+	inline void ResetLatency()
+	{
+		TDS_LATENCY(_latency.Reset();)
+	}
+
+	/**
+	* Sets how many calls are made for every one that is timed (does nothing unless TDS_ENABLE_LATENCY is defined)
+	* @param rate 1 to time every call (the default unless TLATENCY_SAMPLE_RATE is defined), n to time one in n, 0 to stop timing
+	*/
+	inline void SetLatencySampleRate(unsigned int rate)
+	{
+		TDS_LATENCY(_latency.SetSampleRate(rate);)
+		(void)rate;
+	}
+
+	/**
+	* Returns the number of keys in the tree
+	* @return Count
+	*/
+	inline int Count() const
+	{
+		return _count;
+	}
+
+	/**
+	* Returns true if the tree is empty
+	* @return Boolean
+	*/
+	inline bool IsEmpty() const
+	{
+		return _count == 0;
+	}
+
+	/**
+	* Returns the number of bytes allocated for nodes and leaves (keys included)
+	* @return Size in bytes
+	*/
+	inline size_t BytesUsed() const
+	{
+		return _bytes;
+	}
+
+	/**
+	* Inserts a key and value, replacing the value if the key is already in the tree
+	* @param key The key bytes
+	* @param length Number of bytes in the key
+	* @param value The value
+	* @return True if the key was new, false if an existing value was replaced
+	*/
+	bool Insert(const void* key, size_t length, const V& value)
+	{
+		TDS_LATENCY(TLatencyScope latency(_latency, TLATENCY_INSERT);)
+
+		const unsigned char* bytes = (const unsigned char*)key;
+		TRadixNode** ref = &_root;
+		size_t depth = 0;
+		unsigned int visited = 0;
+		for (;;)
+		{
+			TRadixNode* node = *ref;
+			if (node == NULL)
+			{
+				*ref = NewLeaf(bytes, length, value);
+				break;
+			}
+			visited++;
+
+			if (TRadixNode::IsLeaf(node))
+			{
+				Leaf* leaf = Leaf::From(node);
+				TDS_STAT(_stats._comparisons++;)
+				if (leaf->Matches(bytes, length))
+				{
+					leaf->_value = value;
+					TDS_STAT(_stats._insert.Record(visited, visited);)
+					return false;
+				}
+
+				//replace the leaf with a node holding both keys below their common bytes
+				size_t limit = leaf->_length < length ? leaf->_length : length;
+				size_t common = depth;
+				while (common < limit && leaf->_key[common] == bytes[common])
+					common++;
+				*ref = NewNode(TRadixNode::NODE4);
+				SetPrefix(*ref, bytes + depth, common - depth);
+				Attach(ref, node, common);
+				Attach(ref, NewLeaf(bytes, length, value), common);
+				break;
+			}
+
+			if (node->_prefixLength != 0)
+			{
+				size_t matched = PrefixMismatch(node, bytes, length, depth);
+				if (matched < node->_prefixLength)
+				{
+					//split the prefix: a new node holds the matching bytes and branches between
+					//the old node (keeping the rest of its prefix) and the new key
+					unsigned char branch;
+					if (node->_prefixLength <= TRADIXTREE_MAX_PREFIX)
+					{
+						branch = node->_prefix[matched];
+						node->_prefixLength -= (unsigned int)matched + 1;
+						memmove(node->_prefix, node->_prefix + matched + 1, node->_prefixLength);
+					}
+					else
+					{
+						Leaf* leaf = Leaf::From(TRadixNode::Minimum(node));
+						branch = leaf->_key[depth + matched];
+						SetPrefix(node, leaf->_key + depth + matched + 1, node->_prefixLength - matched - 1);
+					}
+					*ref = NewNode(TRadixNode::NODE4);
+					SetPrefix(*ref, bytes + depth, matched);
+					AddChild(ref, branch, node);
+					Attach(ref, NewLeaf(bytes, length, value), depth + matched);
+					break;
+				}
+				depth += node->_prefixLength;
+			}
+
+			if (depth == length)
+			{
+				if (node->_terminal != NULL)
+				{
+					Leaf::From(node->_terminal)->_value = value;
+					TDS_STAT(_stats._insert.Record(visited, visited);)
+					return false;
+				}
+				node->_terminal = NewLeaf(bytes, length, value);
+				break;
+			}
+
+			TRadixNode** child = TRadixNode::FindChild(node, bytes[depth]);
+			if (child == NULL)
+			{
+				AddChild(ref, bytes[depth], NewLeaf(bytes, length, value));
+				break;
+			}
+			ref = child;
+			depth++;
+		}
+
+		TDS_STAT(_stats._insert.Record(visited, visited);)
+		_count++;
+		return true;
+	}
+
+	/**
+	* Inserts a null terminated string key and value, replacing the value if the key is already in the tree
+	* @param key The key
+	* @param value The value
+	* @return True if the key was new, false if an existing value was replaced
+	*/
+	inline bool Insert(const char* key, const V& value)
+	{
+		return Insert(key, strlen(key), value);
+	}
+
+	/**
+	* Finds the value of a key in O(key length)
+	* @param key The key bytes
+	* @param length Number of bytes in the key
+	* @return Pointer to the value (NULL if the key is not in the tree)
+	*/
+	V* Find(const void* key, size_t length) const
+	{
+		TDS_LATENCY(TLatencyScope latency(_latency, TLATENCY_FIND);)
+
+		const unsigned char* bytes = (const unsigned char*)key;
+		TRadixNode* node = _root;
+		size_t depth = 0;
+		unsigned int visited = 0;
+		Leaf* found = NULL;
+		while (node != NULL)
+		{
+			visited++;
+			if (TRadixNode::IsLeaf(node))
+			{
+				found = Leaf::From(node);
+				break;
+			}
+			if (!PrefixMatches(node, bytes, length, depth))
+				break;
+			depth += node->_prefixLength;
+			if (depth == length)
+			{
+				if (node->_terminal != NULL)
+					found = Leaf::From(node->_terminal);
+				break;
+			}
+			TRadixNode** child = TRadixNode::FindChild(node, bytes[depth++]);
+			node = child != NULL ? *child : NULL;
+		}
+
+		(void)visited;
+		TDS_STAT(_stats._find.Record(found != NULL, visited);)
+		TDS_STAT(_stats._comparisons += found != NULL;)
+		return found != NULL && found->Matches(bytes, length) ? &found->_value : NULL;
+	}
+
+	/**
+	* Finds the value of a null terminated string key in O(key length)
+	* @param key The key
+	* @return Pointer to the value (NULL if the key is not in the tree)
+	*/
+	inline V* Find(const char* key) const
+	{
+		return Find(key, strlen(key));
+	}
+
+	/**
+	* Returns true if the key is in the tree
+	* @param key The key (null terminated)
+	* @return Boolean
+	*/
+	inline bool Contains(const char* key) const
+	{
+		return Find(key) != NULL;
+	}
+
+	/**
+	* Finds the longest key in the tree that is a prefix of key (or equal to it)
+	* @param key The key bytes
+	* @param length Number of bytes in the key
+	* @param matched Receives the length of the key found (may be NULL)
+	* @return Pointer to the value of the key found (NULL if no key is a prefix of key)
+	*/
+	V* LongestPrefix(const void* key, size_t length, size_t* matched = NULL) const
+	{
+		TDS_LATENCY(TLatencyScope latency(_latency, TLATENCY_FIND);)
+
+		const unsigned char* bytes = (const unsigned char*)key;
+		TRadixNode* node = _root;
+		size_t depth = 0;
+		size_t verified = 0; //bytes of key known to match the tree (long prefixes are skipped unchecked)
+		Leaf* best = NULL;
+		while (node != NULL)
+		{
+			if (TRadixNode::IsLeaf(node))
+			{
+				Leaf* leaf = Leaf::From(node);
+				if (leaf->_length <= length && memcmp(leaf->_key + verified, bytes + verified, leaf->_length - verified) == 0)
+					best = leaf;
+				break;
+			}
+			if (!PrefixMatches(node, bytes, length, depth))
+				break;
+			if (verified == depth && node->_prefixLength <= TRADIXTREE_MAX_PREFIX)
+				verified += node->_prefixLength;
+			depth += node->_prefixLength;
+
+			if (node->_terminal != NULL)
+			{
+				//a terminal is a prefix of key if the bytes skipped since the last check match
+				Leaf* leaf = Leaf::From(node->_terminal);
+				if (memcmp(leaf->_key + verified, bytes + verified, depth - verified) != 0)
+					break;
+				verified = depth;
+				best = leaf;
+			}
+			if (depth == length)
+				break;
+
+			TRadixNode** child = TRadixNode::FindChild(node, bytes[depth]);
+			if (verified == depth)
+				verified++;
+			depth++;
+			node = child != NULL ? *child : NULL;
+		}
+
+		if (best == NULL)
+			return NULL;
+		if (matched != NULL)
+			*matched = best->_length;
+		return &best->_value;
+	}
+
+	/**
+	* Finds the longest key in the tree that is a prefix of a null terminated string
+	* @param key The key
+	* @param matched Receives the length of the key found (may be NULL)
+	* @return Pointer to the value of the key found (NULL if no key is a prefix of key)
+	*/
+	inline V* LongestPrefix(const char* key, size_t* matched = NULL) const
+	{
+		return LongestPrefix(key, strlen(key), matched);
+	}
+
+	/**
+	* Removes a key and its value from the tree
+	* @param key The key bytes
+	* @param length Number of bytes in the key
+	* @return True if the key was found and removed
+	*/
+	bool Remove(const void* key, size_t length)
+	{
+		TDS_LATENCY(TLatencyScope latency(_latency, TLATENCY_REMOVE);)
+
+		const unsigned char* bytes = (const unsigned char*)key;
+		TRadixNode** ref = &_root;
+		TRadixNode** parent = NULL;
+		unsigned char parentByte = 0;
+		size_t depth = 0;
+		unsigned int visited = 0;
+		bool removed = false;
+		while (*ref != NULL)
+		{
+			TRadixNode* node = *ref;
+			visited++;
+			if (TRadixNode::IsLeaf(node))
+			{
+				TDS_STAT(_stats._comparisons++;)
+				if (!Leaf::From(node)->Matches(bytes, length))
+					break;
+				FreeLeaf(node);
+				if (parent == NULL)
+				{
+					_root = NULL;
+				}
+				else
+				{
+					RemoveChild(*parent, parentByte);
+					Shrink(parent);
+				}
+				removed = true;
+				break;
+			}
+			if (!PrefixMatches(node, bytes, length, depth))
+				break;
+			depth += node->_prefixLength;
+			if (depth == length)
+			{
+				TDS_STAT(_stats._comparisons += node->_terminal != NULL;)
+				if (node->_terminal == NULL || !Leaf::From(node->_terminal)->Matches(bytes, length))
+					break;
+				FreeLeaf(node->_terminal);
+				node->_terminal = NULL;
+				Shrink(ref);
+				removed = true;
+				break;
+			}
+			TRadixNode** child = TRadixNode::FindChild(node, bytes[depth]);
+			if (child == NULL)
+				break;
+			parent = ref;
+			parentByte = bytes[depth++];
+			ref = child;
+		}
+
+		(void)visited;
+		TDS_STAT(_stats._remove.Record(removed, visited);)
+		if (removed)
+			_count--;
+		return removed;
+	}
+
+	/**
+	* Removes a null terminated string key and its value from the tree
+	* @param key The key
+	* @return True if the key was found and removed
+	*/
+	inline bool Remove(const char* key)
+	{
+		return Remove(key, strlen(key));
+	}
+
+	/**
+	* Removes every key
+	*/
+	void Empty()
+	{
+		TDS_LATENCY(TLatencyScope latency(_latency, TLATENCY_EMPTY);)
+
+		if (_root != NULL)
+			FreeAll(_root);
+		_root = NULL;
+		_count = 0;
+	}
+};
+
+
+
+#define TRADIXTREEITER_STACK 32 /**< Depth of the stack kept inside the iterator */
+
+/**
+* Iterates over the keys of a TRadixTree (or the keys starting with a prefix) in byte order. It
+* keeps a stack of the nodes above the current leaf, which only allocates once the tree is deeper
+* than TRADIXTREEITER_STACK nodes. The tree must not be modified while iterating
+*/
+
+template<typename V>
+class TRadixTreeIter
+{
+private:
+	/**
+	* A node on the path to the current leaf and where to carry on in it
+	*/
+	struct Frame
+	{
+		TRadixNode* _node; /**< The node */
+
+		int _pos; /**< The next child position to visit (-1 before its terminal) */
+	};
+
+	TRadixLeaf<V>* _current; /**< The current leaf (NULL when finished) */
+
+	Frame* _stack; /**< The nodes above the current leaf */
+
+	int _depth; /**< Number of frames on the stack */
+
+	int _capacity; /**< Number of frames _stack can hold */
+
+	Frame _inline[TRADIXTREEITER_STACK]; /**< The stack until it outgrows TRADIXTREEITER_STACK frames */
+
+	TDS_STAT(TContainerStats* _stats;) /**< Stats of the tree being iterated */
+
+	/**
+	* Pushes a node to visit
+	* @param node The node
+	*/
+	void Push(TRadixNode* node)
+	{
+		if (_depth == _capacity)
+		{
+			Frame* stack = new Frame[_capacity * 2];
+			memcpy(stack, _stack, _depth * sizeof(Frame));
+			if (_stack != _inline)
+				delete[] _stack;
+			_stack = stack;
+			_capacity *= 2;
+		}
+		_stack[_depth]._node = node;
+		_stack[_depth]._pos = -1;
+		_depth++;
+	}
+
+	/**
+	* Moves to the next leaf below the nodes on the stack (or finishes)
+	*/
+	void Advance()
+	{
+		_current = NULL;
+		while (_depth > 0)
+		{
+			Frame& frame = _stack[_depth - 1];
+			if (frame._pos < 0)
+			{
+				frame._pos = 0;
+				if (frame._node->_terminal != NULL)
+				{
+					_current = TRadixLeaf<V>::From(frame._node->_terminal);
+					return;
+				}
+			}
+
+			unsigned char byte;
+			TRadixNode* child = TRadixNode::NextChild(frame._node, frame._pos, byte);
+			if (child == NULL)
+				_depth--;
+			else if (TRadixNode::IsLeaf(child))
+			{
+				_current = TRadixLeaf<V>::From(child);
+				return;
+			}
+			else
+				Push(child);
+		}
+	}
+
+	/**
+	* Starts at the first key below a node (or leaf)
+	* @param node The node or tagged leaf (NULL for none)
+	*/
+	void Start(TRadixNode* node)
+	{
+		_stack = _inline;
+		_depth = 0;
+		_capacity = TRADIXTREEITER_STACK;
+		_current = NULL;
+		if (node == NULL)
+			return;
+		if (TRadixNode::IsLeaf(node))
+		{
+			_current = TRadixLeaf<V>::From(node);
+			return;
+		}
+		Push(node);
+		Advance();
+	}
+
+	/**
+	* Starts at the first key with a prefix
+	* @param root The root of the tree
+	* @param prefix The prefix bytes
+	* @param length Number of bytes in the prefix
+	*/
+	void StartPrefix(TRadixNode* root, const unsigned char* prefix, size_t length)
+	{
+		//walk down to the first node whose keys all start with at least length bytes, using only
+		//the stored prefix bytes, then check the prefix against one key below it
+		TRadixNode* node = root;
+		size_t depth = 0;
+		while (node != NULL && !TRadixNode::IsLeaf(node) && depth + node->_prefixLength < length)
+		{
+			depth += node->_prefixLength;
+			TRadixNode** child = TRadixNode::FindChild(node, prefix[depth++]);
+			node = child != NULL ? *child : NULL;
+		}
+
+		if (node != NULL)
+		{
+			TRadixLeaf<V>* leaf = TRadixLeaf<V>::From(TRadixNode::Minimum(node));
+			if (leaf->_length < length || memcmp(leaf->_key, prefix, length) != 0)
+				node = NULL;
+		}
+		Start(node);
+	}
+
+	/**
+	* Not copyable (the stack may be on the heap)
+	*/
+	TRadixTreeIter(const TRadixTreeIter&);
+	TRadixTreeIter& operator=(const TRadixTreeIter&);
+
+public:
+	/**
+	* Constructor which starts at the smallest key of the tree
+	* @param tree The tree to iterate over
+	*/
+	template<typename Alloc>
+	TRadixTreeIter(const TRadixTree<V, Alloc>* tree)
+	{
+		TDS_STAT(_stats = &tree->_stats;)
+		Start(tree->_root);
+	}
+
+	/**
+	* Constructor which starts at the smallest key starting with prefix and stops after the last one
+	* @param tree The tree to iterate over
+	* @param prefix The prefix bytes
+	* @param length Number of bytes in the prefix
+	*/
+	template<typename Alloc>
+	TRadixTreeIter(const TRadixTree<V, Alloc>* tree, const void* prefix, size_t length)
+	{
+		TDS_STAT(_stats = &tree->_stats;)
+		StartPrefix(tree->_root, (const unsigned char*)prefix, length);
+	}
+
+	/**
+	* Constructor which starts at the smallest key starting with a null terminated prefix and stops after the last one
+	* @param tree The tree to iterate over
+	* @param prefix The prefix
+	*/
+	template<typename Alloc>
+	TRadixTreeIter(const TRadixTree<V, Alloc>* tree, const char* prefix)
+	{
+		TDS_STAT(_stats = &tree->_stats;)
+		StartPrefix(tree->_root, (const unsigned char*)prefix, strlen(prefix));
+	}
+
+	/**
+	* Destructor which frees the stack if it outgrew the iterator
+	*/
+	~TRadixTreeIter()
+	{
+		if (_stack != _inline)
+			delete[] _stack;
+	}
+
+	/**
+	* Returns true once every key has been visited
+	* @return Boolean
+	*/
+	inline bool IsFinished() const
+	{
+		return _current == NULL;
+	}
+
+	/**
+	* Moves to the next key
+	*/
+	inline void Next()
+	{
+		if (_current == NULL)
+			return;
+
+		TDS_STAT(_stats->_iteratorNexts++;)
+		Advance();
+	}
+
+	/**
+	* Returns the key of the current entry, null terminated (must not be finished)
+	* @return The key
+	*/
+	inline const char* Key() const
+	{
+		return (const char*)_current->_key;
+	}
+
+	/**
+	* Returns the number of bytes in the key of the current entry (must not be finished)
+	* @return Length
+	*/
+	inline size_t KeyLength() const
+	{
+		return _current->_length;
+	}
+
+	/**
+	* Returns the value of the current entry (must not be finished)
+	* @return Reference to the value
+	*/
+	inline V& Value()
+	{
+		return _current->_value;
+	}
+
+	/**
+	* Overloaded operator to de-reference the iterator to the value of the current entry
+	* @return Reference to the value
+	*/
+	V& operator*()
+	{
+		return Value();
+	}
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,309 @@
+#ifndef TRINGBUFFER_H
+#define TRINGBUFFER_H
+
+/* Include for the allocators */
+#include "TAllocator.h"
+
+/* Include for the head and tail indices */
+#include <atomic>
+
+/* Include for std::this_thread::yield */
+#include <thread>
+
+/* Include for std::move */
+#include <utility>
+
+/* Include for placement new */
+#include <new>
+
+/* Definitions and macros */
+#ifndef NULL
+#define NULL 0
+#endif
+
+#define TRINGBUFFER_CACHE_LINE 64 /**< Bytes kept between the producer and consumer indices */
+#define TRINGBUFFER_SPINS 1024 /**< Failed attempts before a blocking Push/Pop starts yielding */
+
+/**
+* A fixed capacity queue for passing elements from exactly one producer thread to exactly one
+* consumer thread without locks. TryPush and TryPop are wait-free and never allocate - the
+* elements live in one array allocated from Alloc (see TAllocator.h) when the buffer is created.
+* PushMany and PopMany move a whole span for the cost of one index update, and Push and Pop spin
+* (then yield) until there is room or an element.
+*
+* The producer and consumer indices live on separate cache lines, and each side keeps a cached
+* copy of the other side's index so it only reads the shared one when the buffer looks full
+* (or empty). Calling the producer methods from more than one thread (or the consumer methods
+* from more than one thread) is not supported
+*/
+
+template<typename T, typename Alloc = TDefaultAllocator>
+class TRingBuffer
+{
+private:
+	Alloc _alloc; /**< The allocator the array is allocated from */
+
+	T* _data; /**< The elements (Capacity() slots) */
+
+	size_t _mask; /**< Capacity - 1 (the capacity is a power of 2) */
+
+	char _pad0[TRINGBUFFER_CACHE_LINE]; /**< Keeps the read-only fields off the index lines */
+
+	std::atomic<size_t> _head; /**< Number of elements ever popped (written by the consumer) */
+
+	size_t _tailCache; /**< The consumer's last read of _tail */
+
+	char _pad1[TRINGBUFFER_CACHE_LINE]; /**< Keeps the consumer and producer lines apart */
+
+	std::atomic<size_t> _tail; /**< Number of elements ever pushed (written by the producer) */
+
+	size_t _headCache; /**< The producer's last read of _head */
+
+	char _pad2[TRINGBUFFER_CACHE_LINE]; /**< Keeps the producer line apart from whatever follows */
+
+	/**
+	* Allocates the array
+	* @param capacity The minimum number of elements (rounded up to a power of 2)
+	*/
+	void Init(size_t capacity)
+	{
+		size_t size = 2;
+		while (size < capacity)
+			size <<= 1;
+		_mask = size - 1;
+		_data = (T*)_alloc.Allocate(size * sizeof(T));
+		_head.store(0, std::memory_order_relaxed);
+		_tail.store(0, std::memory_order_relaxed);
+		_headCache = 0;
+		_tailCache = 0;
+	}
+
+	/**
+	* Returns the number of free slots as seen by the producer
+	* @param tail The producer's _tail
+	* @param wanted Number of slots the caller needs
+	* @return Free slots (only re-reads _head if fewer than wanted looked free)
+	*/
+	inline size_t FreeSlots(size_t tail, size_t wanted)
+	{
+		size_t free = _mask + 1 - (tail - _headCache);
+		if (free < wanted)
+		{
+			_headCache = _head.load(std::memory_order_acquire);
+			free = _mask + 1 - (tail - _headCache);
+		}
+		return free;
+	}
+
+	/**
+	* Returns the number of elements available as seen by the consumer
+	* @param head The consumer's _head
+	* @param wanted Number of elements the caller needs
+	* @return Available elements (only re-reads _tail if fewer than wanted looked available)
+	*/
+	inline size_t UsedSlots(size_t head, size_t wanted)
+	{
+		size_t used = _tailCache - head;
+		if (used < wanted)
+		{
+			_tailCache = _tail.load(std::memory_order_acquire);
+			used = _tailCache - head;
+		}
+		return used;
+	}
+
+	/**
+	* Not copyable (the buffer is shared between two threads by reference)
+	*/
+	TRingBuffer(const TRingBuffer&);
+	TRingBuffer& operator=(const TRingBuffer&);
+
+public:
+	/**
+	* Constructor of an empty buffer
+	* @param capacity The minimum number of elements it can hold (rounded up to a power of 2)
+	*/
+	TRingBuffer(size_t capacity)
+	{
+		Init(capacity);
+	}
+
+	/**
+	* Overloaded constructor which takes the allocator to allocate the array from
+	* @param capacity The minimum number of elements it can hold (rounded up to a power of 2)
+	* @param alloc The allocator (copied)
+	*/
+	TRingBuffer(size_t capacity, const Alloc& alloc) : _alloc(alloc)
+	{
+		Init(capacity);
+	}
+
+	/**
+	* Default destructor which destroys any elements still queued and frees the array
+	*/
+	~TRingBuffer()
+	{
+		size_t tail = _tail.load(std::memory_order_relaxed);
+		for (size_t i = _head.load(std::memory_order_relaxed); i != tail; i++)
+			_data[i & _mask].~T();
+		_alloc.Free(_data, (_mask + 1) * sizeof(T));
+	}
+
+	/**
+	* Appends data if there is room (producer only, wait-free)
+	* @param data The data to copy in
+	* @return False if the buffer was full
+	*/
+	bool TryPush(const T& data)
+	{
+		size_t tail = _tail.load(std::memory_order_relaxed);
+		if (FreeSlots(tail, 1) == 0)
+			return false;
+		new(&_data[tail & _mask]) T(data);
+		_tail.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+
+	/**
+	* Appends data if there is room (producer only, wait-free)
+	* @param data The data to move in
+	* @return False if the buffer was full
+	*/
+	bool TryPush(T&& data)
+	{
+		size_t tail = _tail.load(std::memory_order_relaxed);
+		if (FreeSlots(tail, 1) == 0)
+			return false;
+		new(&_data[tail & _mask]) T(std::move(data));
+		_tail.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+
+	/**
+	* Removes the oldest element if there is one (consumer only, wait-free)
+	* @param out Receives the element
+	* @return False if the buffer was empty
+	*/
+	bool TryPop(T& out)
+	{
+		size_t head = _head.load(std::memory_order_relaxed);
+		if (UsedSlots(head, 1) == 0)
+			return false;
+		T& slot = _data[head & _mask];
+		out = std::move(slot);
+		slot.~T();
+		_head.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+	/**
+	* Appends as many of the count elements as fit in one go (producer only, wait-free)
+	* @param data The elements to copy in
+	* @param count Number of elements
+	* @return Number of elements pushed (the first ones of data, 0 if count is not positive)
+	*/
+	int PushMany(const T* data, int count)
+	{
+		if (count <= 0)
+			return 0;
+
+		size_t tail = _tail.load(std::memory_order_relaxed);
+		size_t free = FreeSlots(tail, (size_t)count);
+		size_t n = (size_t)count < free ? (size_t)count : free;
+		for (size_t i = 0; i < n; i++)
+			new(&_data[(tail + i) & _mask]) T(data[i]);
+		if (n > 0)
+			_tail.store(tail + n, std::memory_order_release);
+		return (int)n;
+	}
+
+	/**
+	* Removes up to count of the oldest elements in one go (consumer only, wait-free)
+	* @param out Receives the elements in order
+	* @param count The most elements to pop
+	* @return Number of elements popped (0 if count is not positive)
+	*/
+	int PopMany(T* out, int count)
+	{
+		if (count <= 0)
+			return 0;
+
+		size_t head = _head.load(std::memory_order_relaxed);
+		size_t used = UsedSlots(head, (size_t)count);
+		size_t n = (size_t)count < used ? (size_t)count : used;
+		for (size_t i = 0; i < n; i++)
+		{
+			T& slot = _data[(head + i) & _mask];
+			out[i] = std::move(slot);
+			slot.~T();
+		}
+		if (n > 0)
+			_head.store(head + n, std::memory_order_release);
+		return (int)n;
+	}
+
+	/**
+	* Appends data, waiting for room if the buffer is full (producer only)
+	* @param data The data to copy in
+	*/
+	void Push(const T& data)
+	{
+		//count failed attempts only up to the limit so a long wait can't overflow
+		for (int spins = 0; !TryPush(data); )
+		{
+			if (spins < TRINGBUFFER_SPINS)
+				spins++;
+			else
+				std::this_thread::yield();
+		}
+	}
+
+	/**
+	* Removes the oldest element, waiting for one if the buffer is empty (consumer only)
+	* @return The element
+	*/
+	T Pop()
+	{
+		T ret;
+		for (int spins = 0; !TryPop(ret); )
+		{
+			if (spins < TRINGBUFFER_SPINS)
+				spins++;
+			else
+				std::this_thread::yield();
+		}
+		return ret;
+	}
+
+	/**
+	* Returns the number of queued elements (exact only from the producer or consumer thread
+	* while the other side is idle)
+	* @return Element count
+	*/
+	inline int Count() const
+	{
+		//read head first so the tail read can never be older than it
+		size_t head = _head.load(std::memory_order_acquire);
+		return (int)(_tail.load(std::memory_order_acquire) - head);
+	}
+
+	/**
+	* Returns true if nothing is queued
+	* @return Boolean
+	*/
+	inline bool IsEmpty() const
+	{
+		return Count() == 0;
+	}
+
+	/**
+	* Returns the number of elements the buffer can hold
+	* @return Capacity (a power of 2)
+	*/
+	inline int Capacity() const
+	{
+		return (int)(_mask + 1);
+	}
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,296 @@
+#ifndef TSERIALIZE_H
+#define TSERIALIZE_H
+
+/* Includes for the streams and fixed size integers */
+#include <istream>
+#include <ostream>
+#include <stdint.h>
+#include <string.h>
+#include <type_traits>
+
+/**
+* Describes how elements of type T are written to and read from a snapshot (see TTree::Serialize
+* and TList::Serialize). Trivially copyable types are written as raw bytes in large batches.
+* For any other type specialize this template with IsBitwise = false and your own Write/Read, e.g.
+*
+*	template<> struct TSerializeTraits<MyType>
+*	{
+*		static const bool IsBitwise = false;
+*		static bool Write(std::ostream& stream, const MyType& value) { ... }
+*		static bool Read(std::istream& stream, MyType& value) { ... }
+*	};
+*
+* Note that pointers are trivially copyable but writing them is rarely meaningful.
+*/
+
+template<typename T>
+struct TSerializeTraits
+{
+	static const bool IsBitwise = std::is_trivially_copyable<T>::value; /**< True if elements can be copied as raw bytes */
+
+	/**
+	* Writes one element
+	* @param stream The stream to write to
+	* @param value The element
+	* @return True if the write succeeded
+	*/
+	static bool Write(std::ostream& stream, const T& value)
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "specialize TSerializeTraits for types that are not trivially copyable");
+		stream.write((const char*)&value, sizeof(T));
+		return stream.good();
+	}
+
+	/**
+	* Reads one element
+	* @param stream The stream to read from
+	* @param value The element to read into
+	* @return True if the read succeeded
+	*/
+	static bool Read(std::istream& stream, T& value)
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "specialize TSerializeTraits for types that are not trivially copyable");
+		stream.read((char*)&value, sizeof(T));
+		return stream.good();
+	}
+};
+
+/**
+* The kind of container a snapshot was written from
+*/
+enum TSnapshotKind
+{
+	TSNAPSHOT_LIST = 1,
+	TSNAPSHOT_TREE = 2
+};
+
+/**
+* The header at the start of every snapshot. Elements follow it in the order of the
+* container (sorted for trees). Snapshots use the byte order of the machine that wrote them
+*/
+
+struct TSnapshotHeader
+{
+	char _magic[4]; /**< Always "TDSS" */
+	uint32_t _byteOrder; /**< 0x01020304 written in native byte order (used to reject foreign snapshots) */
+	uint32_t _version; /**< Format version (currently 1) */
+	uint32_t _kind; /**< A TSnapshotKind */
+	uint32_t _elementSize; /**< sizeof(T) of the writer (0 for elements written with custom traits) */
+	uint32_t _reserved; /**< Padding (always 0) */
+	uint64_t _count; /**< Number of elements that follow */
+
+	/**
+	* Fills in the header for a snapshot
+	* @param kind The kind of container
+	* @param elementSize sizeof(T) for bitwise elements or 0
+	* @param count The number of elements
+	*/
+	void Set(TSnapshotKind kind, uint32_t elementSize, uint64_t count)
+	{
+		memcpy(_magic, "TDSS", 4);
+		_byteOrder = 0x01020304;
+		_version = 1;
+		_kind = (uint32_t)kind;
+		_elementSize = elementSize;
+		_reserved = 0;
+		_count = count;
+	}
+
+	/**
+	* Checks the header was written by a compatible writer
+	* @param kind The kind of container expected
+	* @param elementSize The element size expected
+	* @return True if the snapshot can be read
+	*/
+	bool IsValid(TSnapshotKind kind, uint32_t elementSize) const
+	{
+		return memcmp(_magic, "TDSS", 4) == 0 && _byteOrder == 0x01020304 && _version == 1 &&
+			_kind == (uint32_t)kind && _elementSize == elementSize;
+	}
+};
+
+/**
+* Size of the buffer used to write or read bitwise elements in blocks
+*/
+#define TSNAPSHOT_BUFFER_BYTES 65536
+
+/**
+* Writes the snapshot header for count elements of type T
+* @param stream The stream to write to
+* @param kind The kind of container
+* @param count The number of elements that will follow
+* @return True if the write succeeded
+*/
+template<typename T>
+bool TWriteSnapshotHeader(std::ostream& stream, TSnapshotKind kind, uint64_t count)
+{
+	TSnapshotHeader header;
+	header.Set(kind, TSerializeTraits<T>::IsBitwise ? (uint32_t)sizeof(T) : 0, count);
+	stream.write((const char*)&header, sizeof(header));
+	return stream.good();
+}
+
+/**
+* Reads and checks a snapshot header for elements of type T
+* @param stream The stream to read from
+* @param kind The kind of container expected
+* @param count Set to the number of elements that follow
+* @return True if the header was read and is compatible
+*/
+template<typename T>
+bool TReadSnapshotHeader(std::istream& stream, TSnapshotKind kind, uint64_t& count)
+{
+	TSnapshotHeader header;
+	stream.read((char*)&header, sizeof(header));
+	if (!stream.good() || !header.IsValid(kind, TSerializeTraits<T>::IsBitwise ? (uint32_t)sizeof(T) : 0))
+		return false;
+	count = header._count;
+	return true;
+}
+
+/**
+* Buffers bitwise elements so they are written to the stream in large blocks
+* (elements with custom traits are written one by one)
+*/
+
+template<typename T, bool Bitwise = TSerializeTraits<T>::IsBitwise>
+class TSnapshotWriter
+{
+private:
+	std::ostream& _stream; /**< The stream being written */
+	char* _buffer; /**< Elements waiting to be written */
+	int _batch; /**< Number of elements _buffer can hold */
+	int _used; /**< Number of elements in _buffer */
+
+	TSnapshotWriter(const TSnapshotWriter&);
+	TSnapshotWriter& operator=(const TSnapshotWriter&);
+
+public:
+	TSnapshotWriter(std::ostream& stream) : _stream(stream), _used(0)
+	{
+		_batch = sizeof(T) < TSNAPSHOT_BUFFER_BYTES ? (int)(TSNAPSHOT_BUFFER_BYTES / sizeof(T)) : 1;
+		_buffer = new char[_batch * sizeof(T)];
+	}
+
+	~TSnapshotWriter()
+	{
+		delete[] _buffer;
+	}
+
+	/**
+	* Adds an element to the snapshot
+	* @param value The element
+	* @return True if no write has failed
+	*/
+	inline bool Write(const T& value)
+	{
+		memcpy(_buffer + _used * sizeof(T), &value, sizeof(T));
+		if (++_used == _batch)
+			return Flush();
+		return true;
+	}
+
+	/**
+	* Writes any buffered elements
+	* @return True if no write has failed
+	*/
+	bool Flush()
+	{
+		if (_used > 0)
+			_stream.write(_buffer, (std::streamsize)(_used * sizeof(T)));
+		_used = 0;
+		return _stream.good();
+	}
+};
+
+template<typename T>
+class TSnapshotWriter<T, false>
+{
+private:
+	std::ostream& _stream; /**< The stream being written */
+
+public:
+	TSnapshotWriter(std::ostream& stream) : _stream(stream) {}
+
+	inline bool Write(const T& value)
+	{
+		return TSerializeTraits<T>::Write(_stream, value);
+	}
+
+	bool Flush()
+	{
+		return _stream.good();
+	}
+};
+
+/**
+* Reads elements from a snapshot, in large blocks for bitwise elements
+*/
+
+template<typename T, bool Bitwise = TSerializeTraits<T>::IsBitwise>
+class TSnapshotReader
+{
+private:
+	std::istream& _stream; /**< The stream being read */
+	char* _buffer; /**< Elements read but not yet handed out */
+	int _batch; /**< Number of elements _buffer can hold */
+	uint64_t _remaining; /**< Elements still in the stream */
+	int _used; /**< Number of elements in _buffer */
+	int _next; /**< Index of the next element to hand out */
+
+	TSnapshotReader(const TSnapshotReader&);
+	TSnapshotReader& operator=(const TSnapshotReader&);
+
+public:
+	TSnapshotReader(std::istream& stream, uint64_t count) : _stream(stream), _remaining(count), _used(0), _next(0)
+	{
+		_batch = sizeof(T) < TSNAPSHOT_BUFFER_BYTES ? (int)(TSNAPSHOT_BUFFER_BYTES / sizeof(T)) : 1;
+		_buffer = new char[_batch * sizeof(T)];
+	}
+
+	~TSnapshotReader()
+	{
+		delete[] _buffer;
+	}
+
+	/**
+	* Reads the next element
+	* @param value The element to read into
+	* @return True if the element was read
+	*/
+	inline bool Read(T& value)
+	{
+		if (_next == _used)
+		{
+			int batch = _remaining < (uint64_t)_batch ? (int)_remaining : _batch;
+			if (batch == 0)
+				return false;
+			_stream.read(_buffer, (std::streamsize)(batch * sizeof(T)));
+			if (!_stream.good())
+				return false;
+			_remaining -= batch;
+			_used = batch;
+			_next = 0;
+		}
+		memcpy(&value, _buffer + _next * sizeof(T), sizeof(T));
+		_next++;
+		return true;
+	}
+};
+
+template<typename T>
+class TSnapshotReader<T, false>
+{
+private:
+	std::istream& _stream; /**< The stream being read */
+
+public:
+	TSnapshotReader(std::istream& stream, uint64_t count) : _stream(stream) { (void)count; }
+
+	inline bool Read(T& value)
+	{
+		return TSerializeTraits<T>::Read(_stream, value);
+	}
+};
+
+#endif
\ No newline at end of file
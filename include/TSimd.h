@@ -0,0 +1,598 @@
+#ifndef TSIMD_H
+#define TSIMD_H
+
+/* Include for size_t */
+#include <stddef.h>
+
+/* Include for std::declval */
+#include <utility>
+
+/* Include for std::is_integral */
+#include <type_traits>
+
+/* Include for the x86 intrinsics (the kernels are compiled per instruction set and picked at runtime) */
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__)) && !defined(TDS_DISABLE_SIMD)
+#define TDS_SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+/**
+* Reduction and filter kernels over arrays of elements (the Sum, MinMax, CountIf and FilterInto
+* methods of the containers use them). For int and float arrays they run SSE2 or AVX2 code picked
+* at runtime from what the CPU supports; every other type, and every container that stores its
+* elements in nodes, uses a plain loop. Define TDS_DISABLE_SIMD to always use the plain loops.
+*
+* CountIf and FilterInto take any predicate functor, but only TInRange is vectorized. Float sums
+* are accumulated in double in a different order to a plain loop so the last bits can differ,
+* and MinMax of float arrays holding NaN is unspecified.
+*/
+
+/**
+* The instruction sets the kernels can use
+*/
+enum TSimdLevel
+{
+	TSIMD_SCALAR, /**< Plain loops */
+	TSIMD_SSE2, /**< 128 bit vectors */
+	TSIMD_AVX2 /**< 256 bit vectors */
+};
+
+/**
+* Returns the best instruction set the CPU supports (detected once)
+* @return The level
+*/
+inline TSimdLevel TSimdDetect()
+{
+#ifdef TDS_SIMD_X86
+	static const TSimdLevel level = []()
+	{
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2"))
+			return TSIMD_AVX2;
+		if (__builtin_cpu_supports("sse2"))
+			return TSIMD_SSE2;
+		return TSIMD_SCALAR;
+	}();
+	return level;
+#else
+	return TSIMD_SCALAR;
+#endif
+}
+
+/**
+* Predicate which is true for values in [lo, hi] (use numeric_limits for one sided ranges).
+* CountIf and FilterInto vectorize it for int and float
+*/
+template<typename T>
+struct TInRange
+{
+	T _lo; /**< The smallest value in the range */
+
+	T _hi; /**< The largest value in the range */
+
+	/**
+	* Constructor
+	* @param lo The smallest value in the range
+	* @param hi The largest value in the range
+	*/
+	TInRange(T lo, T hi) : _lo(lo), _hi(hi)
+	{
+	}
+
+	inline bool operator()(const T& value) const
+	{
+		return _lo <= value && value <= _hi;
+	}
+};
+
+/**
+* The type Sum returns - integers widen to long long (unsigned long long for unsigned types) and
+* float to double so the sum can't overflow, otherwise what T + T gives (or T itself for types that
+* can't be added, so containers of them still compile as long as Sum is never called)
+*/
+template<typename T, typename = void>
+struct TSumType
+{
+	typedef T Type;
+};
+
+template<typename T>
+struct TSumType<T, decltype(void(std::declval<const T&>() + std::declval<const T&>()))>
+{
+	typedef typename std::conditional<std::is_integral<T>::value,
+		typename std::conditional<std::is_signed<T>::value, long long, unsigned long long>::type,
+		decltype(std::declval<const T&>() + std::declval<const T&>())>::type Type;
+};
+
+template<>
+struct TSumType<float>
+{
+	typedef double Type;
+};
+
+/**
+* The plain loop kernels (used for every type without vectorized kernels and as the tail of the
+* vectorized ones)
+*/
+template<typename T>
+struct TScalarKernels
+{
+	typedef typename TSumType<T>::Type SumType;
+
+	static SumType Sum(const T* data, size_t count)
+	{
+		SumType sum = SumType();
+		for (size_t i = 0; i < count; i++)
+			sum += data[i];
+		return sum;
+	}
+
+	static void MinMax(const T* data, size_t count, T& min, T& max)
+	{
+		for (size_t i = 0; i < count; i++)
+		{
+			if (data[i] < min) min = data[i];
+			if (max < data[i]) max = data[i];
+		}
+	}
+
+	template<typename Pred>
+	static size_t CountIf(const T* data, size_t count, const Pred& pred)
+	{
+		size_t ret = 0;
+		for (size_t i = 0; i < count; i++)
+			ret += pred(data[i]) ? 1 : 0;
+		return ret;
+	}
+
+	template<typename Pred>
+	static size_t FilterInto(const T* data, size_t count, const Pred& pred, T* out)
+	{
+		size_t ret = 0;
+		for (size_t i = 0; i < count; i++)
+		{
+			if (pred(data[i]))
+				out[ret++] = data[i];
+		}
+		return ret;
+	}
+};
+
+#ifdef TDS_SIMD_X86
+
+/* ---- AVX2 kernels ---- */
+
+__attribute__((target("avx2"))) inline long long TSumAvx2(const int* data, size_t count, size_t& done)
+{
+	__m256i acc0 = _mm256_setzero_si256(), acc1 = _mm256_setzero_si256();
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		__m256i v = _mm256_loadu_si256((const __m256i*)(data + i));
+		acc0 = _mm256_add_epi64(acc0, _mm256_cvtepi32_epi64(_mm256_castsi256_si128(v)));
+		acc1 = _mm256_add_epi64(acc1, _mm256_cvtepi32_epi64(_mm256_extracti128_si256(v, 1)));
+	}
+	long long lanes[4];
+	_mm256_storeu_si256((__m256i*)lanes, _mm256_add_epi64(acc0, acc1));
+	done = i;
+	return lanes[0] + lanes[1] + lanes[2] + lanes[3];
+}
+
+__attribute__((target("avx2"))) inline double TSumAvx2(const float* data, size_t count, size_t& done)
+{
+	__m256d acc0 = _mm256_setzero_pd(), acc1 = _mm256_setzero_pd();
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		acc0 = _mm256_add_pd(acc0, _mm256_cvtps_pd(_mm_loadu_ps(data + i)));
+		acc1 = _mm256_add_pd(acc1, _mm256_cvtps_pd(_mm_loadu_ps(data + i + 4)));
+	}
+	double lanes[4];
+	_mm256_storeu_pd(lanes, _mm256_add_pd(acc0, acc1));
+	done = i;
+	return lanes[0] + lanes[1] + lanes[2] + lanes[3];
+}
+
+__attribute__((target("avx2"))) inline size_t TMinMaxAvx2(const int* data, size_t count, int& min, int& max)
+{
+	__m256i lo = _mm256_set1_epi32(min), hi = _mm256_set1_epi32(max);
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		__m256i v = _mm256_loadu_si256((const __m256i*)(data + i));
+		lo = _mm256_min_epi32(lo, v);
+		hi = _mm256_max_epi32(hi, v);
+	}
+	int los[8], his[8];
+	_mm256_storeu_si256((__m256i*)los, lo);
+	_mm256_storeu_si256((__m256i*)his, hi);
+	TScalarKernels<int>::MinMax(los, 8, min, max);
+	TScalarKernels<int>::MinMax(his, 8, min, max);
+	return i;
+}
+
+__attribute__((target("avx2"))) inline size_t TMinMaxAvx2(const float* data, size_t count, float& min, float& max)
+{
+	__m256 lo = _mm256_set1_ps(min), hi = _mm256_set1_ps(max);
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		__m256 v = _mm256_loadu_ps(data + i);
+		lo = _mm256_min_ps(lo, v);
+		hi = _mm256_max_ps(hi, v);
+	}
+	float los[8], his[8];
+	_mm256_storeu_ps(los, lo);
+	_mm256_storeu_ps(his, hi);
+	TScalarKernels<float>::MinMax(los, 8, min, max);
+	TScalarKernels<float>::MinMax(his, 8, min, max);
+	return i;
+}
+
+/**
+* Returns a bit per element of the 8 at data that is in range
+*/
+__attribute__((target("avx2"))) inline int TInRangeMaskAvx2(const int* data, __m256i lo, __m256i hi)
+{
+	__m256i v = _mm256_loadu_si256((const __m256i*)data);
+	__m256i out = _mm256_or_si256(_mm256_cmpgt_epi32(lo, v), _mm256_cmpgt_epi32(v, hi));
+	return ~_mm256_movemask_ps(_mm256_castsi256_ps(out)) & 0xFF;
+}
+
+__attribute__((target("avx2"))) inline int TInRangeMaskAvx2(const float* data, __m256 lo, __m256 hi)
+{
+	__m256 v = _mm256_loadu_ps(data);
+	__m256 in = _mm256_and_ps(_mm256_cmp_ps(v, lo, _CMP_GE_OQ), _mm256_cmp_ps(v, hi, _CMP_LE_OQ));
+	return _mm256_movemask_ps(in);
+}
+
+__attribute__((target("avx2,popcnt"))) inline size_t TCountInRangeAvx2(const int* data, size_t count, const TInRange<int>& range, size_t& done)
+{
+	__m256i lo = _mm256_set1_epi32(range._lo), hi = _mm256_set1_epi32(range._hi);
+	size_t ret = 0, i = 0;
+	for (; i + 8 <= count; i += 8)
+		ret += (size_t)__builtin_popcount((unsigned int)TInRangeMaskAvx2(data + i, lo, hi));
+	done = i;
+	return ret;
+}
+
+__attribute__((target("avx2,popcnt"))) inline size_t TCountInRangeAvx2(const float* data, size_t count, const TInRange<float>& range, size_t& done)
+{
+	__m256 lo = _mm256_set1_ps(range._lo), hi = _mm256_set1_ps(range._hi);
+	size_t ret = 0, i = 0;
+	for (; i + 8 <= count; i += 8)
+		ret += (size_t)__builtin_popcount((unsigned int)TInRangeMaskAvx2(data + i, lo, hi));
+	done = i;
+	return ret;
+}
+
+__attribute__((target("avx2"))) inline size_t TFilterInRangeAvx2(const int* data, size_t count, const TInRange<int>& range, int* out, size_t& done)
+{
+	__m256i lo = _mm256_set1_epi32(range._lo), hi = _mm256_set1_epi32(range._hi);
+	size_t ret = 0, i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		int mask = TInRangeMaskAvx2(data + i, lo, hi);
+		if (mask == 0)
+			continue;
+		//branch free compaction (out has room for every element so the extra writes are harmless)
+		for (int j = 0; j < 8; j++)
+		{
+			out[ret] = data[i + j];
+			ret += (mask >> j) & 1;
+		}
+	}
+	done = i;
+	return ret;
+}
+
+__attribute__((target("avx2"))) inline size_t TFilterInRangeAvx2(const float* data, size_t count, const TInRange<float>& range, float* out, size_t& done)
+{
+	__m256 lo = _mm256_set1_ps(range._lo), hi = _mm256_set1_ps(range._hi);
+	size_t ret = 0, i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		int mask = TInRangeMaskAvx2(data + i, lo, hi);
+		if (mask == 0)
+			continue;
+		for (int j = 0; j < 8; j++)
+		{
+			out[ret] = data[i + j];
+			ret += (mask >> j) & 1;
+		}
+	}
+	done = i;
+	return ret;
+}
+
+/* ---- SSE2 kernels ---- */
+
+__attribute__((target("sse2"))) inline long long TSumSse2(const int* data, size_t count, size_t& done)
+{
+	__m128i acc = _mm_setzero_si128();
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i*)(data + i));
+		__m128i sign = _mm_srai_epi32(v, 31);
+		acc = _mm_add_epi64(acc, _mm_unpacklo_epi32(v, sign));
+		acc = _mm_add_epi64(acc, _mm_unpackhi_epi32(v, sign));
+	}
+	long long lanes[2];
+	_mm_storeu_si128((__m128i*)lanes, acc);
+	done = i;
+	return lanes[0] + lanes[1];
+}
+
+__attribute__((target("sse2"))) inline double TSumSse2(const float* data, size_t count, size_t& done)
+{
+	__m128d acc0 = _mm_setzero_pd(), acc1 = _mm_setzero_pd();
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 v = _mm_loadu_ps(data + i);
+		acc0 = _mm_add_pd(acc0, _mm_cvtps_pd(v));
+		acc1 = _mm_add_pd(acc1, _mm_cvtps_pd(_mm_movehl_ps(v, v)));
+	}
+	double lanes[2];
+	_mm_storeu_pd(lanes, _mm_add_pd(acc0, acc1));
+	done = i;
+	return lanes[0] + lanes[1];
+}
+
+__attribute__((target("sse2"))) inline size_t TMinMaxSse2(const int* data, size_t count, int& min, int& max)
+{
+	__m128i lo = _mm_set1_epi32(min), hi = _mm_set1_epi32(max);
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		//SSE2 has no 32 bit min/max so select with compare masks
+		__m128i v = _mm_loadu_si128((const __m128i*)(data + i));
+		__m128i less = _mm_cmplt_epi32(v, lo);
+		lo = _mm_or_si128(_mm_and_si128(less, v), _mm_andnot_si128(less, lo));
+		__m128i greater = _mm_cmpgt_epi32(v, hi);
+		hi = _mm_or_si128(_mm_and_si128(greater, v), _mm_andnot_si128(greater, hi));
+	}
+	int los[4], his[4];
+	_mm_storeu_si128((__m128i*)los, lo);
+	_mm_storeu_si128((__m128i*)his, hi);
+	TScalarKernels<int>::MinMax(los, 4, min, max);
+	TScalarKernels<int>::MinMax(his, 4, min, max);
+	return i;
+}
+
+__attribute__((target("sse2"))) inline size_t TMinMaxSse2(const float* data, size_t count, float& min, float& max)
+{
+	__m128 lo = _mm_set1_ps(min), hi = _mm_set1_ps(max);
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 v = _mm_loadu_ps(data + i);
+		lo = _mm_min_ps(lo, v);
+		hi = _mm_max_ps(hi, v);
+	}
+	float los[4], his[4];
+	_mm_storeu_ps(los, lo);
+	_mm_storeu_ps(his, hi);
+	TScalarKernels<float>::MinMax(los, 4, min, max);
+	TScalarKernels<float>::MinMax(his, 4, min, max);
+	return i;
+}
+
+__attribute__((target("sse2"))) inline int TInRangeMaskSse2(const int* data, __m128i lo, __m128i hi)
+{
+	__m128i v = _mm_loadu_si128((const __m128i*)data);
+	__m128i out = _mm_or_si128(_mm_cmplt_epi32(v, lo), _mm_cmpgt_epi32(v, hi));
+	return ~_mm_movemask_ps(_mm_castsi128_ps(out)) & 0xF;
+}
+
+__attribute__((target("sse2"))) inline int TInRangeMaskSse2(const float* data, __m128 lo, __m128 hi)
+{
+	__m128 v = _mm_loadu_ps(data);
+	return _mm_movemask_ps(_mm_and_ps(_mm_cmpge_ps(v, lo), _mm_cmple_ps(v, hi)));
+}
+
+template<typename T, typename V>
+__attribute__((target("sse2"))) inline size_t TCountInRangeSse2(const T* data, size_t count, V lo, V hi, size_t& done)
+{
+	size_t ret = 0, i = 0;
+	for (; i + 4 <= count; i += 4)
+		ret += (size_t)__builtin_popcount((unsigned int)TInRangeMaskSse2(data + i, lo, hi));
+	done = i;
+	return ret;
+}
+
+template<typename T, typename V>
+__attribute__((target("sse2"))) inline size_t TFilterInRangeSse2(const T* data, size_t count, V lo, V hi, T* out, size_t& done)
+{
+	size_t ret = 0, i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		int mask = TInRangeMaskSse2(data + i, lo, hi);
+		if (mask == 0)
+			continue;
+		for (int j = 0; j < 4; j++)
+		{
+			out[ret] = data[i + j];
+			ret += (mask >> j) & 1;
+		}
+	}
+	done = i;
+	return ret;
+}
+
+/**
+* Vectorized kernels for int and float (anything they don't handle falls through to the loops)
+*/
+template<typename T>
+struct TSimdVectorKernels
+{
+	typedef typename TSumType<T>::Type SumType;
+
+	static SumType Sum(const T* data, size_t count)
+	{
+		size_t done = 0;
+		SumType sum = SumType();
+		TSimdLevel level = TSimdDetect();
+		if (level == TSIMD_AVX2)
+			sum = TSumAvx2(data, count, done);
+		else if (level == TSIMD_SSE2)
+			sum = TSumSse2(data, count, done);
+		return sum + TScalarKernels<T>::Sum(data + done, count - done);
+	}
+
+	static void MinMax(const T* data, size_t count, T& min, T& max)
+	{
+		size_t done = 0;
+		TSimdLevel level = TSimdDetect();
+		if (level == TSIMD_AVX2)
+			done = TMinMaxAvx2(data, count, min, max);
+		else if (level == TSIMD_SSE2)
+			done = TMinMaxSse2(data, count, min, max);
+		TScalarKernels<T>::MinMax(data + done, count - done, min, max);
+	}
+
+	template<typename Pred>
+	static size_t CountIf(const T* data, size_t count, const Pred& pred)
+	{
+		return TScalarKernels<T>::CountIf(data, count, pred);
+	}
+
+	static size_t CountIf(const T* data, size_t count, const TInRange<T>& range)
+	{
+		size_t done = 0, ret = 0;
+		TSimdLevel level = TSimdDetect();
+		if (level == TSIMD_AVX2)
+			ret = TCountInRangeAvx2(data, count, range, done);
+		else if (level == TSIMD_SSE2)
+			ret = CountInRangeSse2(data, count, range, done);
+		return ret + TScalarKernels<T>::CountIf(data + done, count - done, range);
+	}
+
+	template<typename Pred>
+	static size_t FilterInto(const T* data, size_t count, const Pred& pred, T* out)
+	{
+		return TScalarKernels<T>::FilterInto(data, count, pred, out);
+	}
+
+	static size_t FilterInto(const T* data, size_t count, const TInRange<T>& range, T* out)
+	{
+		size_t done = 0, ret = 0;
+		TSimdLevel level = TSimdDetect();
+		if (level == TSIMD_AVX2)
+			ret = TFilterInRangeAvx2(data, count, range, out, done);
+		else if (level == TSIMD_SSE2)
+			ret = FilterInRangeSse2(data, count, range, out, done);
+		return ret + TScalarKernels<T>::FilterInto(data + done, count - done, range, out + ret);
+	}
+
+private:
+	static size_t CountInRangeSse2(const int* data, size_t count, const TInRange<int>& range, size_t& done)
+	{
+		return TCountInRangeSse2(data, count, _mm_set1_epi32(range._lo), _mm_set1_epi32(range._hi), done);
+	}
+
+	static size_t CountInRangeSse2(const float* data, size_t count, const TInRange<float>& range, size_t& done)
+	{
+		return TCountInRangeSse2(data, count, _mm_set1_ps(range._lo), _mm_set1_ps(range._hi), done);
+	}
+
+	static size_t FilterInRangeSse2(const int* data, size_t count, const TInRange<int>& range, int* out, size_t& done)
+	{
+		return TFilterInRangeSse2(data, count, _mm_set1_epi32(range._lo), _mm_set1_epi32(range._hi), out, done);
+	}
+
+	static size_t FilterInRangeSse2(const float* data, size_t count, const TInRange<float>& range, float* out, size_t& done)
+	{
+		return TFilterInRangeSse2(data, count, _mm_set1_ps(range._lo), _mm_set1_ps(range._hi), out, done);
+	}
+};
+
+/**
+* The kernels each type uses (the plain loops unless vectorized below)
+*/
+template<typename T>
+struct TSimdKernels : public TScalarKernels<T>
+{
+};
+
+template<>
+struct TSimdKernels<int> : public TSimdVectorKernels<int>
+{
+};
+
+template<>
+struct TSimdKernels<float> : public TSimdVectorKernels<float>
+{
+};
+
+#else
+
+/**
+* The kernels each type uses (always the plain loops without SIMD support)
+*/
+template<typename T>
+struct TSimdKernels : public TScalarKernels<T>
+{
+};
+
+#endif
+
+/**
+* Returns the sum of count elements
+* @param data The elements
+* @param count Number of elements
+* @return The sum (see TSumType)
+*/
+template<typename T>
+inline typename TSumType<T>::Type TSum(const T* data, size_t count)
+{
+	return TSimdKernels<T>::Sum(data, count);
+}
+
+/**
+* Finds the smallest and largest of count elements
+* @param data The elements
+* @param count Number of elements
+* @param min Receives the smallest element
+* @param max Receives the largest element
+* @return False if count is 0 (min and max are left untouched)
+*/
+template<typename T>
+inline bool TMinMax(const T* data, size_t count, T& min, T& max)
+{
+	if (count == 0)
+		return false;
+	min = max = data[0];
+	TSimdKernels<T>::MinMax(data + 1, count - 1, min, max);
+	return true;
+}
+
+/**
+* Counts the elements pred is true for
+* @param data The elements
+* @param count Number of elements
+* @param pred Predicate functor (TInRange is vectorized)
+* @return Number of matching elements
+*/
+template<typename T, typename Pred>
+inline size_t TCountIf(const T* data, size_t count, const Pred& pred)
+{
+	return TSimdKernels<T>::CountIf(data, count, pred);
+}
+
+/**
+* Copies the elements pred is true for to out, keeping their order
+* @param data The elements
+* @param count Number of elements
+* @param pred Predicate functor (TInRange is vectorized)
+* @param out Receives the matching elements (must have room for count elements)
+* @return Number of elements copied
+*/
+template<typename T, typename Pred>
+inline size_t TFilterInto(const T* data, size_t count, const Pred& pred, T* out)
+{
+	return TSimdKernels<T>::FilterInto(data, count, pred, out);
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,788 @@
+#ifndef TSKIPLIST_H
+#define TSKIPLIST_H
+
+/* Include for the allocators */
+#include "TAllocator.h"
+
+/* Include for the default ordering */
+#include "TCompare.h"
+
+/* Include for the atomic links and counters */
+#include <atomic>
+
+/* Include for placement new */
+#include <new>
+
+/* Include for uintptr_t */
+#include <stdint.h>
+
+/* Definitions and macros */
+#ifndef NULL
+#define NULL 0
+#endif
+
+#define TSKIPLIST_MAX_LEVEL 16 /**< Tallest tower (with 1 in 4 nodes promoted per level this covers billions of elements) */
+#define TSKIPLIST_READER_STRIPES 16 /**< Number of cache line padded reader counters per epoch */
+#define TSKIPLIST_RECLAIM_BATCH 128 /**< Erased nodes retired between attempts to free them */
+
+/**
+* Macro to iterate over a skip list (that is not a pointer) in order
+*/
+#define TSKIPLIST_foreach(Type, name, in_list) for (TSkipListIter<Type> name(&in_list); !name.IsFinished(); name.Next())
+
+/* Forward Decl */
+template<typename T> class TSkipListIter;
+
+/**
+* A skip list node. The tower of next links is allocated inline after the node so a node of
+* height h is one allocation of SizeFor(h) bytes - with 1 in 4 nodes promoted per level the
+* average node carries 1.33 links. The low bit of a link marks this node as erased at that level
+*/
+
+template<typename T>
+struct TSkipListNode
+{
+	T _data; /**< The data held by this node */
+
+	std::atomic<unsigned int> _flags; /**< LINKED once the inserter is done, ERASED once the eraser is done */
+
+	unsigned int _height; /**< Number of links in the tower */
+
+	unsigned int _retireEpoch; /**< The epoch the node was retired in */
+
+	TSkipListNode<T>* _retired; /**< The next node in the retired list */
+
+	std::atomic<uintptr_t> _next[1]; /**< First link of the tower (the rest follow the node) */
+
+	/**
+	* Default constructor of an unlinked node
+	*/
+	TSkipListNode() : _flags(0)
+	{
+		_height = 1;
+		_retireEpoch = 0;
+		_retired = NULL;
+		_next[0].store(0, std::memory_order_relaxed);
+	}
+
+	/**
+	* Returns the tower of links
+	* @return Pointer to _height links
+	*/
+	inline std::atomic<uintptr_t>* Next()
+	{
+		return _next;
+	}
+
+	/**
+	* Returns the node a link points to
+	* @param link The link
+	* @return Node pointer (with the mark removed)
+	*/
+	static inline TSkipListNode<T>* Ptr(uintptr_t link)
+	{
+		return (TSkipListNode<T>*)(link & ~(uintptr_t)1);
+	}
+
+	/**
+	* Returns true if a link is marked (the node holding it is being erased)
+	* @param link The link
+	* @return Boolean
+	*/
+	static inline bool Marked(uintptr_t link)
+	{
+		return (link & 1) != 0;
+	}
+
+	/**
+	* Returns the first node at or after node on the bottom level that is not being erased
+	* @param node The node to start from (or NULL)
+	* @return The node or NULL
+	*/
+	static TSkipListNode<T>* SkipErased(TSkipListNode<T>* node)
+	{
+		while (node != NULL)
+		{
+			uintptr_t succ = node->_next[0].load(std::memory_order_acquire);
+			if (!Marked(succ))
+				break;
+			node = Ptr(succ);
+		}
+		return node;
+	}
+
+	/**
+	* Returns the number of bytes a node with the given height needs
+	* @param height Number of links in the tower
+	* @return Size in bytes
+	*/
+	static inline size_t SizeFor(unsigned int height)
+	{
+		return sizeof(TSkipListNode<T>) + (height - 1) * sizeof(std::atomic<uintptr_t>);
+	}
+};
+
+/**
+* Epoch based reclamation for the nodes of a TSkipList. Every operation registers in the counter
+* of the epoch it started in (one of TSKIPLIST_READER_STRIPES padded counters, picked per thread,
+* so threads do not fight over one cache line). The epoch only advances once every operation
+* that started two epochs ago has finished, so a node retired in epoch e can no longer be
+* reached by anyone once the epoch is e + 2
+*/
+
+class TSkipListEpoch
+{
+private:
+	/**
+	* A reader counter on its own cache line
+	*/
+	struct Stripe
+	{
+		std::atomic<int> _readers; /**< Number of operations in progress */
+
+		char _pad[64 - sizeof(std::atomic<int>)]; /**< Keeps neighbouring stripes apart */
+	};
+
+	std::atomic<unsigned int> _epoch; /**< The current epoch */
+
+	Stripe _stripes[2][TSKIPLIST_READER_STRIPES]; /**< Reader counters for even and odd epochs */
+
+	/**
+	* Returns the stripe the calling thread counts itself in
+	* @return Index into the stripes
+	*/
+	static inline unsigned int StripeIndex()
+	{
+		static std::atomic<unsigned int> next(0);
+		static thread_local unsigned int index = next.fetch_add(1, std::memory_order_relaxed) % TSKIPLIST_READER_STRIPES;
+		return index;
+	}
+
+public:
+	/**
+	* Default constructor
+	*/
+	TSkipListEpoch() : _epoch(0)
+	{
+		for (int i = 0; i < 2; i++)
+			for (int j = 0; j < TSKIPLIST_READER_STRIPES; j++)
+				_stripes[i][j]._readers.store(0, std::memory_order_relaxed);
+	}
+
+	/**
+	* Registers the calling thread as reading the structure
+	* @return The epoch to pass to Exit
+	*/
+	inline unsigned int Enter()
+	{
+		for (;;)
+		{
+			unsigned int epoch = _epoch.load();
+			std::atomic<int>& readers = _stripes[epoch & 1][StripeIndex()]._readers;
+			readers.fetch_add(1);
+
+			//if the epoch moved on while registering we may be counted against the wrong one
+			if (_epoch.load() == epoch)
+				return epoch;
+			readers.fetch_sub(1);
+		}
+	}
+
+	/**
+	* Unregisters the calling thread (must be the thread that called Enter)
+	* @param epoch The value returned by Enter
+	*/
+	inline void Exit(unsigned int epoch)
+	{
+		_stripes[epoch & 1][StripeIndex()]._readers.fetch_sub(1);
+	}
+
+	/**
+	* Returns the current epoch
+	* @return Epoch counter
+	*/
+	inline unsigned int Current() const
+	{
+		return _epoch.load();
+	}
+
+	/**
+	* Advances the epoch if no operation from the previous epoch is still running
+	* @return True if the epoch advanced
+	*/
+	bool TryAdvance()
+	{
+		unsigned int epoch = _epoch.load();
+		for (int i = 0; i < TSKIPLIST_READER_STRIPES; i++)
+		{
+			if (_stripes[(epoch + 1) & 1][i]._readers.load() != 0)
+				return false;
+		}
+		return _epoch.compare_exchange_strong(epoch, epoch + 1);
+	}
+};
+
+/**
+* A concurrent ordered set built as a lock-free skip list (Fraser / Herlihy-Shavit). Insert, Erase,
+* Find, Contains and Scan may be called from any number of threads at once without locks, so
+* writers on different parts of the key space proceed in parallel instead of queueing on a mutex
+* around a TTree. Compare is a functor type (see TCompare.h) and equal elements are not stored
+* twice (use a key/value struct ordered by key to use it as a map).
+*
+* Erased nodes are unlinked at once and freed in batches once no running operation can still see
+* them (see TSkipListEpoch), so Alloc must be safe to call from several threads (TDefaultAllocator
+* or TThreadCacheAllocator). An iterator counts as a running operation for its whole lifetime,
+* so keep iterators short lived and use them on the thread that created them. Iteration and Scan
+* see every element that was present for the whole walk and may or may not see elements inserted
+* or erased during it. Destroying the list must not race with any other call
+*/
+
+template<typename T, typename Compare = TLess<T>, typename Alloc = TDefaultAllocator>
+class TSkipList
+{
+	friend class TSkipListIter<T>;
+
+private:
+	typedef TSkipListNode<T> Node;
+
+	enum
+	{
+		LINKED = 1, /**< The inserter has finished linking the tower */
+		ERASED = 2 /**< The eraser has finished marking the tower */
+	};
+
+	Alloc _alloc; /**< The allocator nodes are allocated from */
+
+	Compare _less; /**< The ordering functor */
+
+	Node* _head; /**< Sentinel node with a full height tower */
+
+	std::atomic<int> _count; /**< Number of elements */
+
+	mutable TSkipListEpoch _epochs; /**< Tracks running operations for reclamation (const lookups register too) */
+
+	std::atomic<Node*> _retired; /**< Unlinked nodes waiting to be freed */
+
+	std::atomic<int> _retiredCount; /**< Number of nodes retired since the list was created */
+
+	std::atomic<int> _reclaiming; /**< 1 while a thread is freeing retired nodes */
+
+	/**
+	* Picks the height of a new node (each extra level with probability 1/4)
+	* @return Height between 1 and TSKIPLIST_MAX_LEVEL
+	*/
+	static unsigned int RandomHeight()
+	{
+		static thread_local unsigned int state = 0;
+		if (state == 0)
+			state = (unsigned int)(uintptr_t)&state | 1;
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+
+		unsigned int height = 1;
+		unsigned int bits = state;
+		while (height < TSKIPLIST_MAX_LEVEL && (bits & 3) == 0)
+		{
+			height++;
+			bits >>= 2;
+		}
+		return height;
+	}
+
+	/**
+	* Allocates a node with the given tower height
+	* @param height Number of links
+	* @return The new node
+	*/
+	Node* NewNode(unsigned int height)
+	{
+		Node* node = new(_alloc.Allocate(Node::SizeFor(height))) Node();
+		node->_height = height;
+		for (unsigned int i = 1; i < height; i++)
+			new(&node->Next()[i]) std::atomic<uintptr_t>(0);
+		return node;
+	}
+
+	/**
+	* Destroys and frees a node
+	* @param node The node to free
+	*/
+	void FreeNode(Node* node)
+	{
+		size_t size = Node::SizeFor(node->_height);
+		node->~Node();
+		_alloc.Free(node, size);
+	}
+
+	/**
+	* Finds the predecessor and successor of key on every level, unlinking any erased node on
+	* the way. Must be called between Enter and Exit
+	* @param key The key to look for
+	* @param preds Filled with the last node before key on each level
+	* @param succs Filled with the first node not before key on each level
+	* @return True if succs[0] holds key
+	*/
+	bool Locate(const T& key, Node** preds, Node** succs)
+	{
+		for (;;)
+		{
+			bool retry = false;
+			Node* pred = _head;
+			for (int level = TSKIPLIST_MAX_LEVEL - 1; level >= 0 && !retry; level--)
+			{
+				Node* cur = Node::Ptr(pred->Next()[level].load(std::memory_order_acquire));
+				while (cur != NULL)
+				{
+					uintptr_t succ = cur->Next()[level].load(std::memory_order_acquire);
+					if (Node::Marked(succ))
+					{
+						//cur is being erased - unlink it on this level (fails if pred is being erased too)
+						uintptr_t expected = (uintptr_t)cur;
+						if (!pred->Next()[level].compare_exchange_strong(expected, succ & ~(uintptr_t)1))
+						{
+							retry = true;
+							break;
+						}
+						cur = Node::Ptr(succ);
+						continue;
+					}
+
+					if (!_less(cur->_data, key))
+						break;
+					pred = cur;
+					cur = Node::Ptr(succ);
+				}
+				preds[level] = pred;
+				succs[level] = cur;
+			}
+
+			if (!retry)
+				return succs[0] != NULL && !_less(key, succs[0]->_data);
+		}
+	}
+
+	/**
+	* Returns the first live node not ordered before key without modifying the list. Must be
+	* called between Enter and Exit
+	* @param key The key to look for
+	* @return The node or NULL if every element is ordered before key
+	*/
+	Node* LowerBound(const T& key) const
+	{
+		Node* pred = _head;
+		Node* cur = NULL;
+		for (int level = TSKIPLIST_MAX_LEVEL - 1; level >= 0; level--)
+		{
+			cur = Node::Ptr(pred->Next()[level].load(std::memory_order_acquire));
+			while (cur != NULL)
+			{
+				uintptr_t succ = cur->Next()[level].load(std::memory_order_acquire);
+				if (!Node::Marked(succ))
+				{
+					if (!_less(cur->_data, key))
+						break;
+					pred = cur;
+				}
+				cur = Node::Ptr(succ);
+			}
+		}
+		return cur;
+	}
+
+	/**
+	* Queues a fully unlinked node to be freed once no operation can still see it
+	* @param node The node
+	* @return True if it is time to try freeing the queued nodes
+	*/
+	bool Retire(Node* node)
+	{
+		node->_retireEpoch = _epochs.Current();
+		Node* head = _retired.load(std::memory_order_relaxed);
+		do
+		{
+			node->_retired = head;
+		} while (!_retired.compare_exchange_weak(head, node));
+
+		return (_retiredCount.fetch_add(1, std::memory_order_relaxed) + 1) % TSKIPLIST_RECLAIM_BATCH == 0;
+	}
+
+	/**
+	* Advances the epoch if possible and frees the retired nodes nobody can see any more.
+	* Only one thread reclaims at a time, the others skip. Must be called outside Enter/Exit
+	*/
+	void Reclaim()
+	{
+		if (_reclaiming.exchange(1, std::memory_order_acquire) != 0)
+			return;
+
+		_epochs.TryAdvance();
+		unsigned int epoch = _epochs.Current();
+
+		Node* node = _retired.exchange(NULL);
+		Node* keep = NULL;
+		Node* keepTail = NULL;
+		while (node != NULL)
+		{
+			Node* next = node->_retired;
+			if (epoch - node->_retireEpoch >= 2)
+			{
+				FreeNode(node);
+			}
+			else
+			{
+				//still visible to an old operation - put it back
+				if (keep == NULL)
+					keepTail = node;
+				node->_retired = keep;
+				keep = node;
+			}
+			node = next;
+		}
+
+		if (keep != NULL)
+		{
+			Node* head = _retired.load(std::memory_order_relaxed);
+			do
+			{
+				keepTail->_retired = head;
+			} while (!_retired.compare_exchange_weak(head, keep));
+		}
+
+		_reclaiming.store(0, std::memory_order_release);
+	}
+
+	/**
+	* Not copyable (the list is shared between threads by reference)
+	*/
+	TSkipList(const TSkipList&);
+	TSkipList& operator=(const TSkipList&);
+
+public:
+	/**
+	* Default constructor
+	*/
+	TSkipList() : _count(0), _retired(NULL), _retiredCount(0), _reclaiming(0)
+	{
+		_head = NewNode(TSKIPLIST_MAX_LEVEL);
+	}
+
+	/**
+	* Overloaded constructor which takes the allocator to allocate nodes from
+	* @param alloc The allocator (copied)
+	*/
+	TSkipList(const Alloc& alloc) : _alloc(alloc), _count(0), _retired(NULL), _retiredCount(0), _reclaiming(0)
+	{
+		_head = NewNode(TSKIPLIST_MAX_LEVEL);
+	}
+
+	/**
+	* Default destructor which frees every node (no other thread may be using the list)
+	*/
+	~TSkipList()
+	{
+		Node* node = Node::Ptr(_head->Next()[0].load());
+		while (node != NULL)
+		{
+			Node* next = Node::Ptr(node->Next()[0].load());
+			FreeNode(node);
+			node = next;
+		}
+
+		node = _retired.load();
+		while (node != NULL)
+		{
+			Node* next = node->_retired;
+			FreeNode(node);
+			node = next;
+		}
+		FreeNode(_head);
+	}
+
+	/**
+	* Inserts data if no equal element is present (lock-free)
+	* @param data The data to insert
+	* @return True if it was inserted, false if an equal element was already present
+	*/
+	bool Insert(const T& data)
+	{
+		Node* preds[TSKIPLIST_MAX_LEVEL];
+		Node* succs[TSKIPLIST_MAX_LEVEL];
+		unsigned int height = RandomHeight();
+		Node* node = NULL;
+
+		unsigned int epoch = _epochs.Enter();
+		for (;;)
+		{
+			if (Locate(data, preds, succs))
+			{
+				if (node != NULL)
+					FreeNode(node);
+				_epochs.Exit(epoch);
+				return false;
+			}
+
+			if (node == NULL)
+			{
+				node = NewNode(height);
+				node->_data = data;
+			}
+			for (unsigned int i = 0; i < height; i++)
+				node->Next()[i].store((uintptr_t)succs[i], std::memory_order_relaxed);
+
+			//publishing on the bottom level is what makes the element present
+			uintptr_t expected = (uintptr_t)succs[0];
+			if (preds[0]->Next()[0].compare_exchange_strong(expected, (uintptr_t)node))
+				break;
+		}
+		_count.fetch_add(1, std::memory_order_relaxed);
+
+		//link the rest of the tower, stopping early if the node is erased meanwhile
+		for (unsigned int level = 1; level < height; level++)
+		{
+			bool stop = false;
+			for (;;)
+			{
+				uintptr_t expected = (uintptr_t)succs[level];
+				if (preds[level]->Next()[level].compare_exchange_strong(expected, (uintptr_t)node))
+					break;
+
+				Locate(data, preds, succs);
+				uintptr_t link = node->Next()[level].load();
+				if (Node::Marked(link) || !node->Next()[level].compare_exchange_strong(link, (uintptr_t)succs[level]))
+				{
+					stop = true;
+					break;
+				}
+			}
+			if (stop)
+				break;
+		}
+
+		//if the node was erased while linking the eraser left it to us to unlink and retire
+		bool reclaim = false;
+		if ((node->_flags.fetch_or(LINKED) & ERASED) != 0)
+		{
+			Locate(data, preds, succs);
+			reclaim = Retire(node);
+		}
+		_epochs.Exit(epoch);
+
+		if (reclaim)
+			Reclaim();
+		return true;
+	}
+
+	/**
+	* Erases the element equal to key (lock-free)
+	* @param key The key to erase
+	* @return True if this call erased it, false if it was not present
+	*/
+	bool Erase(const T& key)
+	{
+		Node* preds[TSKIPLIST_MAX_LEVEL];
+		Node* succs[TSKIPLIST_MAX_LEVEL];
+
+		unsigned int epoch = _epochs.Enter();
+		if (!Locate(key, preds, succs))
+		{
+			_epochs.Exit(epoch);
+			return false;
+		}
+
+		//mark the tower top down so the inserter stops linking it
+		Node* victim = succs[0];
+		for (unsigned int level = victim->_height - 1; level >= 1; level--)
+		{
+			uintptr_t link = victim->Next()[level].load();
+			while (!Node::Marked(link))
+				victim->Next()[level].compare_exchange_weak(link, link | 1);
+		}
+
+		//marking the bottom level erases the element - only one thread can do it
+		uintptr_t link = victim->Next()[0].load();
+		for (;;)
+		{
+			if (Node::Marked(link))
+			{
+				_epochs.Exit(epoch);
+				return false;
+			}
+			if (victim->Next()[0].compare_exchange_weak(link, link | 1))
+				break;
+		}
+		_count.fetch_sub(1, std::memory_order_relaxed);
+
+		//whichever of the inserter and the eraser finishes second unlinks and retires the node
+		bool reclaim = false;
+		if ((victim->_flags.fetch_or(ERASED) & LINKED) != 0)
+		{
+			Locate(key, preds, succs);
+			reclaim = Retire(victim);
+		}
+		_epochs.Exit(epoch);
+
+		if (reclaim)
+			Reclaim();
+		return true;
+	}
+
+	/**
+	* Finds the element equal to key and copies it out (lock-free, never writes to the list)
+	* @param key The key to look for
+	* @param out Receives a copy of the element if found
+	* @return True if found
+	*/
+	bool Find(const T& key, T& out) const
+	{
+		unsigned int epoch = _epochs.Enter();
+		Node* node = LowerBound(key);
+		bool found = node != NULL && !_less(key, node->_data);
+		if (found)
+			out = node->_data;
+		_epochs.Exit(epoch);
+		return found;
+	}
+
+	/**
+	* Returns true if an element equal to key is present (lock-free, never writes to the list)
+	* @param key The key to look for
+	* @return Boolean
+	*/
+	bool Contains(const T& key) const
+	{
+		unsigned int epoch = _epochs.Enter();
+		Node* node = LowerBound(key);
+		bool found = node != NULL && !_less(key, node->_data);
+		_epochs.Exit(epoch);
+		return found;
+	}
+
+	/**
+	* Calls func(element) in order for every element in [from, to)
+	* @param from The first key of the range
+	* @param to The key the range stops before
+	* @param func Functor called with a const reference to each element
+	* @return Number of elements visited
+	*/
+	template<typename Func>
+	int Scan(const T& from, const T& to, Func func) const
+	{
+		unsigned int epoch = _epochs.Enter();
+		int visited = 0;
+		Node* node = LowerBound(from);
+		while (node != NULL && _less(node->_data, to))
+		{
+			func((const T&)node->_data);
+			visited++;
+			node = Node::SkipErased(Node::Ptr(node->Next()[0].load(std::memory_order_acquire)));
+		}
+		_epochs.Exit(epoch);
+		return visited;
+	}
+
+	/**
+	* Returns the number of elements (exact only while no other thread is writing)
+	* @return Element count
+	*/
+	inline int Count() const
+	{
+		return _count.load(std::memory_order_relaxed);
+	}
+
+	/**
+	* Returns true if the list has no elements
+	* @return Boolean
+	*/
+	inline bool IsEmpty() const
+	{
+		return Node::SkipErased(Node::Ptr(_head->Next()[0].load(std::memory_order_acquire))) == NULL;
+	}
+};
+
+/**
+* Iterates a TSkipList in order. The iterator keeps the nodes it can reach alive until it is
+* destroyed, so it must be used and destroyed on the thread that created it
+*/
+
+template<typename T>
+class TSkipListIter
+{
+private:
+	TSkipListEpoch* _epochs; /**< The reclamation state of the list */
+
+	unsigned int _epoch; /**< The epoch returned by Enter */
+
+	TSkipListNode<T>* _current; /**< The current node */
+
+	/**
+	* Not copyable (the registration with the list is released in the destructor)
+	*/
+	TSkipListIter(const TSkipListIter&);
+	TSkipListIter& operator=(const TSkipListIter&);
+
+public:
+	/**
+	* Constructor which starts at the first element of list
+	* @param list The list to iterate
+	*/
+	template<typename Compare, typename Alloc>
+	TSkipListIter(TSkipList<T, Compare, Alloc>* list)
+	{
+		_epochs = &list->_epochs;
+		_epoch = _epochs->Enter();
+		_current = TSkipListNode<T>::SkipErased(TSkipListNode<T>::Ptr(list->_head->Next()[0].load(std::memory_order_acquire)));
+	}
+
+	/**
+	* Constructor which starts at the first element not ordered before from
+	* @param list The list to iterate
+	* @param from The key to start at
+	*/
+	template<typename Compare, typename Alloc>
+	TSkipListIter(TSkipList<T, Compare, Alloc>* list, const T& from)
+	{
+		_epochs = &list->_epochs;
+		_epoch = _epochs->Enter();
+		_current = list->LowerBound(from);
+	}
+
+	/**
+	* Default destructor which lets the list free nodes this iterator could reach
+	*/
+	~TSkipListIter()
+	{
+		_epochs->Exit(_epoch);
+	}
+
+	/**
+	* Returns true if every element has been visited
+	* @return Boolean
+	*/
+	inline bool IsFinished()
+	{
+		return _current == NULL;
+	}
+
+	/**
+	* Moves to the next element
+	*/
+	void Next()
+	{
+		_current = TSkipListNode<T>::SkipErased(TSkipListNode<T>::Ptr(_current->Next()[0].load(std::memory_order_acquire)));
+	}
+
+	/**
+	* Returns a copy of the current element (or its default value if finished)
+	* @return The Data
+	*/
+	inline T Value()
+	{
+		T ret = T();
+		if (_current != NULL)
+			ret = _current->_data;
+		return ret;
+	}
+};
+
+#endif
\ No newline at end of file
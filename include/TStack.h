@@ -1,6 +1,15 @@
 #ifndef TSTACK_H
 #define TSTACK_H
 
+/* Include for the node allocators */
+#include "TAllocator.h"
+
+/* Include for the instrumentation counters */
+#include "TStats.h"
+
+/* Include for the latency histograms */
+#include "TLatency.h"
+
 /* Definitions and macros */
 #ifndef NULL
 #define NULL 0
@@ -30,16 +39,43 @@ struct TStackNode
 
 
 /**
-* A template made stack to hold specified data
+* A template made stack to hold specified data. The optional Alloc parameter is the
+* allocator used for the stack nodes (see TAllocator.h)
 */
 
-template<typename T>
+template<typename T, typename Alloc = TDefaultAllocator>
 class TStack
 {
 private:
+	Alloc _alloc; /**< The allocator the nodes are allocated from */
+
+	TDS_STAT(TContainerStats _stats;) /**< Instrumentation counters (only when TDS_ENABLE_STATS is defined) */
+
+	TDS_LATENCY(TLatencyRecorder _latency;) /**< Latency histograms (only when TDS_ENABLE_LATENCY is defined) */
+
 	TStackNode<T>* _top; /**< Pointer to the top of the stack */
 	
 	int _count; /**< Number of items on the stack */
+
+	/**
+	* Allocates a new node from the allocator
+	* @return Pointer to the new node
+	*/
+	inline TStackNode<T>* NewNode()
+	{
+		TDS_STAT(_stats._allocations++;)
+		return TAllocNode<TStackNode<T> >(_alloc);
+	}
+
+	/**
+	* Returns a node to the allocator
+	* @param node The node to free
+	*/
+	inline void FreeNode(TStackNode<T>* node)
+	{
+		TDS_STAT(_stats._frees++;)
+		TFreeNode(_alloc, node);
+	}
 public:
 	/**
 	* Default constructor of the stack
@@ -50,6 +86,16 @@ public:
 		_count = 0;
 	}
 
+	/**
+	* Overloaded constructor which takes the allocator the stack will allocate its nodes from
+	* @param alloc The allocator to copy into the stack
+	*/
+	TStack(const Alloc& alloc) : _alloc(alloc)
+	{
+		_top = NULL;
+		_count = 0;
+	}
+
 	/**
 	* Default destructor of the stack
 	*/
@@ -59,12 +105,83 @@ public:
 		Empty();
 	}
 
+	/**
+	* Returns the allocator used by this stack
+	* @return Reference to the allocator
+	*/
+	inline Alloc& GetAllocator()
+	{
+		return _alloc;
+	}
+
+	/**
+	* Returns the instrumentation counters of this stack (all zero unless TDS_ENABLE_STATS is defined, see TStats.h)
+	* @return Reference to the stats
+	*/
+	inline const TContainerStats& GetStats() const
+	{
+#ifdef TDS_ENABLE_STATS
+		return _stats;
+#else
+		return TContainerStats::Disabled();
+#endif
+	}
+
+	/**
+	* Zeroes the instrumentation counters of this stack
+	*/
+	inline void ResetStats()
+	{
+		TDS_STAT(_stats.Reset();)
+	}
+
+	/**
+	* Returns the latency histograms of this stack (empty unless TDS_ENABLE_LATENCY is defined, see TLatency.h)
+	* @return Reference to the recorder (print it with Dump)
+	*/
+	inline const TLatencyRecorder& GetLatency() const
+	{
+#ifdef TDS_ENABLE_LATENCY
+		return _latency;
+#else
+		return TLatencyRecorder::Disabled();
+#endif
+	}
+
+	/**
+	* Empties the latency histograms of this stack
+	*/
+	inline void ResetLatency()
+	{
+		TDS_LATENCY(_latency.Reset();)
+	}
+
+	/**
+	* Sets how many calls are made for every one that is timed (does nothing unless TDS_ENABLE_LATENCY is defined)
+	* @param rate 1 to time every call (the default unless TLATENCY_SAMPLE_RATE is defined), n to time one in n, 0 to stop timing
+	*/
+	inline void SetLatencySampleRate(unsigned int rate)
+	{
+		TDS_LATENCY(_latency.SetSampleRate(rate);)
+		(void)rate;
+	}
+
 	/**
 	* Call to clear all nodes (will leave data untouched) off 
 	* the stack
 	*/
 	void Empty()
 	{
+		TDS_LATENCY(TLatencyScope latency(_latency, TLATENCY_EMPTY);)
+
+		//nothing to free so just drop every node at once
+		if (TCanDropNodes<T, Alloc>())
+		{
+			_top = NULL;
+			_count = 0;
+			return;
+		}
+
 		while (!IsEmpty())
 			Pop();
 	}
@@ -94,6 +211,8 @@ public:
 	*/
 	T Pop()
 	{
+		TDS_LATENCY(TLatencyScope latency(_latency, TLATENCY_REMOVE);)
+
 		//the data to return
 		T ret = T();
 
@@ -107,10 +226,12 @@ public:
 			_top = _top->_prev;
 
 			//delete tmp
-			delete(tmp);
+			FreeNode(tmp);
 
 			//deduct count 
 			_count--;
+
+			TDS_STAT(_stats._remove.Record(0, 0);)
 		}
 
 		//return it
@@ -123,11 +244,13 @@ public:
 	*/
 	void Push(T data)
 	{
+		TDS_LATENCY(TLatencyScope latency(_latency, TLATENCY_INSERT);)
+
 		//if there are already items on the list
 		if (_top != NULL)
 		{
 			//append a new node and set its data
-			TStackNode<T>* new_top = new TStackNode<T>();
+			TStackNode<T>* new_top = NewNode();
 
 			//set its data
 			new_top->_data = data;
@@ -141,7 +264,7 @@ public:
 		else
 		{
 			//simply create a new node for _top
-			_top = new TStackNode<T>();
+			_top = NewNode();
 
 			//assign data
 			_top->_data = data;
@@ -149,6 +272,8 @@ public:
 
 		//increment count
 		_count++;
+
+		TDS_STAT(_stats._insert.Record(0, 0);)
 	}
 
 	/**
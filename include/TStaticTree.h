@@ -0,0 +1,261 @@
+#ifndef TSTATICTREE_H
+#define TSTATICTREE_H
+
+/* Include for size_t */
+#include <stddef.h>
+
+/* Include for the default comparison */
+#include "TCompare.h"
+
+/* Include for the aggregate kernels */
+#include "TSimd.h"
+
+/* Definitions and macros */
+#ifndef NULL
+#define NULL 0
+#endif
+
+/* Prefetch hint for batched lookups (does nothing on compilers without one) */
+#ifndef TDS_PREFETCH
+#if defined(__GNUC__) || defined(__clang__)
+#define TDS_PREFETCH(addr) __builtin_prefetch(addr)
+#else
+#define TDS_PREFETCH(addr) ((void)0)
+#endif
+#endif
+
+/**
+* Number of lookups FindMany walks down the tree together
+*/
+#define TSTATICTREE_FIND_GROUP 16
+
+/**
+* An immutable ordered set of N values built at compile time. The values are sorted and stored in
+* Eytzinger (breadth first) order - the children of the node at index k are at 2k and 2k + 1 - so a
+* lookup walks down an implicit balanced tree with no pointers and the top levels share cache lines.
+* Declare it static constexpr (see TMakeStaticTree) and it lives in read-only memory with no startup
+* cost, and every lookup with a key known at compile time is itself a constant expression:
+*
+*	static constexpr int opcodes[] = { 9, 3, 7, 1 };
+*	static constexpr auto table = TMakeStaticTree(opcodes);
+*	static_assert(table.Contains(7), "7 is an opcode");
+*
+* Compare is a functor type (see TCompare.h) which returns true if its first argument is ordered
+* before the second. T must be a literal type. The values are sorted with an insertion sort while
+* compiling, which is fine for tables of a few thousand values. Duplicate values are kept.
+*/
+
+template<typename T, size_t N, typename Compare = TLess<T> >
+class TStaticTree
+{
+private:
+	T _data[N + 1]; /**< The values in Eytzinger order starting at index 1 (index 0 is unused) */
+
+	/**
+	* Copies the sorted values into _data in Eytzinger order with an in-order walk of the implicit tree
+	* @param sorted The sorted values
+	* @param next Index of the next sorted value to place
+	* @param k Index in _data of the subtree root
+	* @return The index of the next sorted value after the subtree is filled
+	*/
+	constexpr size_t Fill(const T* sorted, size_t next, size_t k)
+	{
+		if (k <= N)
+		{
+			next = Fill(sorted, next, 2 * k);
+			_data[k] = sorted[next++];
+			next = Fill(sorted, next, 2 * k + 1);
+		}
+		return next;
+	}
+
+	/**
+	* Returns the index in _data of the first value not ordered before key (0 if there is none)
+	* @param key The key
+	* @return Index
+	*/
+	constexpr size_t LowerBoundIndex(const T& key) const
+	{
+		size_t k = 1;
+		while (k <= N)
+			k = 2 * k + (Compare()(_data[k], key) ? 1 : 0);
+
+		//undo the right turns taken after the last left turn (and the left turn itself)
+		while (k & 1)
+			k >>= 1;
+		return k >> 1;
+	}
+
+public:
+	/**
+	* Constructor which sorts the values and lays them out (usually evaluated while compiling)
+	* @param values The values of the set in any order
+	*/
+	constexpr TStaticTree(const T (&values)[N]) : _data()
+	{
+		T sorted[N > 0 ? N : 1] = {};
+		for (size_t i = 0; i < N; i++)
+		{
+			//insertion sort keeps equal values in their original order
+			size_t j = i;
+			while (j > 0 && Compare()(values[i], sorted[j - 1]))
+			{
+				sorted[j] = sorted[j - 1];
+				j--;
+			}
+			sorted[j] = values[i];
+		}
+		Fill(sorted, 0, 1);
+	}
+
+	/**
+	* Returns the number of values in the set
+	* @return Count
+	*/
+	constexpr size_t Count() const
+	{
+		return N;
+	}
+
+	/**
+	* Returns true if the set is empty
+	* @return Boolean
+	*/
+	constexpr bool IsEmpty() const
+	{
+		return N == 0;
+	}
+
+	/**
+	* Finds the first value not ordered before key
+	* @param key The key
+	* @return Pointer to the value (NULL if every value is ordered before key)
+	*/
+	constexpr const T* LowerBound(const T& key) const
+	{
+		size_t k = LowerBoundIndex(key);
+		return k != 0 ? &_data[k] : NULL;
+	}
+
+	/**
+	* Finds a value equal to key (neither is ordered before the other)
+	* @param key The key
+	* @return Pointer to the value (NULL if not found)
+	*/
+	constexpr const T* Find(const T& key) const
+	{
+		size_t k = LowerBoundIndex(key);
+		return k != 0 && !Compare()(key, _data[k]) ? &_data[k] : NULL;
+	}
+
+	/**
+	* Returns true if the set holds a value equal to key
+	* @param key The key
+	* @return Boolean
+	*/
+	constexpr bool Contains(const T& key) const
+	{
+		return Find(key) != NULL;
+	}
+
+	/**
+	* Finds count keys at runtime, walking TSTATICTREE_FIND_GROUP of them down the tree level by
+	* level together. Every descent has the same length, so each key prefetches the node it steps to
+	* and the other keys take their step while it loads
+	* @param keys The keys to look for
+	* @param count Number of keys
+	* @param results Receives a pointer to the value equal to each key (NULL if not found)
+	*/
+	void FindMany(const T* keys, size_t count, const T** results) const
+	{
+		for (size_t first = 0; first < count; first += TSTATICTREE_FIND_GROUP)
+		{
+			size_t group = count - first < TSTATICTREE_FIND_GROUP ? count - first : TSTATICTREE_FIND_GROUP;
+			size_t k[TSTATICTREE_FIND_GROUP];
+			for (size_t i = 0; i < group; i++)
+				k[i] = 1;
+
+			bool walking = N > 0;
+			while (walking)
+			{
+				walking = false;
+				for (size_t i = 0; i < group; i++)
+				{
+					if (k[i] > N)
+						continue;
+					k[i] = 2 * k[i] + (Compare()(_data[k[i]], keys[first + i]) ? 1 : 0);
+					if (k[i] <= N)
+						TDS_PREFETCH(&_data[k[i]]);
+					walking = true;
+				}
+			}
+
+			for (size_t i = 0; i < group; i++)
+			{
+				//same as LowerBoundIndex
+				size_t j = k[i];
+				while (j & 1)
+					j >>= 1;
+				j >>= 1;
+				results[first + i] = j != 0 && !Compare()(keys[first + i], _data[j]) ? &_data[j] : NULL;
+			}
+		}
+	}
+
+	/**
+	* Returns the sum of every value at runtime (SSE2/AVX2 for int and float, see TSimd.h)
+	* @return The sum
+	*/
+	typename TSumType<T>::Type Sum() const
+	{
+		return TSum(&_data[1], N);
+	}
+
+	/**
+	* Counts the values pred is true for at runtime (vectorized for TInRange of int and float)
+	* @param pred Predicate functor
+	* @return Number of matching values
+	*/
+	template<typename Pred>
+	size_t CountIf(Pred pred) const
+	{
+		return TCountIf(&_data[1], N, pred);
+	}
+
+	/**
+	* Copies the values pred is true for to out at runtime, in Eytzinger (not sorted) order
+	* (vectorized for TInRange of int and float)
+	* @param pred Predicate functor
+	* @param out Receives the matching values (must have room for N values)
+	* @return Number of values copied
+	*/
+	template<typename Pred>
+	size_t FilterInto(Pred pred, T* out) const
+	{
+		return TFilterInto(&_data[1], N, pred, out);
+	}
+};
+
+/**
+* Builds a TStaticTree from an array, deducing its size
+* @param values The values of the set in any order
+* @return The tree
+*/
+template<typename T, size_t N>
+constexpr TStaticTree<T, N> TMakeStaticTree(const T (&values)[N])
+{
+	return TStaticTree<T, N>(values);
+}
+
+/**
+* Builds a TStaticTree from an array with the given comparison, e.g. TMakeStaticTree<TLessString>(keys)
+* @param values The values of the set in any order
+* @return The tree
+*/
+template<typename Compare, typename T, size_t N>
+constexpr TStaticTree<T, N, Compare> TMakeStaticTree(const T (&values)[N])
+{
+	return TStaticTree<T, N, Compare>(values);
+}
+
+#endif
\ No newline at end of file
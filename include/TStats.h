@@ -0,0 +1,155 @@
+#ifndef TSTATS_H
+#define TSTATS_H
+
+/**
+* Hot path instrumentation for the containers. Define TDS_ENABLE_STATS (or turn on the
+* TDS_ENABLE_STATS cmake option) before including tds.h to make every container count its
+* comparisons, node allocations/frees, traversal depths and iterator steps. Without it the
+* counters are compiled out completely and GetStats() returns an all zero TContainerStats.
+* Note that every translation unit in a program must agree on the setting.
+*/
+
+/**
+* Wraps code that should only be compiled when stats are enabled
+*/
+#ifdef TDS_ENABLE_STATS
+#define TDS_STAT(...) __VA_ARGS__
+#else
+#define TDS_STAT(...)
+#endif
+
+/**
+* Counters for a single type of operation (e.g. Insert)
+*/
+
+struct TOpStats
+{
+	unsigned long long _count; /**< Number of operations */
+	unsigned long long _comparisons; /**< Total number of comparisons made by the operations */
+	unsigned long long _depthTotal; /**< Sum of the traversal depth (nodes visited) of every operation */
+	unsigned int _maxDepth; /**< The deepest traversal of any single operation */
+
+	/**
+	* Default constructor which zeroes the counters
+	*/
+	TOpStats()
+	{
+		Reset();
+	}
+
+	/**
+	* Zeroes the counters
+	*/
+	void Reset()
+	{
+		_count = _comparisons = _depthTotal = 0;
+		_maxDepth = 0;
+	}
+
+	/**
+	* Records one operation
+	* @param comparisons The number of comparisons it made
+	* @param depth The number of nodes it visited
+	*/
+	inline void Record(unsigned long long comparisons, unsigned int depth)
+	{
+		_count++;
+		_comparisons += comparisons;
+		_depthTotal += depth;
+		if (depth > _maxDepth)
+			_maxDepth = depth;
+	}
+
+	/**
+	* Returns the average number of comparisons per operation
+	* @return Double (0 if there were no operations)
+	*/
+	double AvgComparisons() const
+	{
+		return _count ? (double)_comparisons / (double)_count : 0.0;
+	}
+
+	/**
+	* Returns the average traversal depth per operation
+	* @return Double (0 if there were no operations)
+	*/
+	double AvgDepth() const
+	{
+		return _count ? (double)_depthTotal / (double)_count : 0.0;
+	}
+};
+
+
+
+/**
+* All the counters kept by a container. The members are plain integers so the struct
+* can be copied out and handed to a metrics pipeline (see Export)
+*/
+
+struct TContainerStats
+{
+	TOpStats _insert; /**< Insert / PushBack / Push */
+	TOpStats _find; /**< Find */
+	TOpStats _remove; /**< Remove / PopBack / Pop */
+
+	unsigned long long _comparisons; /**< Every comparison made (including those made by Empty) */
+	unsigned long long _allocations; /**< Number of nodes allocated */
+	unsigned long long _frees; /**< Number of nodes freed */
+	unsigned long long _iteratorNexts; /**< Number of times an iterator over the container was advanced */
+
+	/**
+	* Default constructor which zeroes the counters
+	*/
+	TContainerStats()
+	{
+		Reset();
+	}
+
+	/**
+	* Zeroes every counter
+	*/
+	void Reset()
+	{
+		_insert.Reset();
+		_find.Reset();
+		_remove.Reset();
+		_comparisons = _allocations = _frees = _iteratorNexts = 0;
+	}
+
+	/**
+	* Calls func(name, value) for every counter so they can be exported with stable names
+	* @param func Callable taking (const char*, unsigned long long)
+	*/
+	template<typename Func>
+	void Export(Func func) const
+	{
+		func("insert_count", _insert._count);
+		func("insert_comparisons", _insert._comparisons);
+		func("insert_depth_total", _insert._depthTotal);
+		func("insert_depth_max", (unsigned long long)_insert._maxDepth);
+		func("find_count", _find._count);
+		func("find_comparisons", _find._comparisons);
+		func("find_depth_total", _find._depthTotal);
+		func("find_depth_max", (unsigned long long)_find._maxDepth);
+		func("remove_count", _remove._count);
+		func("remove_comparisons", _remove._comparisons);
+		func("remove_depth_total", _remove._depthTotal);
+		func("remove_depth_max", (unsigned long long)_remove._maxDepth);
+		func("comparisons", _comparisons);
+		func("allocations", _allocations);
+		func("frees", _frees);
+		func("iterator_nexts", _iteratorNexts);
+	}
+
+	/**
+	* Returns the all zero stats returned by containers when stats are compiled out
+	* @return Reference to the shared empty stats
+	*/
+	static const TContainerStats& Disabled()
+	{
+		static const TContainerStats stats;
+		return stats;
+	}
+};
+
+#endif
\ No newline at end of file
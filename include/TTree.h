@@ -4,9 +4,42 @@
 /* Include for TStack */
 #include "TStack.h"
 
+/* Include for the node allocators */
+#include "TAllocator.h"
+
+/* Include for the instrumentation counters */
+#include "TStats.h"
+
+/* Include for the latency histograms */
+#include "TLatency.h"
+
+/* Include for pow */
+#include <math.h>
+
+/* Include for snapshots */
+#include "TSerialize.h"
+
+/* Include for the aggregate kernels */
+#include "TSimd.h"
+
+/* Include for the parallel set operations */
+#include <thread>
+
+/* Include for sorting batches */
+#include <algorithm>
+
 /* Forward Decl */
 template<typename T> class TTreeIter;
 
+/* Prefetch hint for batched lookups (does nothing on compilers without one) */
+#ifndef TDS_PREFETCH
+#if defined(__GNUC__) || defined(__clang__)
+#define TDS_PREFETCH(addr) __builtin_prefetch(addr)
+#else
+#define TDS_PREFETCH(addr) ((void)0)
+#endif
+#endif
+
 /* Definitions */
 #ifndef NULL
 #define NULL 0
@@ -62,24 +95,124 @@ struct TTreeNode
 }; 
 
 
+/**
+* Number of buckets in the depth histogram of TTreeShape (nodes deeper than
+* TTREE_DEPTH_BUCKETS - 1 are counted in the last bucket)
+*/
+#define TTREE_DEPTH_BUCKETS 64
+
+/**
+* Description of the shape and memory footprint of a TTree (see TTree::Shape)
+*/
+
+struct TTreeShape
+{
+	int _count; /**< Number of nodes in the tree */
+	int _height; /**< Number of nodes on the longest root to leaf path (0 if empty) */
+	int _maxDepth; /**< Depth of the deepest node (the root has depth 0) */
+	double _avgDepth; /**< Average depth of all nodes */
+	int _depthHistogram[TTREE_DEPTH_BUCKETS]; /**< Number of nodes at each depth */
+
+	int _maxImbalance; /**< Largest difference between the heights of the left and right subtrees of any node */
+	double _avgImbalance; /**< Average difference between the heights of the left and right subtrees */
+	int _unbalancedNodes; /**< Number of nodes whose subtree heights differ by more than 1 */
+
+	size_t _nodeBytes; /**< Bytes used by the nodes themselves (count * sizeof(TTreeNode<T>)) */
+	size_t _overheadBytes; /**< Extra bytes the allocator uses for those nodes (headers, rounding) */
+
+	/**
+	* Default constructor which zeroes everything
+	*/
+	TTreeShape()
+	{
+		_count = _height = _maxDepth = 0;
+		_avgDepth = 0.0;
+		for (int i = 0; i < TTREE_DEPTH_BUCKETS; i++)
+			_depthHistogram[i] = 0;
+		_maxImbalance = _unbalancedNodes = 0;
+		_avgImbalance = 0.0;
+		_nodeBytes = _overheadBytes = 0;
+	}
+
+	/**
+	* Returns the height divided by the height of a perfectly balanced tree with the same number
+	* of nodes (1 for a perfect tree, count / log2(count) for a tree which is a linked list)
+	* @return Double (0 if the tree is empty)
+	*/
+	double HeightRatio() const
+	{
+		if (_count == 0)
+			return 0.0;
+		int best = 0;
+		while ((1LL << best) - 1 < (long long)_count)
+			best++;
+		return (double)_height / (double)best;
+	}
+};
+
+
+/**
+* Inputs smaller than this (both trees together) never split a set operation across threads
+*/
+#define TTREE_PARALLEL_SET_MIN 65536
+
+/**
+* Number of lookups FindMany keeps in flight at once
+*/
+#define TTREE_FIND_GROUP 16
+
+/**
+* Number of nodes BuildSorted allocates before the first element is read (the count it is given
+* may come from an untrusted snapshot header so it only ever grows with the data actually read)
+*/
+#define TTREE_BUILD_CHUNK 1024
+
+/**
+* The set operations of TTree::SetOperation. Duplicates follow multiset rules (like the std
+* set algorithms): an element found a times in lhs and b times in rhs is kept max(a, b) times by
+* a union, min(a, b) times by an intersection, a - b times by a difference and |a - b| times by
+* a symmetric difference
+*/
+enum TSetOperation
+{
+	TSET_UNION,
+	TSET_INTERSECT,
+	TSET_DIFFERENCE,
+	TSET_SYMMETRIC_DIFFERENCE
+};
+
+
 /**
 * A templated binary tree which must have a comparison function set
 * when initlizing the tree so it can be used correctly. This can be done
 * by either passing the comparison function into the constructor of by 
-* using the SetComparisonFunc method
+* using the SetComparisonFunc method. The optional Alloc parameter is the
+* allocator used for the tree nodes (see TAllocator.h)
 */
 
-template<typename T>
+template<typename T, typename Alloc = TDefaultAllocator>
 class TTree
 {
 	friend class TTreeIter<T>;
-private:
+protected:
+	Alloc _alloc; /**< The allocator the nodes are allocated from */
+
+	TDS_STAT(mutable TContainerStats _stats;) /**< Instrumentation counters (only when TDS_ENABLE_STATS is defined, updated by const lookups too) */
+
+	TDS_LATENCY(mutable TLatencyRecorder _latency;) /**< Latency histograms (only when TDS_ENABLE_LATENCY is defined, updated by const lookups too) */
+
 	TTreeNode<T>* _root; /**< The root of the tree */
 
 	int _count; /**< The number of nodes currently stored in this true */
 
 	int(*_comparison)(T, T); /**< A Pointer to the specified comparison function (must not be a method of a class) the function should return -1 if lhs < rhs, 0 if lhs == rhs or 1 if lhs > rhs */
 
+	int _heightEstimate; /**< Upper bound of the height of the tree kept up to date by Insert (see HeightEstimate) */
+
+	float _rebuildRatio; /**< Insert depth (relative to a balanced tree) past which Insert rebuilds part of the tree (0 for never) */
+
+	double _rebuildAlpha; /**< The weight balance a subtree must break to be rebuilt (derived from _rebuildRatio) */
+
 	/**
 	* To be used internally when removing a node from the tree which has two sibling nodes
 	* it will find the smallest node in the subtree starting at root)
@@ -93,143 +226,1293 @@ private:
 		return root;
 	}
 
-protected:
 	/**
-	* To be used internally to delete a node from the tree. This is a 
-	* recursive method
-	* @param root The node to be removed from the tree
-	* @param data The data to be removed (required for compairson checking)
-	* @return Returns the new value for root
+	* Allocates a new node from the allocator
+	* @return Pointer to the new node
+	*/
+	inline TTreeNode<T>* NewNode()
+	{
+		TDS_STAT(_stats._allocations++;)
+		return TAllocNode<TTreeNode<T> >(_alloc);
+	}
+
+	/**
+	* Returns a node to the allocator
+	* @param node The node to free
+	*/
+	inline void FreeNode(TTreeNode<T>* node)
+	{
+		TDS_STAT(_stats._frees++;)
+		TFreeNode(_alloc, node);
+	}
+
+	/**
+	* Returns the height of a perfectly balanced tree holding count nodes (i.e. ceil(log2(count + 1)))
+	* @param count The number of nodes
+	* @return Integer
+	*/
+	static int BalancedHeight(int count)
+	{
+		int ret = 0;
+		while ((1LL << ret) - 1 < (long long)count)
+			ret++;
+		return ret;
+	}
+
+	/**
+	* Returns the number of nodes in the subtree starting at node (without recursion)
+	* @param node The root of the subtree (can be NULL)
+	* @return Integer
+	*/
+	static int SubtreeSize(TTreeNode<T>* node)
+	{
+		if (node == NULL)
+			return 0;
+
+		TTreeNode<T>* last = node;
+		while (last->_right != NULL)
+			last = last->_right;
+
+		int ret = 1;
+		for (TTreeNode<T>* cur = FirstInOrder(node); cur != last; cur = NextInOrder(cur))
+			ret++;
+		return ret;
+	}
+
+	/**
+	* Called after inserting node at the given depth. If the depth is past the auto rebuild ratio
+	* this finds the lowest ancestor whose subtrees are out of weight balance (the scapegoat) and
+	* rebuilds just that subtree, which keeps the height logarithmic at amortized O(log n) cost
+	* @param node The node just inserted
+	* @param depth Number of nodes on the path from the root to node
+	* @return The root of the subtree that was rebuilt (NULL if nothing was)
+	*/
+	TTreeNode<T>* CheckAutoRebuild(TTreeNode<T>* node, int depth)
+	{
+		if (_rebuildRatio <= 0.0f || _count < 16 || (float)depth <= _rebuildRatio * (float)BalancedHeight(_count))
+			return NULL;
+
+		int size = 1;
+		while (node->_parent != NULL)
+		{
+			TTreeNode<T>* parent = node->_parent;
+			int parent_size = size + 1 + SubtreeSize(parent->_left == node ? parent->_right : parent->_left);
+
+			if ((double)size > _rebuildAlpha * (double)parent_size)
+				return RebuildSubtree(parent, parent_size);
+
+			node = parent;
+			size = parent_size;
+		}
+
+		//no scapegoat found (only possible through rounding) so rebuild everything
+		Rebuild();
+		return _root;
+	}
+
+	/**
+	* Returns the node with the smallest data in the subtree starting at node
+	* @param node The root of the subtree (can be NULL)
+	* @return The leftmost node (NULL if node is NULL)
+	*/
+	static TTreeNode<T>* FirstInOrder(TTreeNode<T>* node)
+	{
+		if (node != NULL)
+		{
+			while (node->_left != NULL)
+				node = node->_left;
+		}
+		return node;
+	}
+
+	/**
+	* Returns the in-order successor of a node using the parent pointers (no stack needed)
+	* @param node The current node
+	* @return The next node in sorted order (NULL if node was the last)
+	*/
+	static TTreeNode<T>* NextInOrder(TTreeNode<T>* node)
+	{
+		if (node->_right != NULL)
+			return FirstInOrder(node->_right);
+
+		//go up until we come from a left child
+		TTreeNode<T>* parent = node->_parent;
+		while (parent != NULL && node == parent->_right)
+		{
+			node = parent;
+			parent = parent->_parent;
+		}
+		return parent;
+	}
+
+	/**
+	* Links the sorted array of nodes [lo, hi) into a perfectly balanced subtree
+	* @param nodes The nodes in sorted order
+	* @param lo Index of the first node
+	* @param hi Index one past the last node
+	* @param parent The parent the subtree root will have
+	* @return The root of the subtree (NULL if lo == hi)
+	*/
+	static TTreeNode<T>* LinkBalanced(TTreeNode<T>** nodes, int lo, int hi, TTreeNode<T>* parent)
+	{
+		if (lo >= hi)
+			return NULL;
+
+		int mid = lo + (hi - lo) / 2;
+		TTreeNode<T>* node = nodes[mid];
+		node->_parent = parent;
+		node->_left = LinkBalanced(nodes, lo, mid, node);
+		node->_right = LinkBalanced(nodes, mid + 1, hi, node);
+		return node;
+	}
+
+	/**
+	* Relinks the subtree starting at node into a perfectly balanced subtree in O(size)
+	* @param node The root of the subtree
+	* @param size The number of nodes in the subtree
+	* @return The new root of the subtree
+	*/
+	TTreeNode<T>* RebuildSubtree(TTreeNode<T>* node, int size)
+	{
+		if (size < 2)
+			return node;
+
+		TTreeNode<T>* parent = node->_parent;
+		bool is_left = parent != NULL && parent->_left == node;
+
+		//collect the nodes in sorted order
+		TTreeNode<T>** nodes = new TTreeNode<T>*[size];
+		TTreeNode<T>* cur = FirstInOrder(node);
+		for (int i = 0; i < size; i++)
+		{
+			nodes[i] = cur;
+			cur = NextInOrder(cur);
+		}
+
+		TTreeNode<T>* root = LinkBalanced(nodes, 0, size, parent);
+		delete[] nodes;
+
+		//hook the new subtree root back into the tree
+		if (parent == NULL)
+			_root = root;
+		else if (is_left)
+			parent->_left = root;
+		else
+			parent->_right = root;
+
+		return root;
+	}
+
+
+	/**
+	* To be used internally to delete a node from the tree. This is a 
+	* recursive method
+	* @param root The node to be removed from the tree
+	* @param data The data to be removed (required for compairson checking)
+	* @return Returns the new value for root
+	*/
+	TTreeNode<T>* DeleteNode(TTreeNode<T>* root, T data)
+	{
+		//return null
+		if (root == NULL) 
+			return root;
+
+		//run comparison
+		int result = _comparison(data, root->_data);
+		TDS_STAT(_stats._comparisons++;)
+
+		// -1 so data is less then traverse left
+		if (result < 0)
+			root->_left = DeleteNode(root->_left, data);
+
+		//same as above except result == 1 so traversse right
+		else if (result > 0)
+			root->_right = DeleteNode(root->_right, data);
+
+		//The node has been found so we can remove it
+		else
+		{
+			// Case 1:  No child - just delete it
+			if (root->_left == NULL && root->_right == NULL) 
+			{
+				FreeNode(root);
+				root = NULL;
+				_count--;
+			}
+
+			//Case 2: One child set the parents right child pointer to right
+			else if (root->_left == NULL) 
+			{
+				TTreeNode<T>* temp = root;
+				root = root->_right;
+				root->_parent = temp->_parent;
+				FreeNode(temp);
+				_count--;
+			}
+			//same as above but swapping left pointer
+			else if (root->_right == NULL) 
+			{
+				TTreeNode<T>* temp = root;
+				root = root->_left;
+				root->_parent = temp->_parent;
+				FreeNode(temp);
+				_count--;
+			}
+			// case 3: 2 children - need to reorder right subtree
+			else 
+			{
+				TTreeNode<T>* temp = FindSmallestFromNode(root->_right);
+				root->_data = temp->_data;
+				root->_right = DeleteNode(root->_right, temp->_data);
+			}
+		}
+		return root;
+	}
+
+	/**
+	* Allocates one contiguous block for count nodes if the allocator is monotonic (so the nodes
+	* never have to be freed one by one)
+	* @param count The number of nodes
+	* @return The block (NULL if nodes have to be allocated one by one)
+	*/
+	inline TTreeNode<T>* AllocBlock(int count)
+	{
+		if (!TAllocatorTraits<Alloc>::IsMonotonic || count <= 0)
+			return NULL;
+		TDS_STAT(_stats._allocations++;)
+		return (TTreeNode<T>*)_alloc.Allocate(sizeof(TTreeNode<T>) * (size_t)count);
+	}
+
+	/**
+	* Allocates a node holding data, from block if there is one (see AllocBlock)
+	* @param data The data of the node
+	* @param block The next free node of a bulk allocation (NULL to allocate nodes one by one)
+	* @return The node
+	*/
+	inline TTreeNode<T>* MakeNode(const T& data, TTreeNode<T>*& block)
+	{
+		TTreeNode<T>* node = block != NULL ? new(block++) TTreeNode<T>() : NewNode();
+		node->_data = data;
+		return node;
+	}
+
+	/**
+	* Allocates the copy of src for CopyFrom and the set operations, from block if there is one
+	* @param src The node to copy
+	* @param parent The parent of the copy
+	* @param block The next free node of a bulk allocation (NULL to allocate nodes one by one)
+	* @return The copy
+	*/
+	inline TTreeNode<T>* CloneNode(const TTreeNode<T>* src, TTreeNode<T>* parent, TTreeNode<T>*& block)
+	{
+		TTreeNode<T>* node = MakeNode(src->_data, block);
+		node->_parent = parent;
+		return node;
+	}
+
+	/**
+	* Copies a batch into a new array sorted by the comparison function (equal elements keep their order)
+	* @param data The batch
+	* @param count The number of elements in the batch
+	* @return The sorted copy (delete[] it when done)
+	*/
+	T* SortBatch(const T* data, int count) const
+	{
+		T* sorted = new T[count];
+		for (int i = 0; i < count; i++)
+			sorted[i] = data[i];
+
+		int(*comparison)(T, T) = _comparison;
+		auto less = [comparison](const T& lhs, const T& rhs) { return comparison(lhs, rhs) <= -1; };
+		if (!std::is_sorted(sorted, sorted + count, less))
+			std::stable_sort(sorted, sorted + count, less);
+		return sorted;
+	}
+
+	/**
+	* Replaces the (empty) contents of this tree with a copy of other in O(n). The nodes are copied
+	* in one pre-order walk that mirrors the structure of other (no comparisons or rebalancing). A
+	* monotonic allocator (e.g. TArenaAllocator) never frees single nodes so the copy is carved out of
+	* one contiguous block in pre-order
+	* @param other The tree to copy
+	*/
+	void CopyFrom(const TTree& other)
+	{
+		_comparison = other._comparison;
+		_heightEstimate = other._heightEstimate;
+		_rebuildRatio = other._rebuildRatio;
+		_rebuildAlpha = other._rebuildAlpha;
+
+		TTreeNode<T>* src = other._root;
+		if (src == NULL)
+			return;
+
+		TTreeNode<T>* block = AllocBlock(other._count);
+		_root = CloneNode(src, NULL, block);
+		TTreeNode<T>* dst = _root;
+
+		//walk both trees together using the parent links (a missing child in the copy means not visited yet)
+		while (src != NULL)
+		{
+			if (src->_left != NULL && dst->_left == NULL)
+			{
+				dst->_left = CloneNode(src->_left, dst, block);
+				src = src->_left;
+				dst = dst->_left;
+			}
+			else if (src->_right != NULL && dst->_right == NULL)
+			{
+				dst->_right = CloneNode(src->_right, dst, block);
+				src = src->_right;
+				dst = dst->_right;
+			}
+			else
+			{
+				src = src->_parent;
+				dst = dst->_parent;
+			}
+		}
+
+		_count = other._count;
+	}
+
+	/**
+	* Writes the nodes of the subtree at root to nodes in sorted order
+	* @param root The root of the subtree (can be NULL)
+	* @param nodes Array with room for every node of the subtree
+	* @return The number of nodes written
+	*/
+	static int Flatten(TTreeNode<T>* root, TTreeNode<T>** nodes)
+	{
+		int count = 0;
+		for (TTreeNode<T>* cur = FirstInOrder(root); cur != NULL; cur = NextInOrder(cur))
+			nodes[count++] = cur;
+		return count;
+	}
+
+	/**
+	* Returns the first node in sorted order of the subtree at root whose data is not ordered before key
+	* @param root The root of the subtree (can be NULL)
+	* @param key The key
+	* @return The node (NULL if every node is ordered before key)
+	*/
+	TTreeNode<T>* LowerBoundNode(TTreeNode<T>* root, const T& key) const
+	{
+		TTreeNode<T>* best = NULL;
+		while (root != NULL)
+		{
+			if (_comparison(root->_data, key) <= -1)
+			{
+				root = root->_right;
+			}
+			else
+			{
+				best = root;
+				root = root->_left;
+			}
+		}
+		return best;
+	}
+
+	/**
+	* Returns the index of the first of the sorted nodes [lo, hi) whose data is not ordered before key
+	* @param nodes The nodes in sorted order
+	* @param lo Index of the first node
+	* @param hi Index one past the last node
+	* @param key The key
+	* @return Index (hi if every node is ordered before key)
+	*/
+	int LowerBoundIndex(TTreeNode<T>** nodes, int lo, int hi, const T& key) const
+	{
+		while (lo < hi)
+		{
+			int mid = lo + (hi - lo) / 2;
+			if (_comparison(nodes[mid]->_data, key) <= -1)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		return lo;
+	}
+
+	/**
+	* Counts the nodes equal to key starting at node and going forwards in sorted order
+	* @param node The first node (can be NULL)
+	* @param key The key
+	* @param limit The most nodes to count
+	* @return Integer
+	*/
+	int CountEqual(TTreeNode<T>* node, const T& key, int limit) const
+	{
+		int count = 0;
+		while (node != NULL && count < limit && _comparison(key, node->_data) == 0)
+		{
+			count++;
+			node = NextInOrder(node);
+		}
+		return count;
+	}
+
+	/**
+	* Returns true if looking every element of small up in big is cheaper than merging both trees
+	* @param small The smaller tree
+	* @param big The larger tree
+	* @return Boolean
+	*/
+	static bool PreferLookups(const TTree& small, const TTree& big)
+	{
+		long long height = big._heightEstimate > 0 ? big._heightEstimate : 1;
+		return (long long)small._count * height < (long long)big._count;
+	}
+
+	/**
+	* Returns true if a batch of count elements is applied faster by merging it with every node of the
+	* tree than by count searches. A merge visits each node about once in sorted (not memory) order,
+	* which measures at roughly 8 times cheaper per node than one level of a search
+	* @param count The size of the batch
+	* @return Boolean
+	*/
+	bool PreferBatchMerge(int count) const
+	{
+		long long height = _heightEstimate > 0 ? _heightEstimate : 1;
+		return (long long)count * height >= 8LL * (long long)_count;
+	}
+
+	/**
+	* Merges two sorted node arrays with op in one linear pass (like the std set algorithms)
+	* @param op The set operation
+	* @param lhs The nodes of the left operand in sorted order
+	* @param lhsCount The number of lhs nodes
+	* @param rhs The nodes of the right operand in sorted order
+	* @param rhsCount The number of rhs nodes
+	* @param out Receives the nodes of the result in sorted order (room for lhsCount + rhsCount)
+	* @param fromRhs Set to 1 for each result node taken from rhs and 0 for each taken from lhs
+	* @return The number of result nodes
+	*/
+	int MergeNodes(TSetOperation op, TTreeNode<T>** lhs, int lhsCount, TTreeNode<T>** rhs, int rhsCount, TTreeNode<T>** out, unsigned char* fromRhs) const
+	{
+		bool keepLhs = op != TSET_INTERSECT; //lhs elements rhs does not have
+		bool keepRhs = op == TSET_UNION || op == TSET_SYMMETRIC_DIFFERENCE; //rhs elements lhs does not have
+		bool keepBoth = op == TSET_UNION || op == TSET_INTERSECT; //elements both have (taken from lhs)
+
+		int i = 0, j = 0, count = 0;
+		while (i < lhsCount && j < rhsCount)
+		{
+			int result = _comparison(lhs[i]->_data, rhs[j]->_data);
+			if (result <= -1)
+			{
+				if (keepLhs)
+				{
+					out[count] = lhs[i];
+					fromRhs[count++] = 0;
+				}
+				i++;
+			}
+			else if (result == 0)
+			{
+				if (keepBoth)
+				{
+					out[count] = lhs[i];
+					fromRhs[count++] = 0;
+				}
+				i++;
+				j++;
+			}
+			else
+			{
+				if (keepRhs)
+				{
+					out[count] = rhs[j];
+					fromRhs[count++] = 1;
+				}
+				j++;
+			}
+		}
+
+		for (; keepLhs && i < lhsCount; i++)
+		{
+			out[count] = lhs[i];
+			fromRhs[count++] = 0;
+		}
+		for (; keepRhs && j < rhsCount; j++)
+		{
+			out[count] = rhs[j];
+			fromRhs[count++] = 1;
+		}
+		return count;
+	}
+
+	/**
+	* MergeNodes split across threads. Both arrays are cut at the same keys (taken evenly from the
+	* larger array) so equal elements always land in the same part, each part is merged on its own
+	* thread into its own region of out and the regions are then closed up
+	* @param threads The number of threads to use (small inputs are merged on the calling thread)
+	* @return The number of result nodes (see MergeNodes for the other parameters)
+	*/
+	int MergeParallel(TSetOperation op, TTreeNode<T>** lhs, int lhsCount, TTreeNode<T>** rhs, int rhsCount, TTreeNode<T>** out, unsigned char* fromRhs, int threads) const
+	{
+		int most = (lhsCount + rhsCount) / (TTREE_PARALLEL_SET_MIN / 4);
+		if (threads > most)
+			threads = most;
+		if (threads < 2 || lhsCount + rhsCount < TTREE_PARALLEL_SET_MIN)
+			return MergeNodes(op, lhs, lhsCount, rhs, rhsCount, out, fromRhs);
+
+		int* lhsCut = new int[threads + 1];
+		int* rhsCut = new int[threads + 1];
+		int* counts = new int[threads];
+		lhsCut[0] = rhsCut[0] = 0;
+		lhsCut[threads] = lhsCount;
+		rhsCut[threads] = rhsCount;
+		for (int p = 1; p < threads; p++)
+		{
+			const T& key = lhsCount >= rhsCount ? lhs[(long long)lhsCount * p / threads]->_data : rhs[(long long)rhsCount * p / threads]->_data;
+			lhsCut[p] = LowerBoundIndex(lhs, lhsCut[p - 1], lhsCount, key);
+			rhsCut[p] = LowerBoundIndex(rhs, rhsCut[p - 1], rhsCount, key);
+		}
+
+		//a part never outputs more nodes than it reads so it can write from its first input index
+		auto part = [&](int p)
+		{
+			int offset = lhsCut[p] + rhsCut[p];
+			counts[p] = MergeNodes(op, lhs + lhsCut[p], lhsCut[p + 1] - lhsCut[p], rhs + rhsCut[p], rhsCut[p + 1] - rhsCut[p], out + offset, fromRhs + offset);
+		};
+
+		std::thread* workers = new std::thread[threads - 1];
+		for (int p = 1; p < threads; p++)
+			workers[p - 1] = std::thread(part, p);
+		part(0);
+		for (int p = 1; p < threads; p++)
+			workers[p - 1].join();
+		delete[] workers;
+
+		int count = counts[0];
+		for (int p = 1; p < threads; p++)
+		{
+			int offset = lhsCut[p] + rhsCut[p];
+			for (int i = 0; i < counts[p]; i++)
+			{
+				out[count] = out[offset + i];
+				fromRhs[count++] = fromRhs[offset + i];
+			}
+		}
+
+		delete[] lhsCut;
+		delete[] rhsCut;
+		delete[] counts;
+		return count;
+	}
+
+	/**
+	* Links the sorted result nodes of a set operation into a perfectly balanced tree which becomes this tree
+	* @param nodes The nodes in sorted order
+	* @param count The number of nodes
+	*/
+	void LinkResult(TTreeNode<T>** nodes, int count)
+	{
+		_root = LinkBalanced(nodes, 0, count, NULL);
+		_count = count;
+		_heightEstimate = BalancedHeight(count);
+	}
+
+	/**
+	* Applies op to lhs and rhs in O(n + m) by merging their sorted nodes and links the result into
+	* this tree. When inPlace lhs is this tree: its nodes in the result are reused and the others
+	* freed, only the nodes taken from rhs are copied. Otherwise this tree is empty and every
+	* result node is a copy
+	* @param op The set operation
+	* @param lhs The left operand
+	* @param rhs The right operand (never this tree)
+	* @param inPlace True if lhs is this tree
+	* @param threads The number of threads the merge may use
+	*/
+	void LinearOperation(TSetOperation op, const TTree& lhs, const TTree& rhs, bool inPlace, int threads)
+	{
+		int lhsCount = lhs._count, rhsCount = rhs._count;
+		TTreeNode<T>** lhsNodes = new TTreeNode<T>*[lhsCount + rhsCount + 1];
+		TTreeNode<T>** rhsNodes = lhsNodes + lhsCount;
+		TTreeNode<T>** out = new TTreeNode<T>*[lhsCount + rhsCount + 1];
+		unsigned char* fromRhs = new unsigned char[lhsCount + rhsCount + 1];
+
+		Flatten(lhs._root, lhsNodes);
+		Flatten(rhs._root, rhsNodes);
+		int count = MergeParallel(op, lhsNodes, lhsCount, rhsNodes, rhsCount, out, fromRhs, threads);
+
+		int copies = 0;
+		for (int i = 0; i < count; i++)
+			copies += inPlace ? fromRhs[i] : 1;
+
+		if (inPlace)
+		{
+			//free the nodes of this tree the result does not use (the used ones are in the same order in out)
+			int k = 0;
+			for (int i = 0; i < lhsCount; i++)
+			{
+				while (k < count && fromRhs[k])
+					k++;
+				if (k < count && out[k] == lhsNodes[i])
+					k++;
+				else
+					FreeNode(lhsNodes[i]);
+			}
+		}
+
+		TTreeNode<T>* block = AllocBlock(copies);
+		for (int i = 0; i < count; i++)
+		{
+			if (!inPlace || fromRhs[i])
+				out[i] = CloneNode(out[i], NULL, block);
+		}
+		LinkResult(out, count);
+
+		delete[] lhsNodes;
+		delete[] out;
+		delete[] fromRhs;
+	}
+
+	/**
+	* Applies an intersection or difference where small is much smaller than big by looking each run
+	* of equal elements of small up in big, which is O(small * height of big) rather than O(n + m)
+	* @param op TSET_INTERSECT or TSET_DIFFERENCE (small must be lhs for a difference)
+	* @param small The smaller operand
+	* @param big The larger operand
+	* @param smallIsLhs True if small is the left operand
+	* @param inPlace True if small is this tree (its unused nodes are freed), false if this tree is empty
+	*/
+	void LookupOperation(TSetOperation op, const TTree& small, const TTree& big, bool smallIsLhs, bool inPlace)
+	{
+		TTreeNode<T>** out = new TTreeNode<T>*[small._count + 1];
+		TTreeNode<T>** dropped = new TTreeNode<T>*[small._count + 1];
+		int count = 0, drops = 0;
+
+		TTreeNode<T>* cur = FirstInOrder(small._root);
+		while (cur != NULL)
+		{
+			//the run of elements equal to first
+			TTreeNode<T>* first = cur;
+			int run = 0;
+			while (cur != NULL && _comparison(first->_data, cur->_data) == 0)
+			{
+				run++;
+				cur = NextInOrder(cur);
+			}
+
+			TTreeNode<T>* match = LowerBoundNode(big._root, first->_data);
+			int matched = CountEqual(match, first->_data, run);
+
+			//an intersection keeps the first matched elements (from lhs), a difference the elements after them
+			bool fromBig = op == TSET_INTERSECT && !smallIsLhs;
+			TTreeNode<T>* src = fromBig ? match : first;
+			for (int i = 0; i < (fromBig ? matched : run); i++, src = NextInOrder(src))
+			{
+				if ((i < matched) == (op == TSET_INTERSECT))
+					out[count++] = src;
+				else
+					dropped[drops++] = src;
+			}
+		}
+
+		if (inPlace)
+		{
+			for (int i = 0; i < drops; i++)
+				FreeNode(dropped[i]);
+		}
+		else
+		{
+			TTreeNode<T>* block = AllocBlock(count);
+			for (int i = 0; i < count; i++)
+				out[i] = CloneNode(out[i], NULL, block);
+		}
+		LinkResult(out, count);
+
+		delete[] out;
+		delete[] dropped;
+	}
+
+	/**
+	* Applies a union, difference or symmetric difference with a much smaller tree to this tree by
+	* inserting and removing each run of equal elements of other (O(other * height of this tree))
+	* @param op TSET_UNION, TSET_DIFFERENCE or TSET_SYMMETRIC_DIFFERENCE
+	* @param other The right operand (never this tree)
+	*/
+	void UpdateOperation(TSetOperation op, const TTree& other)
+	{
+		TTreeNode<T>* cur = FirstInOrder(other._root);
+		while (cur != NULL)
+		{
+			TTreeNode<T>* first = cur;
+			int run = 0;
+			while (cur != NULL && _comparison(first->_data, cur->_data) == 0)
+			{
+				run++;
+				cur = NextInOrder(cur);
+			}
+
+			//a union adds the copies this tree is missing, a difference removes the matched ones and a symmetric difference does both
+			int matched = CountEqual(LowerBoundNode(_root, first->_data), first->_data, run);
+			int removes = op == TSET_UNION ? 0 : matched;
+			int inserts = op == TSET_DIFFERENCE ? 0 : run - matched;
+			for (int i = 0; i < removes; i++)
+				Remove(first->_data);
+			for (int i = 0; i < inserts; i++)
+				Insert(first->_data);
+		}
+	}
+
+public:
+	/**
+	* Default constructor of the Template tree 
+	*/
+	TTree()
+	{
+		_root = NULL;
+		_comparison = NULL;
+		_count = 0;
+		_heightEstimate = 0;
+		_rebuildRatio = 0.0f;
+		_rebuildAlpha = 1.0;
+	}
+
+	/**
+	* Overloaded constructor which will take and set the comparison function 
+	* used to insert and compare objects on the tree
+	* @param ComparisonFunc The pointer to the comparison function (note that this CANNOT be a class member function unless it is static)
+	*/
+	TTree(int (*ComparisonFunc)(T, T))
+	{
+		_root = NULL;
+		_comparison = NULL;
+		_count = 0;
+		_heightEstimate = 0;
+		_rebuildRatio = 0.0f;
+		_rebuildAlpha = 1.0;
+
+		SetComparisonFunc(ComparisonFunc);
+	}
+
+	/**
+	* Overloaded constructor which takes the allocator the tree will allocate its nodes from
+	* @param alloc The allocator to copy into the tree
+	*/
+	TTree(const Alloc& alloc) : _alloc(alloc)
+	{
+		_root = NULL;
+		_comparison = NULL;
+		_count = 0;
+		_heightEstimate = 0;
+		_rebuildRatio = 0.0f;
+		_rebuildAlpha = 1.0;
+	}
+
+	/**
+	* Overloaded constructor which takes both the comparison function and the allocator
+	* @param ComparisonFunc The pointer to the comparison function (note that this CANNOT be a class member function unless it is static)
+	* @param alloc The allocator to copy into the tree
+	*/
+	TTree(int(*ComparisonFunc)(T, T), const Alloc& alloc) : _alloc(alloc)
+	{
+		_root = NULL;
+		_comparison = NULL;
+		_count = 0;
+		_heightEstimate = 0;
+		_rebuildRatio = 0.0f;
+		_rebuildAlpha = 1.0;
+
+		SetComparisonFunc(ComparisonFunc);
+	}
+
+	/**
+	* Copy constructor which deep copies other in O(n) (see Clone). The allocator is copied too
+	* @param other The tree to copy
+	*/
+	TTree(const TTree& other) : _alloc(other._alloc)
+	{
+		_root = NULL;
+		_count = 0;
+		CopyFrom(other);
+	}
+
+	/**
+	* Assignment which empties this tree and deep copies other into it in O(n). This tree keeps its own allocator
+	* @param other The tree to copy
+	* @return This tree
+	*/
+	TTree& operator=(const TTree& other)
+	{
+		if (this != &other)
+		{
+			Empty();
+			CopyFrom(other);
+		}
+		return *this;
+	}
+
+	/**
+	* Returns a deep copy of the tree with the same shape, comparison function and allocator. The
+	* structure is mirrored node for node so this is O(n) with no comparisons (compared to
+	* O(n log n) for re-inserting every element)
+	* @return The copy
+	*/
+	TTree Clone() const
+	{
+		return TTree(*this);
+	}
+
+	/** 
+	* Default destructor which will empty the tree
+	*/
+	virtual ~TTree()
+	{
+		//empty list
+		Empty();
+	}
+
+	/**
+	* Returns the allocator used by this tree
+	* @return Reference to the allocator
+	*/
+	inline Alloc& GetAllocator()
+	{
+		return _alloc;
+	}
+
+	/**
+	* Returns the allocator used by this tree
+	* @return Const reference to the allocator
+	*/
+	inline const Alloc& GetAllocator() const
+	{
+		return _alloc;
+	}
+
+	/**
+	* Returns the instrumentation counters of this tree (all zero unless TDS_ENABLE_STATS is defined, see TStats.h)
+	* @return Reference to the stats
+	*/
+	inline const TContainerStats& GetStats() const
+	{
+#ifdef TDS_ENABLE_STATS
+		return _stats;
+#else
+		return TContainerStats::Disabled();
+#endif
+	}
+
+	/**
+	* Zeroes the instrumentation counters of this tree
+	*/
+	inline void ResetStats()
+	{
+		TDS_STAT(_stats.Reset();)
+	}
+
+	/**
+	* Returns the latency histograms of this tree (empty unless TDS_ENABLE_LATENCY is defined, see TLatency.h)
+	* @return Reference to the recorder (print it with Dump)
+	*/
+	inline const TLatencyRecorder& GetLatency() const
+	{
+#ifdef TDS_ENABLE_LATENCY
+		return _latency;
+#else
+		return TLatencyRecorder::Disabled();
+#endif
+	}
+
+	/**
+	* Empties the latency histograms of this tree
+	*/
+	inline void ResetLatency()
+	{
+		TDS_LATENCY(_latency.Reset();)
+	}
+
+	/**
+	* Sets how many calls are made for every one that is timed (does nothing unless TDS_ENABLE_LATENCY is defined)
+	* @param rate 1 to time every call (the default unless TLATENCY_SAMPLE_RATE is defined), n to time one in n, 0 to stop timing
+	*/
+	inline void SetLatencySampleRate(unsigned int rate)
+	{
+		TDS_LATENCY(_latency.SetSampleRate(rate);)
+		(void)rate;
+	}
+
+	/**
+	* Sets the comparison function
+	* @param ComparisonFunc The pointer to the comparison function (note that this CANNOT be a class member function unless it is static)
+	*/
+	void SetComparisonFunc(int(*ComparisonFunc)(T, T))
+	{
+		//set the comparison func
+		_comparison = ComparisonFunc;
+	}
+
+	/**
+	* returns how many nodes are currently stored in the tree
+	* @return Integer
+	*/
+	inline int Count() const
+	{
+		return _count;
+	}
+
+	/**
+	* Returns true if the tree is empty or false otherwise
+	* @return Integer
+	*/
+	inline bool IsEmpty() const
+	{
+		return !_count;
+	}
+
+	/**
+	* Returns the sum of every element (walks the nodes rather than copying each element out
+	* through an iterator)
+	* @return The sum (see TSumType in TSimd.h)
+	*/
+	typename TSumType<T>::Type Sum() const
+	{
+		typename TSumType<T>::Type sum = typename TSumType<T>::Type();
+		for (TTreeNode<T>* node = FirstInOrder(_root); node != NULL; node = NextInOrder(node))
+			sum += node->_data;
+		return sum;
+	}
+
+	/**
+	* Finds the smallest and largest element by the tree's comparison (the leftmost and rightmost
+	* nodes, so O(height))
+	* @param min Receives the smallest element
+	* @param max Receives the largest element
+	* @return False if the tree is empty (min and max are left untouched)
+	*/
+	bool MinMax(T& min, T& max) const
+	{
+		if (_root == NULL)
+			return false;
+		min = FirstInOrder(_root)->_data;
+		TTreeNode<T>* node = _root;
+		while (node->_right != NULL)
+			node = node->_right;
+		max = node->_data;
+		return true;
+	}
+
+	/**
+	* Counts the elements pred is true for
+	* @param pred Predicate functor, e.g. TInRange<int>(0, 9)
+	* @return Number of matching elements
+	*/
+	template<typename Pred>
+	int CountIf(Pred pred) const
+	{
+		int ret = 0;
+		for (TTreeNode<T>* node = FirstInOrder(_root); node != NULL; node = NextInOrder(node))
+			ret += pred(node->_data) ? 1 : 0;
+		return ret;
+	}
+
+	/**
+	* Copies the elements pred is true for to out in sorted order
+	* @param pred Predicate functor, e.g. TInRange<int>(0, 9)
+	* @param out Receives the matching elements (must have room for Count() elements)
+	* @return Number of elements copied
 	*/
-	TTreeNode<T>* DeleteNode(TTreeNode<T>* root, T data)
+	template<typename Pred>
+	int FilterInto(Pred pred, T* out) const
 	{
-		//return null
-		if (root == NULL) 
-			return root;
+		int ret = 0;
+		for (TTreeNode<T>* node = FirstInOrder(_root); node != NULL; node = NextInOrder(node))
+		{
+			if (pred(node->_data))
+				out[ret++] = node->_data;
+		}
+		return ret;
+	}
 
-		//run comparison
-		int result = _comparison(data, root->_data);
+	/** 
+	* Function to call to empty (delete all nodes (not the data)) in the tree
+	*/
+	void Empty()
+	{
+		TDS_LATENCY(TLatencyScope latency(_latency, TLATENCY_EMPTY);)
 
-		// -1 so data is less then traverse left
-		if (result < 0)
-			root->_left = DeleteNode(root->_left, data);
+		//nothing to free so just drop every node at once
+		if (TCanDropNodes<T, Alloc>())
+		{
+			_root = NULL;
+			_count = 0;
+			_heightEstimate = 0;
+			return;
+		}
 
-		//same as above except result == 1 so traversse right
-		else if (result > 0)
-			root->_right = DeleteNode(root->_right, data);
+		while (!IsEmpty())
+		{
+			_root = DeleteNode(_root, _root->_data);
+		}
 
-		//The node has been found so we can remove it
-		else
+		_heightEstimate = 0;
+	}
+
+	/**
+	* Works out the shape of the tree (height, depths, balance and memory footprint)
+	* in a single non-recursive pass over every node
+	* @return The shape of the tree
+	*/
+	TTreeShape Shape()
+	{
+		TTreeShape shape;
+		shape._count = _count;
+		shape._nodeBytes = (size_t)_count * sizeof(TTreeNode<T>);
+		shape._overheadBytes = (size_t)_count * (TAllocatorTraits<Alloc>::Footprint(sizeof(TTreeNode<T>)) - sizeof(TTreeNode<T>));
+
+		if (_root == NULL)
+			return shape;
+
+		/**
+		* A node being visited by the post-order walk
+		*/
+		struct Frame
 		{
-			// Case 1:  No child - just delete it
-			if (root->_left == NULL && root->_right == NULL) 
+			TTreeNode<T>* _node;
+			int _depth;
+			int _state; /**< 0 = visit left, 1 = visit right, 2 = done */
+			int _leftHeight;
+			int _rightHeight;
+		};
+
+		//the walk needs at most height frames - grow the buffer when the tree is deeper than that
+		int capacity = 64, top = 0;
+		Frame* frames = new Frame[capacity];
+		long long depth_total = 0, imbalance_total = 0;
+
+		frames[0]._node = _root;
+		frames[0]._depth = 0;
+		frames[0]._state = 0;
+		frames[0]._leftHeight = frames[0]._rightHeight = 0;
+
+		while (top >= 0)
+		{
+			Frame& f = frames[top];
+			TTreeNode<T>* child = NULL;
+
+			if (f._state == 0)
 			{
-				SAFE_DELETE(root);
-				_count--;
+				f._state = 1;
+				child = f._node->_left;
 			}
-
-			//Case 2: One child set the parents right child pointer to right
-			else if (root->_left == NULL) 
+			else if (f._state == 1)
 			{
-				TTreeNode<T>* temp = root;
-				root = root->_right;
-				root->_parent = temp->_parent;
-				SAFE_DELETE(temp);
-				_count--;
+				f._state = 2;
+				child = f._node->_right;
 			}
-			//same as above but swapping left pointer
-			else if (root->_right == NULL) 
+			else
 			{
-				TTreeNode<T>* temp = root;
-				root = root->_left;
-				root->_parent = temp->_parent;
-				SAFE_DELETE(temp);
-				_count--;
+				//both subtrees are done so record this node
+				int height = 1 + (f._leftHeight > f._rightHeight ? f._leftHeight : f._rightHeight);
+				int imbalance = f._leftHeight > f._rightHeight ? f._leftHeight - f._rightHeight : f._rightHeight - f._leftHeight;
+
+				depth_total += f._depth;
+				imbalance_total += imbalance;
+				shape._depthHistogram[f._depth < TTREE_DEPTH_BUCKETS ? f._depth : TTREE_DEPTH_BUCKETS - 1]++;
+				if (f._depth > shape._maxDepth) shape._maxDepth = f._depth;
+				if (imbalance > shape._maxImbalance) shape._maxImbalance = imbalance;
+				if (imbalance > 1) shape._unbalancedNodes++;
+
+				//hand the height to the parent (state 1 means we were its left child)
+				top--;
+				if (top >= 0)
+				{
+					if (frames[top]._state == 1)
+						frames[top]._leftHeight = height;
+					else
+						frames[top]._rightHeight = height;
+				}
+				else
+				{
+					shape._height = height;
+				}
+				continue;
 			}
-			// case 3: 2 children - need to reorder right subtree
-			else 
+
+			if (child != NULL)
 			{
-				TTreeNode<T>* temp = FindSmallestFromNode(root->_right);
-				root->_data = temp->_data;
-				root->_right = DeleteNode(root->_right, temp->_data);
+				if (top + 1 == capacity)
+				{
+					Frame* bigger = new Frame[capacity * 2];
+					for (int i = 0; i < capacity; i++)
+						bigger[i] = frames[i];
+					delete[] frames;
+					frames = bigger;
+					capacity *= 2;
+				}
+
+				int depth = frames[top]._depth + 1;
+				top++;
+				frames[top]._node = child;
+				frames[top]._depth = depth;
+				frames[top]._state = 0;
+				frames[top]._leftHeight = frames[top]._rightHeight = 0;
 			}
 		}
-		return root;
+
+		delete[] frames;
+
+		shape._avgDepth = (double)depth_total / (double)_count;
+		shape._avgImbalance = (double)imbalance_total / (double)_count;
+
+		//the walk gives the exact height so tighten the estimate
+		_heightEstimate = shape._height;
+		return shape;
 	}
 
-public:
 	/**
-	* Default constructor of the Template tree 
+	* Returns the exact height of the tree (number of nodes on the longest root to leaf path)
+	* @return Integer
 	*/
-	TTree()
+	int Height()
 	{
-		_root = NULL;
-		_comparison = NULL;
-		_count = 0;
+		return Shape()._height;
 	}
 
 	/**
-	* Overloaded constructor which will take and set the comparison function 
-	* used to insert and compare objects on the tree
-	* @param ComparisonFunc The pointer to the comparison function (note that this CANNOT be a class member function unless it is static)
+	* Returns an O(1) upper bound of the height of the tree. It is kept up to date by Insert but
+	* removals never lower it (Shape, Height and Rebuild reset it to the exact height)
+	* @return Integer
 	*/
-	TTree(int (*ComparisonFunc)(T, T))
+	inline int HeightEstimate()
 	{
-		_root = NULL;
-		_comparison = NULL;
-		_count = 0;
+		return _heightEstimate;
+	}
 
-		SetComparisonFunc(ComparisonFunc);
+	/**
+	* Returns HeightEstimate divided by the height of a perfectly balanced tree with the same number of nodes
+	* @return Float (1 for a perfect tree, 0 for an empty tree)
+	*/
+	inline float HeightRatioEstimate()
+	{
+		return _count ? (float)_heightEstimate / (float)BalancedHeight(_count) : 0.0f;
 	}
 
-	/** 
-	* Default destructor which will empty the tree
+	/**
+	* Turns on automatic rebuilding. When Insert places a node deeper than ratio times the height of a
+	* balanced tree, the smallest subtree on its path that is out of balance is rebuilt (like a
+	* scapegoat tree) so the height stays within about ratio * log2(n). Must be greater than 1
+	* (e.g. 2) - lower ratios keep the tree flatter but rebuild more often
+	* @param ratio The depth ratio that triggers a rebuild (0 to turn automatic rebuilds off)
 	*/
-	virtual ~TTree()
+	void SetAutoRebuild(float ratio)
 	{
-		//empty list
-		Empty();
+		_rebuildRatio = ratio > 1.0f || ratio <= 0.0f ? ratio : 1.01f;
+		_rebuildAlpha = _rebuildRatio > 0.0f ? pow(2.0, -1.0 / (double)_rebuildRatio) : 1.0;
 	}
 
 	/**
-	* Sets the comparison function
-	* @param ComparisonFunc The pointer to the comparison function (note that this CANNOT be a class member function unless it is static)
+	* Relinks every node into a perfectly balanced tree in O(n) (no nodes are allocated or freed
+	* and the data is not copied)
 	*/
-	void SetComparisonFunc(int(*ComparisonFunc)(T, T))
+	void Rebuild()
 	{
-		//set the comparison func
-		_comparison = ComparisonFunc;
+		if (_count < 2)
+			return;
+
+		RebuildSubtree(_root, _count);
+		_heightEstimate = BalancedHeight(_count);
 	}
 
 	/**
-	* returns how many nodes are currently stored in the tree
-	* @return Integer
+	* Writes a snapshot of the tree (a header followed by the data in sorted order) to the stream.
+	* T must be trivially copyable or have a TSerializeTraits specialization (see TSerialize.h)
+	* @param stream The stream to write to
+	* @return True if the snapshot was written
 	*/
-	inline int Count()
+	bool Serialize(std::ostream& stream)
 	{
-		return _count;
+		if (!TWriteSnapshotHeader<T>(stream, TSNAPSHOT_TREE, (uint64_t)_count))
+			return false;
+
+		TSnapshotWriter<T> writer(stream);
+		for (TTreeNode<T>* cur = FirstInOrder(_root); cur != NULL; cur = NextInOrder(cur))
+		{
+			if (!writer.Write(cur->_data))
+				return false;
+		}
+		return writer.Flush();
 	}
 
 	/**
-	* Returns true if the tree is empty or false otherwise
-	* @return Integer
+	* Replaces the contents of the tree with a snapshot written by Serialize. As the data is already
+	* sorted no comparisons are made - the nodes are allocated as they are read and linked into a
+	* perfectly balanced tree in O(n)
+	* @param stream The stream to read from
+	* @return True if the snapshot was read (the tree is left empty if it was not)
 	*/
-	inline bool IsEmpty()
+	bool Deserialize(std::istream& stream)
 	{
-		return !_count;
+		//drop the old contents first so a bad header leaves the tree empty too
+		Empty();
+
+		uint64_t count = 0;
+		if (!TReadSnapshotHeader<T>(stream, TSNAPSHOT_TREE, count) || count > 0x7FFFFFFF)
+			return false;
+
+		TSnapshotReader<T> reader(stream, count);
+		return BuildSorted(reader, (int)count);
 	}
 
-	/** 
-	* Function to call to empty (delete all nodes (not the data)) in the tree
+	/**
+	* Replaces the contents of the tree with count elements read in sorted order from source
+	* (anything with a bool Read(T&) method, e.g. TSnapshotReader or TExternalSorter). No comparisons
+	* are made - the nodes are linked into a perfectly balanced tree in O(n). Nothing is sized from
+	* count up front (a corrupt header must not cost a huge allocation): the node array starts at
+	* TTREE_BUILD_CHUNK and doubles as elements arrive, and a monotonic allocator hands out the nodes
+	* for each doubling in one block
+	* @param source The source of the sorted data
+	* @param count The number of elements to read
+	* @return True if every element was read (the tree is left empty if not)
 	*/
-	void Empty()
+	template<typename Source>
+	bool BuildSorted(Source& source, int count)
 	{
-		while (!IsEmpty())
+		Empty();
+		if (count <= 0)
+			return count == 0;
+
+		int capacity = count < TTREE_BUILD_CHUNK ? count : TTREE_BUILD_CHUNK;
+		TTreeNode<T>** nodes = new TTreeNode<T>*[capacity];
+		TTreeNode<T>* block = AllocBlock(capacity);
+		for (int i = 0; i < count; i++)
 		{
-			_root = DeleteNode(_root, _root->_data);
+			if (i == capacity)
+			{
+				//full - double (but never past count) and get the block for the new slots
+				capacity = capacity < count - capacity ? capacity * 2 : count;
+				TTreeNode<T>** grown = new TTreeNode<T>*[capacity];
+				for (int j = 0; j < i; j++)
+					grown[j] = nodes[j];
+				delete[] nodes;
+				nodes = grown;
+				block = AllocBlock(capacity - i);
+			}
+
+			nodes[i] = block != NULL ? new(block++) TTreeNode<T>() : NewNode();
+			if (!source.Read(nodes[i]->_data))
+			{
+				//source ran dry - give back what we have
+				for (int j = 0; j <= i; j++)
+					FreeNode(nodes[j]);
+				delete[] nodes;
+				return false;
+			}
 		}
+
+		_root = LinkBalanced(nodes, 0, count, NULL);
+		_count = count;
+		_heightEstimate = BalancedHeight(count);
+
+		delete[] nodes;
+		return true;
 	}
 
+
 	
 	/**
 	* Insert the specified data into the tree
@@ -237,6 +1520,8 @@ public:
 	*/
 	virtual void Insert(T data)
 	{
+		TDS_LATENCY(TLatencyScope latency(_latency, TLATENCY_INSERT);)
+
 		//start at _root
 		TTreeNode<T>* cur = _root, *prev = _root;
 
@@ -244,12 +1529,14 @@ public:
 		//to determine if we should go left or right in the tree and remember (declare outside while loop)
 		//so we can check if we went left or right when inserting new node)
 		int result = 0;
+		unsigned int depth = 0;
 
 		//get the next available node
 		while (cur != NULL)
 		{
 			//run comparison
 			result = _comparison(data, cur->_data);
+			depth++;
 
 			//set prev
 			prev = cur;
@@ -259,7 +1546,7 @@ public:
 		}
 
 		//we are at the next available node
-		cur = new TTreeNode<T>();
+		cur = NewNode();
 
 		//set data
 		cur->_data = data;
@@ -283,6 +1570,167 @@ public:
 		}
 
 		_count++;
+
+		//the new node is at depth + 1 (counting nodes)
+		if ((int)depth + 1 > _heightEstimate)
+			_heightEstimate = (int)depth + 1;
+
+		TDS_STAT(_stats._comparisons += depth;)
+		TDS_STAT(_stats._insert.Record(depth, depth);)
+
+		CheckAutoRebuild(cur, (int)depth + 1);
+	}
+
+	/**
+	* Inserts a batch of data (in any order) in one coordinated pass. The batch is sorted first
+	* (skipped if it already is) and then applied in one of two ways:
+	* - a batch that is small next to the tree is inserted in order, each search starting from the
+	*   node inserted before it (climbing only as far as needed) rather than from the root
+	* - a larger batch is merged with the sorted nodes of the tree in O(n + m) and the result is
+	*   relinked perfectly balanced
+	* Nodes come from one bulk allocation when the allocator is monotonic. Automatic rebuilds (see
+	* SetAutoRebuild) are checked once at the end of the batch rather than after every insert
+	* @param data The data to insert
+	* @param count The number of elements in data
+	*/
+	void InsertBatch(const T* data, int count)
+	{
+		if (count <= 0)
+			return;
+
+		T* sorted = SortBatch(data, count);
+		TTreeNode<T>* block = AllocBlock(count);
+
+		if (PreferBatchMerge(count))
+		{
+			//merge backwards so every node moves once and new data goes after equal data already in the tree
+			TTreeNode<T>** nodes = new TTreeNode<T>*[_count + count];
+			int i = Flatten(_root, nodes) - 1;
+			int k = _count + count - 1;
+			for (int j = count - 1; j >= 0; k--)
+			{
+				if (i >= 0 && _comparison(sorted[j], nodes[i]->_data) <= -1)
+					nodes[k] = nodes[i--];
+				else
+					nodes[k] = MakeNode(sorted[j--], block);
+			}
+			LinkResult(nodes, _count + count);
+			delete[] nodes;
+		}
+		else
+		{
+			TTreeNode<T>* finger = NULL;
+			int fingerDepth = 0, maxDepth = 0;
+			TDS_STAT(unsigned int comparisons = 0;)
+
+			for (int j = 0; j < count; j++)
+			{
+				//climb from the last inserted node until the data is inside the current subtree (every
+				//lower bound of it is already below the data as the batch is sorted, so only check the upper one)
+				TTreeNode<T>* cur = finger != NULL ? finger : _root;
+				int depth = finger != NULL ? fingerDepth : 1;
+				while (finger != NULL && cur->_parent != NULL)
+				{
+					TTreeNode<T>* parent = cur->_parent;
+					if (cur == parent->_left && _comparison(sorted[j], parent->_data) <= -1)
+						break;
+					cur = parent;
+					depth--;
+					TDS_STAT(comparisons++;)
+				}
+
+				//then descend as Insert does
+				TTreeNode<T>* prev = NULL;
+				int result = 0;
+				for (depth--; cur != NULL; depth++)
+				{
+					result = _comparison(sorted[j], cur->_data);
+					TDS_STAT(comparisons++;)
+					prev = cur;
+					cur = result <= -1 ? cur->_left : cur->_right;
+				}
+
+				TTreeNode<T>* node = MakeNode(sorted[j], block);
+				node->_parent = prev;
+				if (prev == NULL)
+					_root = node;
+				else if (result <= -1)
+					prev->_left = node;
+				else
+					prev->_right = node;
+
+				finger = node;
+				fingerDepth = depth + 1;
+				if (fingerDepth > maxDepth)
+					maxDepth = fingerDepth;
+			}
+
+			_count += count;
+			if (maxDepth > _heightEstimate)
+				_heightEstimate = maxDepth;
+			TDS_STAT(_stats._comparisons += comparisons;)
+
+			//rebalance once for the whole batch
+			if (_rebuildRatio > 0.0f && _count >= 16 && (float)_heightEstimate > _rebuildRatio * (float)BalancedHeight(_count))
+				Rebuild();
+		}
+
+		TDS_STAT(_stats._insert._count += count;)
+		delete[] sorted;
+	}
+
+	/**
+	* Removes a batch of data (in any order) in one coordinated pass, one matching element for each
+	* element of the batch. The batch is sorted first; a batch that is small next to the tree is removed
+	* in order (adjacent searches share the cached top of the tree), a larger one is merged with the
+	* sorted nodes of the tree in O(n + m) and the remaining nodes are relinked perfectly balanced
+	* @param data The data to remove
+	* @param count The number of elements in data
+	* @return The number of elements removed
+	*/
+	int RemoveBatch(const T* data, int count)
+	{
+		if (count <= 0 || _count == 0)
+			return 0;
+
+		T* sorted = SortBatch(data, count);
+		int before = _count;
+
+		if (PreferBatchMerge(count))
+		{
+			TTreeNode<T>** nodes = new TTreeNode<T>*[_count];
+			int n = Flatten(_root, nodes);
+			int kept = 0, j = 0;
+			for (int i = 0; i < n; i++)
+			{
+				//skip the batch data that is not in the tree
+				while (j < count && _comparison(sorted[j], nodes[i]->_data) <= -1)
+					j++;
+
+				if (j < count && _comparison(sorted[j], nodes[i]->_data) == 0)
+				{
+					FreeNode(nodes[i]);
+					j++;
+				}
+				else
+				{
+					nodes[kept++] = nodes[i];
+				}
+			}
+			LinkResult(nodes, kept);
+			delete[] nodes;
+		}
+		else
+		{
+			for (int j = 0; j < count && _count > 0; j++)
+				_root = DeleteNode(_root, sorted[j]);
+			if (_count == 0)
+				_heightEstimate = 0;
+		}
+
+		TDS_STAT(_stats._remove._count += before - _count;)
+		delete[] sorted;
+		return before - _count;
 	}
 
 	/**
@@ -296,8 +1744,10 @@ public:
 	* @param SearchFunc Poitner to the search function (just like comparison function, this cannot be a member function of a class unless static
 	*/
 	template<typename IDType>
-	T Find(IDType id, int(*SearchFunc)(IDType, T))
+	T Find(IDType id, int(*SearchFunc)(IDType, T)) const
 	{
+		TDS_LATENCY(TLatencyScope latency(_latency, TLATENCY_FIND);)
+
 		//start at _root
 		TTreeNode<T>* cur = _root;
 
@@ -306,12 +1756,14 @@ public:
 
 		//value to return
 		T ret = T();
+		TDS_STAT(unsigned int depth = 0;)
 
 		//get the next available node
 		while (cur != NULL)
 		{
 			//run search function to tell us to go left, right or found
 			result = SearchFunc(id, cur->_data);
+			TDS_STAT(depth++;)
 
 			//if result != 0 then go left or right
 			if (result != 0)
@@ -327,6 +1779,9 @@ public:
 			}
 		}
 
+		TDS_STAT(_stats._comparisons += depth;)
+		TDS_STAT(_stats._find.Record(depth, depth);)
+
 		//return the data
 		return ret;
 	}
@@ -336,8 +1791,10 @@ public:
 	* @param obj The object whos node we want to find
 	* @return Pointer to the node (can be NULL if not found)
 	*/
-	TTreeNode<T>* Find(T obj)
+	TTreeNode<T>* Find(T obj) const
 	{
+		TDS_LATENCY(TLatencyScope latency(_latency, TLATENCY_FIND);)
+
 		//start at _root
 		TTreeNode<T>* cur = _root;
 
@@ -345,12 +1802,14 @@ public:
 		//to determine if we should go left or right in the tree and remember (declare outside while loop)
 		//so we can check if we went left or right when inserting new node)
 		int result = 0;
+		TDS_STAT(unsigned int depth = 0;)
 
 		//get the next available node
 		while (cur != NULL)
 		{
 			//run comparison
 			result = _comparison(obj, cur->_data);
+			TDS_STAT(depth++;)
 
 			//found case
 			if (result == 0) break;
@@ -359,18 +1818,99 @@ public:
 			cur = result <= -1 ? cur->_left : cur->_right;
 		}
 
+		TDS_STAT(_stats._comparisons += depth;)
+		TDS_STAT(_stats._find.Record(depth, depth);)
+
 		return cur;
 	}
 
-	
+	/**
+	* Finds the nodes of count keys at once. Up to TTREE_FIND_GROUP lookups walk down the tree in
+	* turns, each prefetching the child it moves to and only comparing against it on its next turn,
+	* so the cache misses of different keys overlap instead of being paid one after another. Worth
+	* it once the tree is bigger than the cache and there are more than a handful of keys
+	* @param keys The keys to look for
+	* @param count Number of keys
+	* @param results Receives the node of each key (NULL if not found, same as Find)
+	*/
+	void FindMany(const T* keys, int count, TTreeNode<T>** results) const
+	{
+		TTreeNode<T>* cur[TTREE_FIND_GROUP]; //the node each lookup compares against next
+		int index[TTREE_FIND_GROUP]; //the key each lookup is for
+		TDS_STAT(unsigned int depth[TTREE_FIND_GROUP];)
+		int active = 0, next = 0;
+
+		while (active < TTREE_FIND_GROUP && next < count)
+		{
+			cur[active] = _root;
+			index[active] = next++;
+			TDS_STAT(depth[active] = 0;)
+			active++;
+		}
+
+		while (active > 0)
+		{
+			for (int i = 0; i < active; )
+			{
+				TTreeNode<T>* node = cur[i];
+				if (node != NULL)
+				{
+					int result = _comparison(keys[index[i]], node->_data);
+					TDS_STAT(depth[i]++;)
+					if (result != 0)
+					{
+						node = result <= -1 ? node->_left : node->_right;
+						if (node != NULL)
+						{
+							//not done yet - start loading the child and move on to the next lookup
+							TDS_PREFETCH(node);
+							cur[i++] = node;
+							continue;
+						}
+					}
+				}
+
+				//this lookup is finished
+				results[index[i]] = node;
+				TDS_STAT(_stats._comparisons += depth[i];)
+				TDS_STAT(_stats._find.Record(depth[i], depth[i]);)
+
+				//start the next key in its place or close the gap
+				if (next < count)
+				{
+					cur[i] = _root;
+					index[i] = next++;
+					TDS_STAT(depth[i] = 0;)
+					i++;
+				}
+				else
+				{
+					active--;
+					cur[i] = cur[active];
+					index[i] = index[active];
+					TDS_STAT(depth[i] = depth[active];)
+				}
+			}
+		}
+	}
+
 	/**
 	* Removes the specfied data from the tree
 	* @param data The data to remove from the tree
 	*/
 	virtual void Remove(T data)
 	{
+		TDS_LATENCY(TLatencyScope latency(_latency, TLATENCY_REMOVE);)
+		TDS_STAT(unsigned long long before = _stats._comparisons;)
+
 		//recursive call so we start from root
 		_root = DeleteNode(_root, data);
+
+		if (_count == 0)
+			_heightEstimate = 0;
+
+		TDS_STAT(unsigned long long cmp = _stats._comparisons - before;)
+		TDS_STAT(_stats._remove.Record(cmp, (unsigned int)cmp);)
 	}
 
 	/**
@@ -380,14 +1920,175 @@ public:
 	*/
 	virtual void Remove(TTreeIter<T>& itr)
 	{
+		TDS_LATENCY(TLatencyScope latency(_latency, TLATENCY_REMOVE);)
+		TDS_STAT(unsigned long long before = _stats._comparisons;)
+
 		itr._current = DeleteNode(itr._current, itr._current->_data);
+
+		TDS_STAT(unsigned long long cmp = _stats._comparisons - before;)
+		TDS_STAT(_stats._remove.Record(cmp, (unsigned int)cmp);)
 		
 		//push this node
 		itr._stack.Push(itr._current);
 	}
 
+	/**
+	* Replaces the contents of this tree with lhs op rhs (see TSetOperation), using the comparison
+	* function of lhs. The result is a perfectly balanced tree of copies of the data. Both trees are
+	* merged in sorted order in O(n + m), except that an intersection or difference with a much smaller
+	* tree looks the smaller tree's elements up in the larger one instead (O(m log n)). Large merges
+	* are split across threads. This tree may be lhs or rhs
+	* @param op The set operation
+	* @param lhs The left operand
+	* @param rhs The right operand
+	* @param threads The most threads to use (1 to stay on the calling thread)
+	*/
+	void SetOperation(TSetOperation op, const TTree& lhs, const TTree& rhs, int threads = 1)
+	{
+		if (&lhs == this)
+		{
+			SetOperationWith(op, rhs, threads);
+			return;
+		}
+		if (&rhs == this)
+		{
+			TTree copy(*this);
+			SetOperation(op, lhs, copy, threads);
+			return;
+		}
+
+		Empty();
+		_comparison = lhs._comparison;
+
+		if (op == TSET_INTERSECT && PreferLookups(rhs, lhs))
+			LookupOperation(op, rhs, lhs, false, false);
+		else if ((op == TSET_INTERSECT || op == TSET_DIFFERENCE) && PreferLookups(lhs, rhs))
+			LookupOperation(op, lhs, rhs, true, false);
+		else
+			LinearOperation(op, lhs, rhs, false, threads);
+	}
+
+	/**
+	* Replaces the contents of this tree with this op other in place: nodes of this tree that stay in
+	* the result are reused (not copied) and only elements taken from other are allocated. With a much
+	* smaller other a union, difference or symmetric difference just inserts and removes its elements
+	* (O(m log n)) and keeps the current shape, otherwise the result is relinked perfectly balanced
+	* @param op The set operation
+	* @param other The right operand
+	* @param threads The most threads to use (1 to stay on the calling thread)
+	*/
+	void SetOperationWith(TSetOperation op, const TTree& other, int threads = 1)
+	{
+		if (&other == this)
+		{
+			//a set combined with itself is itself or nothing
+			if (op == TSET_DIFFERENCE || op == TSET_SYMMETRIC_DIFFERENCE)
+				Empty();
+			return;
+		}
+
+		if (op != TSET_INTERSECT && PreferLookups(other, *this))
+			UpdateOperation(op, other);
+		else if ((op == TSET_INTERSECT || op == TSET_DIFFERENCE) && PreferLookups(*this, other))
+			LookupOperation(op, *this, other, true, true);
+		else
+			LinearOperation(op, *this, other, true, threads);
+	}
+
+	/**
+	* Adds the elements of other this tree does not have (see SetOperationWith)
+	* @param other The tree to add
+	* @param threads The most threads to use
+	*/
+	inline void Union(const TTree& other, int threads = 1)
+	{
+		SetOperationWith(TSET_UNION, other, threads);
+	}
+
+	/**
+	* Keeps only the elements other also has (see SetOperationWith)
+	* @param other The tree to intersect with
+	* @param threads The most threads to use
+	*/
+	inline void Intersect(const TTree& other, int threads = 1)
+	{
+		SetOperationWith(TSET_INTERSECT, other, threads);
+	}
+
+	/**
+	* Removes the elements other has (see SetOperationWith)
+	* @param other The tree to subtract
+	* @param threads The most threads to use
+	*/
+	inline void Difference(const TTree& other, int threads = 1)
+	{
+		SetOperationWith(TSET_DIFFERENCE, other, threads);
+	}
+
+	/**
+	* Keeps the elements only one of the trees has (see SetOperationWith)
+	* @param other The other tree
+	* @param threads The most threads to use
+	*/
+	inline void SymmetricDifference(const TTree& other, int threads = 1)
+	{
+		SetOperationWith(TSET_SYMMETRIC_DIFFERENCE, other, threads);
+	}
+
 };
 
+/**
+* Returns lhs op rhs as a new tree (see TTree::SetOperation) which uses the allocator of lhs
+* @param op The set operation
+* @param lhs The left operand
+* @param rhs The right operand
+* @param threads The most threads to use (1 to stay on the calling thread)
+* @return The new tree
+*/
+template<typename T, typename Alloc>
+TTree<T, Alloc> TSetOperationOf(TSetOperation op, const TTree<T, Alloc>& lhs, const TTree<T, Alloc>& rhs, int threads = 1)
+{
+	TTree<T, Alloc> result(lhs.GetAllocator());
+	result.SetOperation(op, lhs, rhs, threads);
+	return result;
+}
+
+/**
+* Returns the union of two trees as a new tree (see TTree::SetOperation)
+*/
+template<typename T, typename Alloc>
+TTree<T, Alloc> TUnion(const TTree<T, Alloc>& lhs, const TTree<T, Alloc>& rhs, int threads = 1)
+{
+	return TSetOperationOf(TSET_UNION, lhs, rhs, threads);
+}
+
+/**
+* Returns the intersection of two trees as a new tree (see TTree::SetOperation)
+*/
+template<typename T, typename Alloc>
+TTree<T, Alloc> TIntersect(const TTree<T, Alloc>& lhs, const TTree<T, Alloc>& rhs, int threads = 1)
+{
+	return TSetOperationOf(TSET_INTERSECT, lhs, rhs, threads);
+}
+
+/**
+* Returns the elements of lhs that rhs does not have as a new tree (see TTree::SetOperation)
+*/
+template<typename T, typename Alloc>
+TTree<T, Alloc> TDifference(const TTree<T, Alloc>& lhs, const TTree<T, Alloc>& rhs, int threads = 1)
+{
+	return TSetOperationOf(TSET_DIFFERENCE, lhs, rhs, threads);
+}
+
+/**
+* Returns the elements only one of the trees has as a new tree (see TTree::SetOperation)
+*/
+template<typename T, typename Alloc>
+TTree<T, Alloc> TSymmetricDifference(const TTree<T, Alloc>& lhs, const TTree<T, Alloc>& rhs, int threads = 1)
+{
+	return TSetOperationOf(TSET_SYMMETRIC_DIFFERENCE, lhs, rhs, threads);
+}
+
 
 /**
 * Iterator class created to iterator (loop through) items on a TTree
@@ -398,13 +2099,15 @@ public:
 template<typename T>
 class TTreeIter
 {
-	friend class TTree<T>;
+	template<typename, typename> friend class TTree;
 private:
 
 	TStack<TTreeNode<T>*> _stack; /**< Stack containing nodes to visit */
 
 	TTreeNode<T>* _current; /**< The current node this iterator is at */
 
+	TDS_STAT(TContainerStats* _stats;) /**< The stats of the tree being iterated (only when TDS_ENABLE_STATS is defined) */
+
 	/**
 	* Pushes left node to stack from the given node
 	* @param node The node whos left node will be pushed to stack
@@ -437,6 +2140,8 @@ public:
 	TTreeIter()
 	{
 		_current = NULL;
+		TDS_STAT(_stats = NULL;)
+		TDS_LATENCY(_stack.SetLatencySampleRate(0);)
 	}
 
 	/**
@@ -451,10 +2156,15 @@ public:
 	* Overloaded constructor which takes the tree to iterate over as a pointer
 	* @param tree The pointer to the tree in which this iterator will loop through
 	*/
-    TTreeIter(TTree<T>* tree)
+    template<typename Alloc>
+    TTreeIter(const TTree<T, Alloc>* tree)
     {
        //set current to root
 		_current = tree->_root;
+		TDS_STAT(_stats = &tree->_stats;)
+
+		//the stack is internal so its pushes and pops stay out of the latency histograms
+		TDS_LATENCY(_stack.SetLatencySampleRate(0);)
 
 		//push left and right nodes on the stack (if _current is not NULL)
 		if (_current != NULL)
@@ -480,6 +2190,7 @@ public:
     {
 		//pop from stack
 		_current = _stack.Pop();
+		TDS_STAT(if (_stats != NULL) _stats->_iteratorNexts++;)
 
 		//push left and right
 		PushLeft(_current);
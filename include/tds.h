@@ -1,3 +1,23 @@
+#include "TAllocator.h"
+#include "TArena.h"
+#include "THugePages.h"
+#include "TStats.h"
+#include "TLatency.h"
+#include "TCompare.h"
+#include "TSerialize.h"
+#include "TSimd.h"
 #include "TList.h"
 #include "TStack.h"
-#include "TTree.h"
\ No newline at end of file
+#include "TRingBuffer.h"
+#include "TTree.h"
+#include "TIntervalTree.h"
+#include "TCow.h"
+#include "TPersistentTree.h"
+#include "TSkipList.h"
+#include "TMappedTree.h"
+#include "TExternalSort.h"
+#include "TStaticTree.h"
+#include "THashMap.h"
+#include "TRadixTree.h"
+#include "TMultiIndex.h"
+#include "TPriorityQueue.h"
\ No newline at end of file
@@ -1,9 +1,15 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include "tds.h"
 #include <string>
+#include <sstream>
+#include <thread>
 
 
+#ifndef NDEBUG
 #define NDEBUG 
+#endif
 
 class TestClass
 {
@@ -90,6 +96,35 @@ void RunTListTests()
 	//clear list
 	list.Empty();
 
+	//a list which allocates its nodes from the per thread cache
+	TList<int, TThreadCacheAllocator> cached_list;
+	for (int i = 0; i < 100; i++)
+		cached_list.PushBack(i);
+	int min = 0, max = 0;
+	cached_list.MinMax(min, max);
+	printf("\nSum = %lld, min = %d, max = %d, in [10, 19] = %d\n", cached_list.Sum(), min, max,
+		cached_list.CountIf(TInRange<int>(10, 19)));
+	cached_list.Empty();
+	printf("Cached blocks after emptying = %d\n", TThreadCacheAllocator::CachedBlocks());
+
+	//a list which allocates its nodes from an arena (emptying it is O(1))
+	TArena arena;
+	TList<int, TArenaAllocator> arena_list = TList<int, TArenaAllocator>(TArenaAllocator(&arena));
+	for (int i = 0; i < 100; i++)
+		arena_list.PushBack(i);
+	printf("Arena bytes used = %d\n", (int)arena.BytesUsed());
+	arena_list.Empty();
+
+	//a list whose nodes come from huge page backed regions (4K pages if none are available)
+	THugePagePool pool(THUGEPAGE_TRANSPARENT, THUGEPAGE_SIZE);
+	TList<int, THugePageAllocator> huge_list = TList<int, THugePageAllocator>(THugePageAllocator(&pool));
+	for (int i = 0; i < 100; i++)
+		huge_list.PushBack(i);
+	THugePageCoverage coverage = pool.Coverage();
+	printf("Huge page pool bytes used = %d, reserved = %d, fallback = %s\n", (int)pool.BytesUsed(),
+		(int)coverage._reserved, coverage._fallback > 0 ? "true" : "false");
+	huge_list.Empty();
+
 	printf("\n---------\n");
 }
 
@@ -141,6 +176,12 @@ int CompareInt(int lhs, int rhs)
 	else return 0;
 }
 
+//called for every instrumentation counter of a container
+void PrintStat(const char* name, unsigned long long value)
+{
+	printf("%s = %llu\n", name, value);
+}
+
 /* Contains all tests running on TTree */
 void RunTTreeTests()
 {
@@ -213,11 +254,393 @@ void RunTTreeTests()
 		printf("%d\n", *data);
 	}
 
+	//print the shape of the tree
+	TTreeShape shape = int_tree.Shape();
+	printf("Tree height = %d (estimate %d), average depth = %.2f, max imbalance = %d, bytes = %d\n",
+		shape._height, int_tree.HeightEstimate(), shape._avgDepth, shape._maxImbalance, (int)(shape._nodeBytes + shape._overheadBytes));
+
+	//rebalance it
+	int_tree.Rebuild();
+	printf("Rebuilt height = %d\n", int_tree.Height());
+
+	//take a snapshot and reload it into a new tree (which comes back balanced)
+	std::stringstream snapshot;
+	int_tree.Serialize(snapshot);
+	TTree<int> reloaded = TTree<int>(CompareInt);
+	if (reloaded.Deserialize(snapshot))
+		printf("Reloaded %d items, height = %d\n", reloaded.Count(), reloaded.Height());
+
+#if !defined(_WIN32)
+	//write the tree to a mapped file and open it again without reading it
+	TMappedTree<int> mapped(CompareInt);
+	if (mapped.Create("/tmp/tds_mapped_tree.bin"))
+	{
+		TTREE_foreach(int, itr, int_tree)
+		{
+			mapped.Insert(*itr);
+		}
+		mapped.Sync();
+		mapped.Close();
+	}
+	if (mapped.Open("/tmp/tds_mapped_tree.bin"))
+	{
+		printf("Mapped tree holds %d items, 50 %s\n", (int)mapped.Count(), mapped.Find(50) ? "found" : "not found");
+		printf("Mapped items:");
+		TMAPPEDTREE_foreach(int, itr, mapped)
+		{
+			printf(" %d", *itr);
+		}
+		printf("\n");
+		mapped.Close();
+	}
+	unlink("/tmp/tds_mapped_tree.bin");
+#endif
+
+	//sort more keys than the (tiny) memory budget holds through temporary files into a balanced tree
+	TExternalSorter<int> sorter(CompareInt, 16 * 1024);
+	for (int i = 0; i < 20000; i++)
+		sorter.Add(rand() % 100000);
+	int runs = sorter.RunCount();
+	TTree<int> bulk = TTree<int>(CompareInt);
+	if (sorter.BuildTree(bulk))
+		printf("Bulk built %d items from %d runs, height = %d\n", bulk.Count(), runs, bulk.Height());
+
+	//clone the tree by mirroring its shape, then share it copy on write between two readers
+	TTree<int> cloned = bulk.Clone();
+	TCow<TTree<int> > config(cloned);
+	TCow<TTree<int> > request = config;
+	printf("Cloned %d items, request shares config = %s\n", cloned.Count(), request.IsShared() ? "true" : "false");
+	request.Write().Insert(-1);
+	printf("After the first write: request has %d items, config has %d\n", request->Count(), config->Count());
+
+	//reconcile two key sets with linear merges (the result trees are perfectly balanced)
+	TTree<int> evens = TTree<int>(CompareInt), triples = TTree<int>(CompareInt);
+	for (int i = 0; i < 30; i += 2)
+		evens.Insert(i);
+	for (int i = 0; i < 30; i += 3)
+		triples.Insert(i);
+	TTree<int> both = TIntersect(evens, triples);
+	TTree<int> either = TUnion(evens, triples);
+	evens.Difference(triples);
+	printf("Set operations: union %d, intersection %d, evens without triples %d\n", either.Count(), both.Count(), evens.Count());
+
+	//apply a batch of updates in one pass
+	int updates[] = { 31, 40, 35, 33, 38 };
+	either.InsertBatch(updates, 5);
+	int removed = either.RemoveBatch(updates, 3);
+	printf("Batched: %d items after inserting 5 and removing %d\n", either.Count(), removed);
+
+	//look up a batch of keys with their cache misses overlapped
+	int queries[] = { 26, 27, 29, 33, 35 };
+	TTreeNode<int>* matches[5];
+	either.FindMany(queries, 5, matches);
+	printf("FindMany:");
+	for (int i = 0; i < 5; i++)
+		printf(" %d=%s", queries[i], matches[i] != NULL ? "found" : "missing");
+	printf("\n");
+
+	//print the instrumentation counters (all zero unless built with TDS_ENABLE_STATS)
+	printf("Tree stats\n");
+	int_tree.GetStats().Export(PrintStat);
+
+	//print the latency percentiles of each operation (nothing unless built with TDS_ENABLE_LATENCY)
+	int_tree.GetLatency().Dump(stdout, "int_tree");
+
 	//empty tree
 	int_tree.Empty();
 	printf("\n---------\n");
 }
 
+/* Contains all tests running on TIntervalTree */
+void RunTIntervalTreeTests()
+{
+	printf("Running TIntervalTree Tests\n---------\n");
+
+	//bookings as [start, end] minutes of the day
+	TInterval<int> bookings[] = { TInterval<int>(540, 600), TInterval<int>(570, 660), TInterval<int>(720, 780), TInterval<int>(480, 1020), TInterval<int>(900, 960) };
+	TIntervalTree<int> rooms;
+	rooms.Build(bookings, 5);
+	rooms.Insert(600, 630);
+
+	printf("Overlapping [590, 610]:");
+	int count = rooms.Overlapping(590, 610, [](const TInterval<int>& i) { printf(" [%d, %d]", i._lo, i._hi); });
+	printf(" (%d)\nAt 730:", count);
+	rooms.Stabbing(730, [](const TInterval<int>& i) { printf(" [%d, %d]", i._lo, i._hi); });
+	printf("\nContaining [550, 590]:");
+	rooms.Containing(550, 590, [](const TInterval<int>& i) { printf(" [%d, %d]", i._lo, i._hi); });
+
+	rooms.Remove(480, 1020);
+	const TInterval<int>* free = rooms.FindOverlap(800, 880);
+	printf("\n[800, 880] is %s after remove, count = %d\n", free == NULL ? "free" : "booked", rooms.Count());
+
+	printf("\n---------\n");
+}
+
+/* Contains all tests running on TPersistentTree */
+void RunTPersistentTreeTests()
+{
+	printf("Running TPersistentTree Tests\n---------\n");
+
+	TPersistentTree<int> tree(CompareInt);
+	for (int i = 1; i <= 5; i++)
+		tree = tree.Insert(i * 10);
+
+	//the snapshot keeps seeing the tree as it was when it was taken
+	TPersistentTree<int> snapshot = tree.Snapshot();
+	tree = tree.Remove(30).Insert(35);
+
+	printf("Current:");
+	TPERSISTENTTREE_foreach(int, itr, tree)
+		printf(" %d", *itr);
+	printf("\nSnapshot:");
+	TPERSISTENTTREE_foreach(int, itr, snapshot)
+		printf(" %d", *itr);
+	printf("\nSnapshot still has 30 = %s, height = %d\n", snapshot.Find(30) != NULL ? "true" : "false", snapshot.Height());
+
+	printf("\n---------\n");
+}
+
+/* Contains all tests running on TSkipList */
+void RunTSkipListTests()
+{
+	printf("Running TSkipList Tests\n---------\n");
+
+	//writers do not need a lock around the list
+	TSkipList<int> list;
+	for (int i = 10; i > 0; i--)
+		list.Insert(i * 10);
+	list.Erase(50);
+	printf("Insert of existing 20 = %s\n", list.Insert(20) ? "true" : "false");
+
+	printf("In order:");
+	TSKIPLIST_foreach(int, itr, list)
+		printf(" %d", itr.Value());
+	printf("\nIn [25, 75):");
+	list.Scan(25, 75, [](const int& value) { printf(" %d", value); });
+	printf("\nContains 50 = %s, count = %d\n", list.Contains(50) ? "true" : "false", list.Count());
+
+	printf("\n---------\n");
+}
+
+/* Contains all tests running on TRingBuffer */
+void RunTRingBufferTests()
+{
+	printf("Running TRingBuffer Tests\n---------\n");
+
+	//pass values from a producer thread to this one without a lock or an allocation per value
+	TRingBuffer<int> ring(8);
+	std::thread producer([&ring]()
+	{
+		int values[4] = { 1, 2, 3, 4 };
+		for (int done = 0; done < 4; )
+			done += ring.PushMany(values + done, 4 - done);
+		for (int i = 5; i <= 10; i++)
+			ring.Push(i);
+	});
+
+	int sum = 0;
+	for (int i = 0; i < 10; i++)
+		sum += ring.Pop();
+	producer.join();
+
+	int value = 0;
+	printf("Capacity = %d, sum = %d, empty = %s\n", ring.Capacity(), sum, ring.TryPop(value) ? "false" : "true");
+
+	printf("\n---------\n");
+}
+
+/* Contains all tests running on THashMap */
+void RunTHashMapTests()
+{
+	printf("Running THashMap Tests\n---------\n");
+
+	//look objects up by id in O(1) rather than with TTree::Find and FindObject
+	THashMap<int, TestClass*> objects;
+	objects.Reserve(10);
+	int id = 0;
+	for (int i = 0; i < 10; i++)
+	{
+		TestClass* obj = new TestClass("MyName");
+		objects.Insert(obj->_data, obj);
+		if (i == 5)
+			id = obj->_data;
+	}
+
+	TestClass** found = objects.Find(id);
+	TestClass* removed = found != NULL ? *found : NULL;
+	printf("Object %d %s\n", id, found != NULL ? "found" : "not found");
+	objects.Remove(id);
+	printf("Object %d %s after remove, count = %d\n", id, objects.Contains(id) ? "found" : "not found", objects.Count());
+
+	THASHMAP_foreach(int, TestClass*, itr, objects)
+	{
+		delete itr.Value();
+	}
+	delete removed;
+	objects.Empty();
+
+	printf("\n---------\n");
+}
+
+//orderings and hashes of TestClass objects for TMultiIndex (by id, also looked up by an int)
+struct ClassById
+{
+	bool operator()(const TestClass* lhs, const TestClass* rhs) const { return lhs->_data < rhs->_data; }
+	bool operator()(const TestClass* lhs, int rhs) const { return lhs->_data < rhs; }
+	bool operator()(int lhs, const TestClass* rhs) const { return lhs < rhs->_data; }
+};
+
+//by name, also looked up by a string
+struct ClassByName
+{
+	bool operator()(const TestClass* lhs, const TestClass* rhs) const { return strcmp(lhs->_name, rhs->_name) < 0; }
+	bool operator()(const TestClass* lhs, const char* rhs) const { return strcmp(lhs->_name, rhs) < 0; }
+	bool operator()(const char* lhs, const TestClass* rhs) const { return strcmp(lhs, rhs->_name) < 0; }
+};
+
+struct ClassIdHash
+{
+	size_t operator()(const TestClass* obj) const { return (size_t)obj->_data; }
+	size_t operator()(int id) const { return (size_t)id; }
+};
+
+struct ClassIdEqual
+{
+	bool operator()(const TestClass* lhs, const TestClass* rhs) const { return lhs->_data == rhs->_data; }
+	bool operator()(const TestClass* lhs, int rhs) const { return lhs->_data == rhs; }
+};
+
+/* Contains all tests running on TRadixTree */
+void RunTRadixTreeTests()
+{
+	printf("Running TRadixTree Tests\n---------\n");
+
+	//look objects up by name in O(name length) and list them by prefix
+	const char* names[] = { "player", "player.weapon", "player.weapon.scope", "player.shield", "enemy", "enemy.boss" };
+	TRadixTree<TestClass*> objects;
+	for (int i = 0; i < 6; i++)
+	{
+		TestClass* obj = new TestClass(names[i]);
+		objects.Insert(obj->_name, obj);
+	}
+
+	TestClass** found = objects.Find("player.shield");
+	printf("player.shield %s, count = %d\n", found != NULL ? "found" : "not found", objects.Count());
+
+	printf("Under player.weapon:");
+	TRADIXTREE_prefix_foreach(TestClass*, itr, objects, "player.weapon")
+	{
+		printf(" %s", itr.Key());
+	}
+
+	size_t matched = 0;
+	TestClass** owner = objects.LongestPrefix("enemy.boss.helmet", &matched);
+	printf("\nLongest prefix of enemy.boss.helmet = %.*s (%d)\n", (int)matched, owner != NULL ? (*owner)->_name : "", owner != NULL ? (*owner)->_data : -1);
+
+	TRADIXTREE_foreach(TestClass*, itr, objects)
+	{
+		delete itr.Value();
+	}
+	objects.Empty();
+
+	printf("\n---------\n");
+}
+
+/* Contains all tests running on TMultiIndex */
+void RunTMultiIndexTests()
+{
+	printf("Running TMultiIndex Tests\n---------\n");
+
+	//every object is stored once but ordered by id and name and hashed by id
+	TMultiIndex<TestClass*, TIndexes<TOrderedIndex<ClassById>, TOrderedIndex<ClassByName>, THashedIndex<ClassIdHash, ClassIdEqual> > > objects;
+
+	const char* names[] = { "delta", "alpha", "echo", "charlie", "bravo" };
+	int id = 0;
+	for (int i = 0; i < 5; i++)
+	{
+		TestClass* obj = new TestClass(names[i]);
+		objects.Insert(obj);
+		if (i == 2)
+			id = obj->_data;
+	}
+
+	printf("By name:");
+	TMULTIINDEX_foreach(1, itr, objects)
+	{
+		printf(" %s", itr.Value()->_name);
+	}
+	printf("\n");
+
+	//erase through one index removes it from all of them
+	TestClass* echo = objects.Find<2>(id)->_data;
+	objects.Remove<2>(id);
+	printf("Object %d removed, by name lookup %s, count = %d\n", id, objects.Find<1>("echo") != NULL ? "found" : "not found", objects.Count());
+	delete echo;
+
+	TMULTIINDEX_foreach(0, itr, objects)
+	{
+		delete itr.Value();
+	}
+	objects.Empty();
+
+	printf("\n---------\n");
+}
+
+/* Contains all tests running on TPriorityQueue */
+void RunTPriorityQueueTests()
+{
+	printf("Running TPriorityQueue Tests\n---------\n");
+
+	//a min queue of deadlines, heapified in one go
+	int deadlines[] = { 40, 10, 30, 50, 20 };
+	TPriorityQueue<int> queue;
+	queue.PushMany(deadlines, 5);
+	queue.Push(5);
+
+	//aggregates over the contiguous heap array use SSE2/AVX2 when the CPU has them
+	//FilterInto needs room for every element in case they all match
+	int* urgent = new int[queue.Count()];
+	int urgent_count = queue.FilterInto(TInRange<int>(0, 25), urgent);
+	printf("Deadline sum = %lld, due by 25 = %d\n", queue.Sum(), urgent_count);
+	delete[] urgent;
+
+	printf("Popped:");
+	while (!queue.IsEmpty())
+		printf(" %d", queue.Pop());
+	printf("\n");
+
+	//move a task forward by its handle
+	TIndexedPriorityQueue<int> tasks;
+	int handles[5];
+	for (int i = 0; i < 5; i++)
+		handles[i] = tasks.Push(deadlines[i]);
+
+	tasks.DecreaseKey(handles[3], 1);
+	tasks.Erase(handles[1]);
+	printf("Next task = %d (deadline %d), count = %d\n", tasks.TopHandle(), tasks.Top(), tasks.Count());
+
+	printf("\n---------\n");
+}
+
+/* Contains all tests running on TStaticTree */
+static constexpr const char* config_keys[] = { "width", "height", "depth", "fullscreen", "vsync" };
+static constexpr auto config_table = TMakeStaticTree<TLessString>(config_keys);
+static_assert(config_table.Contains("vsync") && !config_table.Contains("gamma"), "config_table is built while compiling");
+
+void RunTStaticTreeTests()
+{
+	printf("Running TStaticTree Tests\n---------\n");
+
+	const char* lookups[] = { "depth", "gamma", "width" };
+	for (int i = 0; i < 3; i++)
+		printf("%s %s\n", lookups[i], config_table.Contains(lookups[i]) ? "found" : "not found");
+
+	const char* const* next = config_table.LowerBound("g");
+	printf("First key from g = %s\n", next != NULL ? *next : "none");
+
+	printf("\n---------\n");
+}
+
 int main(int argc, char** argv)
 {
 	/* Run TList Tests */
@@ -229,5 +652,32 @@ int main(int argc, char** argv)
 	/* Run TTree Tests */
 	RunTTreeTests();
 
+	/* Run TIntervalTree Tests */
+	RunTIntervalTreeTests();
+
+	/* Run TPersistentTree Tests */
+	RunTPersistentTreeTests();
+
+	/* Run TSkipList Tests */
+	RunTSkipListTests();
+
+	/* Run TRingBuffer Tests */
+	RunTRingBufferTests();
+
+	/* Run THashMap Tests */
+	RunTHashMapTests();
+
+	/* Run TRadixTree Tests */
+	RunTRadixTreeTests();
+
+	/* Run TMultiIndex Tests */
+	RunTMultiIndexTests();
+
+	/* Run TPriorityQueue Tests */
+	RunTPriorityQueueTests();
+
+	/* Run TStaticTree Tests */
+	RunTStaticTreeTests();
+
 	return 0;
 }
\ No newline at end of file
@@ -0,0 +1,953 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+#include <list>
+#include <set>
+#include <algorithm>
+#include "tds.h"
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+#if !defined(_WIN32)
+#include <sys/resource.h>
+#endif
+
+/*
+* Randomized stress harness for the containers in tds.h. Every container runs a long random
+* mix of operations which is checked against a reference STL container after every operation
+* (and with a full content comparison periodically). While running it prints one CSV line per
+* reporting interval:
+*
+*	phase,container,threads,elapsed_s,ops,ops_per_s,p50_ns,p99_ns,p999_ns,max_ns,live_bytes,peak_rss_kb
+*
+* Multi-threaded phases run the same mixes from many threads at once, both on a container shared
+* between the threads (behind a lock) and on per thread containers using TThreadCacheAllocator,
+* on a TSkipList shared without any lock (with threads on disjoint keys and on one small shared
+* range), one thread writes a TPersistentTree while the others read snapshots of it, and one
+* thread feeds a TRingBuffer to another.
+* Any mismatch prints a FAIL line and the program exits with 1.
+*
+* Usage: TemplateDatastructuresStress [--seconds S] [--threads N] [--keys N] [--seed N]
+*/
+
+/* ---- Memory tracking ---- */
+
+static std::atomic<long long> g_liveBytes(0); /**< Bytes currently allocated through the global operator new (glibc only) */
+
+static inline void TrackAlloc(void* p)
+{
+#if defined(__GLIBC__)
+	g_liveBytes.fetch_add((long long)malloc_usable_size(p), std::memory_order_relaxed);
+#else
+	(void)p;
+#endif
+}
+
+static inline void TrackFree(void* p)
+{
+#if defined(__GLIBC__)
+	if (p != NULL)
+		g_liveBytes.fetch_sub((long long)malloc_usable_size(p), std::memory_order_relaxed);
+#else
+	(void)p;
+#endif
+}
+
+/* The replacements are kept out of line - once GCC inlines free into a call site that used new it
+   warns about a mismatched new/delete pair (-Wmismatched-new-delete) */
+#if defined(__GNUC__) || defined(__clang__)
+#define TDS_NOINLINE __attribute__((noinline))
+#elif defined(_MSC_VER)
+#define TDS_NOINLINE __declspec(noinline)
+#else
+#define TDS_NOINLINE
+#endif
+
+TDS_NOINLINE void* operator new(size_t size)
+{
+	void* p = malloc(size ? size : 1);
+	if (p == NULL) throw std::bad_alloc();
+	TrackAlloc(p);
+	return p;
+}
+
+TDS_NOINLINE void* operator new[](size_t size)
+{
+	void* p = malloc(size ? size : 1);
+	if (p == NULL) throw std::bad_alloc();
+	TrackAlloc(p);
+	return p;
+}
+
+TDS_NOINLINE void operator delete(void* p) noexcept { TrackFree(p); free(p); }
+TDS_NOINLINE void operator delete[](void* p) noexcept { TrackFree(p); free(p); }
+TDS_NOINLINE void operator delete(void* p, size_t) noexcept { TrackFree(p); free(p); }
+TDS_NOINLINE void operator delete[](void* p, size_t) noexcept { TrackFree(p); free(p); }
+
+/**
+* Returns the peak resident set size of the process in KB (0 if unknown)
+*/
+static long PeakRssKb()
+{
+#if !defined(_WIN32)
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) == 0)
+	{
+#if defined(__APPLE__)
+		return (long)(usage.ru_maxrss / 1024);
+#else
+		return (long)usage.ru_maxrss;
+#endif
+	}
+#endif
+	return 0;
+}
+
+/* ---- Options ---- */
+
+struct Options
+{
+	double _seconds; /**< How long each phase runs for */
+	int _threads; /**< Number of threads for the multi-threaded phases */
+	int _keys; /**< Keys are drawn from [0, _keys) */
+	unsigned _seed; /**< Seed for every random generator */
+};
+
+static Options g_options;
+
+/* ---- Timing and latency statistics ---- */
+
+static inline long long NowNs()
+{
+	return (long long)std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+* Collects per operation latencies for one reporting interval
+*/
+struct Latencies
+{
+	std::vector<unsigned> _samples;
+
+	inline void Add(long long ns)
+	{
+		_samples.push_back(ns > 0xFFFFFFFFLL ? 0xFFFFFFFFu : (unsigned)ns);
+	}
+
+	void Merge(const Latencies& other)
+	{
+		_samples.insert(_samples.end(), other._samples.begin(), other._samples.end());
+	}
+
+	unsigned Percentile(double p)
+	{
+		if (_samples.empty()) return 0;
+		size_t idx = (size_t)(p * (double)(_samples.size() - 1));
+		std::nth_element(_samples.begin(), _samples.begin() + idx, _samples.end());
+		return _samples[idx];
+	}
+
+	unsigned Max()
+	{
+		if (_samples.empty()) return 0;
+		return *std::max_element(_samples.begin(), _samples.end());
+	}
+
+	void Clear() { _samples.clear(); }
+};
+
+/**
+* Prints one interval line
+*/
+static void Report(const char* phase, const char* container, int threads, double elapsed,
+	long long ops, double interval, Latencies& lat)
+{
+	unsigned p50 = lat.Percentile(0.50);
+	unsigned p99 = lat.Percentile(0.99);
+	unsigned p999 = lat.Percentile(0.999);
+	unsigned max = lat.Max();
+
+	printf("%s,%s,%d,%.2f,%lld,%.0f,%u,%u,%u,%u,%lld,%ld\n",
+		phase, container, threads, elapsed, ops, interval > 0 ? (double)ops / interval : 0.0,
+		p50, p99, p999, max, g_liveBytes.load(std::memory_order_relaxed), PeakRssKb());
+	fflush(stdout);
+}
+
+static std::atomic<bool> g_failed(false);
+
+/**
+* Records a failure (the first one is printed)
+*/
+static void Fail(const char* container, const char* what, long long op)
+{
+	if (!g_failed.exchange(true))
+		printf("FAIL,%s,%s,op %lld\n", container, what, op);
+	fflush(stdout);
+}
+
+/* ---- Checked containers ---- */
+
+static int CompareInt(int lhs, int rhs)
+{
+	if (lhs < rhs) return -1;
+	else if (lhs > rhs) return 1;
+	else return 0;
+}
+
+/**
+* A TTree checked against a std::multiset
+*/
+template<typename Alloc>
+struct CheckedTree
+{
+	TTree<int, Alloc> _tree;
+	std::multiset<int> _ref;
+	const char* _name;
+
+	CheckedTree(const char* name, const Alloc& alloc) : _tree(CompareInt, alloc), _name(name) {}
+
+	bool Verify(long long op)
+	{
+		if (_tree.Count() != (int)_ref.size()) { Fail(_name, "count mismatch", op); return false; }
+
+		//iteration is pre-order so sort before comparing
+		std::vector<int> contents;
+		TTREE_foreach(int, itr, _tree)
+		{
+			contents.push_back(itr.Value());
+		}
+		std::sort(contents.begin(), contents.end());
+		if (!std::equal(contents.begin(), contents.end(), _ref.begin()) || contents.size() != _ref.size())
+		{
+			Fail(_name, "contents mismatch", op);
+			return false;
+		}
+		return true;
+	}
+
+	template<typename RNG>
+	bool Step(RNG& rng, long long op)
+	{
+		int key = (int)(rng() % (unsigned)g_options._keys);
+		int r = (int)(rng() % 1000);
+
+		if (r < 400)
+		{
+			_tree.Insert(key);
+			_ref.insert(key);
+		}
+		else if (r < 700)
+		{
+			bool found = _tree.Find(key) != NULL;
+			if (found != (_ref.find(key) != _ref.end())) { Fail(_name, "find mismatch", op); return false; }
+		}
+		else if (r < 995)
+		{
+			_tree.Remove(key);
+			std::multiset<int>::iterator itr = _ref.find(key);
+			if (itr != _ref.end()) _ref.erase(itr);
+			if (_tree.Count() != (int)_ref.size()) { Fail(_name, "remove count mismatch", op); return false; }
+		}
+		else if (r < 999)
+		{
+			//rebuild and check the result is perfectly balanced
+			_tree.Rebuild();
+			TTreeShape shape = _tree.Shape();
+			if (shape._count != (int)_ref.size() || (shape._count > 0 && shape.HeightRatio() != 1.0))
+			{
+				Fail(_name, "rebuild shape mismatch", op);
+				return false;
+			}
+			if (_tree.HeightEstimate() != shape._height) { Fail(_name, "height estimate mismatch", op); return false; }
+		}
+		else
+		{
+			_tree.Empty();
+			_ref.clear();
+		}
+		return true;
+	}
+};
+
+/**
+* A TList checked against a std::list
+*/
+template<typename Alloc>
+struct CheckedList
+{
+	TList<int, Alloc> _list;
+	std::list<int> _ref;
+	const char* _name;
+
+	CheckedList(const char* name, const Alloc& alloc) : _list(alloc), _name(name) {}
+
+	bool Verify(long long op)
+	{
+		if (_list.Count() != (int)_ref.size()) { Fail(_name, "count mismatch", op); return false; }
+
+		std::list<int>::iterator ref = _ref.begin();
+		TLIST_foreach(int, itr, _list)
+		{
+			if (ref == _ref.end() || *ref != itr.Value()) { Fail(_name, "contents mismatch", op); return false; }
+			++ref;
+		}
+		if (ref != _ref.end()) { Fail(_name, "contents mismatch", op); return false; }
+		return true;
+	}
+
+	template<typename RNG>
+	bool Step(RNG& rng, long long op)
+	{
+		int key = (int)(rng() % (unsigned)g_options._keys);
+		int r = (int)(rng() % 1000);
+
+		//keep lists short enough that removing by value stays cheap
+		if (r < 450 && _ref.size() < 4096)
+		{
+			_list.PushBack(key);
+			_ref.push_back(key);
+		}
+		else if (r < 800)
+		{
+			int expected = _ref.empty() ? 0 : _ref.back();
+			if (!_ref.empty()) _ref.pop_back();
+			if (_list.PopBack() != expected) { Fail(_name, "pop mismatch", op); return false; }
+		}
+		else if (r < 990)
+		{
+			std::list<int>::iterator itr = std::find(_ref.begin(), _ref.end(), key);
+			bool expected = itr != _ref.end();
+			if (expected) _ref.erase(itr);
+			if (_list.Remove(key) != expected) { Fail(_name, "remove mismatch", op); return false; }
+		}
+		else
+		{
+			//remove while iterating
+			int mod = 2 + key % 5;
+			TLIST_foreach(int, itr, _list)
+			{
+				if (itr.Value() % mod == 0)
+					_list.Remove(itr);
+			}
+			for (std::list<int>::iterator itr = _ref.begin(); itr != _ref.end();)
+			{
+				if (*itr % mod == 0) itr = _ref.erase(itr);
+				else ++itr;
+			}
+			return Verify(op);
+		}
+		return true;
+	}
+};
+
+/**
+* A TStack checked against a std::vector
+*/
+template<typename Alloc>
+struct CheckedStack
+{
+	TStack<int, Alloc> _stack;
+	std::vector<int> _ref;
+	const char* _name;
+
+	CheckedStack(const char* name, const Alloc& alloc) : _stack(alloc), _name(name) {}
+
+	bool Verify(long long op)
+	{
+		if (_stack.Count() != (int)_ref.size()) { Fail(_name, "count mismatch", op); return false; }
+		if (_stack.Peek() != (_ref.empty() ? 0 : _ref.back())) { Fail(_name, "peek mismatch", op); return false; }
+		return true;
+	}
+
+	template<typename RNG>
+	bool Step(RNG& rng, long long op)
+	{
+		int key = (int)(rng() % (unsigned)g_options._keys);
+		int r = (int)(rng() % 1000);
+
+		if (r < 480)
+		{
+			_stack.Push(key);
+			_ref.push_back(key);
+		}
+		else if (r < 960)
+		{
+			int expected = _ref.empty() ? 0 : _ref.back();
+			if (!_ref.empty()) _ref.pop_back();
+			if (_stack.Pop() != expected) { Fail(_name, "pop mismatch", op); return false; }
+		}
+		else if (r < 999)
+		{
+			if (_stack.Peek() != (_ref.empty() ? 0 : _ref.back())) { Fail(_name, "peek mismatch", op); return false; }
+		}
+		else
+		{
+			_stack.Empty();
+			_ref.clear();
+		}
+		return true;
+	}
+};
+
+/* ---- Single threaded phase ---- */
+
+/**
+* Runs random steps on the checked container for the configured time, reporting every interval
+*/
+template<typename Checked>
+void RunSingle(Checked& checked)
+{
+	std::mt19937 rng(g_options._seed);
+	Latencies lat;
+	long long start = NowNs(), last = start, ops = 0, interval_ops = 0;
+	long long end = start + (long long)(g_options._seconds * 1e9);
+
+	while (!g_failed.load())
+	{
+		long long t0 = NowNs();
+		if (!checked.Step(rng, ops))
+			break;
+		long long t1 = NowNs();
+		lat.Add(t1 - t0);
+		ops++;
+		interval_ops++;
+
+		//full comparison every so often
+		if ((ops & 0xFFFF) == 0 && !checked.Verify(ops))
+			break;
+
+		if (t1 - last >= 1000000000LL || t1 >= end)
+		{
+			Report("single", checked._name, 1, (double)(t1 - start) / 1e9, interval_ops, (double)(t1 - last) / 1e9, lat);
+			lat.Clear();
+			interval_ops = 0;
+			last = t1;
+			if (t1 >= end)
+				break;
+		}
+	}
+
+	if (!g_failed.load())
+		checked.Verify(ops);
+}
+
+/* ---- Multi threaded phases ---- */
+
+/**
+* Runs func(thread_index, rng, latencies, op_counter) on every thread for the configured time
+* and reports the combined throughput and latencies every interval
+*/
+template<typename Func>
+void RunThreads(const char* phase, const char* name, Func func)
+{
+	int threads = g_options._threads;
+	std::vector<Latencies> lats((size_t)threads);
+	std::vector<std::mutex> locks((size_t)threads);
+	std::atomic<long long> ops(0);
+	std::atomic<bool> stop(false);
+	std::vector<std::thread> pool;
+
+	for (int t = 0; t < threads; t++)
+	{
+		pool.push_back(std::thread([&, t]()
+		{
+			std::mt19937 rng(g_options._seed + 7919u * (unsigned)t);
+			Latencies local;
+			while (!stop.load(std::memory_order_relaxed) && !g_failed.load(std::memory_order_relaxed))
+			{
+				for (int i = 0; i < 256; i++)
+				{
+					long long t0 = NowNs();
+					if (!func(t, rng))
+						break;
+					local.Add(NowNs() - t0);
+				}
+				ops.fetch_add(256, std::memory_order_relaxed);
+
+				//hand the samples over to the reporter
+				std::lock_guard<std::mutex> guard(locks[(size_t)t]);
+				lats[(size_t)t].Merge(local);
+				local.Clear();
+			}
+		}));
+	}
+
+	long long start = NowNs(), last = start, last_ops = 0;
+	long long end = start + (long long)(g_options._seconds * 1e9);
+	while (!g_failed.load())
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		long long now = NowNs();
+		if (now - last < 1000000000LL && now < end)
+			continue;
+
+		Latencies all;
+		for (int t = 0; t < threads; t++)
+		{
+			std::lock_guard<std::mutex> guard(locks[(size_t)t]);
+			all.Merge(lats[(size_t)t]);
+			lats[(size_t)t].Clear();
+		}
+		long long total = ops.load();
+		Report(phase, name, threads, (double)(now - start) / 1e9, total - last_ops, (double)(now - last) / 1e9, all);
+		last_ops = total;
+		last = now;
+		if (now >= end)
+			break;
+	}
+
+	stop.store(true);
+	for (size_t i = 0; i < pool.size(); i++)
+		pool[i].join();
+}
+
+/**
+* A TTree shared between threads behind a mutex. Each thread only touches keys
+* congruent to its index so it can keep its own reference multiset
+*/
+void RunSharedTree()
+{
+	int threads = g_options._threads;
+	std::mutex lock;
+	TTree<int, TThreadCacheAllocator> tree(CompareInt);
+	std::vector<std::multiset<int> > refs((size_t)threads);
+
+	RunThreads("shared", "TTree+mutex", [&](int t, std::mt19937& rng) -> bool
+	{
+		int key = (int)(rng() % (unsigned)g_options._keys);
+		key = key - key % threads + t;
+		int r = (int)(rng() % 100);
+		std::multiset<int>& ref = refs[(size_t)t];
+
+		if (r < 40)
+		{
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				tree.Insert(key);
+			}
+			ref.insert(key);
+		}
+		else if (r < 70)
+		{
+			bool found;
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				found = tree.Find(key) != NULL;
+			}
+			if (found != (ref.find(key) != ref.end())) { Fail("TTree+mutex", "find mismatch", 0); return false; }
+		}
+		else
+		{
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				tree.Remove(key);
+			}
+			std::multiset<int>::iterator itr = ref.find(key);
+			if (itr != ref.end()) ref.erase(itr);
+		}
+		return true;
+	});
+
+	//final check of the whole tree against the union of the references
+	size_t expected = 0;
+	for (int t = 0; t < threads; t++)
+		expected += refs[(size_t)t].size();
+	if (!g_failed.load() && (size_t)tree.Count() != expected)
+		Fail("TTree+mutex", "final count mismatch", 0);
+}
+
+/**
+* A TSkipList shared between threads without a lock. Each thread only touches keys congruent
+* to its index so it can keep its own reference set, and every so often scans a range to check
+* the list stays in order while the other threads write to it
+*/
+void RunSkipList()
+{
+	int threads = g_options._threads;
+	TSkipList<int, TLess<int>, TThreadCacheAllocator> list;
+	std::vector<std::set<int> > refs((size_t)threads);
+
+	RunThreads("shared", "TSkipList", [&](int t, std::mt19937& rng) -> bool
+	{
+		int key = (int)(rng() % (unsigned)g_options._keys);
+		key = key - key % threads + t;
+		int r = (int)(rng() % 100);
+		std::set<int>& ref = refs[(size_t)t];
+
+		if (r < 40)
+		{
+			if (list.Insert(key) != ref.insert(key).second) { Fail("TSkipList", "insert mismatch", 0); return false; }
+		}
+		else if (r < 70)
+		{
+			if (list.Contains(key) != (ref.find(key) != ref.end())) { Fail("TSkipList", "find mismatch", 0); return false; }
+		}
+		else if (r < 99)
+		{
+			if (list.Erase(key) != (ref.erase(key) > 0)) { Fail("TSkipList", "erase mismatch", 0); return false; }
+		}
+		else
+		{
+			int prev = -1;
+			bool sorted = true;
+			list.Scan(key, key + 1000, [&](const int& value) { sorted = sorted && value > prev; prev = value; });
+			if (!sorted) { Fail("TSkipList", "scan out of order", 0); return false; }
+		}
+		return true;
+	});
+
+	//final check of the whole list against the union of the references
+	size_t expected = 0;
+	for (int t = 0; t < threads; t++)
+		expected += refs[(size_t)t].size();
+	size_t walked = 0;
+	TSKIPLIST_foreach(int, itr, list)
+	{
+		int key = itr.Value();
+		if (refs[(size_t)(key % threads)].count(key) == 0) { Fail("TSkipList", "unexpected element", 0); return; }
+		walked++;
+	}
+	if (!g_failed.load() && (walked != expected || (size_t)list.Count() != expected))
+		Fail("TSkipList", "final count mismatch", 0);
+}
+
+/**
+* A TSkipList where every thread inserts and erases keys from one small shared range, so inserts
+* and erases of the same key race each other (and the retire path) all the time. Successful
+* inserts and erases update a per key net count, which must end at 0 or 1 and match the final
+* membership of every key
+*/
+void RunSkipListContended()
+{
+	const int keys = 64;
+	TSkipList<int, TLess<int>, TThreadCacheAllocator> list;
+	std::vector<std::atomic<long long> > net((size_t)keys);
+	for (int k = 0; k < keys; k++)
+		net[(size_t)k].store(0);
+
+	RunThreads("contended", "TSkipList", [&](int, std::mt19937& rng) -> bool
+	{
+		int key = (int)(rng() % (unsigned)keys);
+		int r = (int)(rng() % 100);
+
+		if (r < 45)
+		{
+			if (list.Insert(key))
+				net[(size_t)key].fetch_add(1);
+		}
+		else if (r < 90)
+		{
+			if (list.Erase(key))
+				net[(size_t)key].fetch_sub(1);
+		}
+		else if (r < 99)
+		{
+			list.Contains(key);
+		}
+		else
+		{
+			int prev = -1;
+			bool sorted = true;
+			list.Scan(0, keys, [&](const int& value) { sorted = sorted && value > prev; prev = value; });
+			if (!sorted) { Fail("TSkipList", "contended scan out of order", 0); return false; }
+		}
+		return true;
+	});
+
+	if (g_failed.load())
+		return;
+
+	//every key was inserted exactly once more than it was erased if (and only if) it is present
+	int expected = 0;
+	for (int k = 0; k < keys; k++)
+	{
+		long long n = net[(size_t)k].load();
+		if (n != 0 && n != 1) { Fail("TSkipList", "contended net count out of range", k); return; }
+		if (list.Contains(k) != (n == 1)) { Fail("TSkipList", "contended membership mismatch", k); return; }
+		expected += (int)n;
+	}
+	int walked = 0;
+	TSKIPLIST_foreach(int, itr, list)
+	{
+		walked++;
+	}
+	if (walked != expected || list.Count() != expected)
+		Fail("TSkipList", "contended final count mismatch", 0);
+}
+
+/**
+* Every thread runs its own checked containers using TThreadCacheAllocator so the
+* per thread caches (and frees across many threads) are exercised at the same time
+*/
+void RunPerThread()
+{
+	int threads = g_options._threads;
+	std::vector<CheckedTree<TThreadCacheAllocator>*> trees;
+	std::vector<CheckedList<TThreadCacheAllocator>*> lists;
+	std::vector<CheckedStack<TThreadCacheAllocator>*> stacks;
+	for (int t = 0; t < threads; t++)
+	{
+		trees.push_back(new CheckedTree<TThreadCacheAllocator>("TTree+cache", TThreadCacheAllocator()));
+		lists.push_back(new CheckedList<TThreadCacheAllocator>("TList+cache", TThreadCacheAllocator()));
+		stacks.push_back(new CheckedStack<TThreadCacheAllocator>("TStack+cache", TThreadCacheAllocator()));
+	}
+
+	std::vector<long long> counters((size_t)threads, 0);
+	RunThreads("per-thread", "TTree/TList/TStack+cache", [&](int t, std::mt19937& rng) -> bool
+	{
+		long long op = counters[(size_t)t]++;
+		switch (op % 3)
+		{
+		case 0: return trees[(size_t)t]->Step(rng, op);
+		case 1: return lists[(size_t)t]->Step(rng, op);
+		default: return stacks[(size_t)t]->Step(rng, op);
+		}
+	});
+
+	for (int t = 0; t < threads; t++)
+	{
+		if (!g_failed.load())
+		{
+			trees[(size_t)t]->Verify(counters[(size_t)t]);
+			lists[(size_t)t]->Verify(counters[(size_t)t]);
+			stacks[(size_t)t]->Verify(counters[(size_t)t]);
+		}
+		delete trees[(size_t)t];
+		delete lists[(size_t)t];
+		delete stacks[(size_t)t];
+	}
+}
+
+/**
+* One producer thread pushes an increasing sequence into a TRingBuffer with Push and PushMany
+* while the calling thread pops it with Pop and PopMany, checking that every value arrives once
+* and in order. Runs once per capacity (both are rounded up to a power of 2, and the tiny one
+* keeps the buffer full or empty almost all the time)
+*/
+void RunRingBuffer()
+{
+	const int capacities[] = { 1000, 3 };
+	for (int c = 0; c < 2 && !g_failed.load(); c++)
+	{
+		TRingBuffer<long long> ring((size_t)capacities[c]);
+		std::atomic<bool> done(false);
+		long long produced = 0;
+
+		std::thread producer([&]()
+		{
+			std::mt19937 rng(g_options._seed);
+			long long batch[64];
+			long long end = NowNs() + (long long)(g_options._seconds * 1e9);
+			long long next = 0;
+			while (!g_failed.load(std::memory_order_relaxed) && NowNs() < end)
+			{
+				for (int i = 0; i < 256; i++)
+				{
+					if (rng() % 2 == 0)
+					{
+						ring.Push(next++);
+					}
+					else
+					{
+						int count = (int)(rng() % 64) + 1;
+						for (int j = 0; j < count; j++)
+							batch[j] = next + j;
+						next += ring.PushMany(batch, count);
+					}
+				}
+			}
+			produced = next;
+			done.store(true, std::memory_order_release);
+		});
+
+		//the consumer drains until the producer is done and everything it pushed has arrived
+		std::mt19937 rng(g_options._seed + 1);
+		Latencies lat;
+		long long batch[64];
+		long long expected = 0, start = NowNs();
+		bool ok = true;
+		while (true)
+		{
+			bool finished = done.load(std::memory_order_acquire);
+			long long t0 = NowNs();
+			int got = 0;
+			if (rng() % 2 == 0 && ring.Count() > 0)
+			{
+				//there is an element so a blocking Pop can't wait for a producer that has stopped
+				batch[0] = ring.Pop();
+				got = 1;
+			}
+			else
+			{
+				got = ring.PopMany(batch, (int)(rng() % 64) + 1);
+			}
+
+			//only time calls that returned something and let the producer run when there was nothing
+			if (got > 0)
+				lat.Add(NowNs() - t0);
+			else
+				std::this_thread::yield();
+
+			for (int i = 0; i < got && ok; i++)
+			{
+				if (batch[i] != expected + i) { Fail("TRingBuffer", "value out of order or lost", expected + i); ok = false; }
+			}
+			expected += got;
+
+			if (finished && got == 0 && ring.IsEmpty())
+				break;
+		}
+		producer.join();
+
+		long long now = NowNs();
+		if (ok && (expected != produced || ring.PushMany(batch, -1) != 0 || ring.PopMany(batch, -1) != 0))
+			Fail("TRingBuffer", "final count mismatch", expected);
+		Report("spsc", capacities[c] == 1000 ? "TRingBuffer(1000)" : "TRingBuffer(3)", 2, (double)(now - start) / 1e9, expected, (double)(now - start) / 1e9, lat);
+	}
+}
+
+/**
+* Thread 0 writes a TPersistentTree and publishes every version (with the count and sum of its
+* keys) behind a mutex held only to copy the handle. The other threads take snapshots and walk
+* them without any lock, checking that each one is sorted and matches the published totals
+*/
+void RunPersistentTree()
+{
+	struct Version
+	{
+		TPersistentTree<int, TThreadCacheAllocator> _tree;
+		int _count;
+		long long _sum;
+	};
+
+	//readers walk whole snapshots so keep them small
+	int keys = g_options._keys < 4096 ? g_options._keys : 4096;
+	std::mutex lock;
+	Version published = { TPersistentTree<int, TThreadCacheAllocator>(CompareInt), 0, 0 };
+	Version current = published;
+	std::multiset<int> ref;
+
+	RunThreads("persistent", "TPersistentTree", [&](int t, std::mt19937& rng) -> bool
+	{
+		if (t == 0)
+		{
+			int key = (int)(rng() % (unsigned)keys);
+			if (rng() % 2 == 0)
+			{
+				current._tree = current._tree.Insert(key);
+				current._count++;
+				current._sum += key;
+				ref.insert(key);
+			}
+			else
+			{
+				std::multiset<int>::iterator itr = ref.find(key);
+				bool found = current._tree.Find(key) != NULL;
+				if (found != (itr != ref.end())) { Fail("TPersistentTree", "find mismatch", 0); return false; }
+				current._tree = current._tree.Remove(key);
+				if (found)
+				{
+					current._count--;
+					current._sum -= key;
+					ref.erase(itr);
+				}
+			}
+			if (current._tree.Count() != current._count) { Fail("TPersistentTree", "count mismatch", 0); return false; }
+
+			std::lock_guard<std::mutex> guard(lock);
+			published = current;
+			return true;
+		}
+
+		Version snapshot;
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			snapshot = published;
+		}
+
+		int count = 0, prev = -1;
+		long long sum = 0;
+		TPERSISTENTTREE_foreach(int, itr, snapshot._tree)
+		{
+			if (*itr < prev) { Fail("TPersistentTree", "snapshot out of order", 0); return false; }
+			prev = *itr;
+			sum += prev;
+			count++;
+		}
+		if (count != snapshot._count || sum != snapshot._sum) { Fail("TPersistentTree", "snapshot changed", 0); return false; }
+		return true;
+	});
+}
+
+int main(int argc, char** argv)
+{
+	g_options._seconds = 3.0;
+	g_options._threads = (int)std::thread::hardware_concurrency();
+	g_options._keys = 100000;
+	g_options._seed = 12345;
+	if (g_options._threads < 2) g_options._threads = 2;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--seconds") == 0 && i + 1 < argc) g_options._seconds = atof(argv[++i]);
+		else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) g_options._threads = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--keys") == 0 && i + 1 < argc) g_options._keys = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) g_options._seed = (unsigned)atoi(argv[++i]);
+		else
+		{
+			fprintf(stderr, "usage: %s [--seconds S] [--threads N] [--keys N] [--seed N]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (g_options._threads < 1) g_options._threads = 1;
+	if (g_options._keys < 1) g_options._keys = 1;
+
+	printf("phase,container,threads,elapsed_s,ops,ops_per_s,p50_ns,p99_ns,p999_ns,max_ns,live_bytes,peak_rss_kb\n");
+
+	/* Single threaded mixes against the reference containers */
+	{
+		CheckedTree<TDefaultAllocator> tree("TTree", TDefaultAllocator());
+		RunSingle(tree);
+	}
+	{
+		CheckedTree<TThreadCacheAllocator> tree("TTree+cache", TThreadCacheAllocator());
+		tree._tree.SetAutoRebuild(2.0f);
+		RunSingle(tree);
+	}
+	{
+		TArena arena;
+		CheckedTree<TArenaAllocator> tree("TTree+arena", TArenaAllocator(&arena));
+		RunSingle(tree);
+	}
+	{
+		CheckedList<TDefaultAllocator> list("TList", TDefaultAllocator());
+		RunSingle(list);
+	}
+	{
+		CheckedStack<TDefaultAllocator> stack("TStack", TDefaultAllocator());
+		RunSingle(stack);
+	}
+
+	/* The same mixes from many threads */
+	if (!g_failed.load()) RunSharedTree();
+	if (!g_failed.load()) RunSkipList();
+	if (!g_failed.load()) RunSkipListContended();
+	if (!g_failed.load()) RunPerThread();
+	if (!g_failed.load()) RunPersistentTree();
+	if (!g_failed.load()) RunRingBuffer();
+
+	if (g_failed.load())
+		return 1;
+
+	printf("PASS\n");
+	return 0;
+}
\ No newline at end of file